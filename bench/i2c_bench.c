@@ -0,0 +1,299 @@
+#include <time.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "i2c/i2c.h"
+
+#define LIST_MAX 16
+#define DEFAULT_DURATION 0.1
+#define DEFAULT_ITERATIONS 10000
+
+typedef ssize_t (*BENCH_HANDLE)(const I2CDevice *dev, unsigned int iaddr, void *buf, size_t len);
+
+typedef struct {
+    const char *name;
+    BENCH_HANDLE handle;
+} BenchOp;
+
+typedef struct {
+    unsigned int values[LIST_MAX];
+    unsigned int count;
+} BenchList;
+
+typedef struct {
+    const BenchOp *op;
+    char bus_name[256];
+    unsigned int page_bytes;
+    unsigned int iaddr_bytes;
+    unsigned int size;
+    unsigned int iterations;
+    double duration;
+    unsigned long long *latency;    /* Each operation latency, ns */
+    unsigned int done;
+    int error;
+} BenchThread;
+
+static ssize_t bench_write(const I2CDevice *dev, unsigned int iaddr, void *buf, size_t len)
+{
+    return i2c_write(dev, iaddr, buf, len);
+}
+
+static ssize_t bench_ioctl_write(const I2CDevice *dev, unsigned int iaddr, void *buf, size_t len)
+{
+    return i2c_ioctl_write(dev, iaddr, buf, len);
+}
+
+static const BenchOp bench_ops[] = {
+    {"i2c_read", i2c_read},
+    {"i2c_write", bench_write},
+    {"i2c_ioctl_read", i2c_ioctl_read},
+    {"i2c_ioctl_write", bench_ioctl_write},
+};
+
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static int parse_list(const char *arg, BenchList *list)
+{
+    char *end = NULL;
+
+    list->count = 0;
+    while (*arg && list->count < LIST_MAX) {
+
+        list->values[list->count++] = strtoul(arg, &end, 0);
+        if (end == arg || (*end && *end != ',')) {
+
+            return -1;
+        }
+
+        arg = *end ? end + 1 : end;
+    }
+
+    return list->count ? 0 : -1;
+}
+
+
+static int compare_ull(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+static void *bench_thread(void *arg)
+{
+    int bus;
+    I2CDevice device;
+    unsigned char *buf;
+    unsigned long long start, deadline;
+    BenchThread *ctx = arg;
+
+    if ((bus = i2c_open(ctx->bus_name)) == -1) {
+
+        ctx->error = errno;
+        return NULL;
+    }
+
+    if ((buf = malloc(ctx->size)) == NULL) {
+
+        ctx->error = errno;
+        i2c_close(bus);
+        return NULL;
+    }
+
+    memset(&device, 0, sizeof(device));
+    i2c_init_device(&device);
+    device.bus = bus;
+    device.addr = 0x50;
+    device.page_bytes = ctx->page_bytes;
+    device.iaddr_bytes = ctx->iaddr_bytes;
+    device.completion = I2C_COMPLETION_ACK_POLL;
+    memset(buf, 0x5a, ctx->size);
+
+    deadline = now_ns() + (unsigned long long)(ctx->duration * 1e9);
+    for (ctx->done = 0; ctx->done < ctx->iterations; ctx->done++) {
+
+        start = now_ns();
+        if (ctx->op->handle(&device, 0, buf, ctx->size) != (ssize_t)ctx->size) {
+
+            ctx->error = errno ? errno : EIO;
+            break;
+        }
+
+        ctx->latency[ctx->done] = now_ns() - start;
+        if (ctx->latency[ctx->done] + start > deadline) {
+
+            ctx->done++;
+            break;
+        }
+    }
+
+    free(buf);
+    i2c_close(bus);
+    return NULL;
+}
+
+
+/* Run one benchmark case, print a json object */
+static int bench_case(FILE *out, const BenchOp *op, unsigned int page_bytes, unsigned int iaddr_bytes,
+                      unsigned int size, unsigned int threads, unsigned int iterations, double duration, int first)
+{
+    int err = 0;
+    unsigned int i, started, total = 0;
+    unsigned long long start, elapsed, *latency;
+    pthread_t tids[LIST_MAX];
+    BenchThread ctx[LIST_MAX];
+
+    if ((latency = calloc((size_t)iterations * threads, sizeof(*latency))) == NULL) {
+
+        return -1;
+    }
+
+    start = now_ns();
+    for (i = 0; i < threads; i++) {
+
+        memset(&ctx[i], 0, sizeof(ctx[i]));
+        ctx[i].op = op;
+        ctx[i].size = size;
+        ctx[i].duration = duration;
+        ctx[i].page_bytes = page_bytes;
+        ctx[i].iaddr_bytes = iaddr_bytes;
+        ctx[i].iterations = iterations;
+        ctx[i].latency = latency + (size_t)i * iterations;
+
+        /* Each thread drive a device on it's own simulated adapter, write cycle not counted */
+        snprintf(ctx[i].bus_name, sizeof(ctx[i].bus_name), "sim:eeprom@0x50:size=%u:page=%u:iaddr=%u:twr=0",
+                 iaddr_bytes == 1 ? 256 : 65536, page_bytes, iaddr_bytes);
+        if ((err = pthread_create(&tids[i], NULL, bench_thread, &ctx[i])) != 0) {
+
+            fprintf(stderr, "%s failed: %s\n", op->name, strerror(err));
+            break;
+        }
+    }
+
+    /* Join threads already started even some failed to start, then fail the case */
+    started = i;
+    for (i = 0; i < started; i++) {
+
+        pthread_join(tids[i], NULL);
+        if (ctx[i].error && !err) {
+
+            fprintf(stderr, "%s failed: %s\n", op->name, strerror(ctx[i].error));
+            err = ctx[i].error;
+        }
+    }
+
+    if (err) {
+
+        free(latency);
+        return -1;
+    }
+
+    for (i = 0; i < threads; i++) {
+
+        /* Compact latency samples */
+        memmove(latency + total, ctx[i].latency, ctx[i].done * sizeof(*latency));
+        total += ctx[i].done;
+    }
+
+    elapsed = now_ns() - start;
+    qsort(latency, total, sizeof(*latency), compare_ull);
+
+    fprintf(out, "%s\n    {\"op\": \"%s\", \"page_bytes\": %u, \"iaddr_bytes\": %u, \"size\": %u, \"threads\": %u, "
+            "\"iterations\": %u, \"bytes_per_sec\": %.1f, \"ops_per_sec\": %.1f, "
+            "\"latency_ns\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}}",
+            first ? "" : ",", op->name, page_bytes, iaddr_bytes, size, threads, total,
+            (double)total * size * 1e9 / elapsed, (double)total * 1e9 / elapsed,
+            latency[total * 50 / 100], latency[total * 99 / 100], latency[total * 999 / 1000], latency[total - 1]);
+
+    free(latency);
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    int opt, first = 1;
+    unsigned int o, p, a, s, t;
+    FILE *out = stdout;
+    double duration = DEFAULT_DURATION;
+    unsigned int iterations = DEFAULT_ITERATIONS;
+    BenchList pages = {{8, 32}, 2}, iaddrs = {{1, 2}, 2}, sizes = {{16, 256, 4096}, 3}, threads = {{1, 4}, 2};
+
+    while ((opt = getopt(argc, argv, "p:a:s:t:n:d:o:h")) != -1) {
+
+        switch (opt) {
+
+            case 'p':
+                if (parse_list(optarg, &pages) == 0) continue;
+                break;
+
+            case 'a':
+                if (parse_list(optarg, &iaddrs) == 0) continue;
+                break;
+
+            case 's':
+                if (parse_list(optarg, &sizes) == 0) continue;
+                break;
+
+            case 't':
+                if (parse_list(optarg, &threads) == 0) continue;
+                break;
+
+            case 'n':
+                if ((iterations = strtoul(optarg, NULL, 0))) continue;
+                break;
+
+            case 'd':
+                if ((duration = strtod(optarg, NULL)) > 0) continue;
+                break;
+
+            case 'o':
+                if ((out = fopen(optarg, "w"))) continue;
+                break;
+        }
+
+        fprintf(stderr, "Usage:%s [-p page_bytes,...] [-a iaddr_bytes,...] [-s size,...] [-t threads,...] "
+                "[-n max iterations] [-d max seconds per case] [-o output.json]\n"
+                "Benchmark i2c read/write on simulated bus, output json\n", argv[0]);
+        return opt == 'h' ? 0 : -1;
+    }
+
+    fprintf(out, "{\n  \"version\": \"%s\",\n  \"bus\": \"sim\",\n  \"results\": [", LIBI2C_VERSION);
+
+    for (o = 0; o < sizeof(bench_ops) / sizeof(bench_ops[0]); o++)
+        for (p = 0; p < pages.count; p++)
+            for (a = 0; a < iaddrs.count; a++)
+                for (s = 0; s < sizes.count; s++)
+                    for (t = 0; t < threads.count; t++) {
+
+                        if (threads.values[t] == 0 || threads.values[t] > LIST_MAX ||
+                                bench_case(out, &bench_ops[o], pages.values[p], iaddrs.values[a],
+                                           sizes.values[s], threads.values[t], iterations, duration, first) == -1) {
+
+                            return -1;
+                        }
+
+                        first = 0;
+                    }
+
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout) {
+
+        fclose(out);
+    }
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+# -*- coding: utf-8 -*-
+"""
+pylibi2c I2CDevice read/write benchmark on simulated bus, output json
+"""
+import sys
+import json
+import time
+import argparse
+import threading
+import pylibi2c
+
+OPS = ("read", "write", "ioctl_read", "ioctl_write")
+
+# Python2 has no perf_counter, fallback to time.time
+timer = getattr(time, "perf_counter", time.time)
+
+
+def int_list(arg):
+    return [int(x, 0) for x in arg.split(",")]
+
+
+def percentile(samples, p):
+    return samples[min(len(samples) - 1, len(samples) * p // 1000)]
+
+
+def worker(op, page_bytes, iaddr_bytes, size, iterations, duration, latency, errors):
+    try:
+        bus = "sim:eeprom@0x50:size={}:page={}:iaddr={}:twr=0".format(
+            256 if iaddr_bytes == 1 else 65536, page_bytes, iaddr_bytes)
+        i2c = pylibi2c.I2CDevice(bus, 0x50, page_bytes=page_bytes, iaddr_bytes=iaddr_bytes,
+                                 completion=pylibi2c.I2C_COMPLETION_ACK_POLL)
+        handle = getattr(i2c, op)
+        arg = bytes(bytearray(size)) if op.endswith("write") else size
+        deadline = time.time() + duration
+
+        for _ in range(iterations):
+            start = timer()
+            result = handle(0, arg)
+            latency.append(int((timer() - start) * 1e9))
+
+            if (len(result) if op.endswith("read") else result) != size:
+                raise IOError("short {}".format(op))
+
+            if time.time() > deadline:
+                break
+
+        i2c.close()
+    except (IOError, ValueError) as err:
+        errors.append(str(err))
+
+
+def bench_case(op, page_bytes, iaddr_bytes, size, threads, iterations, duration):
+    latency = []
+    errors = []
+    workers = [threading.Thread(target=worker,
+                                args=(op, page_bytes, iaddr_bytes, size, iterations, duration, latency, errors))
+               for _ in range(threads)]
+
+    start = timer()
+    for t in workers:
+        t.start()
+
+    for t in workers:
+        t.join()
+
+    elapsed = timer() - start
+    if errors:
+        raise IOError("{} failed: {}".format(op, errors[0]))
+
+    latency.sort()
+    return {
+        "op": op, "page_bytes": page_bytes, "iaddr_bytes": iaddr_bytes, "size": size, "threads": threads,
+        "iterations": len(latency),
+        "bytes_per_sec": round(len(latency) * size / elapsed, 1),
+        "ops_per_sec": round(len(latency) / elapsed, 1),
+        "latency_ns": {
+            "p50": percentile(latency, 500), "p99": percentile(latency, 990),
+            "p999": percentile(latency, 999), "max": latency[-1],
+        },
+    }
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description="Benchmark pylibi2c I2CDevice read/write on simulated bus")
+    parser.add_argument('-p', '--page_bytes', help='page bytes list', type=int_list, default=[8, 32])
+    parser.add_argument('-a', '--iaddr_bytes', help='internal address bytes list', type=int_list, default=[1, 2])
+    parser.add_argument('-s', '--size', help='transfer size list', type=int_list, default=[16, 256, 4096])
+    parser.add_argument('-t', '--threads', help='thread count list', type=int_list, default=[1, 4])
+    parser.add_argument('-n', '--iterations', help='max iterations per case', type=int, default=10000)
+    parser.add_argument('-d', '--duration', help='max seconds per case', type=float, default=0.1)
+    parser.add_argument('-o', '--output', help='output json file, default stdout', type=str)
+    args = parser.parse_args()
+
+    results = [bench_case(op, page_bytes, iaddr_bytes, size, threads, args.iterations, args.duration)
+               for op in OPS
+               for page_bytes in args.page_bytes
+               for iaddr_bytes in args.iaddr_bytes
+               for size in args.size
+               for threads in args.threads]
+
+    report = {"version": pylibi2c.__version__, "bus": "sim", "python": sys.version.split()[0], "results": results}
+    output = open(args.output, "w") if args.output else sys.stdout
+    json.dump(report, output, indent=2)
+    output.write("\n")
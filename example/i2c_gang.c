@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "i2c/i2c.h"
+
+#define MAX_TARGETS 128
+#define MAX_IMAGE_BYTES (1024 * 1024)
+
+static const char *stages[] = {"write", "verify", "done"};
+
+
+/* Open bus once, targets on same bus share it */
+int open_bus(char names[][64], int *buses, unsigned int *nbuses, const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < *nbuses; i++) {
+
+        if (!strcmp(names[i], name)) {
+
+            return buses[i];
+        }
+    }
+
+    if ((buses[*nbuses] = i2c_open(name)) == -1) {
+
+        return -1;
+    }
+
+    snprintf(names[*nbuses], 64, "%s", name);
+    return buses[(*nbuses)++];
+}
+
+
+int main(int argc, char **argv)
+{
+    FILE *fp;
+    size_t len;
+    char *sep, name[64];
+    int i, failed, buses[MAX_TARGETS];
+    char bus_names[MAX_TARGETS][64];
+    unsigned char *image = NULL;
+    I2CGangTarget targets[MAX_TARGETS];
+    unsigned long long slowest = 0;
+    unsigned int bus_num, addr, iaddr_bytes = 0, page_bytes = 0, nbuses = 0, ntargets = 0;
+
+    if (argc < 5) {
+
+        fprintf(stdout, "Usage:%s <image> <iaddr_bytes> <page_bytes> <bus:dev_addr> [bus:dev_addr ...]\n"
+                "Program and verify image on all targets, one worker per bus, such as:\n"
+                "\t24c64 i2c_gang eeprom.bin 2 32 0:0x50 0:0x51 1:0x50 /dev/i2c-2:0x50\n", argv[0]);
+        exit(0);
+    }
+
+    /* Get i2c internal address bytes and page bytes */
+    if (sscanf(argv[2], "%u", &iaddr_bytes) != 1 || sscanf(argv[3], "%u", &page_bytes) != 1) {
+
+        fprintf(stderr, "Can't parse i2c 'iaddr_bytes' [%s] or 'page_bytes' [%s]\n", argv[2], argv[3]);
+        exit(-1);
+    }
+
+    /* Load image */
+    if ((fp = fopen(argv[1], "rb")) == NULL || (image = malloc(MAX_IMAGE_BYTES)) == NULL) {
+
+        fprintf(stderr, "Load image [%s] error!\n", argv[1]);
+        exit(-2);
+    }
+
+    len = fread(image, 1, MAX_IMAGE_BYTES, fp);
+    fclose(fp);
+
+    /* Targets bus:dev_addr, bus is number or name, address after last ':' */
+    for (i = 4; i < argc && ntargets < MAX_TARGETS; i++) {
+
+        if ((sep = strrchr(argv[i], ':')) == NULL || sscanf(sep + 1, "0x%x", &addr) != 1) {
+
+            fprintf(stderr, "Can't parse target [%s]\n", argv[i]);
+            exit(-1);
+        }
+
+        snprintf(name, sizeof(name), "%.*s", (int)(sep - argv[i]), argv[i]);
+        if (sscanf(name, "%u", &bus_num) == 1) {
+
+            snprintf(name, sizeof(name), "/dev/i2c-%u", bus_num);
+        }
+
+        i2c_init_device(&targets[ntargets].device);
+        targets[ntargets].device.addr = addr & 0x3ff;
+        targets[ntargets].device.iaddr_bytes = iaddr_bytes;
+        targets[ntargets].device.page_bytes = page_bytes;
+        targets[ntargets].device.completion = I2C_COMPLETION_ACK_POLL;
+
+        if ((targets[ntargets].device.bus = open_bus(bus_names, buses, &nbuses, name)) == -1) {
+
+            fprintf(stderr, "Open i2c bus:%s error!\n", name);
+            exit(-3);
+        }
+
+        ntargets++;
+    }
+
+    if ((failed = i2c_gang_program(targets, ntargets, 0, image, len, 0)) == -1) {
+
+        perror("Gang program failed");
+        exit(-4);
+    }
+
+    for (i = 0; i < (int)ntargets; i++) {
+
+        fprintf(stdout, "%s:\t%-16s write %8llu us, verify %8llu us%s%s\n", argv[i + 4], stages[targets[i].stage],
+                targets[i].write_us, targets[i].verify_us, targets[i].error ? ", " : "",
+                targets[i].error ? strerror(targets[i].error) : "");
+
+        slowest = targets[i].write_us + targets[i].verify_us > slowest ? targets[i].write_us + targets[i].verify_us : slowest;
+    }
+
+    fprintf(stdout, "%u targets, %d failed, %zu bytes, slowest %llu us\n", ntargets, failed, len, slowest);
+
+    for (i = 0; i < (int)nbuses; i++) {
+
+        i2c_close(buses[i]);
+    }
+
+    free(image);
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "i2c/i2c.h"
+
+
+/* Delta of replay against recorded, percent */
+static double delta(unsigned long long recorded, unsigned long long replay)
+{
+    return recorded ? ((double)replay - (double)recorded) * 100.0 / recorded : 0.0;
+}
+
+
+int main(int argc, char **argv)
+{
+    int bus;
+    char bus_name[64];
+    unsigned int bus_num, flags = 0;
+    I2CReplayStat stat;
+    double recorded_rate, replay_rate;
+
+    if (argc < 3) {
+
+        fprintf(stdout, "Usage:%s <record_file> <bus> [realtime]\n"
+                "Replay record file on bus, compare with recorded throughput and latency, such as:\n"
+                "\ti2c_replay eeprom.rec 1\n"
+                "\ti2c_replay eeprom.rec sim:eeprom@0x50:size=8192:page=32 realtime\n", argv[0]);
+        exit(0);
+    }
+
+    /* Bus number or bus name */
+    if (sscanf(argv[2], "%u", &bus_num) == 1) {
+
+        snprintf(bus_name, sizeof(bus_name), "/dev/i2c-%u", bus_num);
+    }
+    else {
+
+        snprintf(bus_name, sizeof(bus_name), "%s", argv[2]);
+    }
+
+    if (argc > 3 && !strcmp(argv[3], "realtime")) {
+
+        flags |= I2C_REPLAY_REALTIME;
+    }
+
+    if ((bus = i2c_open(bus_name)) == -1) {
+
+        fprintf(stderr, "Open i2c bus:%s error!\n", bus_name);
+        exit(-3);
+    }
+
+    if (i2c_replay(bus, argv[1], flags, &stat) == -1) {
+
+        perror("Replay failed");
+        i2c_close(bus);
+        exit(-4);
+    }
+
+    i2c_close(bus);
+
+    recorded_rate = stat.recorded_span_ns ? stat.recorded_bytes * 1e9 / stat.recorded_span_ns : 0.0;
+    replay_rate = stat.replay_span_ns ? stat.bytes * 1e9 / stat.replay_span_ns : 0.0;
+
+    fprintf(stdout, "Records:\t%u, diverged %u, mismatches %u, %llu bytes\n",
+            stat.records, stat.diverged, stat.mismatches, stat.bytes);
+    fprintf(stdout, "Span:\t\trecorded %llu us, replay %llu us, %+.1f%%\n",
+            stat.recorded_span_ns / 1000, stat.replay_span_ns / 1000,
+            delta(stat.recorded_span_ns, stat.replay_span_ns));
+    fprintf(stdout, "Throughput:\trecorded %.0f B/s, replay %.0f B/s, %+.1f%%\n", recorded_rate, replay_rate,
+            recorded_rate ? (replay_rate - recorded_rate) * 100.0 / recorded_rate : 0.0);
+    fprintf(stdout, "Latency:\trecorded %.1f us, replay %.1f us per transfer, %+.1f%%\n",
+            stat.records ? stat.recorded_ns / 1000.0 / stat.records : 0.0,
+            stat.records ? stat.replay_ns / 1000.0 / stat.records : 0.0,
+            delta(stat.recorded_ns, stat.replay_ns));
+
+    return stat.diverged || stat.mismatches ? -1 : 0;
+}
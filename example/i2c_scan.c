@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "i2c/i2c.h"
+
+#define MAX_BUSES 64
+
+
+/* Same layout as i2cdetect */
+void print_i2c_scan(const char *name, const I2CScan *scan)
+{
+    unsigned int addr;
+
+    fprintf(stdout, "%s:\n     0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f", name);
+
+    for (addr = 0; addr < 0x80; addr++) {
+
+        if (addr % 16 == 0) {
+
+            fprintf(stdout, "\n%02x: ", addr);
+        }
+
+        if (addr < scan->first || addr > scan->last) {
+
+            fprintf(stdout, "   ");
+        }
+        else if (I2C_SCAN_FOUND(scan, addr)) {
+
+            fprintf(stdout, "%02x ", addr);
+        }
+        else {
+
+            fprintf(stdout, "-- ");
+        }
+    }
+
+    fprintf(stdout, "\n");
+
+    if (scan->error) {
+
+        fprintf(stdout, "Scan failed: %s\n", strerror(scan->error));
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    int i, count;
+    unsigned int bus_num, nbuses = 0;
+    char names[MAX_BUSES][64];
+    I2CScan scans[MAX_BUSES];
+    I2CAdapter adapters[MAX_BUSES];
+
+    if (argc > 1 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help"))) {
+
+        fprintf(stdout, "Usage:%s [bus ...]\n"
+                "Scan all adapters if no bus specified, such as:\n"
+                "\ti2c_scan\n"
+                "\ti2c_scan 0 1 /dev/i2c-2\n", argv[0]);
+        exit(0);
+    }
+
+    /* Bus number or bus name */
+    for (i = 1; i < argc && nbuses < MAX_BUSES; i++) {
+
+        if (sscanf(argv[i], "%u", &bus_num) == 1) {
+
+            snprintf(names[nbuses++], sizeof(names[0]), "/dev/i2c-%u", bus_num);
+        }
+        else {
+
+            snprintf(names[nbuses++], sizeof(names[0]), "%s", argv[i]);
+        }
+    }
+
+    if (argc == 1) {
+
+        if ((count = i2c_list_adapters(NULL, adapters, MAX_BUSES)) == -1) {
+
+            perror("List i2c adapters failed");
+            exit(-2);
+        }
+
+        for (i = 0; i < count && i < MAX_BUSES; i++) {
+
+            snprintf(names[nbuses++], sizeof(names[0]), "/dev/i2c-%d", adapters[i].nr);
+        }
+    }
+
+    for (i = 0; i < (int)nbuses; i++) {
+
+        if ((scans[i].bus = i2c_open(names[i])) == -1) {
+
+            fprintf(stderr, "Open i2c bus:%s error!\n", names[i]);
+            exit(-3);
+        }
+    }
+
+    /* One thread per bus */
+    count = i2c_scan(scans, nbuses, 0, 0);
+
+    for (i = 0; i < (int)nbuses; i++) {
+
+        print_i2c_scan(names[i], &scans[i]);
+        i2c_close(scans[i].bus);
+    }
+
+    return count == -1 ? -1 : 0;
+}
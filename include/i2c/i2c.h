@@ -5,10 +5,31 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
 #include <sys/types.h>
 #include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 
+/* I2C write cycle completion mode */
+#define I2C_COMPLETION_DELAY        0   /* Sleep #delay milliseconds after each page write */
+#define I2C_COMPLETION_ACK_POLL     1   /* Poll device with address only transfer until it ACK */
+#define I2C_COMPLETION_NONE         2   /* No page and write cycle such as FRAM/MRAM, write only split by adapter limit */
+
+/* I2C page write retry, errno classes count as transient */
+#define I2C_RETRY_NAK               0x1 /* ENXIO or EREMOTEIO, device NAK */
+#define I2C_RETRY_TIMEOUT           0x2 /* ETIMEDOUT, bus or write cycle completion timeout */
+#define I2C_RETRY_ARB_LOST          0x4 /* EAGAIN, arbitration lost */
+#define I2C_RETRY_IO                0x8 /* EIO, other bus error */
+#define I2C_RETRY_DEFAULT           (I2C_RETRY_NAK | I2C_RETRY_TIMEOUT | I2C_RETRY_ARB_LOST)
+
+/* I2C bus lock flags */
+#define I2C_LOCK_FLOCK              0x1 /* i2c_lock also hold flock(LOCK_EX) on bus, arbitrate with other processes */
+
+/* I2C transfer method, i2c_open select fastest one adapter support */
+#define I2C_METHOD_FILE             0   /* File I/O, adapter functionality unknown */
+#define I2C_METHOD_IOCTL            1   /* ioctl(I2C_RDWR), adapter support I2C */
+#define I2C_METHOD_SMBUS            2   /* SMBus i2c block read/write, SMBus only adapter, max 32 bytes per transfer */
+
 /* I2c device */
 typedef struct i2c_device {
     int bus;			        /* I2C Bus fd, return from i2c_open */
@@ -18,17 +39,284 @@ typedef struct i2c_device {
     unsigned short flags;		/* I2C i2c_ioctl_read/write flags */
     unsigned int page_bytes;    /* I2C max number of bytes per page, 1K/2K 8, 4K/8K/16K 16, 32K/64K 32 etc */
     unsigned int iaddr_bytes;   /* I2C device internal(word) address bytes, such as: 24C04 1 byte, 24C64 2 bytes */
+    unsigned char completion;   /* I2C write cycle completion mode, I2C_COMPLETION_DELAY/ACK_POLL/NONE */
+    unsigned int poll_timeout;  /* I2C ACK polling timeout, unit millisecond */
+    unsigned int poll_interval; /* I2C ACK polling interval, unit microsecond */
+    unsigned int poll_max;      /* I2C ACK polling max attempts, 0 means only limit by #poll_timeout */
+    unsigned char pec;          /* SMBus packet error checking */
+    unsigned char retries;      /* I2C max retries of each page write failed with transient error, 0 never retry */
+    unsigned char retry_on;     /* I2C_RETRY_XXX errno classes count as transient, 0 means I2C_RETRY_DEFAULT */
+    unsigned int retry_backoff; /* I2C first retry backoff, doubled each retry and capped at 500ms, unit microsecond, 0 means 1000us */
+    unsigned char block_bits;   /* I2C internal address high bits in slave address, such as: 24C04 1, 24C16 3, 24C1024 1 */
 } I2CDevice;
 
-/* Close i2c bus */
+/* I2C part profile, common EEPROM/FRAM parts */
+typedef struct i2c_part {
+    const char *name;           /* Part name, such as "24c64", matched case insensitive */
+    unsigned int size;          /* Capacity bytes */
+    unsigned int page_bytes;    /* Page bytes, 0 no page such as FRAM */
+    unsigned char iaddr_bytes;  /* Internal address bytes */
+    unsigned char block_bits;   /* Internal address high bits in slave address */
+    unsigned short twr_typ_us;  /* Typical write cycle time, unit microsecond, 0 no write cycle */
+    unsigned short twr_max_us;  /* Max write cycle time, unit microsecond */
+} I2CPart;
+
+/* I2C scattered region of device, i2c_readv/writev segment */
+typedef struct i2c_iovec {
+    unsigned int iaddr;         /* Device internal address */
+    void *buf;                  /* Read to or write from */
+    size_t len;                 /* #buf length */
+} I2CIovec;
+
+/* I2C transaction storage for internal address and write data */
+#define I2C_TXN_DATA_BYTES          1024
+
+/* I2C transaction, many i2c_msg segments submit with one ioctl(I2C_RDWR) */
+typedef struct i2c_txn {
+    int bus;                                    /* I2C Bus fd, return from i2c_open */
+    unsigned int nmsgs;                         /* Number of segments in transaction */
+    unsigned int data_used;                     /* Bytes used of #data */
+    int status[I2C_RDWR_IOCTL_MAX_MSGS];        /* Segment result after submit, 0 success, otherwise -errno */
+    struct i2c_msg msgs[I2C_RDWR_IOCTL_MAX_MSGS];
+    unsigned char data[I2C_TXN_DATA_BYTES];     /* Internal address and write data copied by i2c_txn_add_xxx */
+} I2CTxn;
+
+/* I2C async request operation */
+#define I2C_ASYNC_READ              0   /* Same as i2c_ioctl_read */
+#define I2C_ASYNC_WRITE             1   /* Same as i2c_ioctl_write */
+
+/* I2C async request, submit a copy to engine, get it back with result when it completed */
+typedef struct i2c_async_req {
+    I2CDevice device;           /* Device config, #device.bus is ignored, using engine bus */
+    unsigned int op;            /* I2C_ASYNC_READ or I2C_ASYNC_WRITE */
+    unsigned int iaddr;         /* Device internal address */
+    void *buf;                  /* Read to or write from, must keep valid until request completed */
+    size_t len;                 /* #buf length */
+    void *user_data;            /* Caller context, return as it is */
+    ssize_t result;             /* Completion result, same as i2c_ioctl_read/write */
+    int error;                  /* Completion errno, 0 if success */
+} I2CAsyncReq;
+
+/* I2C async engine, a worker thread per bus */
+typedef struct i2c_async I2CAsync;
+
+/* I2C write-back page cache on top of I2CDevice */
+typedef struct i2c_cache I2CCache;
+
+/* I2C differential write result */
+typedef struct i2c_diff_stat {
+    unsigned int written;       /* Pages programmed */
+    unsigned int skipped;       /* Pages same as device, not programmed */
+} I2CDiffStat;
+
+/* I2C gang programming flags */
+#define I2C_GANG_DIFF               0x1 /* Read back target, only program pages differ from image */
+
+/* I2C gang programming target stage, target failed stage or I2C_GANG_DONE */
+#define I2C_GANG_WRITE              0
+#define I2C_GANG_VERIFY             1   /* Image mismatch error is EBADMSG */
+#define I2C_GANG_DONE               2
+
+/* I2C gang programming target */
+typedef struct i2c_gang_target {
+    I2CDevice device;                   /* Target device and profile, page_bytes, iaddr_bytes, completion etc */
+    int stage;                          /* I2C_GANG_XXX, stage target stopped */
+    int error;                          /* Failed errno, 0 if success */
+    unsigned long long write_us;        /* Program time, unit microsecond */
+    unsigned long long verify_us;       /* Verify time, unit microsecond */
+} I2CGangTarget;
+
+/* I2C adapter found in sysfs */
+typedef struct i2c_adapter {
+    int nr;                     /* Adapter number, bus name is /dev/i2c-#nr */
+    char name[64];              /* Adapter name */
+    unsigned long funcs;        /* Adapter I2C_FUNCS, 0 if /dev/i2c-#nr can't open */
+    unsigned int max_xfer;      /* Max bytes per transfer, 0 if unknown */
+    int method;                 /* Fastest transfer method, I2C_METHOD_XXX */
+} I2CAdapter;
+
+/* I2C bus scan default address range, same as i2cdetect */
+#define I2C_SCAN_FIRST              0x08
+#define I2C_SCAN_LAST               0x77
+
+/* I2C bus scan result, bit N of #map set if address N ACK */
+typedef struct i2c_scan {
+    int bus;                    /* I2C Bus fd, return from i2c_open */
+    unsigned int first;         /* First address probed */
+    unsigned int last;          /* Last address probed */
+    int error;                  /* Scan failed errno, 0 if success */
+    unsigned char map[16];      /* Address bitmap, 128 7 bit addresses */
+} I2CScan;
+
+#define I2C_SCAN_FOUND(scan, addr)  (((scan)->map[(addr) / 8] >> ((addr) % 8)) & 1)
+
+/* I2C statistics latency histogram operation type */
+#define I2C_STATS_READ              0   /* Transfer read data, include write internal address then read */
+#define I2C_STATS_WRITE             1   /* Transfer only write data */
+#define I2C_STATS_SMBUS             2   /* Adapter native ioctl(I2C_SMBUS) */
+#define I2C_STATS_OPS               3
+
+/* I2C statistics latency histogram buckets, bucket 0 < 2us, bucket N [2^N, 2^(N+1)) us, last bucket include all longer */
+#define I2C_STATS_BUCKETS           24
+
+/* I2C statistics snapshot of bus or device */
+typedef struct i2c_stats {
+    unsigned long long xfers;       /* Transactions, I2C_RDWR/I2C_SMBUS ioctl or file read/write */
+    unsigned long long bytes_in;    /* Bytes read from devices */
+    unsigned long long bytes_out;   /* Bytes write to devices, include internal address */
+    unsigned long long ioctls;      /* All ioctl issued, include I2C_SLAVE etc */
+    unsigned long long naks;        /* Transfer failed ENXIO or EREMOTEIO, device NAK */
+    unsigned long long timeouts;    /* Transfer failed ETIMEDOUT */
+    unsigned long long arb_lost;    /* Transfer failed EAGAIN, arbitration lost */
+    unsigned long long errors;      /* Transfer failed other errno */
+    unsigned long long retries;     /* Page writes retried after transient failure */
+    unsigned long long delay_us;    /* Time in fixed i2c delay, unit microsecond */
+    unsigned long long poll_us;     /* Time in ACK polling wait write cycle, unit microsecond */
+    unsigned long long latency[I2C_STATS_OPS][I2C_STATS_BUCKETS];  /* Transaction latency histogram */
+} I2CStats;
+
+/* I2C trace record transfer type */
+#define I2C_TRACE_RDWR              0   /* ioctl(I2C_RDWR) */
+#define I2C_TRACE_SMBUS             1   /* ioctl(I2C_SMBUS) */
+#define I2C_TRACE_READ              2   /* File I/O read */
+#define I2C_TRACE_WRITE             3   /* File I/O write */
+
+/* I2C trace record internal address unknown, transfer not issued by i2c read/write functions */
+#define I2C_TRACE_NO_IADDR          0xffffffffU
+
+/* I2C trace record, one per bus transfer */
+typedef struct i2c_trace {
+    unsigned long long seq;         /* Record sequence number, gap means records dropped when ring full */
+    unsigned long long start_ns;    /* Transfer start, CLOCK_MONOTONIC nanosecond */
+    unsigned long long end_ns;      /* Transfer end, CLOCK_MONOTONIC nanosecond */
+    int bus;                        /* I2C Bus fd */
+    int result;                     /* Transfer return value, failed is -errno */
+    unsigned int iaddr;             /* Internal address or SMBus command, I2C_TRACE_NO_IADDR if unknown */
+    unsigned int len;               /* Data bytes of all messages */
+    unsigned short addr;            /* Device address of first message */
+    unsigned short flags;           /* First message flags, I2C_M_RD is set if any message read */
+    unsigned char type;             /* I2C_TRACE_XXX */
+    unsigned char nmsgs;            /* Number of messages */
+} I2CTrace;
+
+/* I2C trace hook, called by transfer thread every #watermark records, drain with i2c_trace_read */
+typedef void (*I2C_TRACE_HOOK)(void *ctx);
+
+/* I2C record file magic and version */
+#define I2C_RECORD_MAGIC            "I2CREC01"
+#define I2C_RECORD_VERSION          1
+
+/* I2C record file header, records follow it, can be memory-mapped, all fields are host byte order */
+typedef struct i2c_record_file {
+    char magic[8];                  /* I2C_RECORD_MAGIC, without terminating null */
+    uint32_t version;               /* I2C_RECORD_VERSION */
+    uint32_t header_size;           /* Bytes of file header, first record start here */
+    uint64_t start_ns;              /* CLOCK_MONOTONIC when recording start */
+} I2CRecordFile;
+
+/* I2C record of one bus transfer, followed by #nmsgs I2CRecordMsg then each message data, 8 bytes aligned */
+typedef struct i2c_record {
+    uint32_t size;                  /* Record bytes, include header, messages and data */
+    uint8_t type;                   /* I2C_TRACE_XXX */
+    uint8_t nmsgs;                  /* Number of messages */
+    uint16_t addr;                  /* Device address, selected address of file I/O and SMBus */
+    uint64_t start_ns;              /* Transfer start, relative to I2CRecordFile.start_ns */
+    uint64_t end_ns;                /* Transfer end, relative to I2CRecordFile.start_ns */
+    int32_t result;                 /* Transfer return value, failed is -errno */
+    uint8_t read_write;             /* SMBus read_write */
+    uint8_t command;                /* SMBus command */
+    uint16_t smbus_size;            /* SMBus transaction type, I2C_SMBUS_XXX */
+} I2CRecord;
+
+/* I2C record message, data is write data or read back data, SMBus data is union i2c_smbus_data after transfer */
+typedef struct i2c_record_msg {
+    uint16_t addr;
+    uint16_t flags;
+    uint32_t len;
+} I2CRecordMsg;
+
+/* I2C replay flags */
+#define I2C_REPLAY_REALTIME         0x1 /* Keep recorded interval between transfers, otherwise replay at max speed */
+
+/* I2C replay result */
+typedef struct i2c_replay_stat {
+    unsigned int records;                   /* Records replayed */
+    unsigned int diverged;                  /* Transfers result different from recorded, errno is ignored */
+    unsigned int mismatches;                /* Transfers read data different from recorded */
+    unsigned long long bytes;               /* Data bytes of replayed success transfers */
+    unsigned long long recorded_bytes;      /* Data bytes of recorded success transfers */
+    unsigned long long recorded_ns;         /* Sum of recorded transfer latency */
+    unsigned long long replay_ns;           /* Sum of replay transfer latency */
+    unsigned long long recorded_span_ns;    /* Recorded first transfer start to last transfer end */
+    unsigned long long replay_span_ns;      /* Replay first transfer start to last transfer end */
+} I2CReplayStat;
+
+/* I2C bus backend, bus name start with #prefix will use it instead of kernel i2c-dev */
+typedef struct i2c_backend {
+    const char *prefix;                                             /* Bus name prefix, such as "sim:" */
+    void *(*open)(const char *spec);                                /* #spec is bus name without prefix, return private data, failed return NULL */
+    void (*close)(void *priv);
+    ssize_t (*read)(void *priv, void *buf, size_t len);             /* Same as read(2) on i2c-dev */
+    ssize_t (*write)(void *priv, const void *buf, size_t len);      /* Same as write(2) on i2c-dev */
+    int (*ioctl)(void *priv, unsigned long request, unsigned long arg);  /* Same as ioctl(2) on i2c-dev, I2C_SLAVE/I2C_TENBIT/I2C_RDWR etc */
+} I2CBackend;
+
+/* Register i2c bus backend, "sim:" simulated bus backend is built-in */
+int i2c_register_backend(const I2CBackend *backend);
+
+/* Close i2c bus, bus opened by i2c_open is closed after other thread in-flight transfers and held locks released */
 void i2c_close(int bus);
 
-/* Open i2c bus, return i2c bus fd */
+/* Open i2c bus, return i2c bus fd, such as: /dev/i2c-1, sim:eeprom@0x50:size=512:page=16 */
 int i2c_open(const char *bus_name);
 
+/* Enumerate adapters in #sysfs(NULL is /sys/bus/i2c/devices), fill first #max adapters sorted by number, return number of adapters */
+int i2c_list_adapters(const char *sysfs, I2CAdapter *adapters, unsigned int max);
+
+/* Probe 7 bit address with method adapter support, ACK return 1, NAK return 0 */
+int i2c_probe(int bus, unsigned short addr);
+
+/* Scan [first, last](0 is default range) of many buses concurrently, one thread per bus, return number of devices found */
+int i2c_scan(I2CScan *scans, unsigned int nbuses, unsigned int first, unsigned int last);
+
+/* Get adapter functionality and fastest transfer method, cached when bus opened */
+int i2c_get_funcs(int bus, unsigned long *funcs);
+int i2c_get_method(int bus);
+
+/* I2C record all transfers of bus into file with data and timing, replay record file on bus */
+int i2c_record_start(int bus, const char *path);
+int i2c_record_stop(int bus);
+int i2c_replay(int bus, const char *path, unsigned int flags, I2CReplayStat *stat);
+
+/* I2C statistics, lock-free counters of bus and each device address on it, bus opened by i2c_open only */
+int i2c_get_stats(int bus, I2CStats *stats);
+int i2c_get_device_stats(const I2CDevice *device, I2CStats *stats);
+int i2c_reset_stats(int bus);
+
+/* I2C trace, process wide ring of bus transfers, ring allocated by first start, hook only set when stopped */
+int i2c_trace_start(unsigned int depth);
+void i2c_trace_stop(void);
+int i2c_trace_read(I2CTrace *traces, unsigned int max);
+int i2c_trace_set_hook(I2C_TRACE_HOOK hook, void *ctx, unsigned int watermark);
+unsigned long long i2c_trace_dropped(void);
+
+/* I2C bus lock, recursive, i2c_read/write etc hold it for each transfer, hold it to make multi-step sequence atomic, unlock by thread not hold it failed with EPERM */
+int i2c_set_lock(int bus, unsigned int flags);
+int i2c_lock(int bus);
+int i2c_unlock(int bus);
+
+/* Hold i2c bus across calls of other thread, i2c_close is deferred until all references and locks released */
+int i2c_ref(int bus);
+void i2c_unref(int bus);
+
 /* Initialize I2CDevice with default value */
 void i2c_init_device(I2CDevice *device);
 
+/* I2C part profile table, find part by name, initialize I2CDevice with part profile */
+const I2CPart *i2c_get_parts(unsigned int *count);
+const I2CPart *i2c_find_part(const char *name);
+int i2c_init_part(I2CDevice *device, const char *name);
+
 /* Get i2c device description */
 char *i2c_get_device_desc(const I2CDevice *device, char *buf, size_t size);
 
@@ -46,6 +334,67 @@ ssize_t i2c_write(const I2CDevice *device, unsigned int iaddr, const void *buf,
 ssize_t i2c_ioctl_read(const I2CDevice *device, unsigned int iaddr, void *buf, size_t len);
 ssize_t i2c_ioctl_write(const I2CDevice *device, unsigned int iaddr, const void *buf, size_t len);
 
+/* I2C read, write scattered regions, reads of all regions packed into as few ioctl(I2C_RDWR) as possible */
+ssize_t i2c_readv(const I2CDevice *device, const I2CIovec *iov, unsigned int iovcnt);
+ssize_t i2c_writev(const I2CDevice *device, const I2CIovec *iov, unsigned int iovcnt);
+
+/* I2C read, write using fastest method bus adapter support, SMBus method only support 1 byte internal address */
+ssize_t i2c_auto_read(const I2CDevice *device, unsigned int iaddr, void *buf, size_t len);
+ssize_t i2c_auto_write(const I2CDevice *device, unsigned int iaddr, const void *buf, size_t len);
+
+/* I2C transaction, init/reset(reuse without reallocate), add segment return it's index, submit return completed segments */
+void i2c_txn_init(I2CTxn *txn, int bus);
+void i2c_txn_reset(I2CTxn *txn);
+int i2c_txn_add_msg(I2CTxn *txn, unsigned short addr, unsigned short flags, void *buf, size_t len);
+int i2c_txn_add_address(I2CTxn *txn, const I2CDevice *device, unsigned int iaddr);
+int i2c_txn_add_read(I2CTxn *txn, const I2CDevice *device, unsigned int iaddr, void *buf, size_t len);
+int i2c_txn_add_write(I2CTxn *txn, const I2CDevice *device, unsigned int iaddr, const void *buf, size_t len);
+int i2c_txn_submit(I2CTxn *txn);
+
+/* SMBus, using I2C_RDWR if adapter support I2C otherwise ioctl(I2C_SMBUS), #device->pec enable PEC, read return value or -1 */
+int i2c_smbus_access(const I2CDevice *device, char read_write, unsigned char command, int size, union i2c_smbus_data *data);
+int i2c_smbus_write_quick(const I2CDevice *device, unsigned char value);
+int i2c_smbus_read_byte(const I2CDevice *device);
+int i2c_smbus_write_byte(const I2CDevice *device, unsigned char value);
+int i2c_smbus_read_byte_data(const I2CDevice *device, unsigned char command);
+int i2c_smbus_write_byte_data(const I2CDevice *device, unsigned char command, unsigned char value);
+int i2c_smbus_read_word_data(const I2CDevice *device, unsigned char command);
+int i2c_smbus_write_word_data(const I2CDevice *device, unsigned char command, unsigned short value);
+int i2c_smbus_process_call(const I2CDevice *device, unsigned char command, unsigned short value);
+int i2c_smbus_read_block_data(const I2CDevice *device, unsigned char command, unsigned char *values);
+int i2c_smbus_write_block_data(const I2CDevice *device, unsigned char command, unsigned char length, const unsigned char *values);
+int i2c_smbus_read_i2c_block_data(const I2CDevice *device, unsigned char command, unsigned char length, unsigned char *values);
+int i2c_smbus_write_i2c_block_data(const I2CDevice *device, unsigned char command, unsigned char length, const unsigned char *values);
+
+/* SMBus packet error checking CRC-8 */
+unsigned char i2c_smbus_pec(unsigned char crc, const void *buf, size_t len);
+
+/* I2C page cache, read/write only touch cache, flush write back dirty pages, invalidate drop pages, sync flush and drop all */
+I2CCache *i2c_cache_create(const I2CDevice *device, size_t size);
+void i2c_cache_destroy(I2CCache *cache);
+ssize_t i2c_cache_read(I2CCache *cache, unsigned int iaddr, void *buf, size_t len);
+ssize_t i2c_cache_write(I2CCache *cache, unsigned int iaddr, const void *buf, size_t len);
+int i2c_cache_flush(I2CCache *cache);
+void i2c_cache_invalidate(I2CCache *cache, unsigned int iaddr, size_t len);
+int i2c_cache_sync(I2CCache *cache);
+unsigned int i2c_cache_dirty(I2CCache *cache);
+
+/* I2C differential write, only program changed pages, compare with #manifest(page hashes) or read back device if it's NULL */
+ssize_t i2c_write_diff(const I2CDevice *device, unsigned int iaddr, const void *buf, size_t len, uint64_t *manifest, I2CDiffStat *stat);
+size_t i2c_diff_pages(const I2CDevice *device, unsigned int iaddr, size_t len);
+void i2c_diff_manifest(const I2CDevice *device, unsigned int iaddr, const void *buf, size_t len, uint64_t *manifest);
+uint64_t i2c_diff_hash(const void *buf, size_t len);
+
+/* I2C gang programming, program and verify same image on many targets, one worker per bus, return number of failed targets */
+int i2c_gang_program(I2CGangTarget *targets, unsigned int ntargets, unsigned int iaddr, const void *image, size_t len, unsigned int flags);
+
+/* I2C async engine, submit/reap never block, poll i2c_async_fd readable when completion is ready */
+I2CAsync *i2c_async_create(int bus, unsigned int depth);
+void i2c_async_destroy(I2CAsync *async);
+int i2c_async_fd(const I2CAsync *async);
+int i2c_async_submit(I2CAsync *async, const I2CAsyncReq *req);
+int i2c_async_reap(I2CAsync *async, I2CAsyncReq *reqs, unsigned int max);
+
 /* I2C read / write handle function */
 typedef ssize_t (*I2C_READ_HANDLE)(const I2CDevice *dev, unsigned int iaddr, void *buf, size_t len);
 typedef ssize_t (*I2C_WRITE_HANDLE)(const I2CDevice *dev, unsigned int iaddr, const void *buf, size_t len);
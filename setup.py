@@ -12,7 +12,7 @@ INC_DIR = os.path.join(THIS_DIR, 'include')
 VERSION = open('VERSION').read().strip()
 
 pylibi2c_module = Extension('pylibi2c',
-  sources=['src/i2c.c', 'src/pyi2c.c'],
+  sources=['src/i2c.c', 'src/i2c_bus.c', 'src/i2c_sim.c', 'src/i2c_ring.c', 'src/i2c_async.c', 'src/i2c_smbus.c', 'src/i2c_adapter.c', 'src/i2c_cache.c', 'src/i2c_diff.c', 'src/i2c_scan.c', 'src/i2c_gang.c', 'src/i2c_trace.c', 'src/i2c_record.c', 'src/i2c_part.c', 'src/pyi2c.c'],
   extra_compile_args=['-DLIBI2C_VERSION="' + VERSION + '"'],
   include_dirs=[INC_DIR],
 )
@@ -1,4 +1,7 @@
+#include <time.h>
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -6,10 +9,21 @@
 #include <sys/ioctl.h>
 #include <arpa/inet.h>
 #include "i2c/i2c.h"
+#include "i2c_bus.h"
+#include "i2c_trace.h"
 
 /* I2C default delay */
 #define I2C_DEFAULT_DELAY 1
 
+/* I2C default ACK polling timeout(ms), interval(us) */
+#define I2C_DEFAULT_POLL_TIMEOUT 25
+#define I2C_DEFAULT_POLL_INTERVAL 100
+
+/* I2C default first retry backoff(us), max backoff doubling */
+#define I2C_DEFAULT_RETRY_BACKOFF 1000
+#define I2C_RETRY_BACKOFF_SHIFT_MAX 10
+#define I2C_RETRY_BACKOFF_MAX 500000
+
 /* I2C internal address max length */
 #define INT_ADDR_MAX_BYTES 4
 
@@ -17,23 +31,65 @@
 #define PAGE_MAX_BYTES 4096
 
 #define GET_I2C_DELAY(delay) ((delay) == 0 ? I2C_DEFAULT_DELAY : (delay))
+#define GET_POLL_TIMEOUT(timeout) ((timeout) == 0 ? I2C_DEFAULT_POLL_TIMEOUT : (timeout))
+#define GET_POLL_INTERVAL(interval) ((interval) == 0 ? I2C_DEFAULT_POLL_INTERVAL : (interval))
+#define GET_RETRY_ON(retry_on) ((retry_on) == 0 ? I2C_RETRY_DEFAULT : (retry_on))
+#define GET_RETRY_BACKOFF(backoff) ((backoff) == 0 ? I2C_DEFAULT_RETRY_BACKOFF : (backoff))
 #define GET_I2C_FLAGS(tenbit, flags) ((tenbit) ? ((flags) | I2C_M_TEN) : (flags))
 #define GET_WRITE_SIZE(addr, remain, page_bytes) ((addr) + (remain) > (page_bytes) ? (page_bytes) - (addr) : remain)
 
-static void i2c_delay(unsigned char delay);
+/* Page write failed, pages already written is partial progress, errno is kept */
+#define GET_WRITE_RESULT(cnt) ((cnt) ? (ssize_t)(cnt) : -1)
+
+static void i2c_delay(const I2CDevice *device, unsigned char delay);
+static void i2c_perror(const char *msg);
+static int i2c_retry(const I2CDevice *device, unsigned int *retries);
+static int i2c_wait_page(const I2CDevice *device, unsigned int iaddr, int method, unsigned int *retries);
+static int i2c_txn_flush(I2CTxn *txn);
+static size_t i2c_read_size(const I2CDevice *device, unsigned int iaddr, size_t remain);
+static size_t i2c_write_size(const I2CDevice *device, unsigned int iaddr, size_t remain, size_t max);
+static int i2c_wait_complete(const I2CDevice *device, unsigned int iaddr, int method);
+static unsigned short i2c_block_addr(const I2CDevice *device, unsigned int iaddr);
 
 /*
 **	@brief		:	Open i2c bus
-**	#bus_name	:	i2c bus name such as: /dev/i2c-1
+**	#bus_name	:	i2c bus name such as: /dev/i2c-1, bus name start with backend prefix will open by backend
 **	@return		:	failed return -1, success return i2c bus fd
 */
 int i2c_open(const char *bus_name)
 {
     int fd;
+    void *priv = NULL;
+    const I2CBackend *backend = i2c_bus_find_backend(bus_name);
+
+    /* Backend bus using a placeholder fd as bus handle */
+    if (backend) {
+
+        if ((priv = backend->open(bus_name + strlen(backend->prefix))) == NULL) {
+
+            return -1;
+        }
 
+        if ((fd = open("/dev/null", O_RDWR | O_CLOEXEC)) == -1) {
+
+            backend->close(priv);
+            return -1;
+        }
+    }
     /* Open i2c-bus devcice */
-    if ((fd = open(bus_name, O_RDWR)) == -1) {
+    else if ((fd = open(bus_name, O_RDWR)) == -1) {
+
+        return -1;
+    }
 
+    if (i2c_bus_attach(fd, backend, priv) == -1) {
+
+        if (backend) {
+
+            backend->close(priv);
+        }
+
+        close(fd);
         return -1;
     }
 
@@ -41,9 +97,17 @@ int i2c_open(const char *bus_name)
 }
 
 
+/*
+**	@brief		:	Close i2c bus, bus opened by i2c_open is closed after in-flight transfers and locks of other thread
+**					or this thread released, new i2c_lock and transfers with lock failed with EBADF
+**	#bus		:	i2c bus fd
+*/
 void i2c_close(int bus)
 {
-    close(bus);
+    if (i2c_bus_close(bus) == -1) {
+
+        close(bus);
+    }
 }
 
 
@@ -64,6 +128,25 @@ void i2c_init_device(I2CDevice *device)
 
     /* 1 byte internal(word) address */
     device->iaddr_bytes = 1;
+
+    /* Fixed delay after each page write */
+    device->completion = I2C_COMPLETION_DELAY;
+
+    /* ACK polling give up after 25ms, poll every 100us */
+    device->poll_timeout = I2C_DEFAULT_POLL_TIMEOUT;
+    device->poll_interval = I2C_DEFAULT_POLL_INTERVAL;
+    device->poll_max = 0;
+
+    /* SMBus without PEC */
+    device->pec = 0;
+
+    /* Page write failed abort, retry NAK/timeout/arbitration lost after 1ms, 2ms, 4ms... if #retries set */
+    device->retries = 0;
+    device->retry_on = I2C_RETRY_DEFAULT;
+    device->retry_backoff = I2C_DEFAULT_RETRY_BACKOFF;
+
+    /* Internal address not carry into slave address */
+    device->block_bits = 0;
 }
 
 
@@ -95,105 +178,176 @@ char *i2c_get_device_desc(const I2CDevice *device, char *buf, size_t size)
 */
 ssize_t i2c_ioctl_read(const I2CDevice *device, unsigned int iaddr, void *buf, size_t len)
 {
-    struct i2c_msg ioctl_msg[2];
-    struct i2c_rdwr_ioctl_data ioctl_data;
-    unsigned char addr[INT_ADDR_MAX_BYTES];
-    unsigned short flags = GET_I2C_FLAGS(device->tenbit, device->flags);
+    I2CIovec iov;
 
-    memset(addr, 0, sizeof(addr));
-    memset(ioctl_msg, 0, sizeof(ioctl_msg));
-    memset(&ioctl_data, 0, sizeof(ioctl_data));
+    iov.iaddr = iaddr;
+    iov.buf = buf;
+    iov.len = len;
+
+    return i2c_readv(device, &iov, 1);
+}
 
-    /* Target have internal address */
-    if (device->iaddr_bytes) {
 
-        i2c_iaddr_convert(iaddr, device->iaddr_bytes, addr);
+/*
+**	@brief		:	Read scattered regions of #device with as few ioctl(I2C_RDWR) as possible
+**	#device		:	I2CDevice struct
+**	#iov		:	regions to read, each read #iov->len bytes from #iov->iaddr to #iov->buf
+**	#iovcnt		:	number of #iov
+**	@return		:	success return total read length, failed return -1
+*/
+ssize_t i2c_readv(const I2CDevice *device, const I2CIovec *iov, unsigned int iovcnt)
+{
+    I2CTxn txn;
+    ssize_t ret = 0;
+    unsigned int i, iaddr = 0;
+    size_t size, remain = 0;
+    unsigned char *buffer = NULL;
 
-        /* First message is write internal address */
-        ioctl_msg[0].len	=	device->iaddr_bytes;
-        ioctl_msg[0].addr	= 	device->addr;
-        ioctl_msg[0].buf	= 	addr;
-        ioctl_msg[0].flags	= 	flags;
+    i2c_txn_init(&txn, device->bus);
 
-        /* Second message is read data */
-        ioctl_msg[1].len	= 	len;
-        ioctl_msg[1].addr	= 	device->addr;
-        ioctl_msg[1].buf	=	buf;
-        ioctl_msg[1].flags	=	flags | I2C_M_RD;
+    if (i2c_lock(device->bus) == -1) {
 
-        /* Package to i2c message to operation i2c device */
-        ioctl_data.nmsgs	=	2;
-        ioctl_data.msgs		=	ioctl_msg;
+        return -1;
     }
-    /* Target did not have internal address */
-    else {
 
-        /* Direct send read data message */
-        ioctl_msg[0].len	= 	len;
-        ioctl_msg[0].addr	= 	device->addr;
-        ioctl_msg[0].buf	=	buf;
-        ioctl_msg[0].flags	=	flags | I2C_M_RD;
+    /*
+    **  Target have internal address, each chunk first message is write internal address, second message is read data.
+    **  Target did not have internal address, direct send read data message.
+    **  Large read split into adapter sized chunks, chunks of all regions as many as possible submit with one ioctl.
+    */
+    for (i = 0; ret != -1 && i < iovcnt; i++) {
+
+        iaddr = iov[i].iaddr;
+        buffer = iov[i].buf;
+        remain = iov[i].len;
+        ret += remain;
+
+        while (remain > 0) {
+
+            size = i2c_read_size(device, iaddr, remain);
+
+            /* Trace record internal address of first chunk in each submit */
+            if (txn.nmsgs == 0) {
+
+                I2C_TRACE_IADDR(iaddr);
+            }
 
-        /* Package to i2c message to operation i2c device */
-        ioctl_data.nmsgs	=	1;
-        ioctl_data.msgs		=	ioctl_msg;
+            if (i2c_txn_add_read(&txn, device, iaddr, buffer, size) == -1) {
+
+                /* Transaction full, submit it and add this chunk again */
+                if (txn.nmsgs && i2c_txn_flush(&txn) == 0) {
+
+                    continue;
+                }
+
+                i2c_perror("Ioctl read i2c error:");
+                ret = -1;
+                break;
+            }
+
+            iaddr += size;
+            buffer += size;
+            remain -= size;
+        }
     }
 
-    /* Using ioctl interface operation i2c device */
-    if (ioctl(device->bus, I2C_RDWR, (unsigned long)&ioctl_data) == -1) {
+    if (ret != -1 && i2c_txn_flush(&txn) == -1) {
 
-        perror("Ioctl read i2c error:");
-        return -1;
+        i2c_perror("Ioctl read i2c error:");
+        ret = -1;
     }
 
-    return len;
+    i2c_unlock(device->bus);
+    return ret;
 }
 
 
 ssize_t i2c_ioctl_write(const I2CDevice *device, unsigned int iaddr, const void *buf, size_t len)
 {
     ssize_t remain = len;
+    unsigned int retries = 0;
     size_t size = 0, cnt = 0;
+    unsigned long funcs = 0;
     const unsigned char *buffer = buf;
-    unsigned char delay = GET_I2C_DELAY(device->delay);
     unsigned short flags = GET_I2C_FLAGS(device->tenbit, device->flags);
 
-    struct i2c_msg ioctl_msg;
+    struct i2c_msg ioctl_msgs[2];
     struct i2c_rdwr_ioctl_data ioctl_data;
     unsigned char tmp_buf[PAGE_MAX_BYTES + INT_ADDR_MAX_BYTES];
 
+    /* Adapter support NOSTART, internal address and caller data are two messages of one write, data is not copied */
+    int nostart = device->iaddr_bytes && i2c_bus_funcs(device->bus, &funcs) == 0 && (funcs & I2C_FUNC_NOSTART);
+    size_t max = nostart || device->iaddr_bytes == 0 ? I2C_MSG_MAX_BYTES : PAGE_MAX_BYTES;
+
+    ioctl_msgs[0].flags	=	flags;
+    ioctl_msgs[1].flags	=	flags | I2C_M_NOSTART;
+    ioctl_data.msgs		=	ioctl_msgs;
+
     while (remain > 0) {
 
-        size = GET_WRITE_SIZE(iaddr % device->page_bytes, remain, device->page_bytes);
+        size = i2c_write_size(device, iaddr, remain, max);
 
-        /* Convert i2c internal address */
-        memset(tmp_buf, 0, sizeof(tmp_buf));
+        /* Convert i2c internal address, page never cross block so each page has one slave address */
         i2c_iaddr_convert(iaddr, device->iaddr_bytes, tmp_buf);
+        ioctl_msgs[0].addr	=	i2c_block_addr(device, iaddr);
+        ioctl_msgs[1].addr	=	ioctl_msgs[0].addr;
 
-        /* Connect write data after device internal address */
-        memcpy(tmp_buf + device->iaddr_bytes, buffer, size);
+        if (nostart) {
 
-        /* Fill kernel ioctl i2c_msg */
-        memset(&ioctl_msg, 0, sizeof(ioctl_msg));
-        memset(&ioctl_data, 0, sizeof(ioctl_data));
+            ioctl_msgs[0].len	=	device->iaddr_bytes;
+            ioctl_msgs[0].buf	=	tmp_buf;
+            ioctl_msgs[1].len	=	size;
+            ioctl_msgs[1].buf	=	(unsigned char *)buffer;
+            ioctl_data.nmsgs	=	2;
+        }
+        else if (device->iaddr_bytes == 0) {
 
-        ioctl_msg.len	=	device->iaddr_bytes + size;
-        ioctl_msg.addr	=	device->addr;
-        ioctl_msg.buf	=	tmp_buf;
-        ioctl_msg.flags	=	flags;
+            ioctl_msgs[0].len	=	size;
+            ioctl_msgs[0].buf	=	(unsigned char *)buffer;
+            ioctl_data.nmsgs	=	1;
+        }
+        else {
 
-        ioctl_data.nmsgs =	1;
-        ioctl_data.msgs	=	&ioctl_msg;
+            /* Connect write data after device internal address */
+            memcpy(tmp_buf + device->iaddr_bytes, buffer, size);
 
-        if (ioctl(device->bus, I2C_RDWR, (unsigned long)&ioctl_data) == -1) {
+            ioctl_msgs[0].len	=	device->iaddr_bytes + size;
+            ioctl_msgs[0].buf	=	tmp_buf;
+            ioctl_data.nmsgs	=	1;
+        }
 
-            perror("Ioctl write i2c error:");
-            return -1;
+        /* Hold bus for page write and it's write cycle, other transfer to this device will be NAK */
+        if (i2c_lock(device->bus) == -1) {
+
+            return GET_WRITE_RESULT(cnt);
+        }
+
+        I2C_TRACE_IADDR(iaddr);
+        if (i2c_bus_ioctl(device->bus, I2C_RDWR, (unsigned long)&ioctl_data) == -1) {
+
+            i2c_unlock(device->bus);
+
+            /* Transient failure write this page again */
+            if (i2c_retry(device, &retries)) {
+
+                continue;
+            }
+
+            i2c_perror("Ioctl write i2c error:");
+            return GET_WRITE_RESULT(cnt);
         }
 
-        /* XXX: Must have a little time delay */
-        i2c_delay(delay);
+        /* XXX: Must wait device write cycle complete, page is programmed so only polling is retried */
+        if (i2c_wait_page(device, iaddr + size, I2C_METHOD_IOCTL, &retries) == -1) {
 
+            i2c_unlock(device->bus);
+            i2c_perror("Ioctl wait i2c write complete error:");
+            return GET_WRITE_RESULT(cnt);
+        }
+
+        i2c_unlock(device->bus);
+
+        retries = 0;
         cnt += size;
         iaddr += size;
         buffer += size;
@@ -205,21 +359,350 @@ ssize_t i2c_ioctl_write(const I2CDevice *device, unsigned int iaddr, const void
 
 
 /*
-**	@brief	:	read #len bytes data from #device #iaddr to #buf
-**	#device	:	I2CDevice struct, must call i2c_device_init first
-**	#iaddr	:	i2c_device internal address will read data from this address, no address set zero
-**	#buf	:	i2c data will read to here
-**	#len	:	how many data to read, lenght must less than or equal to buf size
-**	@return : 	success return read data length, failed -1
+**	@brief		:	Write scattered regions of #device, each region page split same as i2c_ioctl_write
+**	#device		:	I2CDevice struct
+**	#iov		:	regions to write, each write #iov->len bytes of #iov->buf to #iov->iaddr
+**	#iovcnt		:	number of #iov
+**	@return		:	success return total write length, failed return -1, failed after some pages written return written length
 */
-ssize_t i2c_read(const I2CDevice *device, unsigned int iaddr, void *buf, size_t len)
+ssize_t i2c_writev(const I2CDevice *device, const I2CIovec *iov, unsigned int iovcnt)
+{
+    ssize_t ret;
+    size_t cnt = 0;
+    unsigned int i;
+
+    for (i = 0; i < iovcnt; i++) {
+
+        if ((ret = i2c_ioctl_write(device, iov[i].iaddr, iov[i].buf, iov[i].len)) == -1) {
+
+            return GET_WRITE_RESULT(cnt);
+        }
+
+        cnt += ret;
+
+        /* Region partial written, later regions are not written */
+        if ((size_t)ret != iov[i].len) {
+
+            break;
+        }
+    }
+
+    return cnt;
+}
+
+
+/*
+**	@brief		:	Initialize i2c transaction
+**	#txn		:	I2CTxn struct
+**	#bus		:	i2c bus fd, all segments will submit to this bus
+*/
+void i2c_txn_init(I2CTxn *txn, int bus)
+{
+    txn->bus = bus;
+    i2c_txn_reset(txn);
+}
+
+
+/*
+**	@brief		:	Drop all segments, transaction can be reused without reallocate
+**	#txn		:	I2CTxn struct
+*/
+void i2c_txn_reset(I2CTxn *txn)
+{
+    txn->nmsgs = 0;
+    txn->data_used = 0;
+}
+
+
+/*
+**	@brief		:	Add a raw i2c_msg segment to transaction
+**	#txn		:	I2CTxn struct
+**	#addr		:	i2c device(slave) address of this segment
+**	#flags		:	i2c_msg flags, I2C_M_RD/I2C_M_TEN/I2C_M_NOSTART etc
+**	#buf		:	segment data, must keep valid until i2c_txn_submit return
+**	#len		:	segment data length
+**	@return		:	success return segment index, failed return -1(transaction full errno is ENOSPC)
+*/
+int i2c_txn_add_msg(I2CTxn *txn, unsigned short addr, unsigned short flags, void *buf, size_t len)
+{
+    struct i2c_msg *msg;
+
+    if (len > I2C_MSG_MAX_BYTES) {
+
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (txn->nmsgs >= I2C_RDWR_IOCTL_MAX_MSGS) {
+
+        errno = ENOSPC;
+        return -1;
+    }
+
+    msg = &txn->msgs[txn->nmsgs];
+    msg->addr	=	addr;
+    msg->flags	=	flags;
+    msg->len	=	len;
+    msg->buf	=	buf;
+
+    txn->status[txn->nmsgs] = 0;
+    return txn->nmsgs++;
+}
+
+
+/*
+**	@brief		:	Alloc #len bytes from transaction storage
+**	@return		:	success return storage address, failed return NULL(errno is ENOSPC)
+*/
+static unsigned char *i2c_txn_alloc(I2CTxn *txn, size_t len)
+{
+    unsigned char *data;
+
+    if (txn->data_used + len > sizeof(txn->data)) {
+
+        errno = ENOSPC;
+        return NULL;
+    }
+
+    data = txn->data + txn->data_used;
+    txn->data_used += len;
+    return data;
+}
+
+
+/*
+**	@brief		:	Add a write internal address only segment(address phase) to transaction
+**	#txn		:	I2CTxn struct
+**	#device		:	I2CDevice struct
+**	#iaddr		:	i2c device internal address
+**	@return		:	success return segment index, failed return -1
+*/
+int i2c_txn_add_address(I2CTxn *txn, const I2CDevice *device, unsigned int iaddr)
+{
+    int index;
+    unsigned char *addr;
+    unsigned int data_used = txn->data_used;
+
+    if ((addr = i2c_txn_alloc(txn, device->iaddr_bytes)) == NULL) {
+
+        return -1;
+    }
+
+    i2c_iaddr_convert(iaddr, device->iaddr_bytes, addr);
+
+    index = i2c_txn_add_msg(txn, i2c_block_addr(device, iaddr), GET_I2C_FLAGS(device->tenbit, device->flags),
+                            addr, device->iaddr_bytes);
+    if (index == -1) {
+
+        txn->data_used = data_used;
+    }
+
+    return index;
+}
+
+
+/*
+**	@brief		:	Add read #len bytes from #device #iaddr to #buf segments to transaction
+**	#txn		:	I2CTxn struct
+**	#device		:	I2CDevice struct, device without internal address only add read segment
+**	#iaddr		:	i2c device internal address
+**	#buf		:	read data save to here, must keep valid until i2c_txn_submit return
+**	#len		:	how many data to read
+**	@return		:	success return read segment index, failed return -1
+*/
+int i2c_txn_add_read(I2CTxn *txn, const I2CDevice *device, unsigned int iaddr, void *buf, size_t len)
+{
+    int index;
+    unsigned int nmsgs = txn->nmsgs;
+    unsigned int data_used = txn->data_used;
+    unsigned short flags = GET_I2C_FLAGS(device->tenbit, device->flags);
+
+    /* Address phase */
+    if (device->iaddr_bytes && i2c_txn_add_address(txn, device, iaddr) == -1) {
+
+        return -1;
+    }
+
+    /* Read phase, if failed rollback address phase */
+    if ((index = i2c_txn_add_msg(txn, i2c_block_addr(device, iaddr), flags | I2C_M_RD, buf, len)) == -1) {
+
+        txn->nmsgs = nmsgs;
+        txn->data_used = data_used;
+    }
+
+    return index;
+}
+
+
+/*
+**	@brief		:	Add write #len bytes #buf data to #device #iaddr segment to transaction
+**	#txn		:	I2CTxn struct
+**	#device		:	I2CDevice struct
+**	#iaddr		:	i2c device internal address
+**	#buf		:	data will copy to transaction storage after internal address
+**	#len		:	data length, must not cross device page boundary
+**	@return		:	success return write segment index, failed return -1
+*/
+int i2c_txn_add_write(I2CTxn *txn, const I2CDevice *device, unsigned int iaddr, const void *buf, size_t len)
+{
+    int index;
+    unsigned char *data;
+    unsigned int data_used = txn->data_used;
+
+    if ((data = i2c_txn_alloc(txn, device->iaddr_bytes + len)) == NULL) {
+
+        return -1;
+    }
+
+    /* Connect write data after device internal address */
+    i2c_iaddr_convert(iaddr, device->iaddr_bytes, data);
+    memcpy(data + device->iaddr_bytes, buf, len);
+
+    index = i2c_txn_add_msg(txn, i2c_block_addr(device, iaddr), GET_I2C_FLAGS(device->tenbit, device->flags),
+                            data, device->iaddr_bytes + len);
+    if (index == -1) {
+
+        txn->data_used = data_used;
+    }
+
+    return index;
+}
+
+
+/*
+**	@brief		:	Submit all transaction segments with one ioctl(I2C_RDWR), segment result save to #txn->status
+**	#txn		:	I2CTxn struct
+**	@return		:	success return number of completed segments, failed return -1
+*/
+int i2c_txn_submit(I2CTxn *txn)
+{
+    int ret, err;
+    unsigned int i;
+    struct i2c_rdwr_ioctl_data ioctl_data;
+
+    if (txn->nmsgs == 0) {
+
+        return 0;
+    }
+
+    ioctl_data.msgs		=	txn->msgs;
+    ioctl_data.nmsgs	=	txn->nmsgs;
+
+    ret = i2c_bus_ioctl(txn->bus, I2C_RDWR, (unsigned long)&ioctl_data);
+    err = errno;
+
+    /* Adapter stop at first failed segment, following segments are not transferred */
+    for (i = 0; i < txn->nmsgs; i++) {
+
+        txn->status[i] = ret == -1 ? -err : ((int)i < ret ? 0 : -EIO);
+    }
+
+    errno = err;
+    return ret;
+}
+
+
+/*
+**	@brief		:	Submit transaction and reset it for reuse
+**	#txn		:	I2CTxn struct
+**	@return		:	all segments completed return 0, otherwise return -1
+*/
+static int i2c_txn_flush(I2CTxn *txn)
+{
+    int ret = i2c_txn_submit(txn);
+
+    if (ret != (int)txn->nmsgs) {
+
+        errno = ret == -1 ? errno : EIO;
+        return -1;
+    }
+
+    i2c_txn_reset(txn);
+    return 0;
+}
+
+
+/*
+**	@brief		:	Get how many bytes can be read with one i2c_msg from #iaddr
+**	#device		:	I2CDevice struct
+**	#iaddr		:	i2c device internal address
+**	#remain		:	remain bytes to read
+**	@return		:	chunk size, not exceed adapter limit and not cross internal address space end(address wraparound)
+*/
+static size_t i2c_read_size(const I2CDevice *device, unsigned int iaddr, size_t remain)
+{
+    unsigned long long span;
+    size_t size = remain > I2C_MSG_MAX_BYTES ? I2C_MSG_MAX_BYTES : remain;
+
+    if (device->iaddr_bytes && device->iaddr_bytes < INT_ADDR_MAX_BYTES) {
+
+        span = 1ULL << (8 * device->iaddr_bytes);
+        if (iaddr % span + size > span) {
+
+            size = span - iaddr % span;
+        }
+    }
+
+    return size;
+}
+
+
+/* Write bytes of one transfer, page write not cross page boundary, device without page only limit by address space */
+static size_t i2c_write_size(const I2CDevice *device, unsigned int iaddr, size_t remain, size_t max)
+{
+    size_t size;
+
+    if (device->completion == I2C_COMPLETION_NONE) {
+
+        size = i2c_read_size(device, iaddr, remain);
+    }
+    else {
+
+        size = GET_WRITE_SIZE(iaddr % device->page_bytes, remain, device->page_bytes);
+    }
+
+    return size > max ? max : size;
+}
+
+
+/* Slave address of #iaddr, block select device internal address high bits are added to base slave address */
+static unsigned short i2c_block_addr(const I2CDevice *device, unsigned int iaddr)
 {
-    ssize_t cnt;
+    if (!device->block_bits || !device->iaddr_bytes || device->iaddr_bytes >= INT_ADDR_MAX_BYTES) {
+
+        return device->addr;
+    }
+
+    return device->addr + ((iaddr >> (8 * device->iaddr_bytes)) & ((1U << device->block_bits) - 1));
+}
+
+
+/* Bytes from #iaddr to block end, block select device sequential read not roll over to next block */
+static size_t i2c_block_size(const I2CDevice *device, unsigned int iaddr, size_t remain)
+{
+    unsigned long long span;
+
+    if (!device->block_bits || !device->iaddr_bytes || device->iaddr_bytes >= INT_ADDR_MAX_BYTES) {
+
+        return remain;
+    }
+
+    span = 1ULL << (8 * device->iaddr_bytes);
+    return iaddr % span + remain > span ? span - iaddr % span : remain;
+}
+
+
+/* File I/O read one block, caller hold bus lock, device selected address is valid until read complete */
+static ssize_t i2c_file_read_block(const I2CDevice *device, unsigned int iaddr, void *buf, size_t len)
+{
+    ssize_t ret;
+    size_t cnt = 0;
+    unsigned char *buffer = buf;
     unsigned char addr[INT_ADDR_MAX_BYTES];
     unsigned char delay = GET_I2C_DELAY(device->delay);
 
     /* Set i2c slave address */
-    if (i2c_select(device->bus, device->addr, device->tenbit) == -1) {
+    if (i2c_select(device->bus, i2c_block_addr(device, iaddr), device->tenbit) == -1) {
 
         return -1;
     }
@@ -229,72 +712,164 @@ ssize_t i2c_read(const I2CDevice *device, unsigned int iaddr, void *buf, size_t
     i2c_iaddr_convert(iaddr, device->iaddr_bytes, addr);
 
     /* Write internal address to devide  */
-    if (write(device->bus, addr, device->iaddr_bytes) != device->iaddr_bytes) {
+    I2C_TRACE_IADDR(iaddr);
+    if (i2c_bus_write(device->bus, addr, device->iaddr_bytes) != device->iaddr_bytes) {
 
-        perror("Write i2c internal address error");
+        i2c_perror("Write i2c internal address error");
         return -1;
     }
 
-    /* Wait a while */
-    i2c_delay(delay);
+    /* Wait a while, FRAM/MRAM is ready at once */
+    if (device->completion != I2C_COMPLETION_NONE) {
+
+        i2c_delay(device, delay);
+    }
 
-    /* Read count bytes data from int_addr specify address */
-    if ((cnt = read(device->bus, buf, len)) == -1) {
+    /* Read count bytes data from int_addr specify address, i2c-dev read max 8192 bytes once, device continue sequential read */
+    while (cnt < len) {
 
-        perror("Read i2c data error");
-        return -1;
+        I2C_TRACE_IADDR(iaddr + cnt);
+        if ((ret = i2c_bus_read(device->bus, buffer + cnt, len - cnt)) == -1) {
+
+            i2c_perror("Read i2c data error");
+            return -1;
+        }
+
+        if (ret == 0) {
+
+            break;
+        }
+
+        cnt += ret;
+    }
+
+    return cnt;
+}
+
+
+/* File I/O read, linear address space of block select device read block by block */
+static ssize_t i2c_file_read(const I2CDevice *device, unsigned int iaddr, void *buf, size_t len)
+{
+    ssize_t ret;
+    size_t size, cnt = 0;
+    unsigned char *buffer = buf;
+
+    while (cnt < len) {
+
+        size = i2c_block_size(device, iaddr + cnt, len - cnt);
+
+        if ((ret = i2c_file_read_block(device, iaddr + cnt, buffer + cnt, size)) == -1) {
+
+            return -1;
+        }
+
+        cnt += ret;
+
+        /* Device has no more data */
+        if ((size_t)ret != size) {
+
+            break;
+        }
     }
 
     return cnt;
 }
 
 
+/*
+**	@brief	:	read #len bytes data from #device #iaddr to #buf
+**	#device	:	I2CDevice struct, must call i2c_device_init first
+**	#iaddr	:	i2c_device internal address will read data from this address, no address set zero
+**	#buf	:	i2c data will read to here
+**	#len	:	how many data to read, lenght must less than or equal to buf size
+**	@return : 	success return read data length, failed -1
+*/
+ssize_t i2c_read(const I2CDevice *device, unsigned int iaddr, void *buf, size_t len)
+{
+    ssize_t ret;
+
+    /* Other device on this bus can't select between address write and data read */
+    if (i2c_lock(device->bus) == -1) {
+
+        return -1;
+    }
+
+    ret = i2c_file_read(device, iaddr, buf, len);
+    i2c_unlock(device->bus);
+    return ret;
+}
+
+
 /*
 **	@brief	:	write #buf data to i2c #device #iaddr address
 **	#device	:	I2CDevice struct, must call i2c_device_init first
 **	#iaddr	: 	i2c_device internal address, no address set zero
 **	#buf	:	data will write to i2c device
 **	#len	:	buf data length without '/0'
-**	@return	: 	success return write data length, failed -1
+**	@return	: 	success return write data length, failed -1, failed after some pages written return written length
 */
 ssize_t i2c_write(const I2CDevice *device, unsigned int iaddr, const void *buf, size_t len)
 {
     ssize_t remain = len;
     ssize_t ret;
+    unsigned int retries = 0;
     size_t cnt = 0, size = 0;
     const unsigned char *buffer = buf;
-    unsigned char delay = GET_I2C_DELAY(device->delay);
     unsigned char tmp_buf[PAGE_MAX_BYTES + INT_ADDR_MAX_BYTES];
 
-    /* Set i2c slave address */
-    if (i2c_select(device->bus, device->addr, device->tenbit) == -1) {
-
-        return -1;
-    }
-
     /* Once only can write less than 4 byte */
     while (remain > 0) {
 
-        size = GET_WRITE_SIZE(iaddr % device->page_bytes, remain, device->page_bytes);
+        size = i2c_write_size(device, iaddr, remain, device->iaddr_bytes ? PAGE_MAX_BYTES : I2C_MSG_MAX_BYTES);
 
-        /* Convert i2c internal address */
-        memset(tmp_buf, 0, sizeof(tmp_buf));
-        i2c_iaddr_convert(iaddr, device->iaddr_bytes, tmp_buf);
+        /* Convert i2c internal address, copy data after it, no internal address write caller data directly */
+        if (device->iaddr_bytes) {
 
-        /* Copy data to tmp_buf */
-        memcpy(tmp_buf + device->iaddr_bytes, buffer, size);
+            i2c_iaddr_convert(iaddr, device->iaddr_bytes, tmp_buf);
+            memcpy(tmp_buf + device->iaddr_bytes, buffer, size);
+        }
+
+        /* Hold bus for page write and it's write cycle, select again since other device may selected */
+        if (i2c_lock(device->bus) == -1) {
+
+            return GET_WRITE_RESULT(cnt);
+        }
+
+        /* Set i2c slave address */
+        if (i2c_select(device->bus, i2c_block_addr(device, iaddr), device->tenbit) == -1) {
+
+            i2c_unlock(device->bus);
+            return GET_WRITE_RESULT(cnt);
+        }
 
         /* Write to buf content to i2c device length  is address length and
                 write buffer length */
-        ret = write(device->bus, tmp_buf, device->iaddr_bytes + size);
+        I2C_TRACE_IADDR(iaddr);
+        ret = i2c_bus_write(device->bus, device->iaddr_bytes ? tmp_buf : buffer, device->iaddr_bytes + size);
         if (ret == -1 || (size_t)ret != device->iaddr_bytes + size)
         {
-            perror("I2C write error:");
-            return -1;
+            i2c_unlock(device->bus);
+
+            /* Transient failure write this page again */
+            if (ret == -1 && i2c_retry(device, &retries)) {
+
+                continue;
+            }
+
+            i2c_perror("I2C write error:");
+            return GET_WRITE_RESULT(cnt);
         }
 
-        /* XXX: Must have a little time delay */
-        i2c_delay(delay);
+        /* XXX: Must wait device write cycle complete, page is programmed so only polling is retried */
+        if (i2c_wait_page(device, iaddr + size, I2C_METHOD_FILE, &retries) == -1) {
+
+            i2c_unlock(device->bus);
+            i2c_perror("I2C wait write complete error:");
+            return GET_WRITE_RESULT(cnt);
+        }
+
+        i2c_unlock(device->bus);
+        retries = 0;
 
         /* Move to next #size bytes */
         cnt += size;
@@ -307,6 +882,164 @@ ssize_t i2c_write(const I2CDevice *device, unsigned int iaddr, const void *buf,
 }
 
 
+/* SMBus i2c block read, command is 1 byte internal address, caller hold bus lock */
+static ssize_t i2c_smbus_block_read(const I2CDevice *device, unsigned int iaddr, void *buf, size_t len)
+{
+    int ret;
+    size_t size, cnt = 0;
+    unsigned char *buffer = buf;
+    I2CDevice block = *device;
+
+    /* SMBus transfer using #block->addr, chunk not cross block so each chunk has one slave address */
+    block.block_bits = 0;
+
+    while (cnt < len) {
+
+        size = i2c_read_size(device, iaddr, len - cnt);
+        size = size > I2C_SMBUS_BLOCK_MAX ? I2C_SMBUS_BLOCK_MAX : size;
+        block.addr = i2c_block_addr(device, iaddr);
+
+        if ((ret = i2c_smbus_read_i2c_block_data(&block, iaddr, size, buffer + cnt)) == -1) {
+
+            i2c_perror("SMBus read i2c error");
+            return -1;
+        }
+
+        if (ret == 0) {
+
+            break;
+        }
+
+        cnt += ret;
+        iaddr += ret;
+    }
+
+    return cnt;
+}
+
+
+/* SMBus i2c block write, each transfer not cross page boundary */
+static ssize_t i2c_smbus_block_write(const I2CDevice *device, unsigned int iaddr, const void *buf, size_t len)
+{
+    size_t size, cnt = 0;
+    unsigned int retries = 0;
+    const unsigned char *buffer = buf;
+    I2CDevice block = *device;
+
+    /* SMBus transfer using #block->addr, page not cross block so each page has one slave address */
+    block.block_bits = 0;
+
+    while (cnt < len) {
+
+        size = i2c_write_size(device, iaddr, len - cnt, I2C_SMBUS_BLOCK_MAX);
+        block.addr = i2c_block_addr(device, iaddr);
+
+        /* Hold bus for block write and it's write cycle */
+        if (i2c_lock(device->bus) == -1) {
+
+            return GET_WRITE_RESULT(cnt);
+        }
+
+        if (i2c_smbus_write_i2c_block_data(&block, iaddr, size, buffer + cnt) == -1) {
+
+            i2c_unlock(device->bus);
+
+            if (i2c_retry(device, &retries)) {
+
+                continue;
+            }
+
+            i2c_perror("SMBus write i2c error");
+            return GET_WRITE_RESULT(cnt);
+        }
+
+        if (i2c_wait_page(&block, iaddr + size, I2C_METHOD_SMBUS, &retries) == -1) {
+
+            i2c_unlock(device->bus);
+            i2c_perror("SMBus wait i2c write complete error");
+            return GET_WRITE_RESULT(cnt);
+        }
+
+        i2c_unlock(device->bus);
+        retries = 0;
+
+        cnt += size;
+        iaddr += size;
+    }
+
+    return cnt;
+}
+
+
+/*
+**	@brief	:	read #len bytes data from #device #iaddr to #buf, using fastest method bus adapter support
+**	#device	:	I2CDevice struct, SMBus only adapter #device->iaddr_bytes must be 1
+**	#iaddr	:	i2c_device internal address will read data from this address
+**	#buf	:	i2c data will read to here
+**	#len	:	how many data to read
+**	@return : 	success return read data length, failed -1
+*/
+ssize_t i2c_auto_read(const I2CDevice *device, unsigned int iaddr, void *buf, size_t len)
+{
+    ssize_t ret;
+
+    switch (i2c_get_method(device->bus)) {
+
+        case I2C_METHOD_IOCTL:
+            return i2c_ioctl_read(device, iaddr, buf, len);
+
+        case I2C_METHOD_SMBUS:
+            if (device->iaddr_bytes != 1) {
+
+                errno = EOPNOTSUPP;
+                return -1;
+            }
+
+            if (i2c_lock(device->bus) == -1) {
+
+                return -1;
+            }
+
+            ret = i2c_smbus_block_read(device, iaddr, buf, len);
+            i2c_unlock(device->bus);
+            return ret;
+
+        default:
+            return i2c_read(device, iaddr, buf, len);
+    }
+}
+
+
+/*
+**	@brief	:	write #buf data to i2c #device #iaddr address, using fastest method bus adapter support
+**	#device	:	I2CDevice struct, SMBus only adapter #device->iaddr_bytes must be 1
+**	#iaddr	: 	i2c_device internal address
+**	#buf	:	data will write to i2c device
+**	#len	:	buf data length
+**	@return	: 	success return write data length, failed -1, failed after some pages written return written length
+*/
+ssize_t i2c_auto_write(const I2CDevice *device, unsigned int iaddr, const void *buf, size_t len)
+{
+    switch (i2c_get_method(device->bus)) {
+
+        case I2C_METHOD_IOCTL:
+            return i2c_ioctl_write(device, iaddr, buf, len);
+
+        case I2C_METHOD_SMBUS:
+            if (device->iaddr_bytes != 1) {
+
+                errno = EOPNOTSUPP;
+                return -1;
+            }
+
+            return i2c_smbus_block_write(device, iaddr, buf, len);
+
+        default:
+            return i2c_write(device, iaddr, buf, len);
+    }
+}
+
+
 /*
 **	@brief	:	i2c internal address convert
 **	#iaddr	:	i2c device internal address
@@ -335,7 +1068,7 @@ void i2c_iaddr_convert(unsigned int iaddr, unsigned int len, unsigned char *addr
 
 
 /*
-**	@brief		:	Select i2c address @i2c bus
+**	@brief		:	Select i2c address @i2c bus, bus opened by i2c_open skip ioctl if it's already selected
 **	#bus		:	i2c bus fd
 **	#dev_addr	:	i2c device address
 **	#tenbit		:	i2c device address is tenbit
@@ -343,29 +1076,217 @@ void i2c_iaddr_convert(unsigned int iaddr, unsigned int len, unsigned char *addr
 */
 int i2c_select(int bus, unsigned long dev_addr, unsigned long tenbit)
 {
+    struct i2c_bus *i2c_bus = i2c_bus_get(bus);
+    long selected = I2C_BUS_SELECTED(dev_addr, tenbit);
+    long current = I2C_BUS_SELECTED_NONE;
+
+    if (i2c_bus) {
+
+        /* Invalidate until both ioctl success, another device on this bus will select again */
+        current = atomic_exchange_explicit(&i2c_bus->selected, I2C_BUS_SELECTED_NONE, memory_order_relaxed);
+        if (current == selected) {
+
+            atomic_store_explicit(&i2c_bus->selected, selected, memory_order_relaxed);
+            i2c_bus_put(i2c_bus);
+            return 0;
+        }
+    }
+
     /* Set i2c device address bit */
-    if (ioctl(bus, I2C_TENBIT, tenbit)) {
+    if ((current == I2C_BUS_SELECTED_NONE || (current ^ selected) & 0x10000L) && i2c_bus_ioctl(bus, I2C_TENBIT, tenbit)) {
 
-        perror("Set I2C_TENBIT failed");
+        i2c_perror("Set I2C_TENBIT failed");
+        i2c_bus_put(i2c_bus);
         return -1;
     }
 
     /* Set i2c device as slave ans set it address */
-    if (ioctl(bus, I2C_SLAVE, dev_addr)) {
+    if (i2c_bus_ioctl(bus, I2C_SLAVE, dev_addr)) {
 
-        perror("Set i2c device address failed");
+        i2c_perror("Set i2c device address failed");
+        i2c_bus_put(i2c_bus);
         return -1;
     }
 
+    if (i2c_bus) {
+
+        atomic_store_explicit(&i2c_bus->selected, selected, memory_order_relaxed);
+        i2c_bus_put(i2c_bus);
+    }
+
     return 0;
 }
 
+
+/* Same as perror, errno is kept for caller, first perror on stream may change it */
+static void i2c_perror(const char *msg)
+{
+    int err = errno;
+
+    perror(msg);
+    errno = err;
+}
+
+
+/*
+**  Page write failed with errno, transient failure and #device->retries not used up, backoff and account retry.
+**  #retries is retries of current page, reset by caller after page success, errno is kept.
+**  Backoff is doubled each retry and capped at I2C_RETRY_BACKOFF_MAX, so a page waits at most #device->retries * 500ms.
+*/
+static int i2c_retry(const I2CDevice *device, unsigned int *retries)
+{
+    int err = errno;
+    unsigned long long backoff;
+    unsigned int retry_on = GET_RETRY_ON(device->retry_on);
+    unsigned int shift = *retries < I2C_RETRY_BACKOFF_SHIFT_MAX ? *retries : I2C_RETRY_BACKOFF_SHIFT_MAX;
+
+    if (*retries >= device->retries) {
+
+        return 0;
+    }
+
+    if (!((retry_on & I2C_RETRY_NAK && (err == ENXIO || err == EREMOTEIO)) ||
+            (retry_on & I2C_RETRY_TIMEOUT && err == ETIMEDOUT) ||
+            (retry_on & I2C_RETRY_ARB_LOST && err == EAGAIN) ||
+            (retry_on & I2C_RETRY_IO && err == EIO))) {
+
+        return 0;
+    }
+
+    (*retries)++;
+    i2c_bus_account_retry(device->bus, device->addr);
+    backoff = (unsigned long long)GET_RETRY_BACKOFF(device->retry_backoff) << shift;
+    usleep(backoff < I2C_RETRY_BACKOFF_MAX ? (useconds_t)backoff : I2C_RETRY_BACKOFF_MAX);
+    errno = err;
+    return 1;
+}
+
+
 /*
-**	@brief	:	i2c delay
+**  Wait write cycle of page already programmed, caller hold bus lock.
+**  Transient polling failure is retried by polling again, re-send the page would program it twice.
+*/
+static int i2c_wait_page(const I2CDevice *device, unsigned int iaddr, int method, unsigned int *retries)
+{
+    while (i2c_wait_complete(device, iaddr, method) == -1) {
+
+        if (!i2c_retry(device, retries)) {
+
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+**	@brief	:	i2c delay, accounted to device statistics
+**	#device	:	I2CDevice struct
 **	#msec	:	milliscond to be delay
 */
-static void i2c_delay(unsigned char msec)
+static void i2c_delay(const I2CDevice *device, unsigned char msec)
 {
     usleep(msec * 1e3);
+    i2c_bus_account_wait(device->bus, device->addr, 0, msec * 1000ULL);
+}
+
+
+/*
+**	@brief	:	get monotonic time
+**	@return	:	monotonic time, unit microsecond
+*/
+static unsigned long long i2c_monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
 }
 
+
+/*
+**	@brief		:	send an address only transfer, device ACK it means it's ready
+**	#device		:	I2CDevice struct
+**	#iaddr		:	internal address to send, zero length transfer if device without internal address
+**	#method		:	I2C_METHOD_XXX, send transfer using ioctl(I2C_RDWR), file I/O or SMBus send byte
+**	@return		:	device ACK return 0, otherwise return -1
+*/
+static int i2c_ack_probe(const I2CDevice *device, unsigned int iaddr, int method)
+{
+    struct i2c_msg ioctl_msg;
+    struct i2c_rdwr_ioctl_data ioctl_data;
+    unsigned char addr[INT_ADDR_MAX_BYTES];
+
+    i2c_iaddr_convert(iaddr, device->iaddr_bytes, addr);
+    I2C_TRACE_IADDR(iaddr);
+
+    if (method == I2C_METHOD_FILE) {
+
+        return i2c_bus_write(device->bus, addr, device->iaddr_bytes) == (ssize_t)device->iaddr_bytes ? 0 : -1;
+    }
+
+    if (method == I2C_METHOD_SMBUS) {
+
+        return i2c_smbus_write_byte(device, addr[0]);
+    }
+
+    ioctl_msg.len	=	device->iaddr_bytes;
+    ioctl_msg.addr	=	i2c_block_addr(device, iaddr);
+    ioctl_msg.buf	=	addr;
+    ioctl_msg.flags	=	GET_I2C_FLAGS(device->tenbit, device->flags);
+
+    ioctl_data.nmsgs =	1;
+    ioctl_data.msgs	=	&ioctl_msg;
+
+    return i2c_bus_ioctl(device->bus, I2C_RDWR, (unsigned long)&ioctl_data) == -1 ? -1 : 0;
+}
+
+
+/*
+**	@brief		:	wait i2c device internal write cycle complete
+**	#device		:	I2CDevice struct
+**	#iaddr		:	next internal address, ACK polling using it as address only transfer
+**	#method		:	I2C_METHOD_XXX, polling device using same method as write
+**	@return		:	success return 0, failed return -1, polling timeout errno is ETIMEDOUT
+*/
+static int i2c_wait_complete(const I2CDevice *device, unsigned int iaddr, int method)
+{
+    int ret;
+    unsigned int attempts = 0;
+    unsigned long long start, deadline;
+
+    /* FRAM/MRAM write is complete at stop condition */
+    if (device->completion == I2C_COMPLETION_NONE) {
+
+        return 0;
+    }
+
+    if (device->completion != I2C_COMPLETION_ACK_POLL) {
+
+        i2c_delay(device, GET_I2C_DELAY(device->delay));
+        return 0;
+    }
+
+    start = i2c_monotonic_us();
+    deadline = start + GET_POLL_TIMEOUT(device->poll_timeout) * 1000ULL;
+
+    while ((ret = i2c_ack_probe(device, iaddr, method)) == -1) {
+
+        /* Device NAK when it's busy, other error is real failure */
+        if (errno != ENXIO && errno != EREMOTEIO && errno != EIO && errno != EAGAIN) {
+
+            break;
+        }
+
+        if ((device->poll_max && ++attempts >= device->poll_max) || i2c_monotonic_us() >= deadline) {
+
+            errno = ETIMEDOUT;
+            break;
+        }
+
+        usleep(GET_POLL_INTERVAL(device->poll_interval));
+    }
+
+    i2c_bus_account_wait(device->bus, device->addr, 1, i2c_monotonic_us() - start);
+    return ret;
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "i2c/i2c.h"
+#include "i2c_bus.h"
+
+/* Adapters and clients are listed here, adapter named i2c-N */
+#define I2C_SYSFS_DEVICES "/sys/bus/i2c/devices"
+
+
+static int i2c_adapter_compare(const void *a, const void *b)
+{
+    return ((const I2CAdapter *)a)->nr - ((const I2CAdapter *)b)->nr;
+}
+
+
+/* Read adapter name and functionality, adapter can't open still listed with funcs 0 */
+static void i2c_adapter_probe(int sysfs, const char *entry, int nr, I2CAdapter *adapter)
+{
+    int fd;
+    ssize_t len;
+    char path[NAME_MAX + 16];
+    unsigned long funcs = 0;
+
+    memset(adapter, 0, sizeof(*adapter));
+    adapter->nr = nr;
+
+    snprintf(path, sizeof(path), "%s/name", entry);
+    if ((fd = openat(sysfs, path, O_RDONLY | O_CLOEXEC)) != -1) {
+
+        if ((len = read(fd, adapter->name, sizeof(adapter->name) - 1)) > 0) {
+
+            adapter->name[len] = 0;
+            adapter->name[strcspn(adapter->name, "\n")] = 0;
+        }
+
+        close(fd);
+    }
+
+    snprintf(path, sizeof(path), "/dev/i2c-%d", nr);
+    if ((fd = open(path, O_RDWR | O_CLOEXEC)) != -1) {
+
+        if (ioctl(fd, I2C_FUNCS, &funcs) == 0) {
+
+            adapter->funcs = funcs;
+            adapter->max_xfer = i2c_bus_max_xfer(funcs);
+        }
+
+        close(fd);
+    }
+
+    adapter->method = i2c_bus_method(adapter->funcs);
+}
+
+
+/*
+**	@brief		:	Enumerate i2c adapters with one pass of sysfs, query functionality without keep bus open
+**	#sysfs		:	sysfs i2c devices directory, NULL is /sys/bus/i2c/devices
+**	#adapters	:	found adapters save to here, sorted by adapter number
+**	#max		:	max number of #adapters, 0 only count adapters
+**	@return		:	success return number of adapters(may greater than #max), failed return -1
+*/
+int i2c_list_adapters(const char *sysfs, I2CAdapter *adapters, unsigned int max)
+{
+    DIR *dir;
+    int nr, end;
+    unsigned int count = 0;
+    struct dirent *entry;
+
+    if ((dir = opendir(sysfs ? sysfs : I2C_SYSFS_DEVICES)) == NULL) {
+
+        return -1;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+
+        /* Skip clients such as 1-0050 */
+        if (sscanf(entry->d_name, "i2c-%d%n", &nr, &end) != 1 || entry->d_name[end] || nr < 0) {
+
+            continue;
+        }
+
+        if (count < max) {
+
+            i2c_adapter_probe(dirfd(dir), entry->d_name, nr, &adapters[count]);
+        }
+
+        count++;
+    }
+
+    closedir(dir);
+
+    if (count && max) {
+
+        qsort(adapters, count < max ? count : max, sizeof(I2CAdapter), i2c_adapter_compare);
+    }
+
+    return count;
+}
@@ -0,0 +1,267 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+#include "i2c/i2c.h"
+#include "i2c_ring.h"
+
+/* I2C async engine default and max depth */
+#define I2C_ASYNC_DEFAULT_DEPTH 64
+#define I2C_ASYNC_MAX_DEPTH 65536
+
+/*
+**  Submission ring: caller threads push, worker pop.
+**  Completion ring: worker push, caller threads pop.
+**  In-flight requests limited by #depth, so completion ring never full.
+*/
+struct i2c_async {
+    int bus;                        /* Bus fd, return from i2c_open */
+    int sq_fd;                      /* eventfd, wake sleeping worker */
+    int cq_fd;                      /* eventfd, readable when completion is ready */
+    unsigned int depth;             /* Max in-flight requests */
+    pthread_t worker;
+    struct i2c_ring sq;
+    struct i2c_ring cq;
+    _Alignas(64) _Atomic unsigned int inflight;  /* Submitted but not reaped */
+    _Alignas(64) _Atomic int sleeping;           /* Worker wait on #sq_fd */
+    _Atomic int stop;
+};
+
+static void *i2c_async_worker(void *arg);
+
+
+/*
+**	@brief		:	Create i2c async engine, start a worker thread on #bus
+**	#bus		:	i2c bus fd, return from i2c_open, must keep open until engine destroyed
+**	#depth		:	max in-flight requests, 0 using default 64
+**	@return		:	success return engine, failed return NULL
+*/
+I2CAsync *i2c_async_create(int bus, unsigned int depth)
+{
+    int err;
+    I2CAsync *async;
+
+    depth = depth ? depth : I2C_ASYNC_DEFAULT_DEPTH;
+    if (bus < 0 || depth > I2C_ASYNC_MAX_DEPTH) {
+
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if ((async = aligned_alloc(_Alignof(I2CAsync), sizeof(I2CAsync))) == NULL) {
+
+        return NULL;
+    }
+
+    memset(async, 0, sizeof(*async));
+    async->bus = bus;
+    async->depth = depth;
+    async->sq_fd = async->cq_fd = -1;
+
+    if (i2c_ring_init(&async->sq, depth, sizeof(I2CAsyncReq)) == -1) {
+
+        goto out_free;
+    }
+
+    if (i2c_ring_init(&async->cq, depth, sizeof(I2CAsyncReq)) == -1) {
+
+        goto out_sq;
+    }
+
+    if ((async->sq_fd = eventfd(0, EFD_CLOEXEC)) == -1 ||
+            (async->cq_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1) {
+
+        goto out_fd;
+    }
+
+    if ((err = pthread_create(&async->worker, NULL, i2c_async_worker, async))) {
+
+        errno = err;
+        goto out_fd;
+    }
+
+    return async;
+
+out_fd:
+    err = errno;
+    if (async->sq_fd >= 0) close(async->sq_fd);
+    if (async->cq_fd >= 0) close(async->cq_fd);
+    i2c_ring_free(&async->cq);
+    errno = err;
+
+out_sq:
+    i2c_ring_free(&async->sq);
+
+out_free:
+    free(async);
+    return NULL;
+}
+
+
+/*
+**	@brief		:	Destroy i2c async engine, wait all submitted requests done, completions are discarded
+**	#async		:	engine return from i2c_async_create
+*/
+void i2c_async_destroy(I2CAsync *async)
+{
+    if (!async) {
+
+        return;
+    }
+
+    atomic_store(&async->stop, 1);
+    eventfd_write(async->sq_fd, 1);
+    pthread_join(async->worker, NULL);
+
+    close(async->sq_fd);
+    close(async->cq_fd);
+    i2c_ring_free(&async->sq);
+    i2c_ring_free(&async->cq);
+    free(async);
+}
+
+
+/*
+**	@brief		:	Get completion eventfd, it's readable when completion is ready, don't read or close it
+**	#async		:	engine return from i2c_async_create
+**	@return		:	eventfd
+*/
+int i2c_async_fd(const I2CAsync *async)
+{
+    return async->cq_fd;
+}
+
+
+/*
+**	@brief		:	Submit a request, thread safe, never block
+**	#async		:	engine return from i2c_async_create
+**	#req		:	request copy to engine, #req->buf must keep valid until it completed
+**	@return		:	success return 0, failed return -1, too many in-flight requests errno is EAGAIN
+*/
+int i2c_async_submit(I2CAsync *async, const I2CAsyncReq *req)
+{
+    if (req->op != I2C_ASYNC_READ && req->op != I2C_ASYNC_WRITE) {
+
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Reserve a slot of completion ring */
+    if (atomic_fetch_add(&async->inflight, 1) >= async->depth) {
+
+        atomic_fetch_sub(&async->inflight, 1);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    /* Can't fail, in-flight requests <= depth */
+    i2c_ring_push(&async->sq, req);
+
+    /* Pair with worker, only wake it if it's sleeping */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_exchange(&async->sleeping, 0)) {
+
+        eventfd_write(async->sq_fd, 1);
+    }
+
+    return 0;
+}
+
+
+/*
+**	@brief		:	Reap completed requests in submit order, thread safe, never block
+**	#async		:	engine return from i2c_async_create
+**	#reqs		:	completed requests copy to here, with result and error
+**	#max		:	max number of #reqs
+**	@return		:	number of completed requests, 0 if nothing completed
+*/
+int i2c_async_reap(I2CAsync *async, I2CAsyncReq *reqs, unsigned int max)
+{
+    eventfd_t value;
+    int cleared = 0;
+    unsigned int count = 0;
+
+    while (count < max) {
+
+        if (i2c_ring_pop(&async->cq, &reqs[count]) == 0) {
+
+            count++;
+            continue;
+        }
+
+        if (cleared) {
+
+            break;
+        }
+
+        /* Ring is empty, clear eventfd then check again, completion after it will signal eventfd again */
+        eventfd_read(async->cq_fd, &value);
+        cleared = 1;
+    }
+
+    atomic_fetch_sub(&async->inflight, count);
+    return count;
+}
+
+
+static void i2c_async_process(I2CAsync *async, I2CAsyncReq *req)
+{
+    req->device.bus = async->bus;
+
+    errno = 0;
+    if (req->op == I2C_ASYNC_READ) {
+
+        req->result = i2c_ioctl_read(&req->device, req->iaddr, req->buf, req->len);
+    }
+    else {
+
+        req->result = i2c_ioctl_write(&req->device, req->iaddr, req->buf, req->len);
+    }
+
+    req->error = req->result == -1 ? (errno ? errno : EIO) : 0;
+
+    /* Can't fail, reserved at submit */
+    i2c_ring_push(&async->cq, req);
+    eventfd_write(async->cq_fd, 1);
+}
+
+
+static void *i2c_async_worker(void *arg)
+{
+    eventfd_t value;
+    I2CAsyncReq req;
+    I2CAsync *async = arg;
+
+    while (1) {
+
+        while (i2c_ring_pop(&async->sq, &req) == 0) {
+
+            i2c_async_process(async, &req);
+        }
+
+        /* Announce sleeping then check again, submitter after it will wake us */
+        atomic_store(&async->sleeping, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (i2c_ring_pop(&async->sq, &req) == 0) {
+
+            atomic_store(&async->sleeping, 0);
+            i2c_async_process(async, &req);
+            continue;
+        }
+
+        /* All submitted requests done */
+        if (atomic_load(&async->stop)) {
+
+            break;
+        }
+
+        eventfd_read(async->sq_fd, &value);
+        atomic_store(&async->sleeping, 0);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,997 @@
+#include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include "i2c_bus.h"
+#include "i2c_trace.h"
+
+/* Max number of backends can be registered */
+#define I2C_BACKEND_MAX 8
+
+/*
+**  Bus table indexed by fd, reference count and closing flag live in table never freed,
+**  i2c_bus_get can take reference without touching bus may freed by other thread.
+**  i2c_open hold one reference, bus is freed and fd is closed when i2c_close and last user released.
+*/
+struct i2c_bus_slot {
+    struct i2c_bus *_Atomic bus;
+    _Atomic unsigned int refs;
+    _Atomic int closing;
+};
+
+static const I2CBackend *i2c_backends[I2C_BACKEND_MAX] = {&i2c_sim_backend};
+static struct i2c_bus_slot i2c_buses[I2C_BUS_MAX];
+
+
+/*
+**	@brief		:	Register i2c bus backend, bus name start with backend prefix will use it
+**	#backend	:	I2CBackend struct, must keep valid until program exit
+**	@return		:	success return 0, failed return -1
+*/
+int i2c_register_backend(const I2CBackend *backend)
+{
+    unsigned int i;
+
+    if (!backend || !backend->prefix || !backend->open || !backend->close ||
+            !backend->read || !backend->write || !backend->ioctl) {
+
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (i = 0; i < I2C_BACKEND_MAX; i++) {
+
+        if (i2c_backends[i] == NULL) {
+
+            i2c_backends[i] = backend;
+            return 0;
+        }
+    }
+
+    errno = ENOSPC;
+    return -1;
+}
+
+
+const I2CBackend *i2c_bus_find_backend(const char *bus_name)
+{
+    unsigned int i;
+
+    for (i = 0; i < I2C_BACKEND_MAX && i2c_backends[i]; i++) {
+
+        if (strncmp(bus_name, i2c_backends[i]->prefix, strlen(i2c_backends[i]->prefix)) == 0) {
+
+            return i2c_backends[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+**	@brief		:	Track bus opened by i2c_open
+**	#fd			:	bus fd
+**	#backend	:	bus backend, NULL is kernel i2c-dev
+**	#priv		:	backend private data
+**	@return		:	success return 0, failed return -1
+*/
+int i2c_bus_attach(int fd, const I2CBackend *backend, void *priv)
+{
+    int ret;
+    struct i2c_bus *bus;
+    unsigned long funcs = 0;
+    pthread_mutexattr_t attr;
+
+    /* Kernel bus out of table range still can be used, just without bus state */
+    if (fd < 0 || fd >= I2C_BUS_MAX) {
+
+        errno = EMFILE;
+        return backend ? -1 : 0;
+    }
+
+    if ((bus = calloc(1, sizeof(*bus))) == NULL) {
+
+        return -1;
+    }
+
+    bus->fd = fd;
+    bus->priv = priv;
+    bus->backend = backend;
+    atomic_init(&bus->selected, I2C_BUS_SELECTED_NONE);
+    bus->pec = -1;
+
+    /* Adapter functionality never change, query it once choose transfer method */
+    ret = backend ? backend->ioctl(priv, I2C_FUNCS, (unsigned long)&funcs) : ioctl(fd, I2C_FUNCS, &funcs);
+    bus->funcs = ret == -1 ? -1L : (long)funcs;
+    bus->method = ret == -1 ? I2C_METHOD_FILE : i2c_bus_method(funcs);
+
+    /* Recursive, caller may hold it across several i2c_read/write */
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&bus->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_mutex_init(&bus->record_lock, NULL);
+
+    /* Reference of i2c_open, add not store, transient i2c_bus_get of closed fd may still hold count */
+    atomic_fetch_add(&i2c_buses[fd].refs, 1);
+    atomic_store(&i2c_buses[fd].bus, bus);
+    return 0;
+}
+
+
+static void i2c_bus_free(struct i2c_bus *bus)
+{
+    unsigned int i;
+
+    for (i = 0; i < I2C_BUS_STATS_DEVICES; i++) {
+
+        free(atomic_load_explicit(&bus->devices[i], memory_order_relaxed));
+    }
+
+    if (bus->record) {
+
+        fclose(bus->record);
+    }
+
+    pthread_mutex_destroy(&bus->record_lock);
+    pthread_mutex_destroy(&bus->lock);
+    free(bus);
+}
+
+
+/* Last reference of closing bus released, untrack and free it, close fd at last so it can't be reused before */
+static void i2c_bus_finalize(int fd)
+{
+    struct i2c_bus *bus = atomic_exchange(&i2c_buses[fd].bus, NULL);
+
+    /* Other thread already finalized */
+    if (!bus) {
+
+        return;
+    }
+
+    if (bus->backend) {
+
+        bus->backend->close(bus->priv);
+    }
+
+    i2c_bus_free(bus);
+    atomic_store(&i2c_buses[fd].closing, 0);
+    close(fd);
+}
+
+
+/* Get bus opened by i2c_open and take a reference, return NULL if not opened or released by i2c_close */
+struct i2c_bus *i2c_bus_get(int fd)
+{
+    struct i2c_bus *bus;
+
+    if (fd < 0 || fd >= I2C_BUS_MAX) {
+
+        return NULL;
+    }
+
+    /* No reference left, bus is freeing */
+    if (atomic_fetch_add(&i2c_buses[fd].refs, 1) == 0) {
+
+        if (atomic_fetch_sub(&i2c_buses[fd].refs, 1) == 1 && atomic_load(&i2c_buses[fd].closing)) {
+
+            i2c_bus_finalize(fd);
+        }
+
+        return NULL;
+    }
+
+    if ((bus = atomic_load(&i2c_buses[fd].bus)) == NULL) {
+
+        atomic_fetch_sub(&i2c_buses[fd].refs, 1);
+    }
+
+    return bus;
+}
+
+
+/* Release reference taken by i2c_bus_get */
+void i2c_bus_put(struct i2c_bus *bus)
+{
+    int fd;
+
+    if (!bus) {
+
+        return;
+    }
+
+    fd = bus->fd;
+
+    if (atomic_fetch_sub(&i2c_buses[fd].refs, 1) == 1 && atomic_load(&i2c_buses[fd].closing)) {
+
+        i2c_bus_finalize(fd);
+    }
+}
+
+
+/* Bus is closed by i2c_close but still referenced */
+static int i2c_bus_closing(int fd)
+{
+    return fd >= 0 && fd < I2C_BUS_MAX && atomic_load(&i2c_buses[fd].closing);
+}
+
+
+/* Bus of reference caller already held, #fd must be opened by i2c_open */
+static struct i2c_bus *i2c_bus_held(int fd)
+{
+    return fd >= 0 && fd < I2C_BUS_MAX ? atomic_load(&i2c_buses[fd].bus) : NULL;
+}
+
+
+/*
+**	@brief		:	Release reference of i2c_open, bus freed and fd closed after last reference released
+**	#fd			:	bus fd
+**	@return		:	success return 0, bus not opened by i2c_open return -1
+*/
+int i2c_bus_close(int fd)
+{
+    struct i2c_bus *bus = i2c_bus_get(fd);
+
+    if (!bus) {
+
+        return i2c_bus_closing(fd) ? 0 : -1;
+    }
+
+    /* Closed twice, reference of i2c_open already released */
+    if (atomic_exchange(&i2c_buses[fd].closing, 1)) {
+
+        i2c_bus_put(bus);
+        return 0;
+    }
+
+    i2c_bus_put(bus);
+    i2c_bus_put(bus);
+    return 0;
+}
+
+
+/*
+**	@brief		:	Hold i2c bus, i2c_close is deferred until it released by i2c_unref
+**	#bus		:	i2c bus fd
+**	@return		:	success return 0, bus closed return -1 errno is EBADF, bus not opened by i2c_open not hold return 0
+*/
+int i2c_ref(int bus)
+{
+    struct i2c_bus *i2c_bus = i2c_bus_get(bus);
+
+    if (!i2c_bus) {
+
+        if (i2c_bus_closing(bus)) {
+
+            errno = EBADF;
+            return -1;
+        }
+
+        return 0;
+    }
+
+    /* Closed but still in use, reject new user */
+    if (i2c_bus_closing(bus)) {
+
+        i2c_bus_put(i2c_bus);
+        errno = EBADF;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+**	@brief		:	Release i2c bus hold by i2c_ref, bus closed by i2c_close is freed at last release
+**	#bus		:	i2c bus fd
+*/
+void i2c_unref(int bus)
+{
+    int err = errno;
+
+    i2c_bus_put(i2c_bus_held(bus));
+    errno = err;
+}
+
+
+/*
+**	@brief		:	Set i2c bus lock flags, take effect at next outermost i2c_lock
+**	#bus		:	i2c bus fd
+**	#flags		:	I2C_LOCK_XXX, I2C_LOCK_FLOCK is ignored by backend bus, it's not shared with other processes
+**	@return		:	success return 0, failed return -1
+*/
+int i2c_set_lock(int bus, unsigned int flags)
+{
+    struct i2c_bus *i2c_bus = i2c_bus_get(bus);
+
+    if (!i2c_bus) {
+
+        errno = EBADF;
+        return -1;
+    }
+
+    pthread_mutex_lock(&i2c_bus->lock);
+    i2c_bus->lock_flags = flags;
+    pthread_mutex_unlock(&i2c_bus->lock);
+    i2c_bus_put(i2c_bus);
+    return 0;
+}
+
+
+/* Address of it identify calling thread as lock owner */
+static _Thread_local char i2c_lock_self;
+
+
+/*
+**	@brief		:	Lock i2c bus, recursive, bus not opened by i2c_open is not locked, lock hold bus until unlock
+**	#bus		:	i2c bus fd
+**	@return		:	success return 0, failed return -1, bus closed by i2c_close errno is EBADF
+*/
+int i2c_lock(int bus)
+{
+    struct i2c_bus *i2c_bus = i2c_bus_get(bus);
+
+    if (!i2c_bus) {
+
+        if (i2c_bus_closing(bus)) {
+
+            errno = EBADF;
+            return -1;
+        }
+
+        return 0;
+    }
+
+    pthread_mutex_lock(&i2c_bus->lock);
+
+    /* Closed, only thread already hold lock can go on, bus is released at it's last unlock */
+    if (i2c_bus->lock_depth == 0 && i2c_bus_closing(bus)) {
+
+        pthread_mutex_unlock(&i2c_bus->lock);
+        i2c_bus_put(i2c_bus);
+        errno = EBADF;
+        return -1;
+    }
+
+    /* Outermost lock, arbitrate with other processes */
+    if (i2c_bus->lock_depth == 0 && (i2c_bus->lock_flags & I2C_LOCK_FLOCK) && !i2c_bus->backend) {
+
+        while (flock(bus, LOCK_EX) == -1) {
+
+            if (errno != EINTR) {
+
+                pthread_mutex_unlock(&i2c_bus->lock);
+                i2c_bus_put(i2c_bus);
+                return -1;
+            }
+        }
+
+        i2c_bus->flocked = 1;
+    }
+
+    i2c_bus->lock_depth++;
+    atomic_store(&i2c_bus->lock_owner, &i2c_lock_self);
+    return 0;
+}
+
+
+/*
+**	@brief		:	Unlock i2c bus, errno is preserved if success
+**	#bus		:	i2c bus fd
+**	@return		:	success return 0, failed return -1, calling thread not hold lock errno is EPERM
+*/
+int i2c_unlock(int bus)
+{
+    int err = errno;
+    struct i2c_bus *i2c_bus = i2c_bus_held(bus);
+
+    if (!i2c_bus) {
+
+        return 0;
+    }
+
+    /* Stray unlock or unlock lock of other thread, lock depth and reference are not touched */
+    if (atomic_load(&i2c_bus->lock_owner) != &i2c_lock_self) {
+
+        errno = EPERM;
+        return -1;
+    }
+
+    if (--i2c_bus->lock_depth == 0) {
+
+        atomic_store(&i2c_bus->lock_owner, NULL);
+        if (i2c_bus->flocked) {
+
+            flock(bus, LOCK_UN);
+            i2c_bus->flocked = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&i2c_bus->lock);
+
+    /* Reference of i2c_lock, bus closed while locked is freed here */
+    i2c_bus_put(i2c_bus);
+    errno = err;
+    return 0;
+}
+
+
+int i2c_bus_funcs(int fd, unsigned long *funcs)
+{
+    long cached = -1;
+    struct i2c_bus *bus = i2c_bus_get(fd);
+
+    if (bus) {
+
+        cached = bus->funcs;
+        i2c_bus_put(bus);
+    }
+
+    if (cached != -1) {
+
+        *funcs = cached;
+        return 0;
+    }
+
+    return i2c_bus_ioctl(fd, I2C_FUNCS, (unsigned long)funcs);
+}
+
+
+int i2c_bus_method(unsigned long funcs)
+{
+    if (funcs & I2C_FUNC_I2C) {
+
+        return I2C_METHOD_IOCTL;
+    }
+
+    if ((funcs & I2C_FUNC_SMBUS_I2C_BLOCK) == I2C_FUNC_SMBUS_I2C_BLOCK) {
+
+        return I2C_METHOD_SMBUS;
+    }
+
+    return I2C_METHOD_FILE;
+}
+
+
+unsigned int i2c_bus_max_xfer(unsigned long funcs)
+{
+    switch (i2c_bus_method(funcs)) {
+
+        case I2C_METHOD_IOCTL:
+            return I2C_MSG_MAX_BYTES;
+
+        case I2C_METHOD_SMBUS:
+            return I2C_SMBUS_BLOCK_MAX;
+
+        default:
+            return 0;
+    }
+}
+
+
+/*
+**	@brief		:	Get adapter functionality, bus opened by i2c_open return value cached at open
+**	#bus		:	i2c bus fd
+**	#funcs		:	I2C_FUNC_XXX bits
+**	@return		:	success return 0, failed return -1
+*/
+int i2c_get_funcs(int bus, unsigned long *funcs)
+{
+    return i2c_bus_funcs(bus, funcs);
+}
+
+
+/*
+**	@brief		:	Get fastest transfer method of bus, used by i2c_auto_read/write
+**	#bus		:	i2c bus fd
+**	@return		:	I2C_METHOD_XXX, adapter functionality unknown return I2C_METHOD_FILE
+*/
+int i2c_get_method(int bus)
+{
+    int method;
+    unsigned long funcs;
+    struct i2c_bus *i2c_bus = i2c_bus_get(bus);
+
+    if (i2c_bus) {
+
+        method = i2c_bus->method;
+        i2c_bus_put(i2c_bus);
+        return method;
+    }
+
+    return i2c_bus_funcs(bus, &funcs) == -1 ? I2C_METHOD_FILE : i2c_bus_method(funcs);
+}
+
+
+static unsigned long long i2c_bus_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/* Get device statistics, allocate at first use if #create, lost allocate race free own one */
+static struct i2c_bus_stats *i2c_bus_device_stats(struct i2c_bus *bus, unsigned int addr, int create)
+{
+    struct i2c_bus_stats *expected = NULL, *stats;
+    struct i2c_bus_stats *_Atomic *slot = &bus->devices[addr % I2C_BUS_STATS_DEVICES];
+
+    if ((stats = atomic_load_explicit(slot, memory_order_acquire)) != NULL || !create) {
+
+        return stats;
+    }
+
+    if ((stats = calloc(1, sizeof(*stats))) == NULL) {
+
+        return NULL;
+    }
+
+    if (!atomic_compare_exchange_strong_explicit(slot, &expected, stats, memory_order_acq_rel, memory_order_acquire)) {
+
+        free(stats);
+        return expected;
+    }
+
+    return stats;
+}
+
+
+static unsigned int i2c_bus_latency_bucket(unsigned long long us)
+{
+    unsigned int bucket = 0;
+
+    while (us >>= 1) {
+
+        bucket++;
+    }
+
+    return bucket < I2C_STATS_BUCKETS ? bucket : I2C_STATS_BUCKETS - 1;
+}
+
+
+static void i2c_bus_stats_add(struct i2c_bus_stats *stats, int op, size_t in, size_t out, int error, unsigned long long us)
+{
+    _Atomic unsigned long long *counter = &stats->errors;
+
+    atomic_fetch_add_explicit(&stats->xfers, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->latency[op][i2c_bus_latency_bucket(us)], 1, memory_order_relaxed);
+
+    if (!error) {
+
+        atomic_fetch_add_explicit(&stats->bytes_in, in, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stats->bytes_out, out, memory_order_relaxed);
+        return;
+    }
+
+    switch (error) {
+
+        case ENXIO:
+        case EREMOTEIO:
+            counter = &stats->naks;
+            break;
+
+        case ETIMEDOUT:
+            counter = &stats->timeouts;
+            break;
+
+        case EAGAIN:
+            counter = &stats->arb_lost;
+            break;
+    }
+
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+
+/* Start transfer, #trace describe it, start time shared by statistics and trace */
+static void i2c_bus_begin(I2CTrace *trace, int type)
+{
+    trace->type = type;
+    trace->iaddr = I2C_TRACE_NO_IADDR;
+    trace->start_ns = i2c_bus_now_ns();
+}
+
+
+/*
+**  Transfer completed, account to bus and device #trace->addr, record #trace if trace is on.
+**  #ret is transfer return value, errno is preserved, #trace is completed for bus record.
+*/
+static void i2c_bus_end(struct i2c_bus *bus, I2CTrace *trace, int op, size_t in, size_t out, long ret)
+{
+    int error = ret == -1 ? errno : 0;
+    unsigned long long end = i2c_bus_now_ns();
+    unsigned long long us = (end - trace->start_ns) / 1000;
+    struct i2c_bus_stats *device = i2c_bus_device_stats(bus, trace->addr & 0x3ff, 1);
+
+    i2c_bus_stats_add(&bus->stats, op, in, out, error, us);
+
+    if (device) {
+
+        i2c_bus_stats_add(device, op, in, out, error, us);
+    }
+
+    trace->end_ns = end;
+    trace->bus = bus->fd;
+    trace->result = error ? -error : (int)ret;
+    trace->len = in + out;
+
+    if (atomic_load_explicit(&i2c_trace_on, memory_order_relaxed)) {
+
+        i2c_trace_record(trace);
+    }
+
+    errno = error ? error : errno;
+}
+
+
+/* Address selected by i2c_select, file I/O and I2C_SMBUS transfer with it */
+static unsigned int i2c_bus_selected(struct i2c_bus *bus)
+{
+    return atomic_load_explicit(&bus->selected, memory_order_relaxed) & 0x3ff;
+}
+
+
+/* SMBus transfer data bytes, command byte count as output */
+static void i2c_bus_smbus_bytes(const struct i2c_smbus_ioctl_data *smbus, size_t *in, size_t *out)
+{
+    size_t len = 0;
+
+    switch (smbus->size) {
+
+        case I2C_SMBUS_QUICK:
+            *in = *out = 0;
+            return;
+
+        case I2C_SMBUS_BYTE:
+            *in = smbus->read_write == I2C_SMBUS_READ;
+            *out = smbus->read_write == I2C_SMBUS_WRITE;
+            return;
+
+        case I2C_SMBUS_PROC_CALL:
+            *in = 2;
+            *out = 3;
+            return;
+
+        case I2C_SMBUS_BYTE_DATA:
+            len = 1;
+            break;
+
+        case I2C_SMBUS_WORD_DATA:
+            len = 2;
+            break;
+
+        case I2C_SMBUS_BLOCK_DATA:
+            len = smbus->data ? smbus->data->block[0] + 1 : 0;
+            break;
+
+        default:
+            len = smbus->data ? smbus->data->block[0] : 0;
+            break;
+    }
+
+    *in = smbus->read_write == I2C_SMBUS_READ ? len : 0;
+    *out = smbus->read_write == I2C_SMBUS_WRITE ? len + 1 : 1;
+}
+
+
+ssize_t i2c_bus_read(int fd, void *buf, size_t len)
+{
+    ssize_t ret;
+    I2CTrace trace;
+    struct i2c_bus *bus = i2c_bus_get(fd);
+
+    if (!bus) {
+
+        return read(fd, buf, len);
+    }
+
+    i2c_bus_begin(&trace, I2C_TRACE_READ);
+    ret = bus->backend ? bus->backend->read(bus->priv, buf, len) : read(fd, buf, len);
+
+    trace.addr = i2c_bus_selected(bus);
+    trace.flags = I2C_M_RD;
+    trace.nmsgs = 1;
+    i2c_bus_end(bus, &trace, I2C_STATS_READ, ret > 0 ? ret : 0, 0, ret);
+
+    if (atomic_load_explicit(&bus->recording, memory_order_relaxed)) {
+
+        i2c_bus_record(bus, &trace, 0, buf, len);
+    }
+
+    i2c_bus_put(bus);
+    return ret;
+}
+
+
+ssize_t i2c_bus_write(int fd, const void *buf, size_t len)
+{
+    ssize_t ret;
+    I2CTrace trace;
+    struct i2c_bus *bus = i2c_bus_get(fd);
+
+    if (!bus) {
+
+        return write(fd, buf, len);
+    }
+
+    i2c_bus_begin(&trace, I2C_TRACE_WRITE);
+    ret = bus->backend ? bus->backend->write(bus->priv, buf, len) : write(fd, buf, len);
+
+    trace.addr = i2c_bus_selected(bus);
+    trace.flags = 0;
+    trace.nmsgs = 1;
+    i2c_bus_end(bus, &trace, I2C_STATS_WRITE, 0, ret > 0 ? ret : 0, ret);
+
+    if (atomic_load_explicit(&bus->recording, memory_order_relaxed)) {
+
+        i2c_bus_record(bus, &trace, 0, buf, len);
+    }
+
+    i2c_bus_put(bus);
+    return ret;
+}
+
+
+int i2c_bus_ioctl(int fd, unsigned long request, unsigned long arg)
+{
+    int ret, op;
+    unsigned int i;
+    I2CTrace trace;
+    size_t in = 0, out = 0;
+    struct i2c_rdwr_ioctl_data *rdwr = (struct i2c_rdwr_ioctl_data *)arg;
+    struct i2c_smbus_ioctl_data *smbus = (struct i2c_smbus_ioctl_data *)arg;
+    struct i2c_bus *bus = i2c_bus_get(fd);
+
+    if (!bus) {
+
+        return ioctl(fd, request, arg);
+    }
+
+    atomic_fetch_add_explicit(&bus->stats.ioctls, 1, memory_order_relaxed);
+    i2c_bus_begin(&trace, request == I2C_SMBUS ? I2C_TRACE_SMBUS : I2C_TRACE_RDWR);
+    ret = bus->backend ? bus->backend->ioctl(bus->priv, request, arg) : ioctl(fd, request, arg);
+
+    if (request == I2C_SMBUS) {
+
+        i2c_bus_smbus_bytes(smbus, &in, &out);
+        trace.addr = i2c_bus_selected(bus);
+        trace.flags = smbus->read_write == I2C_SMBUS_READ ? I2C_M_RD : 0;
+        trace.nmsgs = smbus->size == I2C_SMBUS_QUICK || smbus->size == I2C_SMBUS_BYTE ? 1 : 2;
+        trace.iaddr = smbus->size == I2C_SMBUS_QUICK || smbus->size == I2C_SMBUS_BYTE ? I2C_TRACE_NO_IADDR : smbus->command;
+        i2c_bus_end(bus, &trace, I2C_STATS_SMBUS, in, out, ret);
+
+        if (atomic_load_explicit(&bus->recording, memory_order_relaxed)) {
+
+            i2c_bus_record(bus, &trace, arg, NULL, 0);
+        }
+    }
+    else if (request == I2C_RDWR && rdwr->nmsgs) {
+
+        trace.flags = rdwr->msgs[0].flags;
+
+        for (i = 0, op = I2C_STATS_WRITE; i < rdwr->nmsgs; i++) {
+
+            if (rdwr->msgs[i].flags & I2C_M_RD) {
+
+                op = I2C_STATS_READ;
+                trace.flags |= I2C_M_RD;
+                in += rdwr->msgs[i].len;
+            }
+            else {
+
+                out += rdwr->msgs[i].len;
+            }
+        }
+
+        trace.addr = rdwr->msgs[0].addr;
+        trace.nmsgs = rdwr->nmsgs;
+        i2c_bus_end(bus, &trace, op, in, out, ret);
+
+        if (atomic_load_explicit(&bus->recording, memory_order_relaxed)) {
+
+            i2c_bus_record(bus, &trace, arg, NULL, 0);
+        }
+    }
+
+    i2c_bus_put(bus);
+    return ret;
+}
+
+
+void i2c_bus_account_wait(int fd, unsigned short addr, int poll, unsigned long long us)
+{
+    int err = errno;
+    struct i2c_bus_stats *device;
+    struct i2c_bus *bus = i2c_bus_get(fd);
+
+    if (!bus) {
+
+        return;
+    }
+
+    atomic_fetch_add_explicit(poll ? &bus->stats.poll_us : &bus->stats.delay_us, us, memory_order_relaxed);
+
+    if ((device = i2c_bus_device_stats(bus, addr & 0x3ff, 1)) != NULL) {
+
+        atomic_fetch_add_explicit(poll ? &device->poll_us : &device->delay_us, us, memory_order_relaxed);
+    }
+
+    i2c_bus_put(bus);
+    errno = err;
+}
+
+
+void i2c_bus_account_retry(int fd, unsigned short addr)
+{
+    int err = errno;
+    struct i2c_bus_stats *device;
+    struct i2c_bus *bus = i2c_bus_get(fd);
+
+    if (!bus) {
+
+        return;
+    }
+
+    atomic_fetch_add_explicit(&bus->stats.retries, 1, memory_order_relaxed);
+
+    if ((device = i2c_bus_device_stats(bus, addr & 0x3ff, 1)) != NULL) {
+
+        atomic_fetch_add_explicit(&device->retries, 1, memory_order_relaxed);
+    }
+
+    i2c_bus_put(bus);
+    errno = err;
+}
+
+
+/* Accumulate #counters into #stats, caller clear #stats first */
+static void i2c_bus_stats_snapshot(struct i2c_bus_stats *counters, I2CStats *stats)
+{
+    unsigned int op, bucket;
+
+    if (!counters) {
+
+        return;
+    }
+
+    stats->xfers += atomic_load_explicit(&counters->xfers, memory_order_relaxed);
+    stats->bytes_in += atomic_load_explicit(&counters->bytes_in, memory_order_relaxed);
+    stats->bytes_out += atomic_load_explicit(&counters->bytes_out, memory_order_relaxed);
+    stats->ioctls += atomic_load_explicit(&counters->ioctls, memory_order_relaxed);
+    stats->naks += atomic_load_explicit(&counters->naks, memory_order_relaxed);
+    stats->timeouts += atomic_load_explicit(&counters->timeouts, memory_order_relaxed);
+    stats->arb_lost += atomic_load_explicit(&counters->arb_lost, memory_order_relaxed);
+    stats->errors += atomic_load_explicit(&counters->errors, memory_order_relaxed);
+    stats->retries += atomic_load_explicit(&counters->retries, memory_order_relaxed);
+    stats->delay_us += atomic_load_explicit(&counters->delay_us, memory_order_relaxed);
+    stats->poll_us += atomic_load_explicit(&counters->poll_us, memory_order_relaxed);
+
+    for (op = 0; op < I2C_STATS_OPS; op++) {
+
+        for (bucket = 0; bucket < I2C_STATS_BUCKETS; bucket++) {
+
+            stats->latency[op][bucket] += atomic_load_explicit(&counters->latency[op][bucket], memory_order_relaxed);
+        }
+    }
+}
+
+
+static void i2c_bus_stats_reset(struct i2c_bus_stats *counters)
+{
+    unsigned int op, bucket;
+    _Atomic unsigned long long *scalars[] = {
+        &counters->xfers, &counters->bytes_in, &counters->bytes_out, &counters->ioctls, &counters->naks,
+        &counters->timeouts, &counters->arb_lost, &counters->errors, &counters->retries, &counters->delay_us,
+        &counters->poll_us,
+    };
+
+    for (op = 0; op < sizeof(scalars) / sizeof(scalars[0]); op++) {
+
+        atomic_store_explicit(scalars[op], 0, memory_order_relaxed);
+    }
+
+    for (op = 0; op < I2C_STATS_OPS; op++) {
+
+        for (bucket = 0; bucket < I2C_STATS_BUCKETS; bucket++) {
+
+            atomic_store_explicit(&counters->latency[op][bucket], 0, memory_order_relaxed);
+        }
+    }
+}
+
+
+/*
+**	@brief		:	Get statistics snapshot of bus, counters are not read atomically as a whole
+**	#bus		:	i2c bus fd, must opened by i2c_open
+**	#stats		:	snapshot save to here
+**	@return		:	success return 0, failed return -1
+*/
+int i2c_get_stats(int bus, I2CStats *stats)
+{
+    struct i2c_bus *i2c_bus = i2c_bus_get(bus);
+
+    if (!i2c_bus) {
+
+        errno = EBADF;
+        return -1;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    i2c_bus_stats_snapshot(&i2c_bus->stats, stats);
+    i2c_bus_put(i2c_bus);
+    return 0;
+}
+
+
+/*
+**	@brief		:	Get statistics snapshot of device, all zero if nothing transfer with it
+**	#device		:	I2CDevice struct, device bus must opened by i2c_open,
+**					block select device sum all slave address it occupied(#device->addr + block)
+**	#stats		:	snapshot save to here
+**	@return		:	success return 0, failed return -1
+*/
+int i2c_get_device_stats(const I2CDevice *device, I2CStats *stats)
+{
+    unsigned int block, blocks = 1;
+    struct i2c_bus *i2c_bus = i2c_bus_get(device->bus);
+
+    if (!i2c_bus) {
+
+        errno = EBADF;
+        return -1;
+    }
+
+    /* Same as block address of transfers, slave address bits limit it */
+    if (device->block_bits && device->iaddr_bytes && device->iaddr_bytes < 4) {
+
+        blocks = 1U << (device->block_bits < 10 ? device->block_bits : 10);
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    for (block = 0; block < blocks; block++) {
+
+        i2c_bus_stats_snapshot(i2c_bus_device_stats(i2c_bus, (device->addr + block) & 0x3ff, 0), stats);
+    }
+
+    i2c_bus_put(i2c_bus);
+    return 0;
+}
+
+
+/*
+**	@brief		:	Reset statistics of bus and all devices on it
+**	#bus		:	i2c bus fd, must opened by i2c_open
+**	@return		:	success return 0, failed return -1
+*/
+int i2c_reset_stats(int bus)
+{
+    unsigned int i;
+    struct i2c_bus_stats *device;
+    struct i2c_bus *i2c_bus = i2c_bus_get(bus);
+
+    if (!i2c_bus) {
+
+        errno = EBADF;
+        return -1;
+    }
+
+    i2c_bus_stats_reset(&i2c_bus->stats);
+
+    for (i = 0; i < I2C_BUS_STATS_DEVICES; i++) {
+
+        if ((device = i2c_bus_device_stats(i2c_bus, i, 0)) != NULL) {
+
+            i2c_bus_stats_reset(device);
+        }
+    }
+
+    i2c_bus_put(i2c_bus);
+    return 0;
+}
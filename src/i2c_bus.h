@@ -0,0 +1,95 @@
+#ifndef _LIB_I2C_BUS_H_
+#define _LIB_I2C_BUS_H_
+
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "i2c/i2c.h"
+
+/* Max bus fd can be tracked by libi2c */
+#define I2C_BUS_MAX 1024
+
+/* Kernel i2c-dev max bytes per i2c_msg */
+#define I2C_MSG_MAX_BYTES 8192
+
+/* Bus selected slave cache, address bit 0 - 15, tenbit bit 16, -1 nothing selected */
+#define I2C_BUS_SELECTED(addr, tenbit) ((long)((addr) & 0xffff) | ((tenbit) ? 0x10000L : 0))
+#define I2C_BUS_SELECTED_NONE -1L
+
+/* Device statistics slots, indexed by 10 bit address, 7 bit device share slot with same tenbit address */
+#define I2C_BUS_STATS_DEVICES 1024
+
+/* Lock-free statistics counters, same fields as I2CStats */
+struct i2c_bus_stats {
+    _Atomic unsigned long long xfers;
+    _Atomic unsigned long long bytes_in;
+    _Atomic unsigned long long bytes_out;
+    _Atomic unsigned long long ioctls;
+    _Atomic unsigned long long naks;
+    _Atomic unsigned long long timeouts;
+    _Atomic unsigned long long arb_lost;
+    _Atomic unsigned long long errors;
+    _Atomic unsigned long long retries;
+    _Atomic unsigned long long delay_us;
+    _Atomic unsigned long long poll_us;
+    _Atomic unsigned long long latency[I2C_STATS_OPS][I2C_STATS_BUCKETS];
+};
+
+/* I2C bus opened by i2c_open, indexed by bus fd */
+struct i2c_bus {
+    int fd;                         /* Bus fd, kernel i2c-dev fd or backend placeholder fd */
+    void *priv;                     /* Backend private data */
+    const I2CBackend *backend;      /* NULL is kernel i2c-dev */
+    _Atomic long selected;          /* Slave address and tenbit set by i2c_select */
+    pthread_mutex_t lock;           /* Recursive, serialize transfers of devices on this bus */
+    unsigned int lock_depth;        /* Lock recursion depth, protected by #lock */
+    const void *_Atomic lock_owner; /* Thread hold #lock, NULL if not locked, set by owner */
+    unsigned int lock_flags;        /* I2C_LOCK_XXX, protected by #lock */
+    int flocked;                    /* flock(LOCK_EX) is held, protected by #lock */
+    long funcs;                     /* Adapter I2C_FUNCS queried at open, -1 unknown */
+    int method;                     /* Fastest transfer method, I2C_METHOD_XXX */
+    int pec;                        /* I2C_PEC set on bus fd, -1 unknown, protected by #lock */
+    struct i2c_bus_stats stats;     /* Bus statistics */
+    _Atomic int recording;          /* #record is open, checked before take #record_lock */
+    pthread_mutex_t record_lock;    /* Serialize records of transfer threads */
+    FILE *record;                   /* Record file, NULL if not recording, protected by #record_lock */
+    unsigned long long record_base; /* Record start time, ns */
+    struct i2c_bus_stats *_Atomic devices[I2C_BUS_STATS_DEVICES];  /* Device statistics, allocated at first transfer */
+};
+
+/* Built-in simulated bus backend */
+extern const I2CBackend i2c_sim_backend;
+
+/* Find backend by bus name prefix, kernel i2c-dev return NULL */
+const I2CBackend *i2c_bus_find_backend(const char *bus_name);
+
+/* Track bus opened by i2c_open, release reference of i2c_open, bus freed and fd closed after last reference released */
+int i2c_bus_attach(int fd, const I2CBackend *backend, void *priv);
+int i2c_bus_close(int fd);
+
+/* Get bus opened by i2c_open and take a reference, otherwise return NULL, must release it by i2c_bus_put */
+struct i2c_bus *i2c_bus_get(int fd);
+void i2c_bus_put(struct i2c_bus *bus);
+
+/* Get adapter functionality, cached if bus opened by i2c_open */
+int i2c_bus_funcs(int fd, unsigned long *funcs);
+
+/* Fastest transfer method and max bytes per transfer of adapter functionality */
+int i2c_bus_method(unsigned long funcs);
+unsigned int i2c_bus_max_xfer(unsigned long funcs);
+
+/* Account time device waiting, fixed delay or ACK polling(#poll) */
+void i2c_bus_account_wait(int fd, unsigned short addr, int poll, unsigned long long us);
+
+/* Account page write retried after transient failure */
+void i2c_bus_account_retry(int fd, unsigned short addr);
+
+/* Append transfer completed by i2c_bus_end to bus record file, #arg is ioctl arg, #buf and #len is file I/O data */
+void i2c_bus_record(struct i2c_bus *bus, const I2CTrace *trace, unsigned long arg, const void *buf, size_t len);
+
+/* Bus I/O, dispatch to backend or kernel i2c-dev, transfers are accounted to bus and device statistics */
+ssize_t i2c_bus_read(int fd, void *buf, size_t len);
+ssize_t i2c_bus_write(int fd, const void *buf, size_t len);
+int i2c_bus_ioctl(int fd, unsigned long request, unsigned long arg);
+
+#endif
@@ -0,0 +1,343 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "i2c/i2c.h"
+
+/* Cached page state */
+struct i2c_cache_page {
+    unsigned char valid;            /* Page data is loaded from device */
+    unsigned char dirty;            /* Page data [lo, hi) is modified, not write back yet */
+    unsigned int lo, hi;
+};
+
+/*
+**  Write-back cache of device memory [0, size), page aligned to #device.page_bytes.
+**  Pages are loaded on first access, written back by i2c_cache_flush only dirty part of each page.
+*/
+struct i2c_cache {
+    I2CDevice device;               /* Device copy, bus must keep open until cache destroyed */
+    size_t size;                    /* Device memory bytes */
+    unsigned int npages;
+    unsigned char *data;
+    struct i2c_cache_page *pages;
+    pthread_mutex_t lock;
+};
+
+
+/*
+**	@brief		:	Create write-back page cache on top of #device
+**	#device		:	I2CDevice struct, copy to cache, #device->page_bytes is cache page size
+**	#size		:	device memory bytes, cache cover internal address [0, size)
+**	@return		:	success return cache, failed return NULL
+*/
+I2CCache *i2c_cache_create(const I2CDevice *device, size_t size)
+{
+    I2CCache *cache;
+
+    if (!device || !device->page_bytes || !size) {
+
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if ((cache = calloc(1, sizeof(*cache))) == NULL) {
+
+        return NULL;
+    }
+
+    cache->device = *device;
+    cache->size = size;
+    cache->npages = (size + device->page_bytes - 1) / device->page_bytes;
+
+    if ((cache->data = malloc(size)) == NULL || (cache->pages = calloc(cache->npages, sizeof(*cache->pages))) == NULL) {
+
+        free(cache->data);
+        free(cache);
+        return NULL;
+    }
+
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+
+/*
+**	@brief		:	Write back dirty pages and destroy cache, call i2c_cache_flush first if need check error
+**	#cache		:	cache return from i2c_cache_create
+*/
+void i2c_cache_destroy(I2CCache *cache)
+{
+    if (!cache) {
+
+        return;
+    }
+
+    i2c_cache_flush(cache);
+
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->pages);
+    free(cache->data);
+    free(cache);
+}
+
+
+/* Page range [first, last] bytes, last page may be partial */
+static size_t i2c_cache_span(const I2CCache *cache, unsigned int first, unsigned int last)
+{
+    size_t end = (size_t)(last + 1) * cache->device.page_bytes;
+
+    return (end > cache->size ? cache->size : end) - (size_t)first * cache->device.page_bytes;
+}
+
+
+/* Load invalid pages of [first, last], continuous invalid pages load with one read, cache must be locked */
+static int i2c_cache_load(I2CCache *cache, unsigned int first, unsigned int last)
+{
+    size_t len;
+    unsigned int i, page, end;
+    unsigned int page_bytes = cache->device.page_bytes;
+
+    for (page = first; page <= last; page = end + 1) {
+
+        if (cache->pages[page].valid) {
+
+            end = page;
+            continue;
+        }
+
+        for (end = page; end < last && !cache->pages[end + 1].valid; end++);
+
+        len = i2c_cache_span(cache, page, end);
+        if (i2c_auto_read(&cache->device, page * page_bytes, cache->data + (size_t)page * page_bytes, len) != (ssize_t)len) {
+
+            errno = errno ? errno : EIO;
+            return -1;
+        }
+
+        for (i = page; i <= end; i++) {
+
+            cache->pages[i].valid = 1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int i2c_cache_check(const I2CCache *cache, unsigned int iaddr, size_t len)
+{
+    if (iaddr > cache->size || len > cache->size - iaddr) {
+
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+**	@brief		:	Read from cache, pages not cached load from device
+**	#cache		:	cache return from i2c_cache_create
+**	#iaddr		:	device internal address
+**	#buf		:	read data save to here
+**	#len		:	how many data to read, #iaddr + #len must not exceed cache size
+**	@return		:	success return #len, failed return -1
+*/
+ssize_t i2c_cache_read(I2CCache *cache, unsigned int iaddr, void *buf, size_t len)
+{
+    unsigned int page_bytes = cache->device.page_bytes;
+
+    if (i2c_cache_check(cache, iaddr, len) == -1) {
+
+        return -1;
+    }
+
+    if (len == 0) {
+
+        return 0;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+
+    if (i2c_cache_load(cache, iaddr / page_bytes, (iaddr + len - 1) / page_bytes) == -1) {
+
+        pthread_mutex_unlock(&cache->lock);
+        return -1;
+    }
+
+    memcpy(buf, cache->data + iaddr, len);
+    pthread_mutex_unlock(&cache->lock);
+    return len;
+}
+
+
+/*
+**	@brief		:	Write to cache, nothing write to device until i2c_cache_flush
+**	#cache		:	cache return from i2c_cache_create
+**	#iaddr		:	device internal address
+**	#buf		:	data will write to cache
+**	#len		:	data length, #iaddr + #len must not exceed cache size
+**	@return		:	success return #len, failed return -1
+*/
+ssize_t i2c_cache_write(I2CCache *cache, unsigned int iaddr, const void *buf, size_t len)
+{
+    size_t lo, hi;
+    unsigned int page, first, last;
+    struct i2c_cache_page *cached;
+    unsigned int page_bytes = cache->device.page_bytes;
+
+    if (i2c_cache_check(cache, iaddr, len) == -1) {
+
+        return -1;
+    }
+
+    if (len == 0) {
+
+        return 0;
+    }
+
+    first = iaddr / page_bytes;
+    last = (iaddr + len - 1) / page_bytes;
+
+    pthread_mutex_lock(&cache->lock);
+
+    /* Partial written head and tail page must be loaded, write back whole dirty range of page */
+    if ((iaddr % page_bytes && i2c_cache_load(cache, first, first) == -1) ||
+            (iaddr + len < i2c_cache_span(cache, 0, last) && i2c_cache_load(cache, last, last) == -1)) {
+
+        pthread_mutex_unlock(&cache->lock);
+        return -1;
+    }
+
+    memcpy(cache->data + iaddr, buf, len);
+
+    for (page = first; page <= last; page++) {
+
+        cached = &cache->pages[page];
+        lo = page == first ? iaddr % page_bytes : 0;
+        hi = page == last ? iaddr + len - (size_t)page * page_bytes : page_bytes;
+
+        cached->lo = cached->dirty && cached->lo < lo ? cached->lo : lo;
+        cached->hi = cached->dirty && cached->hi > hi ? cached->hi : hi;
+        cached->valid = cached->dirty = 1;
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+    return len;
+}
+
+
+/*
+**	@brief		:	Write back dirty pages, dirty part of continuous pages write with one device write
+**	#cache		:	cache return from i2c_cache_create
+**	@return		:	success return 0, failed return -1, pages failed to write back keep dirty
+*/
+int i2c_cache_flush(I2CCache *cache)
+{
+    size_t len;
+    unsigned int i, page, end, iaddr;
+    unsigned int page_bytes = cache->device.page_bytes;
+
+    pthread_mutex_lock(&cache->lock);
+
+    for (page = 0; page < cache->npages; page = end + 1) {
+
+        if (!cache->pages[page].dirty) {
+
+            end = page;
+            continue;
+        }
+
+        /* Dirty to page end and next page dirty from page start, merge them */
+        for (end = page; end + 1 < cache->npages && cache->pages[end].hi == page_bytes &&
+                cache->pages[end + 1].dirty && cache->pages[end + 1].lo == 0; end++);
+
+        iaddr = page * page_bytes + cache->pages[page].lo;
+        len = (size_t)end * page_bytes + cache->pages[end].hi - iaddr;
+
+        if (i2c_auto_write(&cache->device, iaddr, cache->data + iaddr, len) != (ssize_t)len) {
+
+            pthread_mutex_unlock(&cache->lock);
+            errno = errno ? errno : EIO;
+            return -1;
+        }
+
+        for (i = page; i <= end; i++) {
+
+            cache->pages[i].dirty = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+    return 0;
+}
+
+
+/*
+**	@brief		:	Drop cached pages overlap [iaddr, iaddr + len), dirty data are discarded, next access load from device
+**	#cache		:	cache return from i2c_cache_create
+**	#iaddr		:	device internal address
+**	#len		:	range length, exceed cache size is truncated
+*/
+void i2c_cache_invalidate(I2CCache *cache, unsigned int iaddr, size_t len)
+{
+    unsigned int page, last;
+    unsigned int page_bytes = cache->device.page_bytes;
+
+    if (len == 0 || iaddr >= cache->size) {
+
+        return;
+    }
+
+    len = len > cache->size - iaddr ? cache->size - iaddr : len;
+    last = (iaddr + len - 1) / page_bytes;
+
+    pthread_mutex_lock(&cache->lock);
+
+    for (page = iaddr / page_bytes; page <= last; page++) {
+
+        cache->pages[page].valid = cache->pages[page].dirty = 0;
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+
+/*
+**	@brief		:	Write back dirty pages then drop all cached pages, device may be modified by others
+**	#cache		:	cache return from i2c_cache_create
+**	@return		:	success return 0, failed return -1, nothing dropped if write back failed
+*/
+int i2c_cache_sync(I2CCache *cache)
+{
+    if (i2c_cache_flush(cache) == -1) {
+
+        return -1;
+    }
+
+    i2c_cache_invalidate(cache, 0, cache->size);
+    return 0;
+}
+
+
+/*
+**	@brief		:	Get number of dirty pages
+**	#cache		:	cache return from i2c_cache_create
+**	@return		:	number of dirty pages
+*/
+unsigned int i2c_cache_dirty(I2CCache *cache)
+{
+    unsigned int page, dirty = 0;
+
+    pthread_mutex_lock(&cache->lock);
+
+    for (page = 0; page < cache->npages; page++) {
+
+        dirty += cache->pages[page].dirty;
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+    return dirty;
+}
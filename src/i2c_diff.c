@@ -0,0 +1,214 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "i2c/i2c.h"
+
+/* Read back chunk bytes, rounded down to page boundary */
+#define I2C_DIFF_CHUNK_BYTES 4096
+
+/* 64 bit FNV-1a */
+#define I2C_DIFF_HASH_INIT 0xcbf29ce484222325ULL
+#define I2C_DIFF_HASH_PRIME 0x100000001b3ULL
+
+
+/*
+**	@brief		:	Page hash used by manifest, 64 bit FNV-1a
+**	#buf		:	page data
+**	#len		:	page data length
+**	@return		:	hash
+*/
+uint64_t i2c_diff_hash(const void *buf, size_t len)
+{
+    size_t i;
+    uint64_t hash = I2C_DIFF_HASH_INIT;
+    const unsigned char *data = buf;
+
+    for (i = 0; i < len; i++) {
+
+        hash = (hash ^ data[i]) * I2C_DIFF_HASH_PRIME;
+    }
+
+    return hash;
+}
+
+
+/* Bytes from #iaddr to page end, not exceed #remain */
+static size_t i2c_diff_page_size(const I2CDevice *device, unsigned int iaddr, size_t remain)
+{
+    size_t size = device->page_bytes - iaddr % device->page_bytes;
+
+    return size > remain ? remain : size;
+}
+
+
+/*
+**	@brief		:	Number of pages #len bytes from #iaddr cover, manifest need that many entries
+**	#device		:	I2CDevice struct
+**	#iaddr		:	i2c device internal address
+**	#len		:	data length
+**	@return		:	number of pages
+*/
+size_t i2c_diff_pages(const I2CDevice *device, unsigned int iaddr, size_t len)
+{
+    if (len == 0 || device->page_bytes == 0) {
+
+        return 0;
+    }
+
+    return ((size_t)iaddr + len - 1) / device->page_bytes - iaddr / device->page_bytes + 1;
+}
+
+
+/*
+**	@brief		:	Build manifest of image already on device, each page of image(part of it in range) get a hash
+**	#device		:	I2CDevice struct
+**	#iaddr		:	image internal address
+**	#buf		:	image data
+**	#len		:	image length
+**	#manifest	:	page hashes save to here, must hold i2c_diff_pages entries
+*/
+void i2c_diff_manifest(const I2CDevice *device, unsigned int iaddr, const void *buf, size_t len, uint64_t *manifest)
+{
+    size_t size;
+    const unsigned char *buffer = buf;
+
+    while (len > 0 && device->page_bytes) {
+
+        size = i2c_diff_page_size(device, iaddr, len);
+        *manifest++ = i2c_diff_hash(buffer, size);
+
+        iaddr += size;
+        buffer += size;
+        len -= size;
+    }
+}
+
+
+/* Program continuous changed pages with one write then update their hashes, bus is locked */
+static int i2c_diff_program(const I2CDevice *device, unsigned int iaddr, const unsigned char *buf, size_t len, uint64_t *manifest)
+{
+    if (len == 0) {
+
+        return 0;
+    }
+
+    if (i2c_auto_write(device, iaddr, buf, len) != (ssize_t)len) {
+
+        errno = errno ? errno : EIO;
+        return -1;
+    }
+
+    if (manifest) {
+
+        i2c_diff_manifest(device, iaddr, buf, len, manifest);
+    }
+
+    return 0;
+}
+
+
+/*
+**	@brief		:	Write image only program pages differ from device
+**	#device		:	I2CDevice struct
+**	#iaddr		:	image internal address
+**	#buf		:	image data
+**	#len		:	image length
+**	#manifest	:	page hashes of device content(i2c_diff_manifest), updated after page programmed,
+**					NULL read back device with large sequential reads to compare
+**	#stat		:	number of pages written and skipped save to here, can be NULL
+**	@return		:	success return #len, failed return -1, #stat and #manifest reflect pages done
+*/
+ssize_t i2c_write_diff(const I2CDevice *device, unsigned int iaddr, const void *buf, size_t len,
+                       uint64_t *manifest, I2CDiffStat *stat)
+{
+    int changed;
+    I2CDiffStat dummy;
+    unsigned char *back = NULL;
+    const unsigned char *buffer = buf;
+    unsigned int page = 0, pending_page = 0, pending_pages = 0;
+    unsigned int pending_iaddr = iaddr;
+    size_t size, chunk = 0, offset = 0, pending = 0;
+
+    stat = stat ? stat : &dummy;
+    stat->written = stat->skipped = 0;
+
+    if (device->page_bytes == 0 || device->page_bytes > I2C_DIFF_CHUNK_BYTES) {
+
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (!manifest && (back = malloc(I2C_DIFF_CHUNK_BYTES)) == NULL) {
+
+        return -1;
+    }
+
+    /* Compare and program as a whole, other device on this bus wait */
+    if (i2c_lock(device->bus) == -1) {
+
+        free(back);
+        return -1;
+    }
+
+    for (; len > 0; page++, iaddr += size, buffer += size, len -= size) {
+
+        size = i2c_diff_page_size(device, iaddr, len);
+
+        if (manifest) {
+
+            changed = manifest[page] != i2c_diff_hash(buffer, size);
+        }
+        else {
+
+            /* Read back next chunk end at page boundary */
+            if (offset == chunk) {
+
+                chunk = ((size_t)iaddr + I2C_DIFF_CHUNK_BYTES) / device->page_bytes * device->page_bytes - iaddr;
+                chunk = chunk > len ? len : chunk;
+                offset = 0;
+
+                if (i2c_auto_read(device, iaddr, back, chunk) != (ssize_t)chunk) {
+
+                    goto err;
+                }
+            }
+
+            changed = memcmp(back + offset, buffer, size) != 0;
+            offset += size;
+        }
+
+        if (changed) {
+
+            pending_page = pending ? pending_page : page;
+            pending_iaddr = pending ? pending_iaddr : iaddr;
+            pending += size;
+            pending_pages++;
+            continue;
+        }
+
+        if (i2c_diff_program(device, pending_iaddr, buffer - pending, pending, manifest ? manifest + pending_page : NULL) == -1) {
+
+            goto err;
+        }
+
+        stat->written += pending_pages;
+        stat->skipped++;
+        pending = pending_pages = 0;
+    }
+
+    if (i2c_diff_program(device, pending_iaddr, buffer - pending, pending, manifest ? manifest + pending_page : NULL) == -1) {
+
+        goto err;
+    }
+
+    stat->written += pending_pages;
+    i2c_unlock(device->bus);
+    free(back);
+    return buffer - (const unsigned char *)buf;
+
+err:
+    errno = errno ? errno : EIO;
+    i2c_unlock(device->bus);
+    free(back);
+    return -1;
+}
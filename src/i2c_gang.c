@@ -0,0 +1,203 @@
+#include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "i2c/i2c.h"
+
+/* Verify read back chunk bytes */
+#define I2C_GANG_CHUNK_BYTES 4096
+
+/* Gang programming job, shared by all workers */
+struct i2c_gang {
+    I2CGangTarget *targets;
+    unsigned int ntargets;
+    unsigned int iaddr;
+    const unsigned char *image;
+    size_t len;
+    unsigned int flags;
+};
+
+/* One worker per bus, program targets on #bus one by one */
+struct i2c_gang_worker {
+    struct i2c_gang *gang;
+    int bus;
+    pthread_t thread;
+    int started;
+};
+
+
+static unsigned long long i2c_gang_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
+/* Read back and compare image, mismatch errno is EBADMSG */
+static int i2c_gang_verify(const struct i2c_gang *gang, const I2CDevice *device, unsigned char *back)
+{
+    size_t size, offset;
+
+    for (offset = 0; offset < gang->len; offset += size) {
+
+        size = gang->len - offset > I2C_GANG_CHUNK_BYTES ? I2C_GANG_CHUNK_BYTES : gang->len - offset;
+
+        if (i2c_auto_read(device, gang->iaddr + offset, back, size) != (ssize_t)size) {
+
+            errno = errno ? errno : EIO;
+            return -1;
+        }
+
+        if (memcmp(back, gang->image + offset, size)) {
+
+            errno = EBADMSG;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Program and verify one target, result save to #target */
+static void i2c_gang_target(const struct i2c_gang *gang, I2CGangTarget *target, unsigned char *back)
+{
+    ssize_t ret;
+    unsigned long long start = i2c_gang_now_us();
+
+    errno = 0;
+    target->stage = I2C_GANG_WRITE;
+
+    if (gang->flags & I2C_GANG_DIFF) {
+
+        ret = i2c_write_diff(&target->device, gang->iaddr, gang->image, gang->len, NULL, NULL);
+    }
+    else {
+
+        ret = i2c_auto_write(&target->device, gang->iaddr, gang->image, gang->len);
+    }
+
+    target->write_us = i2c_gang_now_us() - start;
+
+    if (ret != (ssize_t)gang->len) {
+
+        target->error = errno ? errno : EIO;
+        return;
+    }
+
+    start = i2c_gang_now_us();
+    target->stage = I2C_GANG_VERIFY;
+
+    if (!back || i2c_gang_verify(gang, &target->device, back) == -1) {
+
+        target->verify_us = i2c_gang_now_us() - start;
+        target->error = back ? errno : ENOMEM;
+        return;
+    }
+
+    target->verify_us = i2c_gang_now_us() - start;
+    target->stage = I2C_GANG_DONE;
+}
+
+
+/* Worker thread entry */
+static void *i2c_gang_worker(void *arg)
+{
+    unsigned int i;
+    struct i2c_gang_worker *worker = arg;
+    struct i2c_gang *gang = worker->gang;
+    unsigned char *back = malloc(I2C_GANG_CHUNK_BYTES);
+
+    for (i = 0; i < gang->ntargets; i++) {
+
+        if (gang->targets[i].device.bus == worker->bus) {
+
+            i2c_gang_target(gang, &gang->targets[i], back);
+        }
+    }
+
+    free(back);
+    return NULL;
+}
+
+
+/*
+**	@brief		:	Program same image to many devices and verify them, one worker thread per bus,
+**					targets on different buses programmed concurrently, same bus one by one
+**	#targets	:	#targets[i].device is target device and it's profile(page_bytes, iaddr_bytes, completion etc),
+**					ACK polling completion make target finish as soon as device ready,
+**					result save to #targets[i].stage, error, write_us and verify_us
+**	#ntargets	:	number of #targets
+**	#iaddr		:	image internal address
+**	#image		:	image data
+**	#len		:	image length
+**	#flags		:	I2C_GANG_XXX, I2C_GANG_DIFF only program pages differ from image
+**	@return		:	success return number of failed targets, failed return -1
+*/
+int i2c_gang_program(I2CGangTarget *targets, unsigned int ntargets, unsigned int iaddr,
+                     const void *image, size_t len, unsigned int flags)
+{
+    int failed = 0;
+    unsigned int i, j, nworkers = 0;
+    struct i2c_gang_worker *workers;
+    struct i2c_gang gang = {targets, ntargets, iaddr, image, len, flags};
+
+    for (i = 0; i < ntargets; i++) {
+
+        targets[i].stage = I2C_GANG_WRITE;
+        targets[i].error = 0;
+        targets[i].write_us = targets[i].verify_us = 0;
+    }
+
+    if (ntargets == 0) {
+
+        return 0;
+    }
+
+    if ((workers = calloc(ntargets, sizeof(*workers))) == NULL) {
+
+        return -1;
+    }
+
+    /* Group targets by bus */
+    for (i = 0; i < ntargets; i++) {
+
+        for (j = 0; j < nworkers && workers[j].bus != targets[i].device.bus; j++);
+
+        if (j == nworkers) {
+
+            workers[nworkers].gang = &gang;
+            workers[nworkers++].bus = targets[i].device.bus;
+        }
+    }
+
+    /* Thread can't create run worker on caller */
+    for (i = 0; i < nworkers; i++) {
+
+        if (nworkers == 1 || pthread_create(&workers[i].thread, NULL, i2c_gang_worker, &workers[i]) != 0) {
+
+            i2c_gang_worker(&workers[i]);
+            continue;
+        }
+
+        workers[i].started = 1;
+    }
+
+    for (i = 0; i < nworkers; i++) {
+
+        if (workers[i].started) {
+
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+
+    for (i = 0; i < ntargets; i++) {
+
+        failed += targets[i].stage != I2C_GANG_DONE;
+    }
+
+    free(workers);
+    return failed;
+}
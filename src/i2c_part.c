@@ -0,0 +1,115 @@
+#include <errno.h>
+#include <stddef.h>
+#include <strings.h>
+#include "i2c/i2c.h"
+
+/* Microsecond to millisecond, round up */
+#define I2C_PART_US_TO_MS(us) (((us) + 999) / 1000)
+
+/* ACK polling timeout of part, twice of max write cycle time */
+#define I2C_PART_POLL_TIMEOUT(part) (I2C_PART_US_TO_MS((part)->twr_max_us) * 2)
+
+/*
+**  Common EEPROM/FRAM parts, write cycle time from datasheet.
+**  Block select parts(24C04/08/16, 24C1024, 24CM02 etc) put internal address high bits into slave address.
+*/
+static const I2CPart i2c_parts[] = {
+
+    /* name         size        page    iaddr   block   twr_typ twr_max */
+    {"24c01",       128,        8,      1,      0,      3000,   5000},
+    {"24c02",       256,        8,      1,      0,      3000,   5000},
+    {"24c04",       512,        16,     1,      1,      3000,   5000},
+    {"24c08",       1024,       16,     1,      2,      3000,   5000},
+    {"24c16",       2048,       16,     1,      3,      3000,   5000},
+    {"24c32",       4096,       32,     2,      0,      3000,   5000},
+    {"24c64",       8192,       32,     2,      0,      3000,   5000},
+    {"24c128",      16384,      64,     2,      0,      3000,   5000},
+    {"24c256",      32768,      64,     2,      0,      3000,   5000},
+    {"24c512",      65536,      128,    2,      0,      3000,   5000},
+    {"24c1024",     131072,     256,    2,      1,      3000,   5000},
+    {"24cm02",      262144,     256,    2,      2,      3000,   10000},
+    {"fm24c04",     512,        0,      1,      1,      0,      0},
+    {"fm24c16",     2048,       0,      1,      3,      0,      0},
+    {"fm24c64",     8192,       0,      2,      0,      0,      0},
+    {"fm24cl64",    8192,       0,      2,      0,      0,      0},
+    {"fm24v02",     32768,      0,      2,      0,      0,      0},
+    {"fm24v10",     131072,     0,      2,      1,      0,      0},
+    {"mb85rc04",    512,        0,      1,      1,      0,      0},
+    {"mb85rc16",    2048,       0,      1,      3,      0,      0},
+    {"mb85rc64",    8192,       0,      2,      0,      0,      0},
+    {"mb85rc256v",  32768,      0,      2,      0,      0,      0},
+    {"mb85rc512t",  65536,      0,      2,      0,      0,      0},
+    {"mb85rc1mt",   131072,     0,      2,      1,      0,      0},
+};
+
+
+/*
+**	@brief		:	Get built-in part profile table
+**	#count		:	number of parts save to here
+**	@return		:	part profile table
+*/
+const I2CPart *i2c_get_parts(unsigned int *count)
+{
+    *count = sizeof(i2c_parts) / sizeof(i2c_parts[0]);
+    return i2c_parts;
+}
+
+
+/*
+**	@brief		:	Find part profile by name
+**	#name		:	part name, case insensitive, such as: 24C64, fm24cl64
+**	@return		:	success return part profile, not found return NULL and errno is ENOENT
+*/
+const I2CPart *i2c_find_part(const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; name && i < sizeof(i2c_parts) / sizeof(i2c_parts[0]); i++) {
+
+        if (strcasecmp(i2c_parts[i].name, name) == 0) {
+
+            return &i2c_parts[i];
+        }
+    }
+
+    errno = ENOENT;
+    return NULL;
+}
+
+
+/*
+**	@brief		:	Initialize I2CDevice with default value and part profile, #device->bus and addr are kept
+**	#device		:	I2CDevice struct, #device->addr is base(block 0) slave address
+**	#name		:	part name, EEPROM using ACK polling completion, FRAM using I2C_COMPLETION_NONE
+**	@return		:	success return 0, part not found return -1
+*/
+int i2c_init_part(I2CDevice *device, const char *name)
+{
+    int bus = device->bus;
+    unsigned short addr = device->addr;
+    const I2CPart *part = i2c_find_part(name);
+
+    if (!part) {
+
+        return -1;
+    }
+
+    i2c_init_device(device);
+    device->bus = bus;
+    device->addr = addr;
+    device->iaddr_bytes = part->iaddr_bytes;
+    device->block_bits = part->block_bits;
+
+    if (part->twr_max_us == 0) {
+
+        device->page_bytes = part->iaddr_bytes == 1 ? 256 : 4096;
+        device->completion = I2C_COMPLETION_NONE;
+        return 0;
+    }
+
+    device->page_bytes = part->page_bytes;
+    device->delay = I2C_PART_US_TO_MS(part->twr_max_us);
+    device->completion = I2C_COMPLETION_ACK_POLL;
+    device->poll_timeout = I2C_PART_POLL_TIMEOUT(part);
+    return 0;
+}
@@ -0,0 +1,512 @@
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "i2c_bus.h"
+
+/* Record file stdio buffer bytes, transfer thread only copy to it */
+#define I2C_RECORD_BUFFER_BYTES (64 * 1024)
+
+/* Record message data is 8 bytes aligned */
+#define I2C_RECORD_ALIGN(len) (((len) + 7) & ~(size_t)7)
+
+
+static unsigned long long i2c_record_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/* Open record file of #i2c_bus, caller hold bus reference */
+static int i2c_record_open(struct i2c_bus *i2c_bus, const char *path)
+{
+    FILE *fp;
+    I2CRecordFile header;
+
+    pthread_mutex_lock(&i2c_bus->record_lock);
+
+    if (i2c_bus->record) {
+
+        pthread_mutex_unlock(&i2c_bus->record_lock);
+        errno = EBUSY;
+        return -1;
+    }
+
+    if ((fp = fopen(path, "wb")) == NULL) {
+
+        pthread_mutex_unlock(&i2c_bus->record_lock);
+        return -1;
+    }
+
+    setvbuf(fp, NULL, _IOFBF, I2C_RECORD_BUFFER_BYTES);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, I2C_RECORD_MAGIC, sizeof(header.magic));
+    header.version = I2C_RECORD_VERSION;
+    header.header_size = sizeof(header);
+    header.start_ns = i2c_record_now_ns();
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+
+        fclose(fp);
+        pthread_mutex_unlock(&i2c_bus->record_lock);
+        errno = errno ? errno : EIO;
+        return -1;
+    }
+
+    i2c_bus->record = fp;
+    i2c_bus->record_base = header.start_ns;
+    atomic_store_explicit(&i2c_bus->recording, 1, memory_order_release);
+    pthread_mutex_unlock(&i2c_bus->record_lock);
+    return 0;
+}
+
+
+/*
+**	@brief		:	Start recording all transfers of bus into file, with data and timing
+**	#bus		:	i2c bus fd, must be opened by i2c_open
+**	#path		:	record file path, truncated if exist
+**	@return		:	success return 0, failed return -1, already recording errno is EBUSY
+*/
+int i2c_record_start(int bus, const char *path)
+{
+    int ret;
+    struct i2c_bus *i2c_bus = i2c_bus_get(bus);
+
+    if (!i2c_bus || !path) {
+
+        i2c_bus_put(i2c_bus);
+        errno = i2c_bus ? EINVAL : EBADF;
+        return -1;
+    }
+
+    ret = i2c_record_open(i2c_bus, path);
+    i2c_bus_put(i2c_bus);
+    return ret;
+}
+
+
+/* Close record file of #i2c_bus, caller hold bus reference */
+static int i2c_record_close(struct i2c_bus *i2c_bus)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&i2c_bus->record_lock);
+
+    if (!i2c_bus->record) {
+
+        pthread_mutex_unlock(&i2c_bus->record_lock);
+        errno = EINVAL;
+        return -1;
+    }
+
+    atomic_store_explicit(&i2c_bus->recording, 0, memory_order_relaxed);
+
+    if (ferror(i2c_bus->record)) {
+
+        errno = EIO;
+        ret = -1;
+    }
+
+    if (fclose(i2c_bus->record)) {
+
+        ret = -1;
+    }
+
+    i2c_bus->record = NULL;
+    pthread_mutex_unlock(&i2c_bus->record_lock);
+    return ret;
+}
+
+
+/*
+**	@brief		:	Stop recording and close record file
+**	#bus		:	i2c bus fd
+**	@return		:	success return 0, failed return -1, write record failed errno is EIO
+*/
+int i2c_record_stop(int bus)
+{
+    int ret;
+    struct i2c_bus *i2c_bus = i2c_bus_get(bus);
+
+    if (!i2c_bus) {
+
+        errno = EBADF;
+        return -1;
+    }
+
+    ret = i2c_record_close(i2c_bus);
+    i2c_bus_put(i2c_bus);
+    return ret;
+}
+
+
+void i2c_bus_record(struct i2c_bus *bus, const I2CTrace *trace, unsigned long arg, const void *buf, size_t len)
+{
+    unsigned int i, nmsgs = 1;
+    int error = errno;
+    I2CRecord record;
+    I2CRecordMsg msgs[UINT8_MAX];
+    const void *data[UINT8_MAX];
+    static const unsigned char pad[8];
+    const struct i2c_rdwr_ioctl_data *rdwr = (const struct i2c_rdwr_ioctl_data *)arg;
+    const struct i2c_smbus_ioctl_data *smbus = (const struct i2c_smbus_ioctl_data *)arg;
+    unsigned int tenbit = atomic_load_explicit(&bus->selected, memory_order_relaxed) & 0x10000L ? I2C_M_TEN : 0;
+
+    memset(&record, 0, sizeof(record));
+    record.type = trace->type;
+    record.addr = trace->addr;
+    record.result = trace->result;
+
+    /* File I/O and SMBus are one message to selected address */
+    msgs[0].addr = trace->addr;
+    msgs[0].flags = trace->flags | tenbit;
+    msgs[0].len = len;
+    data[0] = buf;
+
+    if (trace->type == I2C_TRACE_SMBUS) {
+
+        msgs[0].len = smbus->data ? sizeof(*smbus->data) : 0;
+        data[0] = smbus->data;
+        record.read_write = smbus->read_write;
+        record.command = smbus->command;
+        record.smbus_size = smbus->size;
+    }
+    else if (trace->type == I2C_TRACE_RDWR) {
+
+        if (rdwr->nmsgs > UINT8_MAX) {
+
+            return;
+        }
+
+        for (i = 0, nmsgs = rdwr->nmsgs; i < nmsgs; i++) {
+
+            msgs[i].addr = rdwr->msgs[i].addr;
+            msgs[i].flags = rdwr->msgs[i].flags;
+            msgs[i].len = rdwr->msgs[i].len;
+            data[i] = rdwr->msgs[i].buf;
+        }
+    }
+
+    record.nmsgs = nmsgs;
+    record.size = sizeof(record) + nmsgs * sizeof(msgs[0]);
+
+    for (i = 0; i < nmsgs; i++) {
+
+        record.size += I2C_RECORD_ALIGN(msgs[i].len);
+    }
+
+    pthread_mutex_lock(&bus->record_lock);
+
+    if (!bus->record) {
+
+        pthread_mutex_unlock(&bus->record_lock);
+        errno = error;
+        return;
+    }
+
+    /* Transfer started before recording start as soon as it start */
+    record.start_ns = trace->start_ns > bus->record_base ? trace->start_ns - bus->record_base : 0;
+    record.end_ns = trace->end_ns > bus->record_base ? trace->end_ns - bus->record_base : 0;
+    fwrite(&record, sizeof(record), 1, bus->record);
+    fwrite(msgs, sizeof(msgs[0]), nmsgs, bus->record);
+
+    for (i = 0; i < nmsgs; i++) {
+
+        fwrite(data[i], 1, msgs[i].len, bus->record);
+        fwrite(pad, 1, I2C_RECORD_ALIGN(msgs[i].len) - msgs[i].len, bus->record);
+    }
+
+    pthread_mutex_unlock(&bus->record_lock);
+    errno = error;
+}
+
+
+/* SMBus data bytes of union i2c_smbus_data, block length come from #data */
+static size_t i2c_replay_smbus_bytes(unsigned int size, const union i2c_smbus_data *data)
+{
+    switch (size) {
+
+        case I2C_SMBUS_QUICK:
+            return 0;
+
+        case I2C_SMBUS_BYTE:
+        case I2C_SMBUS_BYTE_DATA:
+            return 1;
+
+        case I2C_SMBUS_WORD_DATA:
+        case I2C_SMBUS_PROC_CALL:
+            return 2;
+
+        default:
+            if (!data) {
+
+                return 0;
+            }
+
+            return data->block[0] > I2C_SMBUS_BLOCK_MAX ? I2C_SMBUS_BLOCK_MAX + 1 : data->block[0] + 1;
+    }
+}
+
+
+/* Replay one record, return transfer result or -errno, read data differ from recorded set #mismatch */
+static int i2c_replay_record(int bus, const I2CRecord *record, const I2CRecordMsg *rmsgs, const unsigned char *data,
+                             unsigned char *scratch, unsigned long long *latency, int *mismatch)
+{
+    long ret;
+    unsigned int i;
+    size_t offset = 0;
+    unsigned long long start;
+    union i2c_smbus_data smbus_data;
+    struct i2c_smbus_ioctl_data smbus;
+    struct i2c_rdwr_ioctl_data rdwr;
+    struct i2c_msg msgs[UINT8_MAX];
+    const unsigned char *recorded[UINT8_MAX];
+
+    *mismatch = 0;
+
+    if (record->type != I2C_TRACE_RDWR && i2c_select(bus, record->addr, rmsgs[0].flags & I2C_M_TEN) == -1) {
+
+        *latency = 0;
+        return -errno;
+    }
+
+    switch (record->type) {
+
+        case I2C_TRACE_READ:
+            start = i2c_record_now_ns();
+            ret = i2c_bus_read(bus, scratch, rmsgs[0].len);
+            *latency = i2c_record_now_ns() - start;
+            *mismatch = ret >= 0 && record->result >= 0 && memcmp(scratch, data, ret < record->result ? ret : record->result);
+            return ret < 0 ? -errno : ret;
+
+        case I2C_TRACE_WRITE:
+            start = i2c_record_now_ns();
+            ret = i2c_bus_write(bus, data, rmsgs[0].len);
+            *latency = i2c_record_now_ns() - start;
+            return ret < 0 ? -errno : ret;
+
+        case I2C_TRACE_SMBUS:
+            memset(&smbus_data, 0, sizeof(smbus_data));
+            memcpy(&smbus_data, data, rmsgs[0].len < sizeof(smbus_data) ? rmsgs[0].len : sizeof(smbus_data));
+            smbus.read_write = record->read_write;
+            smbus.command = record->command;
+            smbus.size = record->smbus_size;
+            smbus.data = rmsgs[0].len ? &smbus_data : NULL;
+
+            start = i2c_record_now_ns();
+            ret = i2c_bus_ioctl(bus, I2C_SMBUS, (unsigned long)&smbus);
+            *latency = i2c_record_now_ns() - start;
+
+            if (ret >= 0 && record->result >= 0 && smbus.data && smbus.read_write == I2C_SMBUS_READ) {
+
+                *mismatch = memcmp(&smbus_data, data, i2c_replay_smbus_bytes(smbus.size, &smbus_data)) != 0;
+            }
+
+            return ret < 0 ? -errno : ret;
+
+        default:
+            break;
+    }
+
+    /* I2C_RDWR, write data and read buffers in #scratch */
+    for (i = 0; i < record->nmsgs; i++) {
+
+        msgs[i].addr = rmsgs[i].addr;
+        msgs[i].flags = rmsgs[i].flags;
+        msgs[i].len = rmsgs[i].len;
+        msgs[i].buf = scratch + offset;
+        recorded[i] = data;
+
+        if (msgs[i].flags & I2C_M_RECV_LEN) {
+
+            /* Recorded length is updated to extra bytes plus block length, buffer must large enough for max block */
+            msgs[i].buf[0] = record->result >= 0 && rmsgs[i].len > data[0] ? rmsgs[i].len - data[0] : 1;
+            msgs[i].len = msgs[i].buf[0] + I2C_SMBUS_BLOCK_MAX;
+        }
+        else if (!(msgs[i].flags & I2C_M_RD)) {
+
+            memcpy(msgs[i].buf, data, rmsgs[i].len);
+        }
+
+        offset += I2C_RECORD_ALIGN(msgs[i].len);
+        data += I2C_RECORD_ALIGN(rmsgs[i].len);
+    }
+
+    rdwr.msgs = msgs;
+    rdwr.nmsgs = record->nmsgs;
+
+    start = i2c_record_now_ns();
+    ret = i2c_bus_ioctl(bus, I2C_RDWR, (unsigned long)&rdwr);
+    *latency = i2c_record_now_ns() - start;
+
+    for (i = 0; ret >= 0 && record->result >= 0 && i < record->nmsgs; i++) {
+
+        if (msgs[i].flags & I2C_M_RD) {
+
+            *mismatch |= msgs[i].len != rmsgs[i].len || memcmp(msgs[i].buf, recorded[i], rmsgs[i].len);
+        }
+    }
+
+    return ret < 0 ? -errno : ret;
+}
+
+
+/*
+**	@brief		:	Replay record file on bus, compare result and read data, measure latency
+**	#bus		:	i2c bus fd, real or simulated bus
+**	#path		:	record file recorded by i2c_record_start
+**	#flags		:	I2C_REPLAY_XXX, I2C_REPLAY_REALTIME keep recorded interval, otherwise replay at max speed
+**	#stat		:	replay result
+**	@return		:	success return 0, failed return -1, invalid record file errno is EBADMSG
+*/
+int i2c_replay(int bus, const char *path, unsigned int flags, I2CReplayStat *stat)
+{
+    int fd, mismatch;
+    struct stat st;
+    const I2CRecord *record;
+    const I2CRecordMsg *rmsgs;
+    const I2CRecordFile *header;
+    const unsigned char *base = MAP_FAILED;
+    unsigned char *scratch = NULL;
+    size_t offset, need, scratch_size = 0;
+    unsigned long long latency, replay_base = 0, first_ns = 0, end_ns = 0;
+    unsigned int i;
+    long ret;
+    int error = 0;
+
+    if (!stat || !path) {
+
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(stat, 0, sizeof(*stat));
+
+    if ((fd = open(path, O_RDONLY)) == -1) {
+
+        return -1;
+    }
+
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(*header) ||
+            (base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+
+        error = errno ? errno : EBADMSG;
+        error = base == MAP_FAILED && (size_t)st.st_size < sizeof(*header) ? EBADMSG : error;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    close(fd);
+    header = (const I2CRecordFile *)base;
+
+    if (memcmp(header->magic, I2C_RECORD_MAGIC, sizeof(header->magic)) || header->version != I2C_RECORD_VERSION ||
+            header->header_size < sizeof(*header) || header->header_size > (size_t)st.st_size) {
+
+        munmap((void *)base, st.st_size);
+        errno = EBADMSG;
+        return -1;
+    }
+
+    for (offset = header->header_size; offset < (size_t)st.st_size; offset += record->size) {
+
+        record = (const I2CRecord *)(base + offset);
+        rmsgs = (const I2CRecordMsg *)(record + 1);
+
+        /* Record must be complete, unfinished record at end of file is ignored */
+        if (st.st_size - offset < sizeof(*record) || record->size > st.st_size - offset || record->nmsgs == 0 ||
+                record->size < sizeof(*record) + record->nmsgs * sizeof(*rmsgs) || record->size % 8) {
+
+            error = st.st_size - offset < sizeof(*record) || record->size > st.st_size - offset ? 0 : EBADMSG;
+            break;
+        }
+
+        for (i = 0, need = sizeof(*record) + record->nmsgs * sizeof(*rmsgs); i < record->nmsgs; i++) {
+
+            need += I2C_RECORD_ALIGN(rmsgs[i].len);
+        }
+
+        if (need != record->size || (record->type != I2C_TRACE_RDWR && record->nmsgs != 1)) {
+
+            error = EBADMSG;
+            break;
+        }
+
+        /* Scratch hold data of all messages, block read need max block */
+        need += record->nmsgs * I2C_RECORD_ALIGN(I2C_SMBUS_BLOCK_MAX + 2);
+        if (need > scratch_size) {
+
+            free(scratch);
+            if ((scratch = malloc(need)) == NULL) {
+
+                error = ENOMEM;
+                break;
+            }
+
+            scratch_size = need;
+        }
+
+        /* Keep recorded interval from first transfer */
+        if (stat->records == 0) {
+
+            first_ns = record->start_ns;
+            replay_base = i2c_record_now_ns();
+        }
+        else if (flags & I2C_REPLAY_REALTIME && record->start_ns > first_ns) {
+
+            struct timespec ts;
+            unsigned long long at = replay_base + record->start_ns - first_ns;
+
+            ts.tv_sec = at / 1000000000ULL;
+            ts.tv_nsec = at % 1000000000ULL;
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+        }
+
+        /* Bus closed by other thread, stop replay */
+        if (i2c_lock(bus) == -1) {
+
+            error = errno;
+            break;
+        }
+
+        ret = i2c_replay_record(bus, record, rmsgs, (const unsigned char *)(rmsgs + record->nmsgs),
+                                scratch, &latency, &mismatch);
+        i2c_unlock(bus);
+        end_ns = i2c_record_now_ns();
+
+        stat->records++;
+        stat->mismatches += mismatch;
+        stat->diverged += (ret < 0) != (record->result < 0) || (ret >= 0 && ret != record->result);
+        stat->recorded_ns += record->end_ns - record->start_ns;
+        stat->replay_ns += latency;
+        stat->recorded_span_ns = record->end_ns - first_ns;
+
+        for (i = 0, need = 0; i < record->nmsgs; i++) {
+
+            need += record->type == I2C_TRACE_SMBUS ? i2c_replay_smbus_bytes(record->smbus_size,
+                    rmsgs[0].len ? (const void *)(rmsgs + 1) : NULL) : rmsgs[i].len;
+        }
+
+        stat->bytes += ret >= 0 ? need : 0;
+        stat->recorded_bytes += record->result >= 0 ? need : 0;
+    }
+
+    stat->replay_span_ns = stat->records ? end_ns - replay_base : 0;
+    munmap((void *)base, st.st_size);
+    free(scratch);
+
+    if (error) {
+
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
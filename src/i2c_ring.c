@@ -0,0 +1,134 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "i2c_ring.h"
+
+#define I2C_RING_CELL(ring, pos) ((ring)->cells + ((pos) & (ring)->mask) * (ring)->stride)
+#define I2C_RING_SEQ(cell) ((_Atomic size_t *)(cell))
+
+
+/*
+**	@brief		:	Init ring
+**	#ring		:	i2c_ring struct
+**	#depth		:	min number of entries, round up to power of 2
+**	#entry_size	:	entry bytes
+**	@return		:	success return 0, failed return -1
+*/
+int i2c_ring_init(struct i2c_ring *ring, size_t depth, size_t entry_size)
+{
+    size_t i, cells = 1;
+
+    if (depth == 0 || entry_size == 0) {
+
+        errno = EINVAL;
+        return -1;
+    }
+
+    while (cells < depth) {
+
+        cells <<= 1;
+    }
+
+    ring->mask = cells - 1;
+    ring->entry_size = entry_size;
+    ring->stride = I2C_RING_CELL_HEADER + (entry_size + I2C_RING_CELL_HEADER - 1) / I2C_RING_CELL_HEADER * I2C_RING_CELL_HEADER;
+
+    if ((ring->cells = calloc(cells, ring->stride)) == NULL) {
+
+        return -1;
+    }
+
+    /* Cell #i is ready for push at position #i */
+    for (i = 0; i < cells; i++) {
+
+        atomic_init(I2C_RING_SEQ(I2C_RING_CELL(ring, i)), i);
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return 0;
+}
+
+
+void i2c_ring_free(struct i2c_ring *ring)
+{
+    free(ring->cells);
+    ring->cells = NULL;
+}
+
+
+int i2c_ring_push(struct i2c_ring *ring, const void *entry)
+{
+    intptr_t diff;
+    unsigned char *cell;
+    size_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    while (1) {
+
+        cell = I2C_RING_CELL(ring, pos);
+        diff = (intptr_t)atomic_load_explicit(I2C_RING_SEQ(cell), memory_order_acquire) - (intptr_t)pos;
+
+        /* Cell is free on this lap, claim it */
+        if (diff == 0) {
+
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+
+                break;
+            }
+        }
+        /* Cell still hold entry of last lap, ring is full */
+        else if (diff < 0) {
+
+            return -1;
+        }
+        /* Other producer claimed it */
+        else {
+
+            pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+
+    memcpy(cell + I2C_RING_CELL_HEADER, entry, ring->entry_size);
+    atomic_store_explicit(I2C_RING_SEQ(cell), pos + 1, memory_order_release);
+    return 0;
+}
+
+
+int i2c_ring_pop(struct i2c_ring *ring, void *entry)
+{
+    intptr_t diff;
+    unsigned char *cell;
+    size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    while (1) {
+
+        cell = I2C_RING_CELL(ring, pos);
+        diff = (intptr_t)atomic_load_explicit(I2C_RING_SEQ(cell), memory_order_acquire) - (intptr_t)(pos + 1);
+
+        /* Cell is filled on this lap, claim it */
+        if (diff == 0) {
+
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+
+                break;
+            }
+        }
+        /* Cell not filled yet, ring is empty */
+        else if (diff < 0) {
+
+            return -1;
+        }
+        /* Other consumer claimed it */
+        else {
+
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+
+    memcpy(entry, cell + I2C_RING_CELL_HEADER, ring->entry_size);
+
+    /* Ready for push on next lap */
+    atomic_store_explicit(I2C_RING_SEQ(cell), pos + ring->mask + 1, memory_order_release);
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef _LIB_I2C_RING_H_
+#define _LIB_I2C_RING_H_
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+/* Ring cell header size, entry data follow it */
+#define I2C_RING_CELL_HEADER 16
+
+/*
+**  Bounded lock-free multi-producer multi-consumer ring, fixed size entries copied in and out.
+**  Each cell carry a sequence number tell it's ready for push or pop on current lap.
+*/
+struct i2c_ring {
+    size_t mask;                                /* Number of cells - 1, number of cells is power of 2 */
+    size_t stride;                              /* Cell header and entry bytes */
+    size_t entry_size;                          /* Entry bytes */
+    unsigned char *cells;
+    _Alignas(64) _Atomic size_t head;           /* Next push position */
+    _Alignas(64) _Atomic size_t tail;           /* Next pop position */
+};
+
+/* Init ring can hold at least #depth entries, release by i2c_ring_free */
+int i2c_ring_init(struct i2c_ring *ring, size_t depth, size_t entry_size);
+void i2c_ring_free(struct i2c_ring *ring);
+
+/* Copy #entry into ring, full return -1 */
+int i2c_ring_push(struct i2c_ring *ring, const void *entry);
+
+/* Copy oldest entry out of ring, empty return -1 */
+int i2c_ring_pop(struct i2c_ring *ring, void *entry);
+
+#endif
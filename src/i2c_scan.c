@@ -0,0 +1,220 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "i2c/i2c.h"
+#include "i2c_bus.h"
+
+/* Probe with read, write quick may corrupt such as AT24RF08 EEPROM or lock write protect */
+#define I2C_SCAN_READ_PROBE(addr) (((addr) >= 0x30 && (addr) <= 0x37) || ((addr) >= 0x50 && (addr) <= 0x5f))
+
+
+/* Address only I2C_RDWR transfer, zero-length write or 1 byte read */
+static int i2c_probe_rdwr(int bus, unsigned short addr, int read)
+{
+    unsigned char byte;
+    struct i2c_msg ioctl_msg;
+    struct i2c_rdwr_ioctl_data ioctl_data;
+
+    ioctl_msg.addr = addr;
+    ioctl_msg.flags = read ? I2C_M_RD : 0;
+    ioctl_msg.len = read ? 1 : 0;
+    ioctl_msg.buf = &byte;
+
+    ioctl_data.nmsgs = 1;
+    ioctl_data.msgs = &ioctl_msg;
+
+    return i2c_bus_ioctl(bus, I2C_RDWR, (unsigned long)&ioctl_data) == -1 ? -1 : 0;
+}
+
+
+/* File I/O 1 byte read, adapter functionality unknown */
+static int i2c_probe_file(int bus, unsigned short addr)
+{
+    unsigned char byte;
+    int ret = -1;
+
+    if (i2c_lock(bus) == -1) {
+
+        return -1;
+    }
+
+    if (i2c_select(bus, addr, 0) == 0) {
+
+        ret = i2c_bus_read(bus, &byte, 1) == 1 ? 0 : -1;
+    }
+
+    i2c_unlock(bus);
+    return ret;
+}
+
+
+/*
+**	@brief		:	Probe 7 bit address on bus, probe method chosen by adapter functionality:
+**					I2C adapter with SMBus quick zero-length I2C_RDWR, SMBus only adapter SMBus quick,
+**					1 byte read for EEPROM address or adapter without quick(can't send zero-length message)
+**	#bus		:	i2c bus fd
+**	#addr		:	device 7 bit address
+**	@return		:	device ACK return 1, NAK return 0, failed return -1
+*/
+int i2c_probe(int bus, unsigned short addr)
+{
+    int ret;
+    unsigned long funcs = 0;
+    int read = I2C_SCAN_READ_PROBE(addr);
+    I2CDevice device;
+
+    if (addr > 0x7f) {
+
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (i2c_bus_funcs(bus, &funcs) == -1) {
+
+        ret = i2c_probe_file(bus, addr);
+    }
+    else if (funcs & I2C_FUNC_I2C) {
+
+        if (i2c_lock(bus) == -1) {
+
+            return -1;
+        }
+
+        ret = i2c_probe_rdwr(bus, addr, read || !(funcs & I2C_FUNC_SMBUS_QUICK));
+        i2c_unlock(bus);
+    }
+    else {
+
+        i2c_init_device(&device);
+        device.bus = bus;
+        device.addr = addr;
+
+        if ((!read || !(funcs & I2C_FUNC_SMBUS_READ_BYTE)) && (funcs & I2C_FUNC_SMBUS_QUICK)) {
+
+            ret = i2c_smbus_write_quick(&device, I2C_SMBUS_WRITE);
+        }
+        else if (funcs & I2C_FUNC_SMBUS_READ_BYTE) {
+
+            ret = i2c_smbus_read_byte(&device) == -1 ? -1 : 0;
+        }
+        else {
+
+            errno = EOPNOTSUPP;
+            return -1;
+        }
+    }
+
+    if (ret == 0) {
+
+        return 1;
+    }
+
+    /* Address claimed by kernel driver, there is a device */
+    if (errno == EBUSY) {
+
+        return 1;
+    }
+
+    return errno == ENXIO || errno == EREMOTEIO || errno == EIO || errno == ETIMEDOUT || errno == EAGAIN ? 0 : -1;
+}
+
+
+/* Scan one bus, thread entry */
+static void *i2c_scan_bus(void *arg)
+{
+    int ret;
+    unsigned int addr;
+    I2CScan *scan = arg;
+
+    for (addr = scan->first; addr <= scan->last; addr++) {
+
+        if ((ret = i2c_probe(scan->bus, addr)) == -1) {
+
+            scan->error = errno;
+            break;
+        }
+
+        scan->map[addr / 8] |= ret << (addr % 8);
+    }
+
+    return NULL;
+}
+
+
+/*
+**	@brief		:	Scan many buses concurrently, one thread per bus, each address probed by i2c_probe
+**	#scans		:	#scans[i].bus is i2c bus fd, result save to #scans[i].map, bit N set if address N ACK,
+**					#scans[i].error is errno if bus scan failed, addresses before failed one are valid
+**	#nbuses		:	number of #scans
+**	#first		:	first address to probe, 0 means I2C_SCAN_FIRST
+**	#last		:	last address to probe, 0 means I2C_SCAN_LAST
+**	@return		:	success return number of devices found, any bus failed return -1
+*/
+int i2c_scan(I2CScan *scans, unsigned int nbuses, unsigned int first, unsigned int last)
+{
+    unsigned int i, addr;
+    int found = 0, error = 0;
+    pthread_t *threads = NULL;
+    unsigned char *started = NULL;
+
+    first = first ? first : I2C_SCAN_FIRST;
+    last = last ? last : I2C_SCAN_LAST;
+
+    if (first > last || last > 0x7f) {
+
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (i = 0; i < nbuses; i++) {
+
+        memset(scans[i].map, 0, sizeof(scans[i].map));
+        scans[i].first = first;
+        scans[i].last = last;
+        scans[i].error = 0;
+    }
+
+    /* Each bus has it's own lock, probe them in parallel, thread can't create scan it on caller */
+    if (nbuses > 1 && (threads = calloc(nbuses, sizeof(pthread_t))) != NULL) {
+
+        started = calloc(nbuses, 1);
+    }
+
+    for (i = 0; i < nbuses; i++) {
+
+        if (!started || pthread_create(&threads[i], NULL, i2c_scan_bus, &scans[i]) != 0) {
+
+            i2c_scan_bus(&scans[i]);
+            continue;
+        }
+
+        started[i] = 1;
+    }
+
+    for (i = 0; i < nbuses; i++) {
+
+        if (started && started[i]) {
+
+            pthread_join(threads[i], NULL);
+        }
+
+        for (addr = first; addr <= last; addr++) {
+
+            found += I2C_SCAN_FOUND(&scans[i], addr);
+        }
+
+        error = scans[i].error ? scans[i].error : error;
+    }
+
+    free(started);
+    free(threads);
+
+    if (error) {
+
+        errno = error;
+        return -1;
+    }
+
+    return found;
+}
@@ -0,0 +1,682 @@
+#include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "i2c_bus.h"
+#include "i2c_smbus.h"
+
+/*
+**	Simulated i2c bus backend, bus name format:
+**
+**		sim:<type>@<addr>[:<option>=<value>...][,<type>@<addr>...]
+**
+**	type eeprom, 24Cxx EEPROM, options:
+**		size	:	capacity bytes(default 256), if larger than internal address space,
+**					high address bits are select by slave address like 24C04/08/16
+**		page	:	bytes per page(default 8), write wraparound at page boundary
+**		iaddr	:	internal address bytes(default 1, 2 if size > 2048)
+**		twr		:	write cycle time, unit microsecond(default 500), device NAK during write cycle
+**		latency	:	extra latency per message, unit microsecond(default 0)
+**
+**	type fram, FRAM/MRAM, same as eeprom without page and write cycle, options: size, iaddr, latency
+**
+**	type reg, simple register device, options: size(default 256), iaddr(default 1), latency,
+**		pec		:	1 SMBus PEC device, last byte of each read message is PEC,
+**					last byte of write message before stop is PEC, NAK if it mismatch
+**
+**	bus option smbus, adapter only support SMBus(ioctl I2C_SMBUS), I2C_RDWR and read/write not supported
+**	bus option partial, I2C_RDWR NAK after first message return number of completed messages instead of error
+**	bus option noquick, adapter can't send zero-length message, I2C_FUNC_SMBUS_QUICK cleared and zero-length message not supported
+**	bus option nonostart, adapter can't send message without start, I2C_FUNC_NOSTART cleared and I2C_M_NOSTART not supported
+**
+**	such as: sim:eeprom@0x50:size=512:page=16,reg@0x48, sim:smbus,reg@0x48:pec=1
+*/
+
+/* Max number of devices on a simulated bus */
+#define SIM_DEVICE_MAX 16
+
+/* Max block select bits of a simulated device */
+#define SIM_BLOCK_MAX 8
+
+/* Simulated bus functionality, SMBus only adapter and I2C adapter */
+#define SIM_SMBUS_FUNCS (I2C_FUNC_SMBUS_EMUL | I2C_FUNC_SMBUS_READ_BLOCK_DATA)
+#define SIM_FUNCS (I2C_FUNC_I2C | I2C_FUNC_10BIT_ADDR | I2C_FUNC_PROTOCOL_MANGLING | I2C_FUNC_NOSTART | SIM_SMBUS_FUNCS)
+
+enum sim_type {
+    SIM_EEPROM,
+    SIM_REG,
+};
+
+struct sim_device {
+    enum sim_type type;
+    unsigned short addr;            /* Base slave address */
+    unsigned int blocks;            /* Number of slave address occupied */
+    unsigned int size;              /* Capacity bytes */
+    unsigned int page;              /* Page bytes, 0 no page */
+    unsigned int iaddr_bytes;       /* Internal address bytes */
+    unsigned int twr;               /* Write cycle time, us */
+    unsigned int latency;           /* Latency per message, us */
+    unsigned int pec;               /* SMBus PEC device */
+    unsigned int ptr;               /* Current address pointer */
+    unsigned long long busy_until;  /* Write cycle end time, ns */
+    unsigned char *mem;
+};
+
+struct sim_bus {
+    pthread_mutex_t lock;
+    unsigned short slave;           /* Address selected by I2C_SLAVE */
+    unsigned int smbus;             /* SMBus only adapter */
+    unsigned int partial;           /* NAK return completed messages like some adapter drivers */
+    unsigned long hidden;           /* Functionality adapter don't have, I2C_FUNC_XXX */
+    unsigned int pec;               /* Set by I2C_PEC */
+    unsigned int ndevices;
+    struct sim_device devices[SIM_DEVICE_MAX];
+};
+
+/* Write message stream, NOSTART message continue previous one */
+struct sim_write {
+    struct sim_device *device;
+    unsigned int block;
+    unsigned int addr_got;          /* Internal address bytes received */
+    unsigned int addr;              /* Internal address received */
+    unsigned int count;             /* Data bytes received */
+};
+
+
+static unsigned long long sim_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void sim_sleep_us(unsigned int us)
+{
+    struct timespec ts;
+
+    if (us == 0) {
+
+        return;
+    }
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000L;
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+
+/* Find device ack #addr, #block return block select by slave address */
+static struct sim_device *sim_find(struct sim_bus *bus, unsigned short addr, unsigned int *block)
+{
+    unsigned int i;
+    struct sim_device *device;
+
+    for (i = 0; i < bus->ndevices; i++) {
+
+        device = &bus->devices[i];
+        if (addr >= device->addr && addr < device->addr + device->blocks) {
+
+            *block = addr - device->addr;
+            return device;
+        }
+    }
+
+    return NULL;
+}
+
+
+/* Internal address space of one block */
+static unsigned long long sim_block_span(const struct sim_device *device)
+{
+    return device->iaddr_bytes >= 4 ? 1ULL << 32 : 1ULL << (8 * device->iaddr_bytes);
+}
+
+
+static void sim_write_begin(struct sim_write *w, struct sim_device *device, unsigned int block)
+{
+    memset(w, 0, sizeof(*w));
+    w->device = device;
+    w->block = block;
+
+    /* Device without internal address write from current address */
+    if (device->iaddr_bytes == 0) {
+
+        w->addr = device->ptr;
+    }
+}
+
+
+static void sim_write_byte(struct sim_write *w, unsigned char byte)
+{
+    unsigned int addr, page;
+    struct sim_device *device = w->device;
+
+    /* Internal address phase */
+    if (w->addr_got < device->iaddr_bytes) {
+
+        w->addr = (w->addr << 8) | byte;
+        if (++w->addr_got == device->iaddr_bytes) {
+
+            w->addr = (unsigned int)((w->block * sim_block_span(device) + w->addr) % device->size);
+            device->ptr = w->addr;
+        }
+
+        return;
+    }
+
+    /* EEPROM data wraparound at page boundary, register device at device end */
+    if (device->page) {
+
+        page = w->addr - w->addr % device->page;
+        addr = page + (w->addr % device->page + w->count) % device->page;
+        device->ptr = page + (addr + 1 - page) % device->page;
+    }
+    else {
+
+        addr = (w->addr + w->count) % device->size;
+        device->ptr = (addr + 1) % device->size;
+    }
+
+    device->mem[addr] = byte;
+    w->count++;
+}
+
+
+/* Stop condition, EEPROM start write cycle if data received */
+static void sim_write_end(struct sim_write *w)
+{
+    if (w->device && w->count && w->device->twr) {
+
+        w->device->busy_until = sim_now_ns() + w->device->twr * 1000ULL;
+    }
+
+    w->device = NULL;
+}
+
+
+static void sim_read(struct sim_device *device, unsigned char *buf, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+
+        buf[i] = device->mem[device->ptr];
+        device->ptr = (device->ptr + 1) % device->size;
+    }
+}
+
+
+/* Transfer messages like i2c_transfer, bus must be locked */
+static int sim_transfer(struct sim_bus *bus, struct i2c_msg *msgs, unsigned int nmsgs)
+{
+    unsigned int i, j, len, block = 0;
+    struct sim_write w = {NULL, 0, 0, 0, 0};
+    struct sim_device *device = NULL;
+    unsigned long long now = sim_now_ns();
+    unsigned char addr8, crc = 0;
+
+    for (i = 0; i < nmsgs; i++) {
+
+        struct i2c_msg *msg = &msgs[i];
+
+        /* Start condition and address phase, NOSTART continue previous message */
+        if (i == 0 || !(msg->flags & I2C_M_NOSTART)) {
+
+            addr8 = (msg->addr << 1) | (msg->flags & I2C_M_RD ? 1 : 0);
+            crc = i2c_smbus_pec(crc, &addr8, 1);
+
+            sim_write_end(&w);
+            device = sim_find(bus, msg->addr, &block);
+
+            if (device == NULL || device->busy_until > now) {
+
+                if (!(msg->flags & I2C_M_IGNORE_NAK)) {
+
+                    if (bus->partial && i) {
+
+                        return i;
+                    }
+
+                    errno = ENXIO;
+                    return -1;
+                }
+
+                if (msg->flags & I2C_M_RD) {
+
+                    memset(msg->buf, 0xff, msg->len);
+                }
+
+                device = NULL;
+                continue;
+            }
+
+            sim_sleep_us(device->latency);
+
+            if (!(msg->flags & I2C_M_RD)) {
+
+                sim_write_begin(&w, device, block);
+            }
+        }
+
+        if (device == NULL) {
+
+            continue;
+        }
+
+        if (msg->flags & I2C_M_RD) {
+
+            /* SMBus block read, first byte is block length, buf[0] is extra bytes besides block data */
+            if (msg->flags & I2C_M_RECV_LEN) {
+
+                j = device->mem[device->ptr];
+                if (j == 0 || j > I2C_SMBUS_BLOCK_MAX) {
+
+                    errno = EPROTO;
+                    return -1;
+                }
+
+                msg->len = msg->buf[0] + j;
+            }
+
+            /* Last byte is PEC of whole transaction */
+            len = device->pec && msg->len ? msg->len - 1 : msg->len;
+            sim_read(device, msg->buf, len);
+            crc = i2c_smbus_pec(crc, msg->buf, len);
+
+            if (len != msg->len) {
+
+                msg->buf[len] = crc;
+            }
+
+            continue;
+        }
+
+        /* PEC device check PEC before stop, NAK it if mismatch */
+        len = msg->len;
+        if (device->pec && i == nmsgs - 1 && len) {
+
+            len--;
+            if (i2c_smbus_pec(crc, msg->buf, len) != msg->buf[len]) {
+
+                errno = EIO;
+                return -1;
+            }
+        }
+
+        crc = i2c_smbus_pec(crc, msg->buf, len);
+
+        /* NOSTART write after read start a new write stream */
+        if (w.device == NULL) {
+
+            sim_write_begin(&w, device, block);
+        }
+
+        for (j = 0; j < len; j++) {
+
+            sim_write_byte(&w, msg->buf[j]);
+        }
+    }
+
+    sim_write_end(&w);
+    return nmsgs;
+}
+
+
+static ssize_t sim_rw(struct sim_bus *bus, void *buf, size_t len, unsigned short flags)
+{
+    struct i2c_msg msg;
+
+    /* Same as i2c-dev */
+    if (len > 8192) {
+
+        len = 8192;
+    }
+
+    if (bus->smbus || (len == 0 && (bus->hidden & I2C_FUNC_SMBUS_QUICK))) {
+
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    msg.addr = bus->slave;
+    msg.flags = flags;
+    msg.len = len;
+    msg.buf = buf;
+
+    pthread_mutex_lock(&bus->lock);
+    if (sim_transfer(bus, &msg, 1) == -1) {
+
+        pthread_mutex_unlock(&bus->lock);
+        return -1;
+    }
+
+    pthread_mutex_unlock(&bus->lock);
+    return len;
+}
+
+
+static ssize_t sim_read_bus(void *priv, void *buf, size_t len)
+{
+    return sim_rw(priv, buf, len, I2C_M_RD);
+}
+
+
+static ssize_t sim_write_bus(void *priv, const void *buf, size_t len)
+{
+    return sim_rw(priv, (void *)buf, len, 0);
+}
+
+
+/* Same as i2c-dev I2C_RDWR, bus must be locked */
+static int sim_rdwr(void *priv, struct i2c_msg *msgs, unsigned int nmsgs)
+{
+    unsigned int i;
+    struct sim_bus *bus = priv;
+
+    if (nmsgs > I2C_RDWR_IOCTL_MAX_MSGS) {
+
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (i = 0; i < nmsgs; i++) {
+
+        if (msgs[i].len > 8192) {
+
+            errno = EINVAL;
+            return -1;
+        }
+
+        if (msgs[i].len == 0 && (bus->hidden & I2C_FUNC_SMBUS_QUICK)) {
+
+            errno = EOPNOTSUPP;
+            return -1;
+        }
+
+        if ((msgs[i].flags & I2C_M_NOSTART) && (bus->hidden & I2C_FUNC_NOSTART)) {
+
+            errno = EOPNOTSUPP;
+            return -1;
+        }
+
+        /* buf[0] is extra bytes besides block data, buffer must large enough for max block */
+        if (msgs[i].flags & I2C_M_RECV_LEN) {
+
+            if (!(msgs[i].flags & I2C_M_RD) || msgs[i].len < 1 || msgs[i].buf[0] < 1 ||
+                    msgs[i].len < msgs[i].buf[0] + I2C_SMBUS_BLOCK_MAX) {
+
+                errno = EINVAL;
+                return -1;
+            }
+
+            msgs[i].len = msgs[i].buf[0];
+        }
+    }
+
+    return sim_transfer(bus, msgs, nmsgs);
+}
+
+
+static int sim_ioctl(void *priv, unsigned long request, unsigned long arg)
+{
+    int ret;
+    struct sim_bus *bus = priv;
+    struct i2c_rdwr_ioctl_data *rdwr;
+    struct i2c_smbus_ioctl_data *smbus;
+
+    switch (request) {
+
+        case I2C_SLAVE:
+        case I2C_SLAVE_FORCE:
+            if (arg > 0x3ff) {
+
+                errno = EINVAL;
+                return -1;
+            }
+
+            bus->slave = arg;
+            return 0;
+
+        case I2C_TENBIT:
+        case I2C_RETRIES:
+        case I2C_TIMEOUT:
+            return 0;
+
+        case I2C_PEC:
+            bus->pec = arg ? 1 : 0;
+            return 0;
+
+        case I2C_FUNCS:
+            *(unsigned long *)arg = (bus->smbus ? SIM_SMBUS_FUNCS : SIM_FUNCS) & ~bus->hidden;
+            return 0;
+
+        case I2C_RDWR:
+            if (bus->smbus) {
+
+                errno = EOPNOTSUPP;
+                return -1;
+            }
+
+            rdwr = (struct i2c_rdwr_ioctl_data *)arg;
+            pthread_mutex_lock(&bus->lock);
+            ret = sim_rdwr(bus, rdwr->msgs, rdwr->nmsgs);
+            pthread_mutex_unlock(&bus->lock);
+            return ret;
+
+        /* Kernel emulate SMBus with i2c messages if adapter don't speak it */
+        case I2C_SMBUS:
+            smbus = (struct i2c_smbus_ioctl_data *)arg;
+            pthread_mutex_lock(&bus->lock);
+            ret = i2c_smbus_emulate(bus->slave, 0, bus->pec, smbus->read_write, smbus->command,
+                                    smbus->size, smbus->data, sim_rdwr, bus);
+            pthread_mutex_unlock(&bus->lock);
+            return ret;
+
+        default:
+            errno = ENOTTY;
+            return -1;
+    }
+}
+
+
+/* Parse <type>@<addr>[:<option>=<value>...] */
+static int sim_parse_device(struct sim_device *device, char *desc)
+{
+    char *save = NULL, *end = NULL;
+    char *option, *value;
+    char *type = strtok_r(desc, "@", &save);
+    char *addr = strtok_r(NULL, ":", &save);
+    unsigned long long span;
+
+    memset(device, 0, sizeof(*device));
+
+    if (type == NULL || addr == NULL) {
+
+        return -1;
+    }
+
+    if (strcmp(type, "eeprom") == 0) {
+
+        device->type = SIM_EEPROM;
+        device->page = 8;
+        device->twr = 500;
+    }
+    else if (strcmp(type, "fram") == 0) {
+
+        device->type = SIM_EEPROM;
+    }
+    else if (strcmp(type, "reg") == 0) {
+
+        device->type = SIM_REG;
+    }
+    else {
+
+        return -1;
+    }
+
+    device->addr = strtoul(addr, &end, 0);
+    if (*end || device->addr > 0x3ff) {
+
+        return -1;
+    }
+
+    device->size = 256;
+    device->iaddr_bytes = (unsigned int) -1;
+
+    while ((option = strtok_r(NULL, ":", &save)) != NULL) {
+
+        unsigned long number;
+
+        if ((value = strchr(option, '=')) == NULL) {
+
+            return -1;
+        }
+
+        *value++ = 0;
+        number = strtoul(value, &end, 0);
+        if (*end) {
+
+            return -1;
+        }
+
+        if (strcmp(option, "size") == 0) {
+
+            device->size = number;
+        }
+        else if (strcmp(option, "page") == 0 && device->type == SIM_EEPROM) {
+
+            device->page = number;
+        }
+        else if (strcmp(option, "iaddr") == 0) {
+
+            device->iaddr_bytes = number;
+        }
+        else if (strcmp(option, "twr") == 0 && device->type == SIM_EEPROM) {
+
+            device->twr = number;
+        }
+        else if (strcmp(option, "latency") == 0) {
+
+            device->latency = number;
+        }
+        else if (strcmp(option, "pec") == 0 && device->type == SIM_REG) {
+
+            device->pec = number ? 1 : 0;
+        }
+        else {
+
+            return -1;
+        }
+    }
+
+    if (device->iaddr_bytes == (unsigned int) -1) {
+
+        device->iaddr_bytes = device->type == SIM_EEPROM && device->size > 2048 ? 2 : 1;
+    }
+
+    if (device->size == 0 || device->iaddr_bytes > 4 || (device->page && device->size % device->page)) {
+
+        return -1;
+    }
+
+    /* High address bits select by slave address */
+    span = sim_block_span(device);
+    device->blocks = device->iaddr_bytes ? (device->size + span - 1) / span : 1;
+    if (device->blocks > (1 << SIM_BLOCK_MAX) || device->addr + device->blocks > 0x400) {
+
+        return -1;
+    }
+
+    if ((device->mem = malloc(device->size)) == NULL) {
+
+        return -1;
+    }
+
+    memset(device->mem, device->type == SIM_EEPROM ? 0xff : 0x00, device->size);
+    return 0;
+}
+
+
+static void sim_close(void *priv)
+{
+    unsigned int i;
+    struct sim_bus *bus = priv;
+
+    for (i = 0; i < bus->ndevices; i++) {
+
+        free(bus->devices[i].mem);
+    }
+
+    pthread_mutex_destroy(&bus->lock);
+    free(bus);
+}
+
+
+static void *sim_open(const char *spec)
+{
+    char *desc, *save = NULL;
+    char *copy = strdup(spec);
+    struct sim_bus *bus = calloc(1, sizeof(*bus));
+
+    if (copy == NULL || bus == NULL) {
+
+        free(copy);
+        free(bus);
+        return NULL;
+    }
+
+    pthread_mutex_init(&bus->lock, NULL);
+
+    for (desc = strtok_r(copy, ",", &save); desc; desc = strtok_r(NULL, ",", &save)) {
+
+        /* Bus option */
+        if (strcmp(desc, "smbus") == 0) {
+
+            bus->smbus = 1;
+            continue;
+        }
+
+        if (strcmp(desc, "partial") == 0) {
+
+            bus->partial = 1;
+            continue;
+        }
+
+        if (strcmp(desc, "noquick") == 0) {
+
+            bus->hidden |= I2C_FUNC_SMBUS_QUICK;
+            continue;
+        }
+
+        if (strcmp(desc, "nonostart") == 0) {
+
+            bus->hidden |= I2C_FUNC_NOSTART;
+            continue;
+        }
+
+        if (bus->ndevices >= SIM_DEVICE_MAX || sim_parse_device(&bus->devices[bus->ndevices], desc) == -1) {
+
+            free(copy);
+            sim_close(bus);
+            errno = EINVAL;
+            return NULL;
+        }
+
+        bus->ndevices++;
+    }
+
+    free(copy);
+    return bus;
+}
+
+
+const I2CBackend i2c_sim_backend = {
+    "sim:",
+    sim_open,
+    sim_close,
+    sim_read_bus,
+    sim_write_bus,
+    sim_ioctl,
+};
@@ -0,0 +1,506 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "i2c/i2c.h"
+#include "i2c_bus.h"
+#include "i2c_smbus.h"
+#include "i2c_trace.h"
+
+/* SMBus PEC byte of 7 bit address and R/W bit */
+#define I2C_SMBUS_ADDR8(msg) ((unsigned char)(((msg)->addr << 1) | ((msg)->flags & I2C_M_RD ? 1 : 0)))
+
+/* CRC-8 polynomial x^8 + x^2 + x + 1, MSB first, one lookup per byte */
+static const unsigned char i2c_smbus_crc8[256] = {
+    0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15, 0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d,
+    0x70, 0x77, 0x7e, 0x79, 0x6c, 0x6b, 0x62, 0x65, 0x48, 0x4f, 0x46, 0x41, 0x54, 0x53, 0x5a, 0x5d,
+    0xe0, 0xe7, 0xee, 0xe9, 0xfc, 0xfb, 0xf2, 0xf5, 0xd8, 0xdf, 0xd6, 0xd1, 0xc4, 0xc3, 0xca, 0xcd,
+    0x90, 0x97, 0x9e, 0x99, 0x8c, 0x8b, 0x82, 0x85, 0xa8, 0xaf, 0xa6, 0xa1, 0xb4, 0xb3, 0xba, 0xbd,
+    0xc7, 0xc0, 0xc9, 0xce, 0xdb, 0xdc, 0xd5, 0xd2, 0xff, 0xf8, 0xf1, 0xf6, 0xe3, 0xe4, 0xed, 0xea,
+    0xb7, 0xb0, 0xb9, 0xbe, 0xab, 0xac, 0xa5, 0xa2, 0x8f, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9d, 0x9a,
+    0x27, 0x20, 0x29, 0x2e, 0x3b, 0x3c, 0x35, 0x32, 0x1f, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0d, 0x0a,
+    0x57, 0x50, 0x59, 0x5e, 0x4b, 0x4c, 0x45, 0x42, 0x6f, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7d, 0x7a,
+    0x89, 0x8e, 0x87, 0x80, 0x95, 0x92, 0x9b, 0x9c, 0xb1, 0xb6, 0xbf, 0xb8, 0xad, 0xaa, 0xa3, 0xa4,
+    0xf9, 0xfe, 0xf7, 0xf0, 0xe5, 0xe2, 0xeb, 0xec, 0xc1, 0xc6, 0xcf, 0xc8, 0xdd, 0xda, 0xd3, 0xd4,
+    0x69, 0x6e, 0x67, 0x60, 0x75, 0x72, 0x7b, 0x7c, 0x51, 0x56, 0x5f, 0x58, 0x4d, 0x4a, 0x43, 0x44,
+    0x19, 0x1e, 0x17, 0x10, 0x05, 0x02, 0x0b, 0x0c, 0x21, 0x26, 0x2f, 0x28, 0x3d, 0x3a, 0x33, 0x34,
+    0x4e, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5c, 0x5b, 0x76, 0x71, 0x78, 0x7f, 0x6a, 0x6d, 0x64, 0x63,
+    0x3e, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2c, 0x2b, 0x06, 0x01, 0x08, 0x0f, 0x1a, 0x1d, 0x14, 0x13,
+    0xae, 0xa9, 0xa0, 0xa7, 0xb2, 0xb5, 0xbc, 0xbb, 0x96, 0x91, 0x98, 0x9f, 0x8a, 0x8d, 0x84, 0x83,
+    0xde, 0xd9, 0xd0, 0xd7, 0xc2, 0xc5, 0xcc, 0xcb, 0xe6, 0xe1, 0xe8, 0xef, 0xfa, 0xfd, 0xf4, 0xf3,
+};
+
+
+/*
+**	@brief		:	Calculate SMBus packet error checking(CRC-8)
+**	#crc		:	previous crc, start with 0
+**	#buf		:	data
+**	#len		:	#buf length
+**	@return		:	crc of previous data and #buf
+*/
+unsigned char i2c_smbus_pec(unsigned char crc, const void *buf, size_t len)
+{
+    const unsigned char *data = buf;
+
+    while (len--) {
+
+        crc = i2c_smbus_crc8[crc ^ *data++];
+    }
+
+    return crc;
+}
+
+
+/* PEC of a message with it's address byte */
+static unsigned char i2c_smbus_msg_pec(unsigned char crc, const struct i2c_msg *msg, size_t len)
+{
+    unsigned char addr = I2C_SMBUS_ADDR8(msg);
+
+    crc = i2c_smbus_pec(crc, &addr, 1);
+    return i2c_smbus_pec(crc, msg->buf, len);
+}
+
+
+/*
+**	@brief		:	Emulate SMBus protocol with i2c messages
+**	#addr		:	slave address
+**	#flags		:	i2c_msg flags, such as I2C_M_TEN
+**	#pec		:	append PEC to write, check PEC of read
+**	#read_write	:	I2C_SMBUS_READ or I2C_SMBUS_WRITE
+**	#command	:	SMBus command(register)
+**	#size		:	I2C_SMBUS_QUICK/BYTE/BYTE_DATA/WORD_DATA/PROC_CALL/BLOCK_DATA/I2C_BLOCK_DATA
+**	#data		:	SMBus data, same as ioctl(I2C_SMBUS)
+**	#xfer		:	transfer messages
+**	@return		:	success return 0, failed return -1, PEC error errno is EBADMSG
+*/
+int i2c_smbus_emulate(unsigned short addr, unsigned short flags, int pec, char read_write,
+                      unsigned char command, int size, union i2c_smbus_data *data, I2C_SMBUS_XFER xfer, void *ctx)
+{
+    unsigned int i, len, nmsgs = read_write == I2C_SMBUS_READ ? 2 : 1;
+    unsigned char partial = 0, buf0[I2C_SMBUS_BLOCK_MAX + 3], buf1[I2C_SMBUS_BLOCK_MAX + 3];
+    struct i2c_msg *last, msgs[2] = {
+        {addr, flags, 1, buf0},
+        {addr, flags | I2C_M_RD, 0, buf1},
+    };
+
+    buf0[0] = command;
+
+    switch (size) {
+
+        case I2C_SMBUS_QUICK:
+            msgs[0].len = 0;
+            msgs[0].flags = flags | (read_write == I2C_SMBUS_READ ? I2C_M_RD : 0);
+            nmsgs = 1;
+            pec = 0;
+            break;
+
+        case I2C_SMBUS_BYTE:
+            /* Read byte without command, write byte send command as data */
+            if (read_write == I2C_SMBUS_READ) {
+
+                msgs[0].flags = flags | I2C_M_RD;
+                nmsgs = 1;
+            }
+            break;
+
+        case I2C_SMBUS_BYTE_DATA:
+            if (read_write == I2C_SMBUS_READ) {
+
+                msgs[1].len = 1;
+            }
+            else {
+
+                msgs[0].len = 2;
+                buf0[1] = data->byte;
+            }
+            break;
+
+        case I2C_SMBUS_WORD_DATA:
+        case I2C_SMBUS_PROC_CALL:
+            if (size == I2C_SMBUS_PROC_CALL || read_write == I2C_SMBUS_WRITE) {
+
+                msgs[0].len = 3;
+                buf0[1] = data->word & 0xff;
+                buf0[2] = data->word >> 8;
+            }
+
+            if (size == I2C_SMBUS_PROC_CALL || read_write == I2C_SMBUS_READ) {
+
+                msgs[1].len = 2;
+                read_write = I2C_SMBUS_READ;
+                nmsgs = 2;
+            }
+            break;
+
+        case I2C_SMBUS_BLOCK_DATA:
+            if (read_write == I2C_SMBUS_READ) {
+
+                /* Same as i2c-dev I2C_M_RECV_LEN, buf[0] is extra bytes besides block data */
+                msgs[1].flags |= I2C_M_RECV_LEN;
+                msgs[1].len = 1 + (pec ? 1 : 0) + I2C_SMBUS_BLOCK_MAX;
+                buf1[0] = 1 + (pec ? 1 : 0);
+                pec = pec ? -1 : 0;
+            }
+            else {
+
+                if (data->block[0] == 0 || data->block[0] > I2C_SMBUS_BLOCK_MAX) {
+
+                    errno = EINVAL;
+                    return -1;
+                }
+
+                msgs[0].len = data->block[0] + 2;
+                memcpy(buf0 + 1, data->block, data->block[0] + 1);
+            }
+            break;
+
+        case I2C_SMBUS_I2C_BLOCK_DATA:
+            if (data->block[0] == 0 || data->block[0] > I2C_SMBUS_BLOCK_MAX) {
+
+                errno = EINVAL;
+                return -1;
+            }
+
+            if (read_write == I2C_SMBUS_READ) {
+
+                msgs[1].len = data->block[0];
+            }
+            else {
+
+                msgs[0].len = data->block[0] + 1;
+                memcpy(buf0 + 1, data->block + 1, data->block[0]);
+            }
+            break;
+
+        default:
+            errno = EOPNOTSUPP;
+            return -1;
+    }
+
+    last = &msgs[nmsgs - 1];
+
+    if (pec) {
+
+        /* Write only append PEC, otherwise write part is the beginning of read PEC */
+        if (!(msgs[0].flags & I2C_M_RD)) {
+
+            if (nmsgs == 1) {
+
+                buf0[msgs[0].len] = i2c_smbus_msg_pec(0, &msgs[0], msgs[0].len);
+                msgs[0].len++;
+            }
+            else {
+
+                partial = i2c_smbus_msg_pec(0, &msgs[0], msgs[0].len);
+            }
+        }
+
+        /* Read one more PEC byte, I2C_M_RECV_LEN already count it */
+        if ((last->flags & I2C_M_RD) && pec > 0) {
+
+            last->len++;
+        }
+    }
+
+    if (xfer(ctx, msgs, nmsgs) != (int)nmsgs) {
+
+        return -1;
+    }
+
+    /* Block length received as first byte, i2c-dev won't return updated message length */
+    len = last->len;
+    if (last->flags & I2C_M_RECV_LEN) {
+
+        if (buf1[0] == 0 || buf1[0] > I2C_SMBUS_BLOCK_MAX) {
+
+            errno = EPROTO;
+            return -1;
+        }
+
+        len = 1 + buf1[0] + (pec ? 1 : 0);
+    }
+
+    /* Check read PEC */
+    if (pec && (last->flags & I2C_M_RD)) {
+
+        if (i2c_smbus_msg_pec(partial, last, len - 1) != last->buf[len - 1]) {
+
+            errno = EBADMSG;
+            return -1;
+        }
+    }
+
+    if (read_write == I2C_SMBUS_WRITE) {
+
+        return 0;
+    }
+
+    switch (size) {
+
+        case I2C_SMBUS_BYTE:
+            data->byte = buf0[0];
+            break;
+
+        case I2C_SMBUS_BYTE_DATA:
+            data->byte = buf1[0];
+            break;
+
+        case I2C_SMBUS_WORD_DATA:
+        case I2C_SMBUS_PROC_CALL:
+            data->word = buf1[0] | (buf1[1] << 8);
+            break;
+
+        case I2C_SMBUS_BLOCK_DATA:
+            memcpy(data->block, buf1, buf1[0] + 1);
+            break;
+
+        case I2C_SMBUS_I2C_BLOCK_DATA:
+            for (i = 0; i < data->block[0]; i++) {
+
+                data->block[i + 1] = buf1[i];
+            }
+            break;
+    }
+
+    return 0;
+}
+
+
+static int i2c_smbus_rdwr(void *ctx, struct i2c_msg *msgs, unsigned int nmsgs)
+{
+    struct i2c_rdwr_ioctl_data ioctl_data;
+
+    ioctl_data.msgs = msgs;
+    ioctl_data.nmsgs = nmsgs;
+
+    return i2c_bus_ioctl(*(int *)ctx, I2C_RDWR, (unsigned long)&ioctl_data);
+}
+
+
+/* Adapter only speak SMBus, let kernel or adapter do it, bus must be locked */
+static int i2c_smbus_ioctl(const I2CDevice *device, char read_write, unsigned char command, int size, union i2c_smbus_data *data)
+{
+    int pec = -1;
+    struct i2c_smbus_ioctl_data ioctl_data;
+    struct i2c_bus *i2c_bus = i2c_bus_get(device->bus);
+
+    if (i2c_bus) {
+
+        pec = i2c_bus->pec;
+        i2c_bus_put(i2c_bus);
+    }
+
+    if (i2c_select(device->bus, device->addr, device->tenbit) == -1) {
+
+        return -1;
+    }
+
+    if (pec != device->pec) {
+
+        if (i2c_bus_ioctl(device->bus, I2C_PEC, device->pec ? 1 : 0) == -1) {
+
+            return -1;
+        }
+
+        /* Bus is locked, caller lock hold it */
+        if (i2c_bus) {
+
+            i2c_bus->pec = device->pec;
+        }
+    }
+
+    ioctl_data.read_write = read_write;
+    ioctl_data.command = command;
+    ioctl_data.size = size;
+    ioctl_data.data = data;
+
+    return i2c_bus_ioctl(device->bus, I2C_SMBUS, (unsigned long)&ioctl_data) == -1 ? -1 : 0;
+}
+
+
+/*
+**	@brief		:	SMBus transfer, adapter support I2C using I2C_RDWR and PEC calculated by libi2c, otherwise ioctl(I2C_SMBUS)
+**	#device		:	I2CDevice struct, #device->pec enable packet error checking
+**	#read_write	:	I2C_SMBUS_READ or I2C_SMBUS_WRITE
+**	#command	:	SMBus command(register)
+**	#size		:	I2C_SMBUS_QUICK/BYTE/BYTE_DATA/WORD_DATA/PROC_CALL/BLOCK_DATA/I2C_BLOCK_DATA
+**	#data		:	SMBus data, block[0] is block length
+**	@return		:	success return 0, failed return -1, PEC error errno is EBADMSG
+*/
+int i2c_smbus_access(const I2CDevice *device, char read_write, unsigned char command, int size, union i2c_smbus_data *data)
+{
+    int ret;
+    int bus = device->bus;
+    unsigned long funcs = 0;
+
+    if (i2c_bus_funcs(bus, &funcs) == -1) {
+
+        return -1;
+    }
+
+    /* Block read need adapter support I2C_M_RECV_LEN */
+    if (size == I2C_SMBUS_BLOCK_DATA && read_write == I2C_SMBUS_READ && !(funcs & I2C_FUNC_SMBUS_READ_BLOCK_DATA)) {
+
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    if (i2c_lock(bus) == -1) {
+
+        return -1;
+    }
+
+    if (funcs & I2C_FUNC_I2C) {
+
+        /* Trace record command as internal address of emulated transfer */
+        if (size != I2C_SMBUS_QUICK && size != I2C_SMBUS_BYTE) {
+
+            I2C_TRACE_IADDR(command);
+        }
+
+        ret = i2c_smbus_emulate(device->addr, device->tenbit ? I2C_M_TEN : 0, device->pec,
+                                read_write, command, size, data, i2c_smbus_rdwr, &bus);
+    }
+    else {
+
+        ret = i2c_smbus_ioctl(device, read_write, command, size, data);
+    }
+
+    i2c_unlock(bus);
+    return ret;
+}
+
+
+int i2c_smbus_write_quick(const I2CDevice *device, unsigned char value)
+{
+    return i2c_smbus_access(device, value, 0, I2C_SMBUS_QUICK, NULL);
+}
+
+
+int i2c_smbus_read_byte(const I2CDevice *device)
+{
+    union i2c_smbus_data data;
+    return i2c_smbus_access(device, I2C_SMBUS_READ, 0, I2C_SMBUS_BYTE, &data) == -1 ? -1 : data.byte;
+}
+
+
+int i2c_smbus_write_byte(const I2CDevice *device, unsigned char value)
+{
+    return i2c_smbus_access(device, I2C_SMBUS_WRITE, value, I2C_SMBUS_BYTE, NULL);
+}
+
+
+int i2c_smbus_read_byte_data(const I2CDevice *device, unsigned char command)
+{
+    union i2c_smbus_data data;
+    return i2c_smbus_access(device, I2C_SMBUS_READ, command, I2C_SMBUS_BYTE_DATA, &data) == -1 ? -1 : data.byte;
+}
+
+
+int i2c_smbus_write_byte_data(const I2CDevice *device, unsigned char command, unsigned char value)
+{
+    union i2c_smbus_data data;
+
+    data.byte = value;
+    return i2c_smbus_access(device, I2C_SMBUS_WRITE, command, I2C_SMBUS_BYTE_DATA, &data);
+}
+
+
+int i2c_smbus_read_word_data(const I2CDevice *device, unsigned char command)
+{
+    union i2c_smbus_data data;
+    return i2c_smbus_access(device, I2C_SMBUS_READ, command, I2C_SMBUS_WORD_DATA, &data) == -1 ? -1 : data.word;
+}
+
+
+int i2c_smbus_write_word_data(const I2CDevice *device, unsigned char command, unsigned short value)
+{
+    union i2c_smbus_data data;
+
+    data.word = value;
+    return i2c_smbus_access(device, I2C_SMBUS_WRITE, command, I2C_SMBUS_WORD_DATA, &data);
+}
+
+
+int i2c_smbus_process_call(const I2CDevice *device, unsigned char command, unsigned short value)
+{
+    union i2c_smbus_data data;
+
+    data.word = value;
+    return i2c_smbus_access(device, I2C_SMBUS_WRITE, command, I2C_SMBUS_PROC_CALL, &data) == -1 ? -1 : data.word;
+}
+
+
+/*
+**	@brief		:	SMBus block read
+**	#values		:	at least I2C_SMBUS_BLOCK_MAX bytes
+**	@return		:	success return block length, failed return -1
+*/
+int i2c_smbus_read_block_data(const I2CDevice *device, unsigned char command, unsigned char *values)
+{
+    union i2c_smbus_data data;
+
+    if (i2c_smbus_access(device, I2C_SMBUS_READ, command, I2C_SMBUS_BLOCK_DATA, &data) == -1) {
+
+        return -1;
+    }
+
+    memcpy(values, data.block + 1, data.block[0]);
+    return data.block[0];
+}
+
+
+int i2c_smbus_write_block_data(const I2CDevice *device, unsigned char command, unsigned char length, const unsigned char *values)
+{
+    union i2c_smbus_data data;
+
+    if (length == 0 || length > I2C_SMBUS_BLOCK_MAX) {
+
+        errno = EINVAL;
+        return -1;
+    }
+
+    data.block[0] = length;
+    memcpy(data.block + 1, values, length);
+    return i2c_smbus_access(device, I2C_SMBUS_WRITE, command, I2C_SMBUS_BLOCK_DATA, &data);
+}
+
+
+/*
+**	@brief		:	I2C block read, #length bytes from #command without block length byte
+**	@return		:	success return #length, failed return -1
+*/
+int i2c_smbus_read_i2c_block_data(const I2CDevice *device, unsigned char command, unsigned char length, unsigned char *values)
+{
+    union i2c_smbus_data data;
+
+    if (length == 0 || length > I2C_SMBUS_BLOCK_MAX) {
+
+        errno = EINVAL;
+        return -1;
+    }
+
+    data.block[0] = length;
+    if (i2c_smbus_access(device, I2C_SMBUS_READ, command, I2C_SMBUS_I2C_BLOCK_DATA, &data) == -1) {
+
+        return -1;
+    }
+
+    memcpy(values, data.block + 1, data.block[0]);
+    return data.block[0];
+}
+
+
+int i2c_smbus_write_i2c_block_data(const I2CDevice *device, unsigned char command, unsigned char length, const unsigned char *values)
+{
+    union i2c_smbus_data data;
+
+    if (length == 0 || length > I2C_SMBUS_BLOCK_MAX) {
+
+        errno = EINVAL;
+        return -1;
+    }
+
+    data.block[0] = length;
+    memcpy(data.block + 1, values, length);
+    return i2c_smbus_access(device, I2C_SMBUS_WRITE, command, I2C_SMBUS_I2C_BLOCK_DATA, &data);
+}
@@ -0,0 +1,13 @@
+#ifndef _LIB_I2C_SMBUS_H_
+#define _LIB_I2C_SMBUS_H_
+
+#include "i2c/i2c.h"
+
+/* Transfer SMBus emulated messages, same as ioctl(I2C_RDWR), success return number of messages */
+typedef int (*I2C_SMBUS_XFER)(void *ctx, struct i2c_msg *msgs, unsigned int nmsgs);
+
+/* Emulate SMBus protocol with i2c messages like kernel i2c_smbus_xfer_emulated, #pec append or check PEC */
+int i2c_smbus_emulate(unsigned short addr, unsigned short flags, int pec, char read_write,
+                      unsigned char command, int size, union i2c_smbus_data *data, I2C_SMBUS_XFER xfer, void *ctx);
+
+#endif
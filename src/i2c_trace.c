@@ -0,0 +1,175 @@
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include "i2c_ring.h"
+#include "i2c_trace.h"
+
+/* I2C trace default ring depth */
+#define I2C_TRACE_DEFAULT_DEPTH 4096
+
+_Atomic int i2c_trace_on;
+_Thread_local unsigned int i2c_trace_iaddr = I2C_TRACE_NO_IADDR;
+
+/*
+**  Process wide trace ring, every thread transfer on any bus push to it.
+**  Ring is never freed, transfer thread may still pushing after trace stopped.
+*/
+static struct i2c_ring i2c_trace_ring;
+static _Atomic int i2c_trace_allocated;
+static pthread_mutex_t i2c_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+**  Hook only change when trace is off and no producer is in i2c_trace_record.
+**  Producer count is raised before producer check #i2c_trace_on(both seq_cst),
+**  so stop either see the producer and wait it, or the producer see trace is off and never touch the hook.
+*/
+static I2C_TRACE_HOOK i2c_trace_hook;
+static void *i2c_trace_hook_ctx;
+static unsigned int i2c_trace_watermark;
+static _Atomic unsigned int i2c_trace_producers;
+
+static _Atomic unsigned long long i2c_trace_seq;
+static _Atomic unsigned long long i2c_trace_drops;
+
+
+/*
+**	@brief		:	Start recording transfers of all buses
+**	#depth		:	ring depth, 0 using default 4096, only first start allocate ring, later start ignore it
+**	@return		:	success return 0, failed return -1
+*/
+int i2c_trace_start(unsigned int depth)
+{
+    pthread_mutex_lock(&i2c_trace_lock);
+
+    if (!atomic_load_explicit(&i2c_trace_allocated, memory_order_relaxed)) {
+
+        if (i2c_ring_init(&i2c_trace_ring, depth ? depth : I2C_TRACE_DEFAULT_DEPTH, sizeof(I2CTrace)) == -1) {
+
+            pthread_mutex_unlock(&i2c_trace_lock);
+            return -1;
+        }
+
+        atomic_store_explicit(&i2c_trace_allocated, 1, memory_order_release);
+    }
+
+    atomic_store_explicit(&i2c_trace_on, 1, memory_order_release);
+    pthread_mutex_unlock(&i2c_trace_lock);
+    return 0;
+}
+
+
+/*
+**	@brief		:	Stop recording, records in ring still can be read, return after in-flight records of other threads done,
+**					must not be called from trace hook
+*/
+void i2c_trace_stop(void)
+{
+    pthread_mutex_lock(&i2c_trace_lock);
+    atomic_store(&i2c_trace_on, 0);
+
+    while (atomic_load(&i2c_trace_producers)) {
+
+        sched_yield();
+    }
+
+    pthread_mutex_unlock(&i2c_trace_lock);
+}
+
+
+/*
+**	@brief		:	Pop oldest records out of ring
+**	#traces		:	records save to here
+**	#max		:	max number of #traces
+**	@return		:	number of records
+*/
+int i2c_trace_read(I2CTrace *traces, unsigned int max)
+{
+    unsigned int count = 0;
+
+    if (!atomic_load_explicit(&i2c_trace_allocated, memory_order_acquire)) {
+
+        return 0;
+    }
+
+    while (count < max && i2c_ring_pop(&i2c_trace_ring, &traces[count]) == 0) {
+
+        count++;
+    }
+
+    return count;
+}
+
+
+/*
+**	@brief		:	Set hook drain records into application telemetry
+**	#hook		:	called by transfer thread after every #watermark records pushed, NULL remove hook,
+**					it run with bus locked, must not block, transfer on same bus or stop trace
+**	#ctx		:	hook context
+**	#watermark	:	records between hook calls
+**	@return		:	success return 0, trace is recording return -1 errno is EBUSY
+*/
+int i2c_trace_set_hook(I2C_TRACE_HOOK hook, void *ctx, unsigned int watermark)
+{
+    if (hook && watermark == 0) {
+
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&i2c_trace_lock);
+
+    if (atomic_load_explicit(&i2c_trace_on, memory_order_relaxed)) {
+
+        pthread_mutex_unlock(&i2c_trace_lock);
+        errno = EBUSY;
+        return -1;
+    }
+
+    i2c_trace_hook = hook;
+    i2c_trace_hook_ctx = ctx;
+    i2c_trace_watermark = watermark;
+    pthread_mutex_unlock(&i2c_trace_lock);
+    return 0;
+}
+
+
+/*
+**	@brief		:	Get number of records dropped because ring is full
+**	@return		:	dropped records
+*/
+unsigned long long i2c_trace_dropped(void)
+{
+    return atomic_load_explicit(&i2c_trace_drops, memory_order_relaxed);
+}
+
+
+void i2c_trace_record(I2CTrace *trace)
+{
+    if (trace->iaddr == I2C_TRACE_NO_IADDR) {
+
+        trace->iaddr = i2c_trace_iaddr;
+    }
+
+    i2c_trace_iaddr = I2C_TRACE_NO_IADDR;
+
+    /* Stopped after caller checked it, hook may be changing */
+    atomic_fetch_add(&i2c_trace_producers, 1);
+    if (!atomic_load(&i2c_trace_on)) {
+
+        atomic_fetch_sub(&i2c_trace_producers, 1);
+        return;
+    }
+
+    trace->seq = atomic_fetch_add_explicit(&i2c_trace_seq, 1, memory_order_relaxed);
+
+    if (i2c_ring_push(&i2c_trace_ring, trace) == -1) {
+
+        atomic_fetch_add_explicit(&i2c_trace_drops, 1, memory_order_relaxed);
+    }
+    else if (i2c_trace_hook && (trace->seq + 1) % i2c_trace_watermark == 0) {
+
+        i2c_trace_hook(i2c_trace_hook_ctx);
+    }
+
+    atomic_fetch_sub(&i2c_trace_producers, 1);
+}
@@ -0,0 +1,23 @@
+#ifndef _LIB_I2C_TRACE_H_
+#define _LIB_I2C_TRACE_H_
+
+#include <stdatomic.h>
+#include "i2c/i2c.h"
+
+/* Trace is recording, checked before any trace work */
+extern _Atomic int i2c_trace_on;
+
+/* Internal address of next transfer this thread issue, consumed by i2c_trace_record */
+extern _Thread_local unsigned int i2c_trace_iaddr;
+
+/* Set internal address of next transfer, nothing if trace is off */
+#define I2C_TRACE_IADDR(iaddr) do { \
+    if (atomic_load_explicit(&i2c_trace_on, memory_order_relaxed)) { \
+        i2c_trace_iaddr = (iaddr); \
+    } \
+} while (0)
+
+/* Push record, fill #trace->seq and #trace->iaddr if it's unknown, full ring drop it */
+void i2c_trace_record(I2CTrace *trace);
+
+#endif
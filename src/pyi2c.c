@@ -4,10 +4,14 @@
 
 #define _VERSION_ LIBI2C_VERSION
 #define _NAME_ "pylibi2c"
-#define _I2CDEV_MAX_SIZE_ 4096
+#define _I2CDEV_ITER_CHUNK_SIZE_ 4096
+#define _I2CBUS_ASYNC_DEPTH_ 1024
+#define _I2CBUS_LIST_ADAPTERS_ 64
 #define _I2CDEV_MAX_IADDR_BYTES_SIZE 4
-#define _I2CDEV_MAX_PAGE_BYTES_SIZE 1024
+#define _I2CDEV_MAX_PAGE_BYTES_SIZE 4096
+PyDoc_STRVAR(I2CBus_name, "I2CBus");
 PyDoc_STRVAR(I2CDevice_name, "I2CDevice");
+PyDoc_STRVAR(I2CTxn_name, "I2CTxn");
 PyDoc_STRVAR(pylibi2c_doc, "Linux userspace i2c library.\n");
 
 
@@ -20,472 +24,3632 @@ PyDoc_STRVAR(pylibi2c_doc, "Linux userspace i2c library.\n");
 #endif
 
 
-PyDoc_STRVAR(I2CDeviceObject_type_doc, "I2CDevice(bus, address, tenbit=False, iaddr_bytes=1, page_bytes=8, delay=1, flags=0) -> I2CDevice object.\n");
+PyDoc_STRVAR(I2CBusObject_type_doc, "I2CBus(bus, flock=False) -> I2CBus object.\n\n"
+             "Shared i2c bus, many I2CDevice can using it, each transfer hold the bus lock, "
+             "flock=True also arbitrate with other processes.\n");
+/* Python aread/awrite request, completed on event loop thread */
+typedef struct pyi2c_async_ctx {
+    PyObject *future;                   /* asyncio.Future return to caller */
+    PyObject *bytearray;                /* Read to, NULL if write */
+    Py_buffer view;                     /* Write from, pinned until completed */
+    I2CAsyncReq req;
+    struct pyi2c_async_ctx *prev, *next;
+} PyI2CAsyncCtx;
+
 typedef struct {
     PyObject_HEAD;
-    I2CDevice dev;
-} I2CDeviceObject;
+    int bus;
+    int locked_bus;                     /* Bus fd of lock(), unlock it even bus closed while locked */
+    unsigned int locks;                 /* lock() not unlocked yet */
+    I2CAsync *async;                    /* Async engine, create at first aread/awrite */
+    PyObject *loop;                     /* Event loop completion fd registered on, NULL if nothing pending */
+    PyI2CAsyncCtx *pending;             /* Submitted to engine */
+    PyI2CAsyncCtx *backlog;             /* Wait for engine slot, submit order */
+    PyI2CAsyncCtx *backlog_tail;
+} I2CBusObject;
 
+static void I2CBus_async_close(I2CBusObject *self);
 
-static PyObject *I2CDevice_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+
+static PyObject *I2CBus_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
     (void)args;
     (void)kwds;
 
-    I2CDeviceObject *self;
+    I2CBusObject *self;
 
-    if ((self = (I2CDeviceObject *)type->tp_alloc(type, 0)) == NULL) {
+    if ((self = (I2CBusObject *)type->tp_alloc(type, 0)) == NULL) {
 
         return NULL;
     }
 
-    memset(&self->dev, 0, sizeof(self->dev));
-    i2c_init_device(&self->dev);
-
-    Py_INCREF(self);
+    self->bus = -1;
+    self->locked_bus = -1;
+    self->locks = 0;
+    self->async = NULL;
+    self->loop = NULL;
+    self->pending = self->backlog = self->backlog_tail = NULL;
     return (PyObject *)self;
 }
 
 
-PyDoc_STRVAR(I2CDevice_close_doc, "close()\n\nClose i2c device.\n");
-static PyObject *I2CDevice_close(I2CDeviceObject *self) {
+/* I2CBus(bus, flock=False) */
+static int I2CBus_init(I2CBusObject *self, PyObject *args, PyObject *kwds) {
 
-    /* Close i2c bus */
-    if (self->dev.bus >= 0) {
+    int flock = 0;
+    char *bus_name = NULL;
+    static char *kwlist[] = {"bus", "flock", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|i:__init__", kwlist, &bus_name, &flock)) {
 
-        i2c_close(self->dev.bus);
+        return -1;
     }
 
-    Py_INCREF(Py_None);
-    return Py_None;
+    if (self->bus >= 0) {
+
+        I2CBus_async_close(self);
+        i2c_close(self->bus);
+        self->bus = -1;
+    }
+
+    if ((self->bus = i2c_open(bus_name)) == -1) {
+        PyErr_SetFromErrno(PyExc_IOError);
+        return -1;
+    }
+
+    if (flock && i2c_set_lock(self->bus, I2C_LOCK_FLOCK) == -1) {
+        PyErr_SetFromErrno(PyExc_IOError);
+        return -1;
+    }
+
+    return 0;
 }
 
 
-static void I2CDevice_free(I2CDeviceObject *self) {
+PyDoc_STRVAR(I2CBus_close_doc, "close()\n\nClose i2c bus, I2CDevice using it will raise IOError.\n");
+static PyObject *I2CBus_close(I2CBusObject *self) {
 
-    PyObject *ref = I2CDevice_close(self);
-    Py_XDECREF(ref);
+    int bus = self->bus;
+
+    if (bus >= 0) {
+
+        /* Pending aread/awrite raise IOError */
+        I2CBus_async_close(self);
+
+        /* Closed after in-flight transfers of other thread and lock() released */
+        self->bus = -1;
+        Py_BEGIN_ALLOW_THREADS
+        i2c_close(bus);
+        Py_END_ALLOW_THREADS
+    }
+
+    Py_RETURN_NONE;
+}
+
+
+static void I2CBus_free(I2CBusObject *self) {
+
+    if (self->bus >= 0) {
+
+        I2CBus_async_close(self);
+        i2c_close(self->bus);
+    }
 
     Py_TYPE(self)->tp_free((PyObject *)self);
 }
 
 
-/* I2CDevice(bus, addr, tenbit=0, iaddr_bytes=1, page_bytes=8, delay=1, flags=0) */
-static int I2CDevice_init(I2CDeviceObject *self, PyObject *args, PyObject *kwds) {
+PyDoc_STRVAR(I2CBus_lock_doc, "lock()\n\nLock i2c bus, recursive, make several transfer of this thread atomic.\n");
+static PyObject *I2CBus_lock(I2CBusObject *self) {
 
-    char *bus_name = NULL;
-    static char *kwlist[] = {"bus", "addr", "tenbit", "iaddr_bytes", "page_bytes", "delay", "flags", NULL};
+    int ret;
+    int bus = self->bus;
 
-    /* Bus name and device address is required */
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "sH|BBHBH:__init__", kwlist,
-                                     &bus_name, &self->dev.addr,
-                                     &self->dev.tenbit, &self->dev.iaddr_bytes, &self->dev.page_bytes, &self->dev.delay, &self->dev.flags)) {
+    if (bus < 0) {
+        PyErr_SetString(PyExc_IOError, "I2CBus is closed");
+        return NULL;
+    }
 
-        return -1;
+    /* Hold bus with GIL, close of other thread can't release it while waiting lock */
+    if (i2c_ref(bus) == -1) {
+        PyErr_SetFromErrno(PyExc_IOError);
+        return NULL;
     }
 
-    /* Open i2c bus */
-    if ((self->dev.bus = i2c_open(bus_name)) == -1) {
+    Py_BEGIN_ALLOW_THREADS
+    ret = i2c_lock(bus);
+    i2c_unref(bus);
+    Py_END_ALLOW_THREADS
+
+    if (ret == -1) {
         PyErr_SetFromErrno(PyExc_IOError);
-        return -1;
+        return NULL;
     }
 
-    return 0;
+    self->locked_bus = bus;
+    self->locks++;
+    Py_RETURN_NONE;
 }
 
 
-static PyObject *I2CDevice_enter(PyObject *self, PyObject *args) {
+PyDoc_STRVAR(I2CBus_unlock_doc, "unlock()\n\nUnlock i2c bus locked by lock().\n");
+static PyObject *I2CBus_unlock(I2CBusObject *self) {
+
+    /* Bus closed while locked is released at last unlock */
+    int bus = self->locks ? self->locked_bus : self->bus;
 
-    if (!PyArg_ParseTuple(args, ""))
+    if (bus < 0) {
+        PyErr_SetString(PyExc_IOError, "I2CBus is closed");
         return NULL;
+    }
 
-    Py_INCREF(self);
-    return self;
+    /* Not locked by this thread */
+    if (i2c_unlock(bus) == -1) {
+        PyErr_SetFromErrno(PyExc_IOError);
+        return NULL;
+    }
+
+    if (self->locks) {
+
+        self->locks--;
+    }
+
+    Py_RETURN_NONE;
 }
 
 
-static PyObject *I2CDevice_exit(I2CDeviceObject *self, PyObject *args) {
+static PyObject *I2CBus_exit(I2CBusObject *self, PyObject *args) {
 
-    PyObject *exc_type = 0;
-    PyObject *exc_value = 0;
-    PyObject *traceback = 0;
+    (void)args;
+    return I2CBus_unlock(self);
+}
 
-    if (!PyArg_UnpackTuple(args, "__exit__", 3, 3, &exc_type, &exc_value, &traceback)) {
 
-        return 0;
+/* asyncio.get_running_loop */
+static PyObject *pyi2c_get_running_loop(void) {
+
+    PyObject *asyncio;
+    static PyObject *get_running_loop = NULL;
+
+    if (get_running_loop == NULL) {
+
+        if ((asyncio = PyImport_ImportModule("asyncio")) == NULL) {
+
+            return NULL;
+        }
+
+        get_running_loop = PyObject_GetAttrString(asyncio, "get_running_loop");
+        Py_DECREF(asyncio);
+
+        if (get_running_loop == NULL) {
+
+            return NULL;
+        }
     }
 
-    /* Close i2c bus */
-    I2CDevice_close(self);
-    Py_RETURN_FALSE;
+    return PyObject_CallObject(get_running_loop, NULL);
 }
 
 
-/* str */
-static PyObject *I2CDevice_str(PyObject *object) {
+static void pyi2c_async_ctx_free(PyI2CAsyncCtx *ctx) {
 
-    char desc[128];
-    PyObject *dev_desc = NULL;
-    I2CDeviceObject *self = (I2CDeviceObject *)object;
-    i2c_get_device_desc(&self->dev, desc, sizeof(desc));
+    Py_XDECREF(ctx->future);
+    Py_XDECREF(ctx->bytearray);
 
-#if PY_MAJOR_VERSION >= 3
-    dev_desc = PyUnicode_FromString(desc);
-#else
-    dev_desc = PyString_FromString(desc);
-#endif
+    if (ctx->view.obj) {
 
-    Py_INCREF(dev_desc);
-    return dev_desc;
+        PyBuffer_Release(&ctx->view);
+    }
+
+    PyMem_Free(ctx);
 }
 
 
-/* i2c read device */
-static PyObject *i2c_read_device(I2CDeviceObject *self, PyObject *args, int ioctl) {
+/* Set request result to it's future, free it */
+static void pyi2c_async_ctx_complete(PyI2CAsyncCtx *ctx, PyObject *error) {
 
-    int result;
-    unsigned int len = 0;
-    unsigned int iaddr = 0;
-    PyObject *bytearray = NULL;
-    char buf[_I2CDEV_MAX_SIZE_];
-    memset(buf, 0, sizeof(buf));
-    I2C_READ_HANDLE read_handle = NULL;
+    PyObject *ret, *value = NULL;
 
-    if (!PyArg_ParseTuple(args, "II:read", &iaddr, &len)) {
+    ret = PyObject_CallMethod(ctx->future, "cancelled", NULL);
+    if (ret == NULL || PyObject_IsTrue(ret)) {
 
-        return NULL;
+        goto out;
     }
 
-    len = len > sizeof(buf) ? sizeof(buf) : len;
-    read_handle = ioctl ? i2c_ioctl_read : i2c_read;
-    result = read_handle(&self->dev, iaddr, buf, len);
+    if (error) {
+
+        Py_INCREF(error);
+        value = error;
+    }
+    else if (ctx->req.result < 0 && ctx->bytearray) {
+
+        value = PyObject_CallFunction(PyExc_IOError, "is", ctx->req.error, strerror(ctx->req.error));
+    }
+    else if (ctx->bytearray && (size_t)ctx->req.result != ctx->req.len) {
+
+        value = PyObject_CallFunction(PyExc_IOError, "s", "short read");
+    }
+
+    Py_XDECREF(ret);
+    if (value) {
+
+        ret = PyObject_CallMethod(ctx->future, "set_exception", "O", value);
+        Py_DECREF(value);
+    }
+    else if (ctx->bytearray) {
+
+        ret = PyObject_CallMethod(ctx->future, "set_result", "O", ctx->bytearray);
+    }
+    else {
+
+        /* Same as write, failed return -1 */
+        ret = PyObject_CallMethod(ctx->future, "set_result", "n", ctx->req.result);
+    }
+
+out:
+    if (ret == NULL) {
+
+        PyErr_WriteUnraisable(ctx->future);
+    }
+
+    Py_XDECREF(ret);
+    pyi2c_async_ctx_free(ctx);
+}
+
+
+static void pyi2c_async_link(PyI2CAsyncCtx **head, PyI2CAsyncCtx *ctx) {
+
+    ctx->prev = NULL;
+    ctx->next = *head;
+
+    if (*head) {
+
+        (*head)->prev = ctx;
+    }
+
+    *head = ctx;
+}
+
+
+static void pyi2c_async_unlink(PyI2CAsyncCtx **head, PyI2CAsyncCtx *ctx) {
+
+    if (ctx->prev) {
+
+        ctx->prev->next = ctx->next;
+    }
+    else {
+
+        *head = ctx->next;
+    }
+
+    if (ctx->next) {
+
+        ctx->next->prev = ctx->prev;
+    }
+}
+
+
+/* Nothing pending or force, unregister completion fd let bus and loop go */
+static void I2CBus_async_release_loop(I2CBusObject *self, int force) {
+
+    PyObject *ret;
+
+    if (!self->loop || (!force && (self->pending || self->backlog))) {
+
+        return;
+    }
+
+    ret = PyObject_CallMethod(self->loop, "is_closed", NULL);
+    if (ret && !PyObject_IsTrue(ret)) {
+
+        Py_DECREF(ret);
+        ret = PyObject_CallMethod(self->loop, "remove_reader", "i", i2c_async_fd(self->async));
+    }
+
+    if (ret == NULL) {
+
+        PyErr_WriteUnraisable(self->loop);
+    }
+
+    Py_XDECREF(ret);
+    Py_CLEAR(self->loop);
+}
+
+
+/* Submit backlog requests until engine is full */
+static void I2CBus_async_flush(I2CBusObject *self) {
+
+    PyI2CAsyncCtx *ctx;
+
+    while ((ctx = self->backlog)) {
+
+        if (i2c_async_submit(self->async, &ctx->req) == -1) {
+
+            return;
+        }
+
+        if ((self->backlog = ctx->next) == NULL) {
+
+            self->backlog_tail = NULL;
+        }
+
+        pyi2c_async_link(&self->pending, ctx);
+    }
+}
+
+
+/* Submit request, engine full queue it in backlog */
+static void I2CBus_async_submit(I2CBusObject *self, PyI2CAsyncCtx *ctx) {
+
+    ctx->prev = ctx->next = NULL;
+
+    if (!self->backlog && i2c_async_submit(self->async, &ctx->req) == 0) {
+
+        pyi2c_async_link(&self->pending, ctx);
+        return;
+    }
+
+    if (self->backlog_tail) {
+
+        self->backlog_tail->next = ctx;
+    }
+    else {
+
+        self->backlog = ctx;
+    }
+
+    self->backlog_tail = ctx;
+}
+
+
+/* Completion fd readable callback, run on event loop */
+static PyObject *I2CBus_async_reap(I2CBusObject *self, PyObject *args) {
+    (void)args;
+
+    int i, count;
+    I2CAsyncReq done[32];
+
+    if (!self->async) {
+
+        Py_RETURN_NONE;
+    }
+
+    do {
+
+        count = i2c_async_reap(self->async, done, sizeof(done) / sizeof(done[0]));
+        for (i = 0; i < count; i++) {
+
+            PyI2CAsyncCtx *ctx = done[i].user_data;
+            pyi2c_async_unlink(&self->pending, ctx);
+            ctx->req = done[i];
+            pyi2c_async_ctx_complete(ctx, NULL);
+        }
+
+    } while (count == sizeof(done) / sizeof(done[0]));
+
+    I2CBus_async_flush(self);
+    I2CBus_async_release_loop(self, 0);
+    Py_RETURN_NONE;
+}
+
+
+/* Stop engine, wait in-flight request done, pending request raise IOError */
+static void I2CBus_async_close(I2CBusObject *self) {
+
+    PyObject *error;
+    PyI2CAsyncCtx *ctx;
+    I2CAsync *async = self->async;
+
+    if (!async) {
+
+        return;
+    }
+
+    I2CBus_async_release_loop(self, 1);
+
+    Py_BEGIN_ALLOW_THREADS
+    i2c_async_destroy(async);
+    Py_END_ALLOW_THREADS
+
+    error = PyObject_CallFunction(PyExc_IOError, "s", "I2C bus is closed");
+
+    while ((ctx = self->pending) || (ctx = self->backlog)) {
+
+        if (ctx == self->pending) {
+
+            pyi2c_async_unlink(&self->pending, ctx);
+        }
+        else if ((self->backlog = ctx->next) == NULL) {
+
+            self->backlog_tail = NULL;
+        }
+
+        pyi2c_async_ctx_complete(ctx, error);
+    }
+
+    Py_XDECREF(error);
+    self->async = NULL;
+}
+
+
+/* Submit aread/awrite, return asyncio.Future */
+static PyObject *I2CBus_async_request(I2CBusObject *self, const I2CDevice *dev, unsigned int op,
+                                      unsigned int iaddr, Py_buffer *view, size_t len) {
+
+    PyObject *loop, *reap, *ret;
+    PyI2CAsyncCtx *ctx;
+
+    if ((loop = pyi2c_get_running_loop()) == NULL) {
+
+        goto out_view;
+    }
+
+    if (self->loop && self->loop != loop) {
+
+        PyErr_SetString(PyExc_RuntimeError, "I2CBus has pending request on another event loop");
+        goto out_loop;
+    }
+
+    if (!self->async && (self->async = i2c_async_create(self->bus, _I2CBUS_ASYNC_DEPTH_)) == NULL) {
 
-    if (result < 0) {
         PyErr_SetFromErrno(PyExc_IOError);
-        return NULL;
+        goto out_loop;
     }
 
-    if ((uint)result != len)
-    {
-        perror("short read");
-        return NULL;
+    /* First pending request, wake up when completion is ready */
+    if (!self->loop) {
+
+        if ((reap = PyObject_GetAttrString((PyObject *)self, "_reap")) == NULL) {
+
+            goto out_loop;
+        }
+
+        ret = PyObject_CallMethod(loop, "add_reader", "iO", i2c_async_fd(self->async), reap);
+        Py_DECREF(reap);
+
+        if (ret == NULL) {
+
+            goto out_loop;
+        }
+
+        Py_DECREF(ret);
+        Py_INCREF(loop);
+        self->loop = loop;
+    }
+
+    if ((ctx = PyMem_Malloc(sizeof(*ctx))) == NULL) {
+
+        PyErr_NoMemory();
+        goto out_release;
+    }
+
+    memset(ctx, 0, sizeof(*ctx));
+
+    if ((ctx->future = PyObject_CallMethod(loop, "create_future", NULL)) == NULL) {
+
+        PyMem_Free(ctx);
+        goto out_release;
+    }
+
+    if (view) {
+
+        ctx->view = *view;
+        ctx->req.buf = view->buf;
+    }
+    else {
+
+        if ((ctx->bytearray = PyByteArray_FromStringAndSize(NULL, len)) == NULL) {
+
+            pyi2c_async_ctx_free(ctx);
+            goto out_release;
+        }
+
+        ctx->req.buf = PyByteArray_AS_STRING(ctx->bytearray);
+    }
+
+    ctx->req.device = *dev;
+    ctx->req.op = op;
+    ctx->req.iaddr = iaddr;
+    ctx->req.len = len;
+    ctx->req.user_data = ctx;
+
+    I2CBus_async_submit(self, ctx);
+    Py_DECREF(loop);
+
+    Py_INCREF(ctx->future);
+    return ctx->future;
+
+out_release:
+    I2CBus_async_release_loop(self, 0);
+
+out_loop:
+    Py_DECREF(loop);
+
+out_view:
+    if (view) {
+
+        PyBuffer_Release(view);
+    }
+
+    return NULL;
+}
+
+
+/* fd */
+PyDoc_STRVAR(I2CBus_fd_doc, "i2c bus fd, -1 if closed.\n");
+static PyObject *I2CBus_get_fd(I2CBusObject *self, void *closure) {
+    (void)closure;
+
+    return Py_BuildValue("i", self->bus);
+}
+
+
+PyDoc_STRVAR(I2CBus_funcs_doc, "Adapter functionality I2C_FUNC_XXX, queried when bus opened.\n");
+static PyObject *I2CBus_get_funcs(I2CBusObject *self, void *closure) {
+    (void)closure;
+
+    unsigned long funcs = 0;
+
+    if (self->bus < 0 || i2c_get_funcs(self->bus, &funcs) == -1) {
+
+        PyErr_SetFromErrno(PyExc_IOError);
+        return NULL;
+    }
+
+    return PyLong_FromUnsignedLong(funcs);
+}
+
+
+PyDoc_STRVAR(I2CBus_method_doc, "Fastest transfer method I2C_METHOD_XXX, used by auto_read/auto_write.\n");
+static PyObject *I2CBus_get_method(I2CBusObject *self, void *closure) {
+    (void)closure;
+
+    if (self->bus < 0) {
+
+        PyErr_SetString(PyExc_IOError, "I2C bus is closed");
+        return NULL;
+    }
+
+    return PyLong_FromLong(i2c_get_method(self->bus));
+}
+
+
+/* I2CStats to dict, latency is dict of read/write/smbus histogram list */
+static PyObject *i2c_stats_dict(const I2CStats *stats) {
+
+    unsigned int op, bucket;
+    PyObject *latency, *histogram;
+    static const char *ops[I2C_STATS_OPS] = {"read", "write", "smbus"};
+
+    if ((latency = PyDict_New()) == NULL) {
+
+        return NULL;
+    }
+
+    for (op = 0; op < I2C_STATS_OPS; op++) {
+
+        if ((histogram = PyList_New(I2C_STATS_BUCKETS)) == NULL) {
+
+            Py_DECREF(latency);
+            return NULL;
+        }
+
+        for (bucket = 0; bucket < I2C_STATS_BUCKETS; bucket++) {
+
+            PyList_SET_ITEM(histogram, bucket, PyLong_FromUnsignedLongLong(stats->latency[op][bucket]));
+        }
+
+        if (PyDict_SetItemString(latency, ops[op], histogram) == -1) {
+
+            Py_DECREF(histogram);
+            Py_DECREF(latency);
+            return NULL;
+        }
+
+        Py_DECREF(histogram);
+    }
+
+    return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:N}",
+                         "xfers", stats->xfers, "bytes_in", stats->bytes_in, "bytes_out", stats->bytes_out,
+                         "ioctls", stats->ioctls, "naks", stats->naks, "timeouts", stats->timeouts,
+                         "arb_lost", stats->arb_lost, "errors", stats->errors, "retries", stats->retries,
+                         "delay_us", stats->delay_us, "poll_us", stats->poll_us, "latency", latency);
+}
+
+
+PyDoc_STRVAR(I2CBus_stats_doc, "stats() -> dict\n\n"
+             "Bus statistics, transfers, bytes, ioctls, errno classes, delay/polling time and latency histograms, "
+             "latency bucket 0 < 2us, bucket N [2^N, 2^(N+1)) us.\n");
+static PyObject *I2CBus_stats(I2CBusObject *self) {
+
+    I2CStats stats;
+
+    if (self->bus < 0 || i2c_get_stats(self->bus, &stats) == -1) {
+
+        PyErr_SetFromErrno(PyExc_IOError);
+        return NULL;
+    }
+
+    return i2c_stats_dict(&stats);
+}
+
+
+PyDoc_STRVAR(I2CBus_reset_stats_doc, "reset_stats()\n\nReset statistics of bus and all devices on it.\n");
+static PyObject *I2CBus_reset_stats(I2CBusObject *self) {
+
+    if (self->bus < 0 || i2c_reset_stats(self->bus) == -1) {
+
+        PyErr_SetFromErrno(PyExc_IOError);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+
+PyDoc_STRVAR(I2CBus_record_start_doc, "record_start(path)\n\n"
+             "Record all transfers of this bus into file, with data and timing, until record_stop().\n");
+static PyObject *I2CBus_record_start(I2CBusObject *self, PyObject *args) {
+
+    const char *path;
+
+    if (!PyArg_ParseTuple(args, "s:record_start", &path)) {
+
+        return NULL;
+    }
+
+    if (self->bus < 0 || i2c_record_start(self->bus, path) == -1) {
+
+        PyErr_SetFromErrno(PyExc_IOError);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+
+PyDoc_STRVAR(I2CBus_record_stop_doc, "record_stop()\n\nStop recording and close record file.\n");
+static PyObject *I2CBus_record_stop(I2CBusObject *self) {
+
+    if (self->bus < 0 || i2c_record_stop(self->bus) == -1) {
+
+        PyErr_SetFromErrno(PyExc_IOError);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+
+PyDoc_STRVAR(I2CBus_replay_doc, "replay(path, realtime=False) -> dict\n\n"
+             "Replay record file on this bus, realtime keep recorded interval, otherwise replay at max speed, "
+             "return records, diverged, mismatches, replay/recorded bytes and latency and span in ns.\n");
+static PyObject *I2CBus_replay(I2CBusObject *self, PyObject *args, PyObject *kwds) {
+
+    int ret;
+    const char *path;
+    int realtime = 0;
+    I2CReplayStat stat;
+    int bus = self->bus;
+    static char *kwlist[] = {"path", "realtime", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|i:replay", kwlist, &path, &realtime)) {
+
+        return NULL;
+    }
+
+    if (bus < 0) {
+
+        PyErr_SetString(PyExc_IOError, "I2CBus is closed");
+        return NULL;
+    }
+
+    if (i2c_ref(bus) == -1) {
+
+        PyErr_SetFromErrno(PyExc_IOError);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = i2c_replay(bus, path, realtime ? I2C_REPLAY_REALTIME : 0, &stat);
+    i2c_unref(bus);
+    Py_END_ALLOW_THREADS
+
+    if (ret == -1) {
+
+        PyErr_SetFromErrno(PyExc_IOError);
+        return NULL;
+    }
+
+    return Py_BuildValue("{s:I,s:I,s:I,s:K,s:K,s:K,s:K,s:K,s:K}",
+                         "records", stat.records, "diverged", stat.diverged, "mismatches", stat.mismatches,
+                         "bytes", stat.bytes, "recorded_bytes", stat.recorded_bytes, "recorded_ns", stat.recorded_ns, "replay_ns", stat.replay_ns,
+                         "recorded_span_ns", stat.recorded_span_ns, "replay_span_ns", stat.replay_span_ns);
+}
+
+
+static PyMethodDef I2CBus_methods[] = {
+
+    {"close", (PyCFunction)I2CBus_close, METH_NOARGS, I2CBus_close_doc},
+    {"lock", (PyCFunction)I2CBus_lock, METH_NOARGS, I2CBus_lock_doc},
+    {"unlock", (PyCFunction)I2CBus_unlock, METH_NOARGS, I2CBus_unlock_doc},
+    {"__enter__", (PyCFunction)I2CBus_lock, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)I2CBus_exit, METH_VARARGS, NULL},
+    {"stats", (PyCFunction)I2CBus_stats, METH_NOARGS, I2CBus_stats_doc},
+    {"reset_stats", (PyCFunction)I2CBus_reset_stats, METH_NOARGS, I2CBus_reset_stats_doc},
+    {"record_start", (PyCFunction)I2CBus_record_start, METH_VARARGS, I2CBus_record_start_doc},
+    {"record_stop", (PyCFunction)I2CBus_record_stop, METH_NOARGS, I2CBus_record_stop_doc},
+    {"replay", (PyCFunction)I2CBus_replay, METH_VARARGS | METH_KEYWORDS, I2CBus_replay_doc},
+    {"_reap", (PyCFunction)I2CBus_async_reap, METH_NOARGS, NULL},
+    {NULL},
+};
+
+
+static PyGetSetDef I2CBus_getseters[] = {
+
+    {"fd", (getter)I2CBus_get_fd, NULL, I2CBus_fd_doc, NULL},
+    {"funcs", (getter)I2CBus_get_funcs, NULL, I2CBus_funcs_doc, NULL},
+    {"method", (getter)I2CBus_get_method, NULL, I2CBus_method_doc, NULL},
+    {NULL},
+};
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+
+static PyTypeObject I2CBusObjectType = {
+#if PY_MAJOR_VERSION >= 3
+    PyVarObject_HEAD_INIT(NULL, 0)
+#else
+    PyObject_HEAD_INIT(NULL) 0, /* ob_size */
+#endif
+    I2CBus_name,		        /* tp_name */
+    sizeof(I2CBusObject),	    /* tp_basicsize */
+    0,			        	    /* tp_itemsize */
+    (destructor)I2CBus_free,    /* tp_dealloc */
+    0,				            /* tp_print */
+    0,				            /* tp_getattr */
+    0,				            /* tp_setattr */
+    0,				            /* tp_compare */
+    0,				            /* tp_repr */
+    0,				            /* tp_as_number */
+    0,				            /* tp_as_sequence */
+    0,				            /* tp_as_mapping */
+    0,				            /* tp_hash */
+    0,				            /* tp_call */
+    0,				            /* tp_str */
+    0,				            /* tp_getattro */
+    0,				            /* tp_setattro */
+    0,				            /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
+    I2CBusObject_type_doc,	    /* tp_doc */
+    0,				            /* tp_traverse */
+    0,				            /* tp_clear */
+    0,				            /* tp_richcompare */
+    0,				            /* tp_weaklistoffset */
+    0,				            /* tp_iter */
+    0,				            /* tp_iternext */
+    I2CBus_methods,		        /* tp_methods */
+    0,				            /* tp_members */
+    I2CBus_getseters,           /* tp_getset */
+    0,				            /* tp_base */
+    0,				            /* tp_dict */
+    0,				            /* tp_descr_get */
+    0,				            /* tp_descr_set */
+    0,				            /* tp_dictoffset */
+    (initproc)I2CBus_init,	    /* tp_init */
+    0,				            /* tp_alloc */
+    I2CBus_new,		            /* tp_new */
+};
+
+#pragma GCC diagnostic pop
+
+
+PyDoc_STRVAR(I2CDeviceObject_type_doc, "I2CDevice(bus, address, tenbit=False, iaddr_bytes=1, page_bytes=8, delay=1, flags=0, "
+             "completion=I2C_COMPLETION_DELAY, poll_timeout=25, poll_interval=100, poll_max=0, pec=False, "
+             "retries=0, retry_on=I2C_RETRY_DEFAULT, retry_backoff=1000, block_bits=0, part=None) -> I2CDevice object.\n\n"
+             "bus is bus name such as /dev/i2c-1, or I2CBus shared with other I2CDevice.\n"
+             "part is part name such as '24c16', 'fm24cl64', it set default of other arguments, see parts().\n");
+typedef struct {
+    PyObject_HEAD;
+    I2CDevice dev;
+    I2CBusObject *bus;          /* Bus device on, NULL if closed */
+    int own_bus;                /* Bus opened by device, close it with device */
+} I2CDeviceObject;
+
+
+static PyObject *I2CDevice_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    (void)args;
+    (void)kwds;
+
+    I2CDeviceObject *self;
+
+    if ((self = (I2CDeviceObject *)type->tp_alloc(type, 0)) == NULL) {
+
+        return NULL;
+    }
+
+    memset(&self->dev, 0, sizeof(self->dev));
+    i2c_init_device(&self->dev);
+    self->dev.bus = -1;
+    self->bus = NULL;
+    self->own_bus = 0;
+
+    return (PyObject *)self;
+}
+
+
+PyDoc_STRVAR(I2CDevice_close_doc, "close()\n\nClose i2c device.\n");
+static PyObject *I2CDevice_close(I2CDeviceObject *self) {
+
+    /* Close i2c bus, shared bus closed by I2CBus */
+    if (self->bus && self->own_bus) {
+
+        Py_XDECREF(I2CBus_close(self->bus));
+    }
+
+    Py_CLEAR(self->bus);
+    self->own_bus = 0;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+
+/* Copy device for bus I/O without GIL, attributes may be changed by other thread */
+static int I2CDevice_get_dev(I2CDeviceObject *self, I2CDevice *dev) {
+
+    *dev = self->dev;
+    dev->bus = self->bus ? self->bus->bus : -1;
+
+    if (dev->bus < 0) {
+        PyErr_SetString(PyExc_IOError, "I2C bus is closed");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Copy device and hold it's bus for bus I/O without GIL, bus closed by other thread is released after I2CDevice_release_dev */
+static int I2CDevice_hold_dev(I2CDeviceObject *self, I2CDevice *dev) {
+
+    if (I2CDevice_get_dev(self, dev) == -1) {
+
+        return -1;
+    }
+
+    if (i2c_ref(dev->bus) == -1) {
+        PyErr_SetFromErrno(PyExc_IOError);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void I2CDevice_release_dev(I2CDevice *dev) {
+
+    i2c_unref(dev->bus);
+}
+
+
+static void I2CDevice_free(I2CDeviceObject *self) {
+
+    PyObject *ref = I2CDevice_close(self);
+    Py_XDECREF(ref);
+
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+/* I2CDevice(bus, addr, tenbit=0, iaddr_bytes=1, page_bytes=8, delay=1, flags=0, completion=0, poll_timeout=25, poll_interval=100, poll_max=0, pec=0,
+              retries=0, retry_on=I2C_RETRY_DEFAULT, retry_backoff=1000, block_bits=0, part=None) */
+static int I2CDevice_init(I2CDeviceObject *self, PyObject *args, PyObject *kwds) {
+
+    PyObject *bus = NULL;
+    const char *part = NULL;
+    PyObject *part_obj = kwds ? PyDict_GetItemString(kwds, "part") : NULL;
+    static char *kwlist[] = {"bus", "addr", "tenbit", "iaddr_bytes", "page_bytes", "delay", "flags",
+                             "completion", "poll_timeout", "poll_interval", "poll_max", "pec",
+                             "retries", "retry_on", "retry_backoff", "block_bits", "part", NULL
+                            };
+
+    /* Part profile first, explicit arguments override it */
+    if (part_obj && part_obj != Py_None) {
+
+        if (!PyArg_Parse(part_obj, "s", &part)) {
+
+            return -1;
+        }
+
+        if (i2c_init_part(&self->dev, part) == -1) {
+
+            PyErr_Format(PyExc_ValueError, "Unknown part '%s'", part);
+            return -1;
+        }
+    }
+
+    /* Bus name or I2CBus and device address is required */
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OH|BBHBHBIIIBBBIBz:__init__", kwlist,
+                                     &bus, &self->dev.addr,
+                                     &self->dev.tenbit, &self->dev.iaddr_bytes, &self->dev.page_bytes, &self->dev.delay, &self->dev.flags,
+                                     &self->dev.completion, &self->dev.poll_timeout, &self->dev.poll_interval, &self->dev.poll_max, &self->dev.pec,
+                                     &self->dev.retries, &self->dev.retry_on, &self->dev.retry_backoff, &self->dev.block_bits, &part)) {
+
+        return -1;
+    }
+
+    Py_XDECREF(I2CDevice_close(self));
+
+    /* Shared bus, keep it alive until device closed */
+    if (PyObject_TypeCheck(bus, &I2CBusObjectType)) {
+
+        Py_INCREF(bus);
+        self->bus = (I2CBusObject *)bus;
+        return 0;
+    }
+
+    /* Open i2c bus by name, device own it */
+    if ((self->bus = (I2CBusObject *)PyObject_CallFunctionObjArgs((PyObject *)&I2CBusObjectType, bus, NULL)) == NULL) {
+
+        return -1;
+    }
+
+    self->own_bus = 1;
+    return 0;
+}
+
+
+static PyObject *I2CDevice_enter(PyObject *self, PyObject *args) {
+    (void)args;
+
+    Py_INCREF(self);
+    return self;
+}
+
+
+static PyObject *I2CDevice_exit(I2CDeviceObject *self, PyObject *args) {
+
+    PyObject *exc_type = 0;
+    PyObject *exc_value = 0;
+    PyObject *traceback = 0;
+
+    if (!PyArg_UnpackTuple(args, "__exit__", 3, 3, &exc_type, &exc_value, &traceback)) {
+
+        return 0;
+    }
+
+    /* Close i2c bus */
+    Py_XDECREF(I2CDevice_close(self));
+    Py_RETURN_FALSE;
+}
+
+
+/* str */
+static PyObject *I2CDevice_str(PyObject *object) {
+
+    char desc[128];
+    PyObject *dev_desc = NULL;
+    I2CDeviceObject *self = (I2CDeviceObject *)object;
+    i2c_get_device_desc(&self->dev, desc, sizeof(desc));
+
+#if PY_MAJOR_VERSION >= 3
+    dev_desc = PyUnicode_FromString(desc);
+#else
+    dev_desc = PyString_FromString(desc);
+#endif
+
+    return dev_desc;
+}
+
+
+/* i2c read device */
+static PyObject *i2c_read_device(I2CDeviceObject *self, PyObject *args, I2C_READ_HANDLE read_handle) {
+
+    ssize_t result;
+    I2CDevice dev;
+    unsigned int len = 0;
+    unsigned int iaddr = 0;
+    PyObject *bytearray = NULL;
+
+    if (!PyArg_ParseTuple(args, "II:read", &iaddr, &len)) {
+
+        return NULL;
+    }
+
+    /* Read data direct to bytearray */
+    if ((bytearray = PyByteArray_FromStringAndSize(NULL, len)) == NULL) {
+
+        return NULL;
+    }
+
+    /* Attributes may be changed by other thread while bus I/O without GIL */
+    if (I2CDevice_hold_dev(self, &dev) == -1) {
+
+        Py_DECREF(bytearray);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    result = read_handle(&dev, iaddr, PyByteArray_AS_STRING(bytearray), len);
+    I2CDevice_release_dev(&dev);
+    Py_END_ALLOW_THREADS
+
+    if (result < 0) {
+        Py_DECREF(bytearray);
+        PyErr_SetFromErrno(PyExc_IOError);
+        return NULL;
+    }
+
+    if ((unsigned int)result != len)
+    {
+        Py_DECREF(bytearray);
+        PyErr_SetString(PyExc_IOError, "short read");
+        return NULL;
+    }
+
+    return bytearray;
+}
+
+
+/* i2c read device into buffer */
+static PyObject *i2c_readinto_device(I2CDeviceObject *self, PyObject *args, int ioctl) {
+
+    ssize_t result;
+    I2CDevice dev;
+    Py_buffer buf;
+    unsigned int iaddr = 0;
+    I2C_READ_HANDLE read_handle = NULL;
+
+    /* Any writable contiguous buffer, pinned until PyBuffer_Release */
+    if (!PyArg_ParseTuple(args, "Iw*:readinto", &iaddr, &buf)) {
+
+        return NULL;
+    }
+
+    read_handle = ioctl ? i2c_ioctl_read : i2c_read;
+    if (I2CDevice_hold_dev(self, &dev) == -1) {
+
+        PyBuffer_Release(&buf);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    result = read_handle(&dev, iaddr, buf.buf, buf.len);
+    I2CDevice_release_dev(&dev);
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&buf);
+
+    if (result < 0) {
+        PyErr_SetFromErrno(PyExc_IOError);
+        return NULL;
+    }
+
+    return PyLong_FromSsize_t(result);
+}
+
+
+/* i2c write device */
+static PyObject *i2c_write_device(I2CDeviceObject *self, PyObject *args, I2C_WRITE_HANDLE write_handle) {
+
+    ssize_t ret;
+    I2CDevice dev;
+    Py_buffer buf;
+    unsigned int iaddr = 0;
+
+    /* Any contiguous buffer or str without copy, it is pinned(can't resize or release) until PyBuffer_Release */
+    if (!PyArg_ParseTuple(args, "Is*:write", &iaddr, &buf)) {
+        return NULL;
+    }
+
+    if (I2CDevice_hold_dev(self, &dev) == -1) {
+
+        PyBuffer_Release(&buf);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = write_handle(&dev, iaddr, buf.buf, buf.len);
+    I2CDevice_release_dev(&dev);
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&buf);
+    return PyLong_FromSsize_t(ret);
+}
+
+
+/* file read */
+PyDoc_STRVAR(I2CDevice_read_doc, "read(iaddr, buf, size)\n\nRead #size bytes data from device #iaddress to #buf.\n");
+static PyObject *I2CDevice_read(I2CDeviceObject *self, PyObject *args) {
+
+    return i2c_read_device(self, args, i2c_read);
+}
+
+
+/* file write */
+PyDoc_STRVAR(I2CDevice_write_doc, "write(iaddr, buf, size)\n\nWrite #size bytes data from #buf to device #iaddress.\n");
+static PyObject *I2CDevice_write(I2CDeviceObject *self, PyObject *args) {
+
+    return i2c_write_device(self, args, i2c_write);
+}
+
+
+/* file read into */
+PyDoc_STRVAR(I2CDevice_readinto_doc, "readinto(iaddr, buffer)\n\nRead len(buffer) bytes data from device #iaddress direct into writable #buffer, return read bytes.\n");
+static PyObject *I2CDevice_readinto(I2CDeviceObject *self, PyObject *args) {
+
+    return i2c_readinto_device(self, args, 0);
+}
+
+
+/* ioctl read into */
+PyDoc_STRVAR(I2CDevice_ioctl_readinto_doc, "ioctl_readinto(iaddr, buffer)\n\nIoctl read len(buffer) bytes data from device #iaddress direct into writable #buffer, return read bytes.\n");
+static PyObject *I2CDevice_ioctl_readinto(I2CDeviceObject *self, PyObject *args) {
+
+    return i2c_readinto_device(self, args, 1);
+}
+
+
+/* ioctl read */
+PyDoc_STRVAR(I2CDevice_ioctl_read_doc, "ioctl_read(iaddr, buf, size)\n\nIoctl read #size bytes data from device #iaddress to #buf.\n");
+static PyObject *I2CDevice_ioctl_read(I2CDeviceObject *self, PyObject *args) {
+
+    return i2c_read_device(self, args, i2c_ioctl_read);
+}
+
+
+/* ioctl write */
+PyDoc_STRVAR(I2CDevice_ioctl_write_doc, "ioctl_write(iaddr, buf, size)\n\nIoctl write #size bytes data from #buf to device #iaddress.\n");
+static PyObject *I2CDevice_ioctl_write(I2CDeviceObject *self, PyObject *args) {
+
+    return i2c_write_device(self, args, i2c_ioctl_write);
+}
+
+
+/* ioctl read scattered regions */
+PyDoc_STRVAR(I2CDevice_readv_doc, "readv(regions) -> list\n\n"
+             "Ioctl read scattered #regions [(iaddr, size), ...] with one call, "
+             "reads are packed into as few transfers as possible, return list of bytearray.\n");
+static PyObject *I2CDevice_readv(I2CDeviceObject *self, PyObject *args) {
+
+    ssize_t result;
+    I2CDevice dev;
+    Py_ssize_t i, count;
+    I2CIovec *iov = NULL;
+    unsigned int iaddr, len;
+    PyObject *regions, *seq, *item, *list = NULL;
+
+    if (!PyArg_ParseTuple(args, "O:readv", &regions)) {
+
+        return NULL;
+    }
+
+    if ((seq = PySequence_Fast(regions, "readv 'regions' must be a sequence")) == NULL) {
+
+        return NULL;
+    }
+
+    count = PySequence_Fast_GET_SIZE(seq);
+    if (count && (iov = calloc(count, sizeof(I2CIovec))) == NULL) {
+
+        PyErr_NoMemory();
+        goto out;
+    }
+
+    if ((list = PyList_New(count)) == NULL) {
+
+        goto out;
+    }
+
+    /* Read data direct to bytearray of each region */
+    for (i = 0; i < count; i++) {
+
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq, i), "II:readv", &iaddr, &len) ||
+                (item = PyByteArray_FromStringAndSize(NULL, len)) == NULL) {
+
+            Py_CLEAR(list);
+            goto out;
+        }
+
+        PyList_SET_ITEM(list, i, item);
+        iov[i].iaddr = iaddr;
+        iov[i].buf = PyByteArray_AS_STRING(item);
+        iov[i].len = len;
+    }
+
+    if (I2CDevice_hold_dev(self, &dev) == -1) {
+
+        Py_CLEAR(list);
+        goto out;
+    }
+
+    /* Bytearrays are kept alive by #list */
+    Py_BEGIN_ALLOW_THREADS
+    result = i2c_readv(&dev, iov, count);
+    I2CDevice_release_dev(&dev);
+    Py_END_ALLOW_THREADS
+
+    if (result < 0) {
+
+        Py_CLEAR(list);
+        PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+out:
+    free(iov);
+    Py_DECREF(seq);
+    return list;
+}
+
+
+/* ioctl write scattered regions */
+PyDoc_STRVAR(I2CDevice_writev_doc, "writev(regions) -> int\n\n"
+             "Ioctl write scattered #regions [(iaddr, buf), ...] with one call, each region split by page, return written bytes.\n");
+static PyObject *I2CDevice_writev(I2CDeviceObject *self, PyObject *args) {
+
+    ssize_t ret = -1;
+    I2CDevice dev;
+    Py_ssize_t i, count, pinned = 0;
+    I2CIovec *iov = NULL;
+    Py_buffer *bufs = NULL;
+    PyObject *regions, *seq, *result = NULL;
+
+    if (!PyArg_ParseTuple(args, "O:writev", &regions)) {
+
+        return NULL;
+    }
+
+    if ((seq = PySequence_Fast(regions, "writev 'regions' must be a sequence")) == NULL) {
+
+        return NULL;
+    }
+
+    count = PySequence_Fast_GET_SIZE(seq);
+    if (count && ((iov = calloc(count, sizeof(I2CIovec))) == NULL || (bufs = calloc(count, sizeof(Py_buffer))) == NULL)) {
+
+        PyErr_NoMemory();
+        goto out;
+    }
+
+    /* Any contiguous buffer or str without copy, pinned until PyBuffer_Release */
+    for (pinned = 0; pinned < count; pinned++) {
+
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq, pinned), "Is*:writev", &iov[pinned].iaddr, &bufs[pinned])) {
+
+            goto out;
+        }
+
+        iov[pinned].buf = bufs[pinned].buf;
+        iov[pinned].len = bufs[pinned].len;
+    }
+
+    if (I2CDevice_hold_dev(self, &dev) == -1) {
+
+        goto out;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = i2c_writev(&dev, iov, count);
+    I2CDevice_release_dev(&dev);
+    Py_END_ALLOW_THREADS
+
+    result = PyLong_FromSsize_t(ret);
+
+out:
+    for (i = 0; i < pinned; i++) {
+
+        PyBuffer_Release(&bufs[i]);
+    }
+
+    free(bufs);
+    free(iov);
+    Py_DECREF(seq);
+    return result;
+}
+
+
+/* auto read */
+PyDoc_STRVAR(I2CDevice_auto_read_doc, "auto_read(iaddr, size)\n\nRead #size bytes data from device #iaddress, using fastest method bus adapter support.\n");
+static PyObject *I2CDevice_auto_read(I2CDeviceObject *self, PyObject *args) {
+
+    return i2c_read_device(self, args, i2c_auto_read);
+}
+
+
+/* auto write */
+PyDoc_STRVAR(I2CDevice_auto_write_doc, "auto_write(iaddr, buf)\n\nWrite #buf data to device #iaddress, using fastest method bus adapter support.\n");
+static PyObject *I2CDevice_auto_write(I2CDeviceObject *self, PyObject *args) {
+
+    return i2c_write_device(self, args, i2c_auto_write);
+}
+
+
+/* differential write */
+PyDoc_STRVAR(I2CDevice_write_diff_doc, "write_diff(iaddr, buf, manifest=None) -> (written, skipped)\n\n"
+             "Write #buf to device #iaddress only program pages differ from device, return number of pages written and skipped.\n"
+             "#manifest is writable buffer of page hashes return from diff_manifest, updated after programmed, "
+             "None read back device to compare.\n");
+static PyObject *I2CDevice_write_diff(I2CDeviceObject *self, PyObject *args, PyObject *kwds) {
+
+    size_t pages;
+    ssize_t ret;
+    I2CDevice dev;
+    Py_buffer buf, manifest;
+    I2CDiffStat stat = {0, 0};
+    uint64_t *hashes = NULL;
+    PyObject *manifest_obj = Py_None;
+    unsigned int iaddr = 0;
+    static char *kwlist[] = {"iaddr", "buf", "manifest", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "Is*|O:write_diff", kwlist, &iaddr, &buf, &manifest_obj)) {
+
+        return NULL;
+    }
+
+    if (I2CDevice_get_dev(self, &dev) == -1) {
+
+        PyBuffer_Release(&buf);
+        return NULL;
+    }
+
+    manifest.obj = NULL;
+    pages = i2c_diff_pages(&dev, iaddr, buf.len);
+
+    /* Manifest may not aligned, using a copy */
+    if (manifest_obj != Py_None) {
+
+        if (PyObject_GetBuffer(manifest_obj, &manifest, PyBUF_WRITABLE) == -1) {
+
+            PyBuffer_Release(&buf);
+            return NULL;
+        }
+
+        if ((size_t)manifest.len < pages * sizeof(uint64_t)) {
+
+            PyErr_SetString(PyExc_ValueError, "Manifest is too small");
+            goto out;
+        }
+
+        if ((hashes = PyMem_Malloc(pages * sizeof(uint64_t) + 1)) == NULL) {
+
+            PyErr_NoMemory();
+            goto out;
+        }
+
+        memcpy(hashes, manifest.buf, pages * sizeof(uint64_t));
+    }
+
+    if (i2c_ref(dev.bus) == -1) {
+
+        PyErr_SetFromErrno(PyExc_IOError);
+        goto out;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = i2c_write_diff(&dev, iaddr, buf.buf, buf.len, hashes, &stat);
+    I2CDevice_release_dev(&dev);
+    Py_END_ALLOW_THREADS
+
+    if (hashes) {
+
+        memcpy(manifest.buf, hashes, pages * sizeof(uint64_t));
+    }
+
+    if (ret == -1) {
+
+        PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+out:
+    PyMem_Free(hashes);
+    PyBuffer_Release(&buf);
+    if (manifest.obj) {
+
+        PyBuffer_Release(&manifest);
+    }
+
+    return PyErr_Occurred() ? NULL : Py_BuildValue("(II)", stat.written, stat.skipped);
+}
+
+
+/* differential write manifest */
+PyDoc_STRVAR(I2CDevice_diff_manifest_doc, "diff_manifest(iaddr, buf) -> bytearray\n\n"
+             "Page hashes of image #buf already on device #iaddress, using by write_diff instead of read back device.\n");
+static PyObject *I2CDevice_diff_manifest(I2CDeviceObject *self, PyObject *args) {
+
+    size_t pages;
+    Py_buffer buf;
+    uint64_t *hashes;
+    unsigned int iaddr = 0;
+    PyObject *bytearray;
+
+    if (!PyArg_ParseTuple(args, "Is*:diff_manifest", &iaddr, &buf)) {
+
+        return NULL;
+    }
+
+    pages = i2c_diff_pages(&self->dev, iaddr, buf.len);
+    if ((hashes = PyMem_Malloc(pages * sizeof(uint64_t) + 1)) == NULL) {
+
+        PyBuffer_Release(&buf);
+        return PyErr_NoMemory();
+    }
+
+    i2c_diff_manifest(&self->dev, iaddr, buf.buf, buf.len, hashes);
+    bytearray = PyByteArray_FromStringAndSize((const char *)hashes, pages * sizeof(uint64_t));
+
+    PyMem_Free(hashes);
+    PyBuffer_Release(&buf);
+    return bytearray;
+}
+
+
+/* asyncio read */
+PyDoc_STRVAR(I2CDevice_aread_doc, "aread(iaddr, size) -> awaitable\n\n"
+             "Same as ioctl_read, running on bus async worker, await it on asyncio event loop get the bytearray.\n");
+static PyObject *I2CDevice_aread(I2CDeviceObject *self, PyObject *args) {
+
+    I2CDevice dev;
+    unsigned int len = 0;
+    unsigned int iaddr = 0;
+
+    if (!PyArg_ParseTuple(args, "II:aread", &iaddr, &len)) {
+
+        return NULL;
+    }
+
+    if (I2CDevice_get_dev(self, &dev) == -1) {
+
+        return NULL;
+    }
+
+    return I2CBus_async_request(self->bus, &dev, I2C_ASYNC_READ, iaddr, NULL, len);
+}
+
+
+/* asyncio write */
+PyDoc_STRVAR(I2CDevice_awrite_doc, "awrite(iaddr, buf) -> awaitable\n\n"
+             "Same as ioctl_write, running on bus async worker, await it on asyncio event loop get the write bytes.\n");
+static PyObject *I2CDevice_awrite(I2CDeviceObject *self, PyObject *args) {
+
+    I2CDevice dev;
+    Py_buffer buf;
+    unsigned int iaddr = 0;
+
+    /* Buffer is pinned until request completed */
+    if (!PyArg_ParseTuple(args, "Is*:awrite", &iaddr, &buf)) {
+
+        return NULL;
+    }
+
+    if (I2CDevice_get_dev(self, &dev) == -1) {
+
+        PyBuffer_Release(&buf);
+        return NULL;
+    }
+
+    return I2CBus_async_request(self->bus, &dev, I2C_ASYNC_WRITE, iaddr, &buf, buf.len);
+}
+
+
+/* SMBus transfer without GIL, failed raise IOError */
+static int i2c_smbus_device(I2CDeviceObject *self, char read_write, unsigned char command, int size, union i2c_smbus_data *data) {
+
+    int ret;
+    I2CDevice dev;
+
+    if (I2CDevice_hold_dev(self, &dev) == -1) {
+
+        return -1;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = i2c_smbus_access(&dev, read_write, command, size, data);
+    I2CDevice_release_dev(&dev);
+    Py_END_ALLOW_THREADS
+
+    if (ret == -1) {
+
+        PyErr_SetFromErrno(PyExc_IOError);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* SMBus write block from buffer, #size is I2C_SMBUS_BLOCK_DATA or I2C_SMBUS_I2C_BLOCK_DATA */
+static PyObject *i2c_smbus_write_block_device(I2CDeviceObject *self, PyObject *args, int size) {
+
+    int ret;
+    Py_buffer buf;
+    unsigned char command = 0;
+    union i2c_smbus_data data;
+
+    if (!PyArg_ParseTuple(args, "Bs*:write_block_data", &command, &buf)) {
+
+        return NULL;
+    }
+
+    /* Same as i2c_smbus_write_block_data and i2c_smbus_write_i2c_block_data */
+    if (buf.len < 1 || buf.len > I2C_SMBUS_BLOCK_MAX) {
+
+        PyBuffer_Release(&buf);
+        PyErr_SetString(PyExc_ValueError, "Block data length must be 1 to 32");
+        return NULL;
+    }
+
+    data.block[0] = buf.len;
+    memcpy(data.block + 1, buf.buf, buf.len);
+    PyBuffer_Release(&buf);
+
+    ret = i2c_smbus_device(self, I2C_SMBUS_WRITE, command, size, &data);
+    return ret == -1 ? NULL : PyLong_FromLong(data.block[0]);
+}
+
+
+PyDoc_STRVAR(I2CDevice_write_quick_doc, "write_quick(value)\n\nSMBus quick command, #value is the R/W bit.\n");
+static PyObject *I2CDevice_write_quick(I2CDeviceObject *self, PyObject *args) {
+
+    unsigned char value = 0;
+
+    if (!PyArg_ParseTuple(args, "B:write_quick", &value)) {
+
+        return NULL;
+    }
+
+    if (i2c_smbus_device(self, value, 0, I2C_SMBUS_QUICK, NULL) == -1) {
+
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+
+PyDoc_STRVAR(I2CDevice_read_byte_doc, "read_byte() -> int\n\nSMBus receive byte.\n");
+static PyObject *I2CDevice_read_byte(I2CDeviceObject *self, PyObject *args) {
+    (void)args;
+
+    union i2c_smbus_data data;
+
+    if (i2c_smbus_device(self, I2C_SMBUS_READ, 0, I2C_SMBUS_BYTE, &data) == -1) {
+
+        return NULL;
+    }
+
+    return PyLong_FromLong(data.byte);
+}
+
+
+PyDoc_STRVAR(I2CDevice_write_byte_doc, "write_byte(value)\n\nSMBus send byte.\n");
+static PyObject *I2CDevice_write_byte(I2CDeviceObject *self, PyObject *args) {
+
+    unsigned char value = 0;
+
+    if (!PyArg_ParseTuple(args, "B:write_byte", &value)) {
+
+        return NULL;
+    }
+
+    if (i2c_smbus_device(self, I2C_SMBUS_WRITE, value, I2C_SMBUS_BYTE, NULL) == -1) {
+
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+
+PyDoc_STRVAR(I2CDevice_read_byte_data_doc, "read_byte_data(command) -> int\n\nSMBus read byte from #command register.\n");
+static PyObject *I2CDevice_read_byte_data(I2CDeviceObject *self, PyObject *args) {
+
+    unsigned char command = 0;
+    union i2c_smbus_data data;
+
+    if (!PyArg_ParseTuple(args, "B:read_byte_data", &command)) {
+
+        return NULL;
+    }
+
+    if (i2c_smbus_device(self, I2C_SMBUS_READ, command, I2C_SMBUS_BYTE_DATA, &data) == -1) {
+
+        return NULL;
+    }
+
+    return PyLong_FromLong(data.byte);
+}
+
+
+PyDoc_STRVAR(I2CDevice_write_byte_data_doc, "write_byte_data(command, value)\n\nSMBus write byte to #command register.\n");
+static PyObject *I2CDevice_write_byte_data(I2CDeviceObject *self, PyObject *args) {
+
+    unsigned char command = 0;
+    union i2c_smbus_data data;
+
+    if (!PyArg_ParseTuple(args, "BB:write_byte_data", &command, &data.byte)) {
+
+        return NULL;
+    }
+
+    if (i2c_smbus_device(self, I2C_SMBUS_WRITE, command, I2C_SMBUS_BYTE_DATA, &data) == -1) {
+
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+
+PyDoc_STRVAR(I2CDevice_read_word_data_doc, "read_word_data(command) -> int\n\nSMBus read word(little endian) from #command register.\n");
+static PyObject *I2CDevice_read_word_data(I2CDeviceObject *self, PyObject *args) {
+
+    unsigned char command = 0;
+    union i2c_smbus_data data;
+
+    if (!PyArg_ParseTuple(args, "B:read_word_data", &command)) {
+
+        return NULL;
+    }
+
+    if (i2c_smbus_device(self, I2C_SMBUS_READ, command, I2C_SMBUS_WORD_DATA, &data) == -1) {
+
+        return NULL;
+    }
+
+    return PyLong_FromLong(data.word);
+}
+
+
+PyDoc_STRVAR(I2CDevice_write_word_data_doc, "write_word_data(command, value)\n\nSMBus write word(little endian) to #command register.\n");
+static PyObject *I2CDevice_write_word_data(I2CDeviceObject *self, PyObject *args) {
+
+    unsigned char command = 0;
+    union i2c_smbus_data data;
+
+    if (!PyArg_ParseTuple(args, "BH:write_word_data", &command, &data.word)) {
+
+        return NULL;
+    }
+
+    if (i2c_smbus_device(self, I2C_SMBUS_WRITE, command, I2C_SMBUS_WORD_DATA, &data) == -1) {
+
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+
+PyDoc_STRVAR(I2CDevice_process_call_doc, "process_call(command, value) -> int\n\nSMBus process call, write word then read word.\n");
+static PyObject *I2CDevice_process_call(I2CDeviceObject *self, PyObject *args) {
+
+    unsigned char command = 0;
+    union i2c_smbus_data data;
+
+    if (!PyArg_ParseTuple(args, "BH:process_call", &command, &data.word)) {
+
+        return NULL;
+    }
+
+    if (i2c_smbus_device(self, I2C_SMBUS_WRITE, command, I2C_SMBUS_PROC_CALL, &data) == -1) {
+
+        return NULL;
+    }
+
+    return PyLong_FromLong(data.word);
+}
+
+
+PyDoc_STRVAR(I2CDevice_read_block_data_doc, "read_block_data(command) -> bytearray\n\nSMBus block read, length sent by device.\n");
+static PyObject *I2CDevice_read_block_data(I2CDeviceObject *self, PyObject *args) {
+
+    unsigned char command = 0;
+    union i2c_smbus_data data;
+
+    if (!PyArg_ParseTuple(args, "B:read_block_data", &command)) {
+
+        return NULL;
+    }
+
+    if (i2c_smbus_device(self, I2C_SMBUS_READ, command, I2C_SMBUS_BLOCK_DATA, &data) == -1) {
+
+        return NULL;
+    }
+
+    return PyByteArray_FromStringAndSize((const char *)data.block + 1, data.block[0]);
+}
+
+
+PyDoc_STRVAR(I2CDevice_write_block_data_doc, "write_block_data(command, buf) -> int\n\nSMBus block write, 1 - 32 bytes, return write bytes.\n");
+static PyObject *I2CDevice_write_block_data(I2CDeviceObject *self, PyObject *args) {
+
+    return i2c_smbus_write_block_device(self, args, I2C_SMBUS_BLOCK_DATA);
+}
+
+
+PyDoc_STRVAR(I2CDevice_read_i2c_block_data_doc, "read_i2c_block_data(command, length) -> bytearray\n\n"
+             "Read #length(1 - 32) bytes from #command register, no length byte on bus.\n");
+static PyObject *I2CDevice_read_i2c_block_data(I2CDeviceObject *self, PyObject *args) {
+
+    unsigned char length = 0;
+    unsigned char command = 0;
+    union i2c_smbus_data data;
+
+    if (!PyArg_ParseTuple(args, "BB:read_i2c_block_data", &command, &length)) {
+
+        return NULL;
+    }
+
+    if (length == 0 || length > I2C_SMBUS_BLOCK_MAX) {
+
+        PyErr_SetString(PyExc_ValueError, "Block data length must be 1 - 32");
+        return NULL;
+    }
+
+    data.block[0] = length;
+    if (i2c_smbus_device(self, I2C_SMBUS_READ, command, I2C_SMBUS_I2C_BLOCK_DATA, &data) == -1) {
+
+        return NULL;
+    }
+
+    return PyByteArray_FromStringAndSize((const char *)data.block + 1, data.block[0]);
+}
+
+
+PyDoc_STRVAR(I2CDevice_write_i2c_block_data_doc, "write_i2c_block_data(command, buf) -> int\n\n"
+             "Write 1 - 32 bytes to #command register, no length byte on bus, return write bytes.\n");
+static PyObject *I2CDevice_write_i2c_block_data(I2CDeviceObject *self, PyObject *args) {
+
+    return i2c_smbus_write_block_device(self, args, I2C_SMBUS_I2C_BLOCK_DATA);
+}
+
+
+/* Streaming read iterator */
+typedef struct {
+    PyObject_HEAD;
+    I2CDeviceObject *device;
+    unsigned int iaddr;
+    unsigned int remain;
+    unsigned int chunk;
+    int ioctl;
+} I2CReadIterObject;
+
+
+static void I2CReadIter_free(I2CReadIterObject *self) {
+
+    Py_XDECREF(self->device);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+static PyObject *I2CReadIter_next(I2CReadIterObject *self) {
+
+    ssize_t result;
+    I2CDevice dev;
+    PyObject *bytearray = NULL;
+    I2C_READ_HANDLE read_handle = self->ioctl ? i2c_ioctl_read : i2c_read;
+    unsigned int len = self->remain > self->chunk ? self->chunk : self->remain;
+
+    /* StopIteration */
+    if (len == 0) {
+
+        return NULL;
+    }
+
+    if ((bytearray = PyByteArray_FromStringAndSize(NULL, len)) == NULL) {
+
+        return NULL;
+    }
+
+    if (I2CDevice_hold_dev(self->device, &dev) == -1) {
+
+        Py_DECREF(bytearray);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    result = read_handle(&dev, self->iaddr, PyByteArray_AS_STRING(bytearray), len);
+    I2CDevice_release_dev(&dev);
+    Py_END_ALLOW_THREADS
+
+    if (result < 0 || (unsigned int)result != len) {
+
+        Py_DECREF(bytearray);
+        if (result < 0) {
+            PyErr_SetFromErrno(PyExc_IOError);
+        }
+        else {
+            PyErr_SetString(PyExc_IOError, "short read");
+        }
+
+        return NULL;
+    }
+
+    self->iaddr += len;
+    self->remain -= len;
+    return bytearray;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+
+static PyTypeObject I2CReadIterObjectType = {
+#if PY_MAJOR_VERSION >= 3
+    PyVarObject_HEAD_INIT(NULL, 0)
+#else
+    PyObject_HEAD_INIT(NULL) 0, /* ob_size */
+#endif
+    "I2CReadIterator",          /* tp_name */
+    sizeof(I2CReadIterObject),  /* tp_basicsize */
+    0,			        	    /* tp_itemsize */
+    (destructor)I2CReadIter_free,/* tp_dealloc */
+    0,				            /* tp_print */
+    0,				            /* tp_getattr */
+    0,				            /* tp_setattr */
+    0,				            /* tp_compare */
+    0,				            /* tp_repr */
+    0,				            /* tp_as_number */
+    0,				            /* tp_as_sequence */
+    0,				            /* tp_as_mapping */
+    0,				            /* tp_hash */
+    0,				            /* tp_call */
+    0,				            /* tp_str */
+    0,				            /* tp_getattro */
+    0,				            /* tp_setattro */
+    0,				            /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,         /* tp_flags */
+    0,				            /* tp_doc */
+    0,				            /* tp_traverse */
+    0,				            /* tp_clear */
+    0,				            /* tp_richcompare */
+    0,				            /* tp_weaklistoffset */
+    PyObject_SelfIter,          /* tp_iter */
+    (iternextfunc)I2CReadIter_next,/* tp_iternext */
+};
+
+#pragma GCC diagnostic pop
+
+
+static PyObject *i2c_iter_read_device(I2CDeviceObject *self, PyObject *args, PyObject *kwds, int ioctl) {
+
+    I2CReadIterObject *iter;
+    unsigned int iaddr = 0, total = 0, chunk = _I2CDEV_ITER_CHUNK_SIZE_;
+    static char *kwlist[] = {"iaddr", "total", "chunk", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "II|I:iter_read", kwlist, &iaddr, &total, &chunk)) {
+
+        return NULL;
+    }
+
+    if (chunk == 0) {
+        PyErr_SetString(PyExc_ValueError, "The 'chunk' must be greater than 0");
+        return NULL;
+    }
+
+    if ((iter = PyObject_New(I2CReadIterObject, &I2CReadIterObjectType)) == NULL) {
+
+        return NULL;
+    }
+
+    Py_INCREF(self);
+    iter->device = self;
+    iter->iaddr = iaddr;
+    iter->remain = total;
+    iter->chunk = chunk;
+    iter->ioctl = ioctl;
+    return (PyObject *)iter;
+}
+
+
+/* file streaming read */
+PyDoc_STRVAR(I2CDevice_iter_read_doc, "iter_read(iaddr, total, chunk=4096)\n\n"
+             "Return a iterator read #total bytes data from device #iaddress, each iteration yield a #chunk bytes bytearray.\n");
+static PyObject *I2CDevice_iter_read(I2CDeviceObject *self, PyObject *args, PyObject *kwds) {
+
+    return i2c_iter_read_device(self, args, kwds, 0);
+}
+
+
+/* ioctl streaming read */
+PyDoc_STRVAR(I2CDevice_ioctl_iter_read_doc, "ioctl_iter_read(iaddr, total, chunk=4096)\n\n"
+             "Return a iterator ioctl read #total bytes data from device #iaddress, each iteration yield a #chunk bytes bytearray.\n");
+static PyObject *I2CDevice_ioctl_iter_read(I2CDeviceObject *self, PyObject *args, PyObject *kwds) {
+
+    return i2c_iter_read_device(self, args, kwds, 1);
+}
+
+
+/* Write-back page cache */
+typedef struct {
+    PyObject_HEAD;
+    I2CDeviceObject *device;
+    int bus;                    /* Bus cache created on, device may reopen other bus */
+    unsigned int users;         /* Operations running without GIL */
+    I2CCache *cache;            /* NULL if closed */
+} I2CCacheObject;
+
+
+/* Check cache and it's bus still open, mark it in use */
+static int I2CCache_acquire(I2CCacheObject *self) {
+
+    I2CDevice dev;
+
+    if (self->cache == NULL) {
+
+        PyErr_SetString(PyExc_IOError, "I2C cache is closed");
+        return -1;
+    }
+
+    if (I2CDevice_get_dev(self->device, &dev) == -1) {
+
+        return -1;
+    }
+
+    if (dev.bus != self->bus) {
+
+        PyErr_SetString(PyExc_IOError, "I2C bus is closed");
+        return -1;
+    }
+
+    /* Bus closed by other thread is released after I2CCache_release */
+    if (i2c_ref(self->bus) == -1) {
+
+        PyErr_SetFromErrno(PyExc_IOError);
+        return -1;
+    }
+
+    self->users++;
+    return 0;
+}
+
+
+static void I2CCache_release(I2CCacheObject *self) {
+
+    self->users--;
+    i2c_unref(self->bus);
+}
+
+
+static void I2CCache_free(I2CCacheObject *self) {
+
+    I2CCache *cache = self->cache;
+    int held = cache && I2CCache_acquire(self) == 0;
+
+    /* Bus is gone, dirty pages can't write back */
+    if (cache && !held) {
+
+        PyErr_Clear();
+        i2c_cache_invalidate(cache, 0, (size_t) -1);
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    i2c_cache_destroy(cache);
+    Py_END_ALLOW_THREADS
+
+    if (held) {
+
+        I2CCache_release(self);
+    }
+
+    Py_XDECREF(self->device);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+PyDoc_STRVAR(I2CCache_close_doc, "close()\n\nWrite back dirty pages and close cache.\n");
+static PyObject *I2CCache_close(I2CCacheObject *self) {
+
+    int ret;
+    I2CCache *cache = self->cache;
+
+    if (cache == NULL) {
+
+        Py_RETURN_NONE;
+    }
+
+    if (I2CCache_acquire(self) == -1) {
+
+        return NULL;
+    }
+
+    /* Other thread is using it */
+    if (self->users > 1) {
+
+        I2CCache_release(self);
+        errno = EBUSY;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = i2c_cache_flush(cache);
+    Py_END_ALLOW_THREADS
+
+    I2CCache_release(self);
+    if (ret == -1) {
+
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    self->cache = NULL;
+    i2c_cache_destroy(cache);
+    Py_RETURN_NONE;
+}
+
+
+static PyObject *I2CCache_exit(I2CCacheObject *self, PyObject *args) {
+    (void)args;
+
+    PyObject *ret = I2CCache_close(self);
+
+    if (ret == NULL) {
+
+        return NULL;
+    }
+
+    Py_DECREF(ret);
+    Py_RETURN_FALSE;
+}
+
+
+PyDoc_STRVAR(I2CCache_read_doc, "read(iaddr, size) -> bytearray\n\nRead #size bytes from cache, pages not cached load from device.\n");
+static PyObject *I2CCache_read(I2CCacheObject *self, PyObject *args) {
+
+    ssize_t ret;
+    unsigned int len = 0;
+    unsigned int iaddr = 0;
+    PyObject *bytearray = NULL;
+
+    if (!PyArg_ParseTuple(args, "II:read", &iaddr, &len)) {
+
+        return NULL;
+    }
+
+    if ((bytearray = PyByteArray_FromStringAndSize(NULL, len)) == NULL) {
+
+        return NULL;
+    }
+
+    if (I2CCache_acquire(self) == -1) {
+
+        Py_DECREF(bytearray);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = i2c_cache_read(self->cache, iaddr, PyByteArray_AS_STRING(bytearray), len);
+    Py_END_ALLOW_THREADS
+
+    I2CCache_release(self);
+    if (ret == -1) {
+
+        Py_DECREF(bytearray);
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    return bytearray;
+}
+
+
+PyDoc_STRVAR(I2CCache_write_doc, "write(iaddr, buf) -> int\n\nWrite #buf to cache, nothing write to device until flush.\n");
+static PyObject *I2CCache_write(I2CCacheObject *self, PyObject *args) {
+
+    ssize_t ret;
+    Py_buffer buf;
+    unsigned int iaddr = 0;
+
+    if (!PyArg_ParseTuple(args, "Is*:write", &iaddr, &buf)) {
+
+        return NULL;
+    }
+
+    if (I2CCache_acquire(self) == -1) {
+
+        PyBuffer_Release(&buf);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = i2c_cache_write(self->cache, iaddr, buf.buf, buf.len);
+    Py_END_ALLOW_THREADS
+
+    I2CCache_release(self);
+    PyBuffer_Release(&buf);
+    if (ret == -1) {
+
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    return PyLong_FromSsize_t(ret);
+}
+
+
+/* flush and sync */
+static PyObject *i2c_cache_flush_device(I2CCacheObject *self, int (*flush)(I2CCache *)) {
+
+    int ret;
+
+    if (I2CCache_acquire(self) == -1) {
+
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = flush(self->cache);
+    Py_END_ALLOW_THREADS
+
+    I2CCache_release(self);
+    if (ret == -1) {
+
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    Py_RETURN_NONE;
+}
+
+
+PyDoc_STRVAR(I2CCache_flush_doc, "flush()\n\nWrite back dirty pages, dirty part of continuous pages write at once.\n");
+static PyObject *I2CCache_flush(I2CCacheObject *self) {
+
+    return i2c_cache_flush_device(self, i2c_cache_flush);
+}
+
+
+PyDoc_STRVAR(I2CCache_sync_doc, "sync()\n\nWrite back dirty pages then drop all cached pages, next read load from device.\n");
+static PyObject *I2CCache_sync(I2CCacheObject *self) {
+
+    return i2c_cache_flush_device(self, i2c_cache_sync);
+}
+
+
+PyDoc_STRVAR(I2CCache_invalidate_doc, "invalidate(iaddr=0, size=-1)\n\n"
+             "Drop cached pages overlap [iaddr, iaddr + size), dirty data are discarded, size -1 means to the end.\n");
+static PyObject *I2CCache_invalidate(I2CCacheObject *self, PyObject *args, PyObject *kwds) {
+
+    Py_ssize_t len = -1;
+    unsigned int iaddr = 0;
+    static char *kwlist[] = {"iaddr", "size", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|In:invalidate", kwlist, &iaddr, &len)) {
+
+        return NULL;
+    }
+
+    if (self->cache == NULL) {
+
+        PyErr_SetString(PyExc_IOError, "I2C cache is closed");
+        return NULL;
+    }
+
+    /* Never touch bus, no need release GIL */
+    i2c_cache_invalidate(self->cache, iaddr, len < 0 ? (size_t) -1 : (size_t)len);
+    Py_RETURN_NONE;
+}
+
+
+PyDoc_STRVAR(I2CCache_dirty_doc, "Number of dirty pages.\n");
+static PyObject *I2CCache_get_dirty(I2CCacheObject *self, void *closure) {
+    (void)closure;
+
+    return PyLong_FromUnsignedLong(self->cache ? i2c_cache_dirty(self->cache) : 0);
+}
+
+
+static PyMethodDef I2CCache_methods[] = {
+
+    {"read", (PyCFunction)I2CCache_read, METH_VARARGS, I2CCache_read_doc},
+    {"write", (PyCFunction)I2CCache_write, METH_VARARGS, I2CCache_write_doc},
+    {"flush", (PyCFunction)I2CCache_flush, METH_NOARGS, I2CCache_flush_doc},
+    {"sync", (PyCFunction)I2CCache_sync, METH_NOARGS, I2CCache_sync_doc},
+    {"invalidate", (PyCFunction)I2CCache_invalidate, METH_VARARGS | METH_KEYWORDS, I2CCache_invalidate_doc},
+    {"close", (PyCFunction)I2CCache_close, METH_NOARGS, I2CCache_close_doc},
+    {"__enter__", (PyCFunction)I2CDevice_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)I2CCache_exit, METH_VARARGS, NULL},
+    {NULL},
+};
+
+
+static PyGetSetDef I2CCache_getseters[] = {
+
+    {"dirty", (getter)I2CCache_get_dirty, NULL, I2CCache_dirty_doc, NULL},
+    {NULL},
+};
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+
+static PyTypeObject I2CCacheObjectType = {
+#if PY_MAJOR_VERSION >= 3
+    PyVarObject_HEAD_INIT(NULL, 0)
+#else
+    PyObject_HEAD_INIT(NULL) 0, /* ob_size */
+#endif
+    "I2CCache",                 /* tp_name */
+    sizeof(I2CCacheObject),     /* tp_basicsize */
+    0,			        	    /* tp_itemsize */
+    (destructor)I2CCache_free,  /* tp_dealloc */
+    0,				            /* tp_print */
+    0,				            /* tp_getattr */
+    0,				            /* tp_setattr */
+    0,				            /* tp_compare */
+    0,				            /* tp_repr */
+    0,				            /* tp_as_number */
+    0,				            /* tp_as_sequence */
+    0,				            /* tp_as_mapping */
+    0,				            /* tp_hash */
+    0,				            /* tp_call */
+    0,				            /* tp_str */
+    0,				            /* tp_getattro */
+    0,				            /* tp_setattro */
+    0,				            /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,         /* tp_flags */
+    0,				            /* tp_doc */
+    0,				            /* tp_traverse */
+    0,				            /* tp_clear */
+    0,				            /* tp_richcompare */
+    0,				            /* tp_weaklistoffset */
+    0,				            /* tp_iter */
+    0,				            /* tp_iternext */
+    I2CCache_methods,           /* tp_methods */
+    0,				            /* tp_members */
+    I2CCache_getseters,         /* tp_getset */
+};
+
+#pragma GCC diagnostic pop
+
+
+PyDoc_STRVAR(I2CDevice_cache_doc, "cache(size) -> I2CCache\n\n"
+             "Return a write-back cache of device internal address [0, size), page size is current 'page_bytes', "
+             "read/write only touch cache, flush/sync/close write back dirty pages.\n");
+static PyObject *I2CDevice_cache(I2CDeviceObject *self, PyObject *args) {
+
+    I2CDevice dev;
+    unsigned int size = 0;
+    I2CCacheObject *cache;
+
+    if (!PyArg_ParseTuple(args, "I:cache", &size)) {
+
+        return NULL;
+    }
+
+    if (I2CDevice_get_dev(self, &dev) == -1) {
+
+        return NULL;
+    }
+
+    if ((cache = PyObject_New(I2CCacheObject, &I2CCacheObjectType)) == NULL) {
+
+        return NULL;
+    }
+
+    Py_INCREF(self);
+    cache->device = self;
+    cache->bus = dev.bus;
+    cache->users = 0;
+
+    if ((cache->cache = i2c_cache_create(&dev, size)) == NULL) {
+
+        Py_DECREF(cache);
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    return (PyObject *)cache;
+}
+
+
+/* pylibi2c module methods */
+PyDoc_STRVAR(I2CDevice_stats_doc, "stats() -> dict\n\nDevice statistics, same as I2CBus.stats only transfers of this device address.\n");
+static PyObject *I2CDevice_stats(I2CDeviceObject *self) {
+
+    I2CDevice dev;
+    I2CStats stats;
+
+    if (I2CDevice_get_dev(self, &dev) == -1) {
+
+        return NULL;
+    }
+
+    if (i2c_get_device_stats(&dev, &stats) == -1) {
+
+        PyErr_SetFromErrno(PyExc_IOError);
+        return NULL;
+    }
+
+    return i2c_stats_dict(&stats);
+}
+
+
+static PyMethodDef I2CDevice_methods[] = {
+
+    {"read", (PyCFunction)I2CDevice_read, METH_VARARGS, I2CDevice_read_doc},
+    {"write", (PyCFunction)I2CDevice_write, METH_VARARGS, I2CDevice_write_doc},
+    {"close", (PyCFunction)I2CDevice_close, METH_NOARGS, I2CDevice_close_doc},
+    {"readinto", (PyCFunction)I2CDevice_readinto, METH_VARARGS, I2CDevice_readinto_doc},
+    {"ioctl_read", (PyCFunction)I2CDevice_ioctl_read, METH_VARARGS, I2CDevice_ioctl_read_doc},
+    {"ioctl_readinto", (PyCFunction)I2CDevice_ioctl_readinto, METH_VARARGS, I2CDevice_ioctl_readinto_doc},
+    {"iter_read", (PyCFunction)I2CDevice_iter_read, METH_VARARGS | METH_KEYWORDS, I2CDevice_iter_read_doc},
+    {"ioctl_iter_read", (PyCFunction)I2CDevice_ioctl_iter_read, METH_VARARGS | METH_KEYWORDS, I2CDevice_ioctl_iter_read_doc},
+    {"ioctl_write", (PyCFunction)I2CDevice_ioctl_write, METH_VARARGS, I2CDevice_ioctl_write_doc},
+    {"readv", (PyCFunction)I2CDevice_readv, METH_VARARGS, I2CDevice_readv_doc},
+    {"writev", (PyCFunction)I2CDevice_writev, METH_VARARGS, I2CDevice_writev_doc},
+    {"write_diff", (PyCFunction)I2CDevice_write_diff, METH_VARARGS | METH_KEYWORDS, I2CDevice_write_diff_doc},
+    {"diff_manifest", (PyCFunction)I2CDevice_diff_manifest, METH_VARARGS, I2CDevice_diff_manifest_doc},
+    {"stats", (PyCFunction)I2CDevice_stats, METH_NOARGS, I2CDevice_stats_doc},
+    {"cache", (PyCFunction)I2CDevice_cache, METH_VARARGS, I2CDevice_cache_doc},
+    {"auto_read", (PyCFunction)I2CDevice_auto_read, METH_VARARGS, I2CDevice_auto_read_doc},
+    {"auto_write", (PyCFunction)I2CDevice_auto_write, METH_VARARGS, I2CDevice_auto_write_doc},
+    {"aread", (PyCFunction)I2CDevice_aread, METH_VARARGS, I2CDevice_aread_doc},
+    {"awrite", (PyCFunction)I2CDevice_awrite, METH_VARARGS, I2CDevice_awrite_doc},
+    {"write_quick", (PyCFunction)I2CDevice_write_quick, METH_VARARGS, I2CDevice_write_quick_doc},
+    {"read_byte", (PyCFunction)I2CDevice_read_byte, METH_NOARGS, I2CDevice_read_byte_doc},
+    {"write_byte", (PyCFunction)I2CDevice_write_byte, METH_VARARGS, I2CDevice_write_byte_doc},
+    {"read_byte_data", (PyCFunction)I2CDevice_read_byte_data, METH_VARARGS, I2CDevice_read_byte_data_doc},
+    {"write_byte_data", (PyCFunction)I2CDevice_write_byte_data, METH_VARARGS, I2CDevice_write_byte_data_doc},
+    {"read_word_data", (PyCFunction)I2CDevice_read_word_data, METH_VARARGS, I2CDevice_read_word_data_doc},
+    {"write_word_data", (PyCFunction)I2CDevice_write_word_data, METH_VARARGS, I2CDevice_write_word_data_doc},
+    {"process_call", (PyCFunction)I2CDevice_process_call, METH_VARARGS, I2CDevice_process_call_doc},
+    {"read_block_data", (PyCFunction)I2CDevice_read_block_data, METH_VARARGS, I2CDevice_read_block_data_doc},
+    {"write_block_data", (PyCFunction)I2CDevice_write_block_data, METH_VARARGS, I2CDevice_write_block_data_doc},
+    {"read_i2c_block_data", (PyCFunction)I2CDevice_read_i2c_block_data, METH_VARARGS, I2CDevice_read_i2c_block_data_doc},
+    {"write_i2c_block_data", (PyCFunction)I2CDevice_write_i2c_block_data, METH_VARARGS, I2CDevice_write_i2c_block_data_doc},
+    {"__enter__", (PyCFunction)I2CDevice_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)I2CDevice_exit, METH_VARARGS, NULL},
+    {NULL},
+};
+
+
+/* Check */
+static int check_user_input(const char *name, PyObject *input, int min, int max) {
+
+    int value;
+
+    if (input == NULL) {
+        PyErr_SetString(PyExc_TypeError, "Cannot delete the last attribute");
+        return -1;
+    }
+
+    /* tenbit and pec attribute, boolean type */
+    if (strcmp(name, "tenbit") == 0 || strcmp(name, "pec") == 0) {
+        if (!PyBool_Check(input)) {
+            PyErr_SetString(PyExc_TypeError, "The last attribute value must be boolean");
+            return -1;
+        }
+
+        return 0;
+    }
+
+    /* Other attribute, integer type */
+    if (!PyInt_Check(input)) {
+        PyErr_SetString(PyExc_TypeError, "The last attribute value must be an integer");
+        return -1;
+    }
+
+    /* Convert value to int */
+    value = PyLong_AsLong(input);
+
+    /* Check input value range */
+    if (value < min || value > max) {
+        PyErr_Format(PyExc_ValueError, "invalid ' %s'(%d - %d)", name, min, max);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* flags */
+PyDoc_STRVAR(I2CDevice_flags_doc, "ioctl_read/write i2c_msg flags\n\n"
+             "I_2C_M_NOSTART\n"
+             "In a combined transaction, no 'S Addr Wr/Rd [A]' is generated at some point."
+             "For example, setting I2C_M_NOSTART on the second partial message generates something like:\n\n"
+             "\t\t\tS Addr Rd [A] [Data] NA Data [A] P\n\n"
+             "If you set the I2C_M_NOSTART variable for the first partial message, we do not generate Addr,"
+             "but we do generate the startbit S. This will probably confuse all other clients on your bus, so don't try this.\n\n"
+             "I2C_M_IGNORE_NAK\n"
+             "Normally message is interrupted immediately if there is [NA] from the"
+             "client. Setting this flag treats any [NA] as [A], and all of message is sent.These messages may still fail to SCL lo->hi timeout.\n\n"
+             "I2C_M_NO_RD_ACK\n"
+             "In a read message, master A/NA bit is skipped.\n\n");
+static PyObject *I2CDevice_get_flags(I2CDeviceObject *self, void *closure) {
+    (void)closure;
+
+    return Py_BuildValue("H", self->dev.flags);
+}
+
+static int I2CDevice_set_flags(I2CDeviceObject *self, PyObject *value, void *closure)
+{
+    (void)closure;
+
+    if (check_user_input("falgs", value, 0, I2C_M_NOSTART) != 0) {
+
+        return -1;
+    }
+
+    self->dev.flags = PyLong_AsLong(value);
+    return 0;
+}
+
+/* delay */
+PyDoc_STRVAR(I2CDevice_delay_doc, "i2c internal operate delay, unit milliscond.\n\n");
+static PyObject *I2CDevice_get_delay(I2CDeviceObject *self, void *closure) {
+    (void)closure;
+
+    return Py_BuildValue("B", self->dev.delay);
+}
+
+static int I2CDevice_set_delay(I2CDeviceObject *self, PyObject *value, void *closure)
+{
+    (void)closure;
+
+    if (check_user_input("delay", value, 0, 100) != 0) {
+
+        return -1;
+    }
+
+    self->dev.delay = PyLong_AsLong(value);
+    return 0;
+}
+
+/* tenbit */
+PyDoc_STRVAR(I2CDevice_tenbit_doc, "True, Enable 10 bit addressing.\n\nFalse, 7 bit addressing(default).\n");
+static PyObject *I2CDevice_get_tenbit(I2CDeviceObject *self, void *closure) {
+    (void)closure;
+
+    PyObject *result = self->dev.tenbit ? Py_True : Py_False;
+    Py_INCREF(result);
+    return result;
+}
+
+static int I2CDevice_set_tenbit(I2CDeviceObject *self, PyObject *value, void *closure)
+{
+    (void)closure;
+
+    if (check_user_input("tenbit", value, 0, 1) != 0) {
+
+        return -1;
+    }
+
+    self->dev.tenbit = PyLong_AsLong(value);
+    return 0;
+}
+
+/* iaddr_bytes */
+PyDoc_STRVAR(I2CDevice_page_bytes_doc, "i2c EEPROM max number of bytes per page (must be divisible by 8)\n\n"
+             "8, 8 bytes per page, such as 24C01/24C02\n\n"
+             "16, 16 bytes per page, such as 24C04/24C08/24C16\n\n"
+             "32, 32 bytes per page, such as 24C32/24C64\n\n");
+static PyObject *I2CDevice_get_page_bytes(I2CDeviceObject *self, void *closure) {
+    (void)closure;
+
+    return Py_BuildValue("I", self->dev.page_bytes);
+}
+
+static int I2CDevice_set_page_bytes(I2CDeviceObject *self, PyObject *value, void *closure)
+{
+    (void)closure;
+
+    int page_bytes = 0;
+
+    if (check_user_input("page_bytes", value, 8, _I2CDEV_MAX_PAGE_BYTES_SIZE) != 0) {
+
+        return -1;
+    }
+
+    page_bytes = PyLong_AsLong(value);
+
+    /* Divisible by 8 */
+    if (page_bytes % 8) {
+        PyErr_SetString(PyExc_ValueError, "The 'page_bytes' must be divisible by 8");
+        return -1;
+    }
+
+    self->dev.page_bytes = page_bytes;
+    return 0;
+}
+
+/* iaddr_bytes */
+PyDoc_STRVAR(I2CDevice_iaddr_bytes_doc, "I2C device internal(word) address bytes.\n\n"
+             "0, special device, without internal address\n\n"
+             "1, 1 byte internal address, such as 24C04\n\n"
+             "2, 2 byte internal address, such as 24C64\n\n"
+             "2, 3 byte internal address, such as 24C1024\n\n");
+static PyObject *I2CDevice_get_iaddr_bytes(I2CDeviceObject *self, void *closure) {
+    (void)closure;
+
+    return Py_BuildValue("I", self->dev.iaddr_bytes);
+}
+
+static int I2CDevice_set_iaddr_bytes(I2CDeviceObject *self, PyObject *value, void *closure)
+{
+    (void)closure;
+
+    if (check_user_input("iaddr_bytes", value, 0, _I2CDEV_MAX_IADDR_BYTES_SIZE) != 0) {
+
+        return -1;
+    }
+
+    self->dev.iaddr_bytes = PyLong_AsLong(value);
+    return 0;
+}
+
+/* completion */
+PyDoc_STRVAR(I2CDevice_completion_doc, "i2c write cycle completion mode.\n\n"
+             "I2C_COMPLETION_DELAY, sleep 'delay' milliseconds after each page write(default)\n\n"
+             "I2C_COMPLETION_ACK_POLL, poll device with address only transfer until it ACK, "
+             "limited by 'poll_timeout' and 'poll_max'\n\n"
+             "I2C_COMPLETION_NONE, FRAM/MRAM without page and write cycle, write is not split by 'page_bytes' and no wait\n\n");
+static PyObject *I2CDevice_get_completion(I2CDeviceObject *self, void *closure) {
+    (void)closure;
+
+    return Py_BuildValue("b", self->dev.completion);
+}
+
+static int I2CDevice_set_completion(I2CDeviceObject *self, PyObject *value, void *closure)
+{
+    (void)closure;
+
+    if (check_user_input("completion", value, I2C_COMPLETION_DELAY, I2C_COMPLETION_NONE) != 0) {
+
+        return -1;
+    }
+
+    self->dev.completion = PyLong_AsLong(value);
+    return 0;
+}
+
+/* poll_timeout */
+PyDoc_STRVAR(I2CDevice_poll_timeout_doc, "i2c ACK polling timeout, unit millisecond.\n\n");
+static PyObject *I2CDevice_get_poll_timeout(I2CDeviceObject *self, void *closure) {
+    (void)closure;
+
+    return Py_BuildValue("I", self->dev.poll_timeout);
+}
+
+static int I2CDevice_set_poll_timeout(I2CDeviceObject *self, PyObject *value, void *closure)
+{
+    (void)closure;
+
+    if (check_user_input("poll_timeout", value, 0, 60000) != 0) {
+
+        return -1;
+    }
+
+    self->dev.poll_timeout = PyLong_AsLong(value);
+    return 0;
+}
+
+/* poll_interval */
+PyDoc_STRVAR(I2CDevice_poll_interval_doc, "i2c ACK polling interval, unit microsecond.\n\n");
+static PyObject *I2CDevice_get_poll_interval(I2CDeviceObject *self, void *closure) {
+    (void)closure;
+
+    return Py_BuildValue("I", self->dev.poll_interval);
+}
+
+static int I2CDevice_set_poll_interval(I2CDeviceObject *self, PyObject *value, void *closure)
+{
+    (void)closure;
+
+    if (check_user_input("poll_interval", value, 0, 1000000) != 0) {
+
+        return -1;
+    }
+
+    self->dev.poll_interval = PyLong_AsLong(value);
+    return 0;
+}
+
+/* poll_max */
+PyDoc_STRVAR(I2CDevice_poll_max_doc, "i2c ACK polling max attempts, 0 means only limit by 'poll_timeout'.\n\n");
+static PyObject *I2CDevice_get_poll_max(I2CDeviceObject *self, void *closure) {
+    (void)closure;
+
+    return Py_BuildValue("I", self->dev.poll_max);
+}
+
+static int I2CDevice_set_poll_max(I2CDeviceObject *self, PyObject *value, void *closure)
+{
+    (void)closure;
+
+    if (check_user_input("poll_max", value, 0, 1000000) != 0) {
+
+        return -1;
+    }
+
+    self->dev.poll_max = PyLong_AsLong(value);
+    return 0;
+}
+
+/* pec */
+PyDoc_STRVAR(I2CDevice_pec_doc, "True, SMBus packet error checking enabled.\n\nFalse, disabled(default).\n");
+static PyObject *I2CDevice_get_pec(I2CDeviceObject *self, void *closure) {
+    (void)closure;
+
+    PyObject *result = self->dev.pec ? Py_True : Py_False;
+    Py_INCREF(result);
+    return result;
+}
+
+static int I2CDevice_set_pec(I2CDeviceObject *self, PyObject *value, void *closure)
+{
+    (void)closure;
+
+    if (check_user_input("pec", value, 0, 1) != 0) {
+
+        return -1;
+    }
+
+    self->dev.pec = PyLong_AsLong(value);
+    return 0;
+}
+
+/* retries */
+PyDoc_STRVAR(I2CDevice_retries_doc, "i2c max retries of each page write failed with transient error, 0 never retry(default).\n\n"
+             "Write resume from failed page, failed after some pages written return written bytes.\n");
+static PyObject *I2CDevice_get_retries(I2CDeviceObject *self, void *closure) {
+    (void)closure;
+
+    return Py_BuildValue("B", self->dev.retries);
+}
+
+static int I2CDevice_set_retries(I2CDeviceObject *self, PyObject *value, void *closure)
+{
+    (void)closure;
+
+    if (check_user_input("retries", value, 0, 255) != 0) {
+
+        return -1;
+    }
+
+    self->dev.retries = PyLong_AsLong(value);
+    return 0;
+}
+
+/* retry_on */
+PyDoc_STRVAR(I2CDevice_retry_on_doc, "errno classes count as transient, I2C_RETRY_NAK/TIMEOUT/ARB_LOST/IO combination, "
+             "0 means I2C_RETRY_DEFAULT.\n\n");
+static PyObject *I2CDevice_get_retry_on(I2CDeviceObject *self, void *closure) {
+    (void)closure;
+
+    return Py_BuildValue("B", self->dev.retry_on);
+}
+
+static int I2CDevice_set_retry_on(I2CDeviceObject *self, PyObject *value, void *closure)
+{
+    (void)closure;
+
+    if (check_user_input("retry_on", value, 0, 255) != 0) {
+
+        return -1;
+    }
+
+    self->dev.retry_on = PyLong_AsLong(value);
+    return 0;
+}
+
+/* retry_backoff */
+PyDoc_STRVAR(I2CDevice_retry_backoff_doc, "i2c first retry backoff, doubled each retry and capped at 500ms, unit microsecond, 0 means 1000us.\n\n");
+static PyObject *I2CDevice_get_retry_backoff(I2CDeviceObject *self, void *closure) {
+    (void)closure;
+
+    return Py_BuildValue("I", self->dev.retry_backoff);
+}
+
+static int I2CDevice_set_retry_backoff(I2CDeviceObject *self, PyObject *value, void *closure)
+{
+    (void)closure;
+
+    if (check_user_input("retry_backoff", value, 0, 1000000) != 0) {
+
+        return -1;
+    }
+
+    self->dev.retry_backoff = PyLong_AsLong(value);
+    return 0;
+}
+
+/* block_bits */
+PyDoc_STRVAR(I2CDevice_block_bits_doc, "i2c internal address high bits in slave address, such as: 24C04 1, 24C16 3, 24C1024 1, "
+             "0 means no block select.\n\n");
+static PyObject *I2CDevice_get_block_bits(I2CDeviceObject *self, void *closure) {
+    (void)closure;
+
+    return Py_BuildValue("B", self->dev.block_bits);
+}
+
+static int I2CDevice_set_block_bits(I2CDeviceObject *self, PyObject *value, void *closure)
+{
+    (void)closure;
+
+    if (check_user_input("block_bits", value, 0, 3) != 0) {
+
+        return -1;
+    }
+
+    self->dev.block_bits = PyLong_AsLong(value);
+    return 0;
+}
+
+static PyGetSetDef I2CDevice_getseters[] = {
+
+    {"flags", (getter)I2CDevice_get_flags, (setter)I2CDevice_set_flags, I2CDevice_flags_doc, NULL},
+    {"delay", (getter)I2CDevice_get_delay, (setter)I2CDevice_set_delay, I2CDevice_delay_doc, NULL},
+    {"tenbit", (getter)I2CDevice_get_tenbit, (setter)I2CDevice_set_tenbit, I2CDevice_tenbit_doc, NULL},
+    {"page_bytes", (getter)I2CDevice_get_page_bytes, (setter)I2CDevice_set_page_bytes, I2CDevice_page_bytes_doc, NULL},
+    {"iaddr_bytes", (getter)I2CDevice_get_iaddr_bytes, (setter)I2CDevice_set_iaddr_bytes, I2CDevice_iaddr_bytes_doc, NULL},
+    {"completion", (getter)I2CDevice_get_completion, (setter)I2CDevice_set_completion, I2CDevice_completion_doc, NULL},
+    {"poll_timeout", (getter)I2CDevice_get_poll_timeout, (setter)I2CDevice_set_poll_timeout, I2CDevice_poll_timeout_doc, NULL},
+    {"poll_interval", (getter)I2CDevice_get_poll_interval, (setter)I2CDevice_set_poll_interval, I2CDevice_poll_interval_doc, NULL},
+    {"poll_max", (getter)I2CDevice_get_poll_max, (setter)I2CDevice_set_poll_max, I2CDevice_poll_max_doc, NULL},
+    {"pec", (getter)I2CDevice_get_pec, (setter)I2CDevice_set_pec, I2CDevice_pec_doc, NULL},
+    {"retries", (getter)I2CDevice_get_retries, (setter)I2CDevice_set_retries, I2CDevice_retries_doc, NULL},
+    {"retry_on", (getter)I2CDevice_get_retry_on, (setter)I2CDevice_set_retry_on, I2CDevice_retry_on_doc, NULL},
+    {"retry_backoff", (getter)I2CDevice_get_retry_backoff, (setter)I2CDevice_set_retry_backoff, I2CDevice_retry_backoff_doc, NULL},
+    {"block_bits", (getter)I2CDevice_get_block_bits, (setter)I2CDevice_set_block_bits, I2CDevice_block_bits_doc, NULL},
+    {NULL},
+};
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+
+static PyTypeObject I2CDeviceObjectType = {
+#if PY_MAJOR_VERSION >= 3
+    PyVarObject_HEAD_INIT(NULL, 0)
+#else
+    PyObject_HEAD_INIT(NULL) 0, /* ob_size */
+#endif
+    I2CDevice_name,		        /* tp_name */
+    sizeof(I2CDeviceObject),	/* tp_basicsize */
+    0,			        	    /* tp_itemsize */
+    (destructor)I2CDevice_free,/* tp_dealloc */
+    0,				            /* tp_print */
+    0,				            /* tp_getattr */
+    0,				            /* tp_setattr */
+    0,				            /* tp_compare */
+    0,				            /* tp_repr */
+    0,				            /* tp_as_number */
+    0,				            /* tp_as_sequence */
+    0,				            /* tp_as_mapping */
+    0,				            /* tp_hash */
+    0,				            /* tp_call */
+    I2CDevice_str,	            /* tp_str */
+    0,				            /* tp_getattro */
+    0,				            /* tp_setattro */
+    0,				            /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
+    I2CDeviceObject_type_doc,	/* tp_doc */
+    0,				            /* tp_traverse */
+    0,				            /* tp_clear */
+    0,				            /* tp_richcompare */
+    0,				            /* tp_weaklistoffset */
+    0,				            /* tp_iter */
+    0,				            /* tp_iternext */
+    I2CDevice_methods,		    /* tp_methods */
+    0,				            /* tp_members */
+    I2CDevice_getseters,        /* tp_getset */
+    0,				            /* tp_base */
+    0,				            /* tp_dict */
+    0,				            /* tp_descr_get */
+    0,				            /* tp_descr_set */
+    0,				            /* tp_dictoffset */
+    (initproc)I2CDevice_init,	/* tp_init */
+    0,				            /* tp_alloc */
+    I2CDevice_new,		        /* tp_new */
+};
+
+#pragma GCC diagnostic pop
+
+PyDoc_STRVAR(I2CTxnObject_type_doc, "I2CTxn(bus) -> I2CTxn object.\n\n"
+             "Transaction on I2CBus, segments of many devices submit with one ioctl(I2C_RDWR), "
+             "status report each segment result, reset() reuse it.\n");
+typedef struct {
+    PyObject_HEAD;
+    I2CBusObject *bus;
+    PyObject *reads;            /* Read segment bytearray, None for other segments */
+    int busy;                   /* Submitting without GIL */
+    I2CTxn txn;
+} I2CTxnObject;
+
+
+static PyObject *I2CTxn_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    (void)args;
+    (void)kwds;
+
+    I2CTxnObject *self;
+
+    if ((self = (I2CTxnObject *)type->tp_alloc(type, 0)) == NULL) {
+
+        return NULL;
+    }
+
+    self->bus = NULL;
+    self->busy = 0;
+    i2c_txn_init(&self->txn, -1);
+
+    if ((self->reads = PyList_New(0)) == NULL) {
+
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    return (PyObject *)self;
+}
+
+
+/* I2CTxn(bus) */
+static int I2CTxn_init(I2CTxnObject *self, PyObject *args, PyObject *kwds) {
+
+    PyObject *bus = NULL;
+    static char *kwlist[] = {"bus", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!:__init__", kwlist, &I2CBusObjectType, &bus)) {
+
+        return -1;
+    }
+
+    if (((I2CBusObject *)bus)->bus < 0) {
+
+        PyErr_SetString(PyExc_IOError, "I2C bus is closed");
+        return -1;
+    }
+
+    Py_INCREF(bus);
+    Py_XDECREF(self->bus);
+    self->bus = (I2CBusObject *)bus;
+
+    i2c_txn_init(&self->txn, self->bus->bus);
+    return PyList_SetSlice(self->reads, 0, PyList_GET_SIZE(self->reads), NULL);
+}
+
+
+static void I2CTxn_free(I2CTxnObject *self) {
+
+    Py_XDECREF(self->bus);
+    Py_XDECREF(self->reads);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+/* Transaction can't be changed while other thread submitting it */
+static int I2CTxn_check(I2CTxnObject *self) {
+
+    if (self->bus == NULL) {
+
+        PyErr_SetString(PyExc_IOError, "I2CTxn is not initialized");
+        return -1;
+    }
+
+    if (self->busy) {
+
+        errno = EBUSY;
+        PyErr_SetFromErrno(PyExc_IOError);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Copy device of segment, it must on transaction bus */
+static int I2CTxn_get_dev(I2CTxnObject *self, PyObject *device, I2CDevice *dev) {
+
+    if (I2CTxn_check(self) == -1 || I2CDevice_get_dev((I2CDeviceObject *)device, dev) == -1) {
+
+        return -1;
+    }
+
+    if (((I2CDeviceObject *)device)->bus != self->bus) {
+
+        PyErr_SetString(PyExc_ValueError, "I2CDevice is not on transaction bus");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Segment added, #read is bytearray of read segment #index or NULL, keep #reads same length as segments */
+static PyObject *I2CTxn_added(I2CTxnObject *self, int index, PyObject *read, unsigned int nmsgs, unsigned int data_used) {
+
+    if (index == -1) {
+
+        Py_XDECREF(read);
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    while ((unsigned int)PyList_GET_SIZE(self->reads) < self->txn.nmsgs) {
+
+        if (PyList_Append(self->reads, read && PyList_GET_SIZE(self->reads) == index ? read : Py_None) == -1) {
+
+            /* Rollback segments */
+            self->txn.nmsgs = nmsgs;
+            self->txn.data_used = data_used;
+            PyList_SetSlice(self->reads, nmsgs, PyList_GET_SIZE(self->reads), NULL);
+            Py_XDECREF(read);
+            return NULL;
+        }
+    }
+
+    Py_XDECREF(read);
+    return PyLong_FromLong(index);
+}
+
+
+PyDoc_STRVAR(I2CTxn_add_address_doc, "add_address(device, iaddr) -> int\n\nAdd write #iaddr only segment(address phase) of #device, return segment index.\n");
+static PyObject *I2CTxn_add_address(I2CTxnObject *self, PyObject *args) {
+
+    I2CDevice dev;
+    PyObject *device;
+    unsigned int iaddr = 0;
+    unsigned int nmsgs = self->txn.nmsgs, data_used = self->txn.data_used;
+
+    if (!PyArg_ParseTuple(args, "O!I:add_address", &I2CDeviceObjectType, &device, &iaddr)) {
+
+        return NULL;
+    }
+
+    if (I2CTxn_get_dev(self, device, &dev) == -1) {
+
+        return NULL;
+    }
+
+    return I2CTxn_added(self, i2c_txn_add_address(&self->txn, &dev, iaddr), NULL, nmsgs, data_used);
+}
+
+
+PyDoc_STRVAR(I2CTxn_add_read_doc, "add_read(device, iaddr, size) -> int\n\n"
+             "Add read #size bytes from #device #iaddr segments, return read segment index, data(index) get data after submit.\n");
+static PyObject *I2CTxn_add_read(I2CTxnObject *self, PyObject *args) {
+
+    I2CDevice dev;
+    PyObject *device, *read;
+    unsigned int len = 0, iaddr = 0;
+    unsigned int nmsgs = self->txn.nmsgs, data_used = self->txn.data_used;
+
+    if (!PyArg_ParseTuple(args, "O!II:add_read", &I2CDeviceObjectType, &device, &iaddr, &len)) {
+
+        return NULL;
+    }
+
+    if (I2CTxn_get_dev(self, device, &dev) == -1) {
+
+        return NULL;
+    }
+
+    if ((read = PyByteArray_FromStringAndSize(NULL, len)) == NULL) {
+
+        return NULL;
+    }
+
+    /* Bytearray never exposed, it's buffer is valid until reset */
+    memset(PyByteArray_AS_STRING(read), 0, len);
+    return I2CTxn_added(self, i2c_txn_add_read(&self->txn, &dev, iaddr, PyByteArray_AS_STRING(read), len), read, nmsgs, data_used);
+}
+
+
+PyDoc_STRVAR(I2CTxn_add_write_doc, "add_write(device, iaddr, buf) -> int\n\n"
+             "Add write #buf to #device #iaddr segment, #buf is copied and must not cross page boundary, return segment index.\n");
+static PyObject *I2CTxn_add_write(I2CTxnObject *self, PyObject *args) {
+
+    int index;
+    Py_buffer buf;
+    I2CDevice dev;
+    PyObject *device;
+    unsigned int iaddr = 0;
+    unsigned int nmsgs = self->txn.nmsgs, data_used = self->txn.data_used;
+
+    if (!PyArg_ParseTuple(args, "O!Is*:add_write", &I2CDeviceObjectType, &device, &iaddr, &buf)) {
+
+        return NULL;
+    }
+
+    if (I2CTxn_get_dev(self, device, &dev) == -1) {
+
+        PyBuffer_Release(&buf);
+        return NULL;
+    }
+
+    index = i2c_txn_add_write(&self->txn, &dev, iaddr, buf.buf, buf.len);
+    PyBuffer_Release(&buf);
+    return I2CTxn_added(self, index, NULL, nmsgs, data_used);
+}
+
+
+PyDoc_STRVAR(I2CTxn_submit_doc, "submit() -> int\n\n"
+             "Submit all segments with one ioctl(I2C_RDWR), return completed segments, failed return -1, status has each segment -errno.\n");
+static PyObject *I2CTxn_submit(I2CTxnObject *self) {
+
+    int ret;
+    int bus;
+
+    if (I2CTxn_check(self) == -1) {
+
+        return NULL;
+    }
+
+    if ((bus = self->bus->bus) < 0) {
+
+        PyErr_SetString(PyExc_IOError, "I2C bus is closed");
+        return NULL;
+    }
+
+    /* Bus closed by other thread is released after submit */
+    if (i2c_ref(bus) == -1) {
+
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    self->busy = 1;
+    self->txn.bus = bus;
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = i2c_txn_submit(&self->txn);
+    i2c_unref(bus);
+    Py_END_ALLOW_THREADS
+
+    self->busy = 0;
+    return PyLong_FromLong(ret);
+}
+
+
+PyDoc_STRVAR(I2CTxn_reset_doc, "reset()\n\nDrop all segments, reuse transaction.\n");
+static PyObject *I2CTxn_reset(I2CTxnObject *self) {
+
+    if (I2CTxn_check(self) == -1) {
+
+        return NULL;
+    }
+
+    i2c_txn_reset(&self->txn);
+    if (PyList_SetSlice(self->reads, 0, PyList_GET_SIZE(self->reads), NULL) == -1) {
+
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+
+PyDoc_STRVAR(I2CTxn_data_doc, "data(index) -> bytearray\n\nCopy of read segment #index data, valid after submit.\n");
+static PyObject *I2CTxn_data(I2CTxnObject *self, PyObject *args) {
+
+    int index = 0;
+    PyObject *read;
+
+    if (!PyArg_ParseTuple(args, "i:data", &index) || I2CTxn_check(self) == -1) {
+
+        return NULL;
+    }
+
+    if (index < 0 || index >= PyList_GET_SIZE(self->reads) || (read = PyList_GET_ITEM(self->reads, index)) == Py_None) {
+
+        PyErr_SetString(PyExc_IndexError, "not a read segment");
+        return NULL;
+    }
+
+    return PyByteArray_FromStringAndSize(PyByteArray_AS_STRING(read), PyByteArray_GET_SIZE(read));
+}
+
+
+PyDoc_STRVAR(I2CTxn_nmsgs_doc, "Number of segments.\n");
+static PyObject *I2CTxn_get_nmsgs(I2CTxnObject *self, void *closure) {
+    (void)closure;
+
+    return PyLong_FromUnsignedLong(self->txn.nmsgs);
+}
+
+
+PyDoc_STRVAR(I2CTxn_status_doc, "Each segment result after submit, 0 success, otherwise -errno.\n");
+static PyObject *I2CTxn_get_status(I2CTxnObject *self, void *closure) {
+    (void)closure;
+
+    unsigned int i;
+    PyObject *status;
+
+    if ((status = PyTuple_New(self->txn.nmsgs)) == NULL) {
+
+        return NULL;
+    }
+
+    for (i = 0; i < self->txn.nmsgs; i++) {
+
+        PyTuple_SET_ITEM(status, i, PyLong_FromLong(self->txn.status[i]));
+    }
+
+    return status;
+}
+
+
+static PyMethodDef I2CTxn_methods[] = {
+
+    {"add_address", (PyCFunction)I2CTxn_add_address, METH_VARARGS, I2CTxn_add_address_doc},
+    {"add_read", (PyCFunction)I2CTxn_add_read, METH_VARARGS, I2CTxn_add_read_doc},
+    {"add_write", (PyCFunction)I2CTxn_add_write, METH_VARARGS, I2CTxn_add_write_doc},
+    {"submit", (PyCFunction)I2CTxn_submit, METH_NOARGS, I2CTxn_submit_doc},
+    {"reset", (PyCFunction)I2CTxn_reset, METH_NOARGS, I2CTxn_reset_doc},
+    {"data", (PyCFunction)I2CTxn_data, METH_VARARGS, I2CTxn_data_doc},
+    {NULL},
+};
+
+
+static PyGetSetDef I2CTxn_getseters[] = {
+
+    {"nmsgs", (getter)I2CTxn_get_nmsgs, NULL, I2CTxn_nmsgs_doc, NULL},
+    {"status", (getter)I2CTxn_get_status, NULL, I2CTxn_status_doc, NULL},
+    {NULL},
+};
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+
+static PyTypeObject I2CTxnObjectType = {
+#if PY_MAJOR_VERSION >= 3
+    PyVarObject_HEAD_INIT(NULL, 0)
+#else
+    PyObject_HEAD_INIT(NULL) 0, /* ob_size */
+#endif
+    I2CTxn_name,		        /* tp_name */
+    sizeof(I2CTxnObject),	    /* tp_basicsize */
+    0,			        	    /* tp_itemsize */
+    (destructor)I2CTxn_free,    /* tp_dealloc */
+    0,				            /* tp_print */
+    0,				            /* tp_getattr */
+    0,				            /* tp_setattr */
+    0,				            /* tp_compare */
+    0,				            /* tp_repr */
+    0,				            /* tp_as_number */
+    0,				            /* tp_as_sequence */
+    0,				            /* tp_as_mapping */
+    0,				            /* tp_hash */
+    0,				            /* tp_call */
+    0,				            /* tp_str */
+    0,				            /* tp_getattro */
+    0,				            /* tp_setattro */
+    0,				            /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,         /* tp_flags */
+    I2CTxnObject_type_doc,	    /* tp_doc */
+    0,				            /* tp_traverse */
+    0,				            /* tp_clear */
+    0,				            /* tp_richcompare */
+    0,				            /* tp_weaklistoffset */
+    0,				            /* tp_iter */
+    0,				            /* tp_iternext */
+    I2CTxn_methods,		        /* tp_methods */
+    0,				            /* tp_members */
+    I2CTxn_getseters,           /* tp_getset */
+    0,				            /* tp_base */
+    0,				            /* tp_dict */
+    0,				            /* tp_descr_get */
+    0,				            /* tp_descr_set */
+    0,				            /* tp_dictoffset */
+    (initproc)I2CTxn_init,	    /* tp_init */
+    0,				            /* tp_alloc */
+    I2CTxn_new,		            /* tp_new */
+};
+
+#pragma GCC diagnostic pop
+
+PyDoc_STRVAR(pylibi2c_list_adapters_doc, "list_adapters(sysfs=None) -> list\n\n"
+             "Enumerate i2c adapters, each is a dict with nr, bus, name, funcs, max_xfer and method.\n");
+static PyObject *pylibi2c_list_adapters(PyObject *module, PyObject *args, PyObject *kwds) {
+    (void)module;
+
+    char bus[32];
+    int i, count = 0;
+    PyObject *list, *adapter;
+    const char *sysfs = NULL;
+    I2CAdapter *adapters = NULL;
+    unsigned int max = _I2CBUS_LIST_ADAPTERS_;
+    static char *kwlist[] = {"sysfs", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|z:list_adapters", kwlist, &sysfs)) {
+
+        return NULL;
+    }
+
+    /* Usually one pass, more adapters than buffer list again with large buffer */
+    Py_BEGIN_ALLOW_THREADS
+    while ((adapters = malloc(max * sizeof(I2CAdapter))) != NULL) {
+
+        if ((count = i2c_list_adapters(sysfs, adapters, max)) <= (int)max) {
+
+            break;
+        }
+
+        free(adapters);
+        max = count;
+    }
+    Py_END_ALLOW_THREADS
+
+    if (adapters == NULL || count == -1) {
+
+        free(adapters);
+        return adapters ? PyErr_SetFromErrno(PyExc_IOError) : PyErr_NoMemory();
+    }
+
+    if ((list = PyList_New(0)) == NULL) {
+
+        free(adapters);
+        return NULL;
+    }
+
+    for (i = 0; i < count; i++) {
+
+        snprintf(bus, sizeof(bus), "/dev/i2c-%d", adapters[i].nr);
+        adapter = Py_BuildValue("{s:i,s:s,s:s,s:k,s:I,s:i}", "nr", adapters[i].nr, "bus", bus, "name", adapters[i].name,
+                                "funcs", adapters[i].funcs, "max_xfer", adapters[i].max_xfer, "method", adapters[i].method);
+
+        if (adapter == NULL || PyList_Append(list, adapter) == -1) {
+
+            Py_XDECREF(adapter);
+            Py_DECREF(list);
+            free(adapters);
+            return NULL;
+        }
+
+        Py_DECREF(adapter);
+    }
+
+    free(adapters);
+    return list;
+}
+
+
+PyDoc_STRVAR(pylibi2c_scan_doc, "scan(buses, first=0x08, last=0x77) -> list\n\n"
+             "Probe addresses [first, last] of buses(I2CBus or bus name) concurrently, one thread per bus, "
+             "return list of found addresses for each bus.\n");
+static PyObject *pylibi2c_scan(PyObject *module, PyObject *args, PyObject *kwds) {
+    (void)module;
+
+    int ret;
+    Py_ssize_t i, nbuses;
+    unsigned int addr;
+    I2CScan *scans = NULL;
+    PyObject *buses, *seq, *opened, *item, *list = NULL, *found;
+    unsigned int first = I2C_SCAN_FIRST, last = I2C_SCAN_LAST;
+    static char *kwlist[] = {"buses", "first", "last", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|II:scan", kwlist, &buses, &first, &last)) {
+
+        return NULL;
+    }
+
+    if (first == 0 || first > last || last > 0x7f) {
+
+        PyErr_SetString(PyExc_ValueError, "scan address range must in [0x01, 0x7f]");
+        return NULL;
+    }
+
+    if ((seq = PySequence_Fast(buses, "scan 'buses' must be a sequence")) == NULL) {
+
+        return NULL;
+    }
+
+    /* Bus name open with I2CBus, closed when scan done */
+    nbuses = PySequence_Fast_GET_SIZE(seq);
+    if ((opened = PyList_New(nbuses)) == NULL) {
+
+        Py_DECREF(seq);
+        return NULL;
+    }
+
+    if (nbuses && (scans = calloc(nbuses, sizeof(I2CScan))) == NULL) {
+
+        PyErr_NoMemory();
+        goto out;
+    }
+
+    for (i = 0; i < nbuses; i++) {
+
+        item = PySequence_Fast_GET_ITEM(seq, i);
+
+        if (PyObject_TypeCheck(item, &I2CBusObjectType)) {
+
+            Py_INCREF(item);
+        }
+        else if ((item = PyObject_CallFunctionObjArgs((PyObject *)&I2CBusObjectType, item, NULL)) == NULL) {
+
+            goto out;
+        }
+
+        PyList_SET_ITEM(opened, i, item);
+
+        if ((scans[i].bus = ((I2CBusObject *)item)->bus) < 0) {
+
+            PyErr_SetString(PyExc_IOError, "I/O operation on closed I2CBus");
+            goto out;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = i2c_scan(scans, nbuses, first, last);
+    Py_END_ALLOW_THREADS
+
+    if (ret == -1) {
+
+        PyErr_SetFromErrno(PyExc_IOError);
+        goto out;
     }
 
-    /* Copy data to bytearray and return */
-    bytearray = PyByteArray_FromStringAndSize(buf, len);
-    Py_INCREF(bytearray);
-    return bytearray;
-}
+    if ((list = PyList_New(nbuses)) == NULL) {
 
+        goto out;
+    }
 
-/* i2c write device */
-static PyObject *i2c_write_device(I2CDeviceObject *self, PyObject *args, int ioctl) {
+    for (i = 0; i < nbuses; i++) {
 
-    char *buf = NULL;
-    Py_ssize_t size = 0;
-    unsigned int iaddr = 0;
-    PyObject *result = NULL;
-    I2C_WRITE_HANDLE write_handle = NULL;
+        if ((found = PyList_New(0)) == NULL) {
 
-    if (!PyArg_ParseTuple(args, "Is#::write", &iaddr, &buf, &size)) {
-        return NULL;
-    }
+            Py_CLEAR(list);
+            goto out;
+        }
 
-    write_handle = ioctl ? i2c_ioctl_write : i2c_write;
-    result = Py_BuildValue("i", write_handle(&self->dev, iaddr, buf, size));
+        PyList_SET_ITEM(list, i, found);
 
-    Py_INCREF(result);
-    return result;
-}
+        for (addr = first; addr <= last; addr++) {
 
+            if (!I2C_SCAN_FOUND(&scans[i], addr)) {
 
-/* file read */
-PyDoc_STRVAR(I2CDevice_read_doc, "read(iaddr, buf, size)\n\nRead #size bytes data from device #iaddress to #buf.\n");
-static PyObject *I2CDevice_read(I2CDeviceObject *self, PyObject *args) {
+                continue;
+            }
 
-    return i2c_read_device(self, args, 0);
-}
+            if ((item = PyInt_FromLong(addr)) == NULL || PyList_Append(found, item) == -1) {
 
+                Py_XDECREF(item);
+                Py_CLEAR(list);
+                goto out;
+            }
 
-/* file write */
-PyDoc_STRVAR(I2CDevice_write_doc, "write(iaddr, buf, size)\n\nWrite #size bytes data from #buf to device #iaddress.\n");
-static PyObject *I2CDevice_write(I2CDeviceObject *self, PyObject *args) {
+            Py_DECREF(item);
+        }
+    }
 
-    return i2c_write_device(self, args, 0);
+out:
+    free(scans);
+    Py_DECREF(opened);
+    Py_DECREF(seq);
+    return list;
 }
 
 
-/* ioctl read */
-PyDoc_STRVAR(I2CDevice_ioctl_read_doc, "ioctl_read(iaddr, buf, size)\n\nIoctl read #size bytes data from device #iaddress to #buf.\n");
-static PyObject *I2CDevice_ioctl_read(I2CDeviceObject *self, PyObject *args) {
+PyDoc_STRVAR(pylibi2c_gang_program_doc, "gang_program(devices, iaddr, image, diff=False) -> list\n\n"
+             "Program and verify image on I2CDevice list, one worker per bus, diff=True only program changed pages, "
+             "return dict with stage, error, write_us and verify_us for each device.\n");
+static PyObject *pylibi2c_gang_program(PyObject *module, PyObject *args, PyObject *kwds) {
+    (void)module;
 
-    return i2c_read_device(self, args, 1);
-}
+    int ret, diff = 0;
+    Py_buffer image;
+    Py_ssize_t i, ntargets, held = 0;
+    unsigned int iaddr = 0;
+    I2CGangTarget *targets = NULL;
+    PyObject *devices, *seq, *item, *list = NULL;
+    static char *kwlist[] = {"devices", "iaddr", "image", "diff", NULL};
 
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OIs*|i:gang_program", kwlist, &devices, &iaddr, &image, &diff)) {
 
-/* ioctl write */
-PyDoc_STRVAR(I2CDevice_ioctl_write_doc, "ioctl_write(iaddr, buf, size)\n\nIoctl write #size bytes data from #buf to device #iaddress.\n");
-static PyObject *I2CDevice_ioctl_write(I2CDeviceObject *self, PyObject *args) {
+        return NULL;
+    }
 
-    return i2c_write_device(self, args, 1);
-}
+    if ((seq = PySequence_Fast(devices, "gang_program 'devices' must be a sequence")) == NULL) {
 
+        PyBuffer_Release(&image);
+        return NULL;
+    }
 
-/* pylibi2c module methods */
-static PyMethodDef I2CDevice_methods[] = {
+    ntargets = PySequence_Fast_GET_SIZE(seq);
+    if (ntargets && (targets = calloc(ntargets, sizeof(I2CGangTarget))) == NULL) {
 
-    {"read", (PyCFunction)I2CDevice_read, METH_VARARGS, I2CDevice_read_doc},
-    {"write", (PyCFunction)I2CDevice_write, METH_VARARGS, I2CDevice_write_doc},
-    {"close", (PyCFunction)I2CDevice_close, METH_NOARGS, I2CDevice_close_doc},
-    {"ioctl_read", (PyCFunction)I2CDevice_ioctl_read, METH_VARARGS, I2CDevice_ioctl_read_doc},
-    {"ioctl_write", (PyCFunction)I2CDevice_ioctl_write, METH_VARARGS, I2CDevice_ioctl_write_doc},
-    {"__enter__", (PyCFunction)I2CDevice_enter, METH_NOARGS, NULL},
-    {"__exit__", (PyCFunction)I2CDevice_exit, METH_NOARGS, NULL},
-    {NULL},
-};
+        PyErr_NoMemory();
+        goto out;
+    }
 
+    for (i = 0; i < ntargets; i++) {
 
-/* Check */
-static int check_user_input(const char *name, PyObject *input, int min, int max) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
 
-    int value;
+        if (!PyObject_TypeCheck(item, &I2CDeviceObjectType)) {
 
-    if (input == NULL) {
-        PyErr_SetString(PyExc_TypeError, "Cannot delete the last attribute");
-        return -1;
-    }
+            PyErr_SetString(PyExc_TypeError, "gang_program 'devices' must be I2CDevice");
+            goto out;
+        }
 
-    /* tenbit attribute, boolean type */
-    if (memcmp(name, "tenbit", strlen(name)) == 0) {
-        if (!PyBool_Check(input)) {
-            PyErr_SetString(PyExc_TypeError, "The last attribute value must be boolean");
-            return -1;
+        if (I2CDevice_hold_dev((I2CDeviceObject *)item, &targets[i].device) == -1) {
+
+            goto out;
         }
 
-        return 0;
+        held++;
     }
 
-    /* Other attribute, integer type */
-    if (!PyInt_Check(input)) {
-        PyErr_SetString(PyExc_TypeError, "The last attribute value must be an integer");
-        return -1;
+    /* Devices are kept alive by #seq, their bus are held until gang program done */
+    Py_BEGIN_ALLOW_THREADS
+    ret = i2c_gang_program(targets, ntargets, iaddr, image.buf, image.len, diff ? I2C_GANG_DIFF : 0);
+    Py_END_ALLOW_THREADS
+
+    if (ret == -1) {
+
+        PyErr_SetFromErrno(PyExc_IOError);
+        goto out;
     }
 
-    /* Convert value to int */
-    value = PyLong_AsLong(input);
+    if ((list = PyList_New(ntargets)) == NULL) {
 
-    /* Check input value range */
-    if (value < min || value > max) {
-        PyErr_Format(PyExc_ValueError, "invalid ' %s'(%d - %d)", name, min, max);
-        return -1;
+        goto out;
     }
 
-    return 0;
-}
+    for (i = 0; i < ntargets; i++) {
 
-/* flags */
-PyDoc_STRVAR(I2CDevice_flags_doc, "ioctl_read/write i2c_msg flags\n\n"
-             "I_2C_M_NOSTART\n"
-             "In a combined transaction, no 'S Addr Wr/Rd [A]' is generated at some point."
-             "For example, setting I2C_M_NOSTART on the second partial message generates something like:\n\n"
-             "\t\t\tS Addr Rd [A] [Data] NA Data [A] P\n\n"
-             "If you set the I2C_M_NOSTART variable for the first partial message, we do not generate Addr,"
-             "but we do generate the startbit S. This will probably confuse all other clients on your bus, so don't try this.\n\n"
-             "I2C_M_IGNORE_NAK\n"
-             "Normally message is interrupted immediately if there is [NA] from the"
-             "client. Setting this flag treats any [NA] as [A], and all of message is sent.These messages may still fail to SCL lo->hi timeout.\n\n"
-             "I2C_M_NO_RD_ACK\n"
-             "In a read message, master A/NA bit is skipped.\n\n");
-static PyObject *I2CDevice_get_flags(I2CDeviceObject *self, void *closure) {
-    (void)closure;
+        if ((item = Py_BuildValue("{s:i,s:i,s:K,s:K}", "stage", targets[i].stage, "error", targets[i].error,
+                                  "write_us", targets[i].write_us, "verify_us", targets[i].verify_us)) == NULL) {
 
-    PyObject *result = Py_BuildValue("H", self->dev.flags);
-    Py_INCREF(result);
-    return result;
-}
+            Py_CLEAR(list);
+            goto out;
+        }
 
-static int I2CDevice_set_flags(I2CDeviceObject *self, PyObject *value, void *closure)
-{
-    (void)closure;
+        PyList_SET_ITEM(list, i, item);
+    }
 
-    if (check_user_input("falgs", value, 0, I2C_M_NOSTART) != 0) {
+out:
+    for (i = 0; i < held; i++) {
 
-        return -1;
+        I2CDevice_release_dev(&targets[i].device);
     }
 
-    self->dev.flags = PyLong_AsLong(value);
-    return 0;
+    free(targets);
+    Py_DECREF(seq);
+    PyBuffer_Release(&image);
+    return list;
 }
 
-/* delay */
-PyDoc_STRVAR(I2CDevice_delay_doc, "i2c internal operate delay, unit milliscond.\n\n");
-static PyObject *I2CDevice_get_delay(I2CDeviceObject *self, void *closure) {
-    (void)closure;
 
-    PyObject *result = Py_BuildValue("b", self->dev.delay);
-    Py_INCREF(result);
-    return result;
-}
+PyDoc_STRVAR(pylibi2c_trace_start_doc, "trace_start(depth=0)\n\n"
+             "Start recording transfers of all buses, depth is ring size of first start, 0 is default 4096.\n");
+static PyObject *pylibi2c_trace_start(PyObject *module, PyObject *args, PyObject *kwds) {
+    (void)module;
 
-static int I2CDevice_set_delay(I2CDeviceObject *self, PyObject *value, void *closure)
-{
-    (void)closure;
+    unsigned int depth = 0;
+    static char *kwlist[] = {"depth", NULL};
 
-    if (check_user_input("delay", value, 0, 100) != 0) {
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|I:trace_start", kwlist, &depth)) {
 
-        return -1;
+        return NULL;
     }
 
-    self->dev.delay = PyLong_AsLong(value);
-    return 0;
+    if (i2c_trace_start(depth) == -1) {
+
+        PyErr_SetFromErrno(PyExc_IOError);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
 }
 
-/* tenbit */
-PyDoc_STRVAR(I2CDevice_tenbit_doc, "True, Enable 10 bit addressing.\n\nFalse, 7 bit addressing(default).\n");
-static PyObject *I2CDevice_get_tenbit(I2CDeviceObject *self, void *closure) {
-    (void)closure;
 
-    PyObject *result = self->dev.tenbit ? Py_True : Py_False;
-    Py_INCREF(result);
-    return result;
+PyDoc_STRVAR(pylibi2c_trace_stop_doc, "trace_stop()\n\nStop recording transfers, recorded still can be read.\n");
+static PyObject *pylibi2c_trace_stop(PyObject *module) {
+    (void)module;
+
+    i2c_trace_stop();
+    Py_RETURN_NONE;
 }
 
-static int I2CDevice_set_tenbit(I2CDeviceObject *self, PyObject *value, void *closure)
-{
-    (void)closure;
 
-    if (check_user_input("tenbit", value, 0, 1) != 0) {
+PyDoc_STRVAR(pylibi2c_trace_read_doc, "trace_read(max=4096) -> list\n\n"
+             "Pop recorded transfers, each is a dict with seq, start_ns, end_ns, bus, result, iaddr(None if unknown), "
+             "len, addr, flags, type and nmsgs.\n");
+static PyObject *pylibi2c_trace_read(PyObject *module, PyObject *args, PyObject *kwds) {
+    (void)module;
 
-        return -1;
-    }
+    int i, count;
+    unsigned int max = _I2CDEV_ITER_CHUNK_SIZE_;
+    I2CTrace *traces;
+    PyObject *list, *trace, *iaddr;
+    static char *kwlist[] = {"max", NULL};
 
-    self->dev.tenbit = PyLong_AsLong(value);
-    return 0;
-}
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|I:trace_read", kwlist, &max)) {
 
-/* iaddr_bytes */
-PyDoc_STRVAR(I2CDevice_page_bytes_doc, "i2c EEPROM max number of bytes per page (must be divisible by 8)\n\n"
-             "8, 8 bytes per page, such as 24C01/24C02\n\n"
-             "16, 16 bytes per page, such as 24C04/24C08/24C16\n\n"
-             "32, 32 bytes per page, such as 24C32/24C64\n\n");
-static PyObject *I2CDevice_get_page_bytes(I2CDeviceObject *self, void *closure) {
-    (void)closure;
+        return NULL;
+    }
 
-    PyObject *result = Py_BuildValue("I", self->dev.page_bytes);
-    Py_INCREF(result);
-    return result;
-}
+    if ((traces = malloc((max ? max : 1) * sizeof(I2CTrace))) == NULL) {
 
-static int I2CDevice_set_page_bytes(I2CDeviceObject *self, PyObject *value, void *closure)
-{
-    (void)closure;
+        return PyErr_NoMemory();
+    }
 
-    int page_bytes = 0;
+    count = i2c_trace_read(traces, max);
 
-    if (check_user_input("page_bytes", value, 8, _I2CDEV_MAX_PAGE_BYTES_SIZE) != 0) {
+    if ((list = PyList_New(count)) == NULL) {
 
-        return -1;
+        free(traces);
+        return NULL;
     }
 
-    page_bytes = PyLong_AsLong(value);
+    for (i = 0; i < count; i++) {
 
-    /* Divisible by 8 */
-    if (page_bytes % 8) {
-        PyErr_SetString(PyExc_ValueError, "The 'page_bytes' must be divisible by 8");
-        return -1;
+        if (traces[i].iaddr == I2C_TRACE_NO_IADDR) {
+
+            Py_INCREF(Py_None);
+            iaddr = Py_None;
+        }
+        else if ((iaddr = PyLong_FromUnsignedLong(traces[i].iaddr)) == NULL) {
+
+            Py_DECREF(list);
+            free(traces);
+            return NULL;
+        }
+
+        trace = Py_BuildValue("{s:K,s:K,s:K,s:i,s:i,s:N,s:I,s:H,s:H,s:B,s:B}",
+                              "seq", traces[i].seq, "start_ns", traces[i].start_ns, "end_ns", traces[i].end_ns,
+                              "bus", traces[i].bus, "result", traces[i].result, "iaddr", iaddr, "len", traces[i].len,
+                              "addr", traces[i].addr, "flags", traces[i].flags, "type", traces[i].type, "nmsgs", traces[i].nmsgs);
+
+        if (trace == NULL) {
+
+            Py_DECREF(list);
+            free(traces);
+            return NULL;
+        }
+
+        PyList_SET_ITEM(list, i, trace);
     }
 
-    self->dev.page_bytes = page_bytes;
-    return 0;
+    free(traces);
+    return list;
 }
 
-/* iaddr_bytes */
-PyDoc_STRVAR(I2CDevice_iaddr_bytes_doc, "I2C device internal(word) address bytes.\n\n"
-             "0, special device, without internal address\n\n"
-             "1, 1 byte internal address, such as 24C04\n\n"
-             "2, 2 byte internal address, such as 24C64\n\n"
-             "2, 3 byte internal address, such as 24C1024\n\n");
-static PyObject *I2CDevice_get_iaddr_bytes(I2CDeviceObject *self, void *closure) {
-    (void)closure;
 
-    PyObject *result = Py_BuildValue("b", self->dev.iaddr_bytes);
-    Py_INCREF(result);
-    return result;
+PyDoc_STRVAR(pylibi2c_trace_dropped_doc, "trace_dropped() -> int\n\nNumber of records dropped because trace ring is full.\n");
+static PyObject *pylibi2c_trace_dropped(PyObject *module) {
+    (void)module;
+
+    return PyLong_FromUnsignedLongLong(i2c_trace_dropped());
 }
 
-static int I2CDevice_set_iaddr_bytes(I2CDeviceObject *self, PyObject *value, void *closure)
-{
-    (void)closure;
 
-    if (check_user_input("iaddr_bytes", value, 0, _I2CDEV_MAX_IADDR_BYTES_SIZE) != 0) {
+PyDoc_STRVAR(pylibi2c_parts_doc, "parts() -> list\n\n"
+             "Built-in EEPROM/FRAM part profiles, each is a dict with name, size, page_bytes, iaddr_bytes, block_bits, "
+             "twr_typ_us and twr_max_us.\n");
+static PyObject *pylibi2c_parts(PyObject *module) {
+    (void)module;
 
-        return -1;
+    unsigned int i, count;
+    PyObject *list, *part;
+    const I2CPart *parts = i2c_get_parts(&count);
+
+    if ((list = PyList_New(count)) == NULL) {
+
+        return NULL;
     }
 
-    self->dev.iaddr_bytes = PyLong_AsLong(value);
-    return 0;
-}
+    for (i = 0; i < count; i++) {
 
-static PyGetSetDef I2CDevice_getseters[] = {
+        part = Py_BuildValue("{s:s,s:I,s:I,s:B,s:B,s:H,s:H}",
+                             "name", parts[i].name, "size", parts[i].size, "page_bytes", parts[i].page_bytes,
+                             "iaddr_bytes", parts[i].iaddr_bytes, "block_bits", parts[i].block_bits,
+                             "twr_typ_us", parts[i].twr_typ_us, "twr_max_us", parts[i].twr_max_us);
 
-    {"flags", (getter)I2CDevice_get_flags, (setter)I2CDevice_set_flags, I2CDevice_flags_doc, NULL},
-    {"delay", (getter)I2CDevice_get_delay, (setter)I2CDevice_set_delay, I2CDevice_delay_doc, NULL},
-    {"tenbit", (getter)I2CDevice_get_tenbit, (setter)I2CDevice_set_tenbit, I2CDevice_tenbit_doc, NULL},
-    {"page_bytes", (getter)I2CDevice_get_page_bytes, (setter)I2CDevice_set_page_bytes, I2CDevice_page_bytes_doc, NULL},
-    {"iaddr_bytes", (getter)I2CDevice_get_iaddr_bytes, (setter)I2CDevice_set_iaddr_bytes, I2CDevice_iaddr_bytes_doc, NULL},
-    {NULL},
-};
+        if (part == NULL) {
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+            Py_DECREF(list);
+            return NULL;
+        }
 
-static PyTypeObject I2CDeviceObjectType = {
-#if PY_MAJOR_VERSION >= 3
-    PyVarObject_HEAD_INIT(NULL, 0)
-#else
-    PyObject_HEAD_INIT(NULL) 0, /* ob_size */
-#endif
-    I2CDevice_name,		        /* tp_name */
-    sizeof(I2CDeviceObject),	/* tp_basicsize */
-    0,			        	    /* tp_itemsize */
-    (destructor)I2CDevice_free,/* tp_dealloc */
-    0,				            /* tp_print */
-    0,				            /* tp_getattr */
-    0,				            /* tp_setattr */
-    0,				            /* tp_compare */
-    0,				            /* tp_repr */
-    0,				            /* tp_as_number */
-    0,				            /* tp_as_sequence */
-    0,				            /* tp_as_mapping */
-    0,				            /* tp_hash */
-    0,				            /* tp_call */
-    I2CDevice_str,	            /* tp_str */
-    0,				            /* tp_getattro */
-    0,				            /* tp_setattro */
-    0,				            /* tp_as_buffer */
-    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
-    I2CDeviceObject_type_doc,	/* tp_doc */
-    0,				            /* tp_traverse */
-    0,				            /* tp_clear */
-    0,				            /* tp_richcompare */
-    0,				            /* tp_weaklistoffset */
-    0,				            /* tp_iter */
-    0,				            /* tp_iternext */
-    I2CDevice_methods,		    /* tp_methods */
-    0,				            /* tp_members */
-    I2CDevice_getseters,        /* tp_getset */
-    0,				            /* tp_base */
-    0,				            /* tp_dict */
-    0,				            /* tp_descr_get */
-    0,				            /* tp_descr_set */
-    0,				            /* tp_dictoffset */
-    (initproc)I2CDevice_init,	/* tp_init */
-    0,				            /* tp_alloc */
-    I2CDevice_new,		        /* tp_new */
-};
+        PyList_SET_ITEM(list, i, part);
+    }
+
+    return list;
+}
 
-#pragma GCC diagnostic pop
 
 static PyMethodDef pylibi2c_methods[] = {
+    {"list_adapters", (PyCFunction)pylibi2c_list_adapters, METH_VARARGS | METH_KEYWORDS, pylibi2c_list_adapters_doc},
+    {"gang_program", (PyCFunction)pylibi2c_gang_program, METH_VARARGS | METH_KEYWORDS, pylibi2c_gang_program_doc},
+    {"trace_start", (PyCFunction)pylibi2c_trace_start, METH_VARARGS | METH_KEYWORDS, pylibi2c_trace_start_doc},
+    {"trace_stop", (PyCFunction)pylibi2c_trace_stop, METH_NOARGS, pylibi2c_trace_stop_doc},
+    {"trace_read", (PyCFunction)pylibi2c_trace_read, METH_VARARGS | METH_KEYWORDS, pylibi2c_trace_read_doc},
+    {"trace_dropped", (PyCFunction)pylibi2c_trace_dropped, METH_NOARGS, pylibi2c_trace_dropped_doc},
+    {"scan", (PyCFunction)pylibi2c_scan, METH_VARARGS | METH_KEYWORDS, pylibi2c_scan_doc},
+    {"parts", (PyCFunction)pylibi2c_parts, METH_NOARGS, pylibi2c_parts_doc},
     {NULL}
 };
 
@@ -495,6 +3659,31 @@ void define_constants(PyObject *module) {
     PyModule_AddObject(module, "I2C_M_NOSTART", Py_BuildValue("H", I2C_M_NOSTART));
     PyModule_AddObject(module, "I2C_M_NO_RD_ACK", Py_BuildValue("H", I2C_M_NO_RD_ACK));
     PyModule_AddObject(module, "I2C_M_IGNORE_NAK", Py_BuildValue("H", I2C_M_IGNORE_NAK));
+    PyModule_AddObject(module, "I2C_COMPLETION_DELAY", Py_BuildValue("B", I2C_COMPLETION_DELAY));
+    PyModule_AddObject(module, "I2C_COMPLETION_ACK_POLL", Py_BuildValue("B", I2C_COMPLETION_ACK_POLL));
+    PyModule_AddObject(module, "I2C_COMPLETION_NONE", Py_BuildValue("B", I2C_COMPLETION_NONE));
+    PyModule_AddObject(module, "I2C_RETRY_NAK", Py_BuildValue("B", I2C_RETRY_NAK));
+    PyModule_AddObject(module, "I2C_RETRY_TIMEOUT", Py_BuildValue("B", I2C_RETRY_TIMEOUT));
+    PyModule_AddObject(module, "I2C_RETRY_ARB_LOST", Py_BuildValue("B", I2C_RETRY_ARB_LOST));
+    PyModule_AddObject(module, "I2C_RETRY_IO", Py_BuildValue("B", I2C_RETRY_IO));
+    PyModule_AddObject(module, "I2C_RETRY_DEFAULT", Py_BuildValue("B", I2C_RETRY_DEFAULT));
+    PyModule_AddObject(module, "I2C_GANG_WRITE", Py_BuildValue("i", I2C_GANG_WRITE));
+    PyModule_AddObject(module, "I2C_GANG_VERIFY", Py_BuildValue("i", I2C_GANG_VERIFY));
+    PyModule_AddObject(module, "I2C_GANG_DONE", Py_BuildValue("i", I2C_GANG_DONE));
+    PyModule_AddObject(module, "I2C_TRACE_RDWR", Py_BuildValue("i", I2C_TRACE_RDWR));
+    PyModule_AddObject(module, "I2C_TRACE_SMBUS", Py_BuildValue("i", I2C_TRACE_SMBUS));
+    PyModule_AddObject(module, "I2C_TRACE_READ", Py_BuildValue("i", I2C_TRACE_READ));
+    PyModule_AddObject(module, "I2C_TRACE_WRITE", Py_BuildValue("i", I2C_TRACE_WRITE));
+    PyModule_AddObject(module, "I2C_METHOD_FILE", Py_BuildValue("i", I2C_METHOD_FILE));
+    PyModule_AddObject(module, "I2C_METHOD_IOCTL", Py_BuildValue("i", I2C_METHOD_IOCTL));
+    PyModule_AddObject(module, "I2C_METHOD_SMBUS", Py_BuildValue("i", I2C_METHOD_SMBUS));
+    PyModule_AddObject(module, "I2C_FUNC_I2C", Py_BuildValue("k", (unsigned long)I2C_FUNC_I2C));
+    PyModule_AddObject(module, "I2C_FUNC_10BIT_ADDR", Py_BuildValue("k", (unsigned long)I2C_FUNC_10BIT_ADDR));
+    PyModule_AddObject(module, "I2C_FUNC_NOSTART", Py_BuildValue("k", (unsigned long)I2C_FUNC_NOSTART));
+    PyModule_AddObject(module, "I2C_FUNC_SMBUS_QUICK", Py_BuildValue("k", (unsigned long)I2C_FUNC_SMBUS_QUICK));
+    PyModule_AddObject(module, "I2C_FUNC_SMBUS_PEC", Py_BuildValue("k", (unsigned long)I2C_FUNC_SMBUS_PEC));
+    PyModule_AddObject(module, "I2C_FUNC_SMBUS_READ_BLOCK_DATA", Py_BuildValue("k", (unsigned long)I2C_FUNC_SMBUS_READ_BLOCK_DATA));
+    PyModule_AddObject(module, "I2C_FUNC_SMBUS_I2C_BLOCK", Py_BuildValue("k", (unsigned long)I2C_FUNC_SMBUS_I2C_BLOCK));
 }
 
 
@@ -522,7 +3711,9 @@ PyMODINIT_FUNC initpylibi2c(void)
 
     PyObject *module;
 
-    if (PyType_Ready(&I2CDeviceObjectType) < 0) {
+    if (PyType_Ready(&I2CBusObjectType) < 0 || PyType_Ready(&I2CDeviceObjectType) < 0 ||
+            PyType_Ready(&I2CReadIterObjectType) < 0 || PyType_Ready(&I2CCacheObjectType) < 0 ||
+            PyType_Ready(&I2CTxnObjectType) < 0) {
 #if PY_MAJOR_VERSION >= 3
         return NULL;
 #else
@@ -546,10 +3737,18 @@ PyMODINIT_FUNC initpylibi2c(void)
     PyDict_SetItemString(dict, "__version__", version);
     Py_DECREF(version);
 
+    /* Register I2CBusObject */
+    Py_INCREF(&I2CBusObjectType);
+    PyModule_AddObject(module, I2CBus_name, (PyObject *)&I2CBusObjectType);
+
     /* Register I2CDeviceObject */
     Py_INCREF(&I2CDeviceObjectType);
     PyModule_AddObject(module, I2CDevice_name, (PyObject *)&I2CDeviceObjectType);
 
+    /* Register I2CTxnObject */
+    Py_INCREF(&I2CTxnObjectType);
+    PyModule_AddObject(module, I2CTxn_name, (PyObject *)&I2CTxnObjectType);
+
 #if PY_MAJOR_VERSION >= 3
     return module;
 #endif
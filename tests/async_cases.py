@@ -0,0 +1,67 @@
+import asyncio
+import unittest
+import threading
+import pylibi2c
+
+
+class AsyncTest(unittest.TestCase):
+    def test_aread_awrite(self):
+        i2c = pylibi2c.I2CDevice("sim:eeprom@0x50:size=512:page=16", 0x50, page_bytes=16,
+                                 completion=pylibi2c.I2C_COMPLETION_ACK_POLL)
+        data = bytes(bytearray(range(64)))
+
+        async def main():
+            self.assertEqual(await i2c.awrite(0x20, data), len(data))
+            self.assertSequenceEqual(await i2c.aread(0x20, len(data)), bytearray(data))
+
+        asyncio.run(main())
+
+        async def read():
+            return await i2c.aread(0x20, 4)
+
+        # Bus rebind to new event loop
+        self.assertSequenceEqual(asyncio.run(read()), bytearray(data[:4]))
+
+        with self.assertRaises(RuntimeError):
+            i2c.aread(0, 1)
+
+    def test_outstanding(self):
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50,eeprom@0x51")
+        devices = [pylibi2c.I2CDevice(bus, addr) for addr in (0x50, 0x51)]
+        threads = threading.active_count()
+
+        async def main():
+            # More than engine depth, rest wait in backlog, native worker is not a python thread
+            futures = [devices[i % 2].aread(i % 256, 1) for i in range(3000)]
+            self.assertEqual(threading.active_count(), threads)
+            return await asyncio.gather(*futures)
+
+        self.assertEqual([len(r) for r in asyncio.run(main())], [1] * 3000)
+
+    def test_error(self):
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50:latency=20000")
+        i2c = pylibi2c.I2CDevice(bus, 0x52)
+
+        async def main():
+            with self.assertRaises(IOError):
+                await i2c.aread(0, 1)
+
+            self.assertEqual(await i2c.awrite(0, b"\x00"), -1)
+
+            # Cancelled request still run, result discarded
+            future = i2c.aread(0, 1)
+            future.cancel()
+            with self.assertRaises(asyncio.CancelledError):
+                await future
+
+            # Pending request raise IOError when bus closed
+            future = pylibi2c.I2CDevice(bus, 0x50).aread(0, 1)
+            bus.close()
+            with self.assertRaises(IOError):
+                await future
+
+            with self.assertRaises(IOError):
+                i2c.aread(0, 1)
+
+        asyncio.run(main())
+
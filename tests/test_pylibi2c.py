@@ -1,13 +1,24 @@
+import os
+import sys
+import time
+import errno
+import array
 import random
+import shutil
+import tempfile
 import unittest
+import threading
 import pylibi2c
 
+# Default test on simulated 24C04 @0x56, set LIBI2C_TEST_BUS=/dev/i2c-1 test real device
+BUS = os.environ.get("LIBI2C_TEST_BUS", "sim:eeprom@0x56:size=512:page=16")
+
 
 class Pylibi2cTest(unittest.TestCase):
     def setUp(self):
         self.i2c_size = 256
         # 24C04 E2PROM test
-        self.i2c = pylibi2c.I2CDevice(bus="/dev/i2c-1", addr=0x56, page_bytes=16)
+        self.i2c = pylibi2c.I2CDevice(bus=BUS, addr=0x56, page_bytes=16)
 
     def test_init(self):
         with self.assertRaises(TypeError):
@@ -20,13 +31,13 @@ class Pylibi2cTest(unittest.TestCase):
             pylibi2c.I2CDevice("1", "2")
 
         with self.assertRaises(TypeError):
-            pylibi2c.I2CDevice("/dev/i2c-1")
+            pylibi2c.I2CDevice(BUS)
 
         with self.assertRaises(IOError):
             pylibi2c.I2CDevice("/dev/i2c-100", 0x56)
 
     def test_getattr(self):
-        i2c = pylibi2c.I2CDevice("/dev/i2c-1", 0x56)
+        i2c = pylibi2c.I2CDevice(BUS, 0x56)
 
         with self.assertRaises(AttributeError):
             i2c.bus
@@ -35,7 +46,7 @@ class Pylibi2cTest(unittest.TestCase):
             i2c.addr
 
     def test_setattr(self):
-        i2c = pylibi2c.I2CDevice("/dev/i2c-1", 0x56)
+        i2c = pylibi2c.I2CDevice(BUS, 0x56)
 
         with self.assertRaises(AttributeError):
             i2c.bus = ""
@@ -44,10 +55,10 @@ class Pylibi2cTest(unittest.TestCase):
             i2c.addr = ""
 
     def test_flags(self):
-        i2c = pylibi2c.I2CDevice("/dev/i2c-1", 0x56)
+        i2c = pylibi2c.I2CDevice(BUS, 0x56)
         self.assertEqual(i2c.flags, 0)
 
-        i2c = pylibi2c.I2CDevice("/dev/i2c-1", 0x56, flags=1)
+        i2c = pylibi2c.I2CDevice(BUS, 0x56, flags=1)
         self.assertEqual(i2c.flags, 1)
 
         with self.assertRaises(TypeError):
@@ -69,10 +80,10 @@ class Pylibi2cTest(unittest.TestCase):
         self.assertEqual(i2c.flags, pylibi2c.I2C_M_IGNORE_NAK)
 
     def test_delay(self):
-        i2c = pylibi2c.I2CDevice("/dev/i2c-1", 0x56)
+        i2c = pylibi2c.I2CDevice(BUS, 0x56)
         self.assertEqual(i2c.delay, 1)
 
-        i2c = pylibi2c.I2CDevice("/dev/i2c-1", 0x56, delay=0)
+        i2c = pylibi2c.I2CDevice(BUS, 0x56, delay=0)
         self.assertEqual(i2c.delay, 0)
 
         with self.assertRaises(TypeError):
@@ -93,11 +104,37 @@ class Pylibi2cTest(unittest.TestCase):
         i2c.delay = 100
         self.assertEqual(i2c.delay, 100)
 
+    def test_completion(self):
+        i2c = pylibi2c.I2CDevice(BUS, 0x56)
+        self.assertEqual(i2c.completion, pylibi2c.I2C_COMPLETION_DELAY)
+        self.assertEqual(i2c.poll_timeout, 25)
+        self.assertEqual(i2c.poll_interval, 100)
+        self.assertEqual(i2c.poll_max, 0)
+
+        i2c = pylibi2c.I2CDevice(BUS, 0x56, completion=pylibi2c.I2C_COMPLETION_ACK_POLL, poll_max=10)
+        self.assertEqual(i2c.completion, pylibi2c.I2C_COMPLETION_ACK_POLL)
+        self.assertEqual(i2c.poll_max, 10)
+
+        with self.assertRaises(TypeError):
+            i2c.completion = "1"
+
+        with self.assertRaises(ValueError):
+            i2c.completion = 3
+
+        with self.assertRaises(ValueError):
+            i2c.poll_timeout = -1
+
+        i2c.poll_timeout = 10
+        self.assertEqual(i2c.poll_timeout, 10)
+
+        i2c.poll_interval = 50
+        self.assertEqual(i2c.poll_interval, 50)
+
     def test_tenbit(self):
-        i2c = pylibi2c.I2CDevice("/dev/i2c-1", 0x56)
+        i2c = pylibi2c.I2CDevice(BUS, 0x56)
         self.assertEqual(i2c.tenbit, False)
 
-        i2c = pylibi2c.I2CDevice("/dev/i2c-1", 0x56, tenbit=1)
+        i2c = pylibi2c.I2CDevice(BUS, 0x56, tenbit=1)
         self.assertEqual(i2c.tenbit, True)
 
         with self.assertRaises(TypeError):
@@ -116,10 +153,10 @@ class Pylibi2cTest(unittest.TestCase):
         self.assertEqual(i2c.tenbit, True)
 
     def test_page_bytes(self):
-        i2c = pylibi2c.I2CDevice("/dev/i2c-1", 0x56)
+        i2c = pylibi2c.I2CDevice(BUS, 0x56)
         self.assertEqual(i2c.page_bytes, 8)
 
-        i2c = pylibi2c.I2CDevice("/dev/i2c-1", 0x56, page_bytes=16)
+        i2c = pylibi2c.I2CDevice(BUS, 0x56, page_bytes=16)
         self.assertEqual(i2c.page_bytes, 16)
 
         with self.assertRaises(TypeError):
@@ -138,7 +175,7 @@ class Pylibi2cTest(unittest.TestCase):
             i2c.page_bytes = 10
 
         with self.assertRaises(ValueError):
-            i2c.page_bytes = 2048
+            i2c.page_bytes = 8192
 
         i2c.page_bytes = 32
         self.assertEqual(i2c.page_bytes, 32)
@@ -147,10 +184,10 @@ class Pylibi2cTest(unittest.TestCase):
         self.assertEqual(i2c.page_bytes, 64)
 
     def test_iaddr_bytes(self):
-        i2c = pylibi2c.I2CDevice("/dev/i2c-1", 0x56)
+        i2c = pylibi2c.I2CDevice(BUS, 0x56)
         self.assertEqual(i2c.iaddr_bytes, 1)
 
-        i2c = pylibi2c.I2CDevice("/dev/i2c-1", 0x56, iaddr_bytes=2)
+        i2c = pylibi2c.I2CDevice(BUS, 0x56, iaddr_bytes=2)
         self.assertEqual(i2c.iaddr_bytes, 2)
 
         with self.assertRaises(TypeError):
@@ -231,5 +268,1063 @@ class Pylibi2cTest(unittest.TestCase):
             self.assertEqual(self.i2c.ioctl_read(addr, len(data)).decode("ascii"), data)
 
 
+    def test_readinto(self):
+        w_buf = bytearray(range(self.i2c_size))
+        self.assertEqual(self.i2c.ioctl_write(0, w_buf), self.i2c_size)
+
+        r_buf = bytearray(self.i2c_size)
+        self.assertEqual(self.i2c.readinto(0, r_buf), self.i2c_size)
+        self.assertSequenceEqual(w_buf, r_buf)
+
+        r_buf = bytearray(self.i2c_size)
+        self.assertEqual(self.i2c.ioctl_readinto(16, memoryview(r_buf)[16:32]), 16)
+        self.assertSequenceEqual(w_buf[16:32], r_buf[16:32])
+        self.assertEqual(r_buf[0], 0)
+
+        r_buf = array.array('B', bytes(bytearray(8)))
+        self.assertEqual(self.i2c.ioctl_readinto(8, r_buf), 8)
+        self.assertSequenceEqual(w_buf[8:16], bytearray(r_buf))
+
+        with self.assertRaises(TypeError):
+            self.i2c.readinto(0, bytes(bytearray(8)))
+
+    def test_buffer_write(self):
+        w_buf = bytearray(range(64))
+        self.assertEqual(self.i2c.ioctl_write(0, memoryview(w_buf)[32:]), 32)
+        self.assertEqual(self.i2c.write(32, array.array('B', w_buf[:32])), 32)
+        self.assertSequenceEqual(self.i2c.ioctl_read(0, 64), w_buf[32:] + w_buf[:32])
+
+    def test_reference(self):
+        i2c = pylibi2c.I2CDevice(BUS, 0x56)
+        self.assertEqual(sys.getrefcount(i2c), 2)
+        data = i2c.ioctl_read(0, 16)
+        self.assertEqual(sys.getrefcount(data), 2)
+        desc = str(i2c)
+        self.assertEqual(sys.getrefcount(desc), 2)
+
+
+class SimulatedBusTest(unittest.TestCase):
+    def test_open(self):
+        with self.assertRaises(IOError):
+            pylibi2c.I2CDevice("sim:flash@0x50", 0x50)
+
+        with self.assertRaises(IOError):
+            pylibi2c.I2CDevice("sim:eeprom@0x50:speed=100", 0x50)
+
+        with self.assertRaises(IOError):
+            pylibi2c.I2CDevice("sim:eeprom@0x50:size=100:page=16", 0x50)
+
+    def test_page_wraparound(self):
+        i2c = pylibi2c.I2CDevice("sim:eeprom@0x50:page=16", 0x50, page_bytes=32)
+        i2c.ioctl_write(0, bytes(bytearray(range(1, 33))))
+        self.assertSequenceEqual(i2c.ioctl_read(0, 16), bytearray(range(17, 33)))
+
+    def test_block_select(self):
+        i2c = pylibi2c.I2CDevice("sim:eeprom@0x50:size=512:page=16", 0x51, page_bytes=16)
+        data = bytes(bytearray(range(16)))
+        self.assertEqual(i2c.ioctl_write(0x10, data), len(data))
+        self.assertSequenceEqual(i2c.ioctl_read(0x10, len(data)), bytearray(data))
+
+        with self.assertRaises(IOError):
+            pylibi2c.I2CDevice("sim:eeprom@0x50:size=512", 0x52).ioctl_read(0, 1)
+
+    def test_nonostart(self):
+        bus = pylibi2c.I2CBus("sim:nonostart,eeprom@0x50:page=16:twr=0,eeprom@0x54:size=4096:page=32:twr=0")
+        self.assertEqual(bus.funcs & pylibi2c.I2C_FUNC_NOSTART, 0)
+
+        # Adapter without NOSTART, page write copy internal address and data to one message
+        for addr, iaddr_bytes, page_bytes, size in ((0x50, 1, 16, 256), (0x54, 2, 32, 4096)):
+            i2c = pylibi2c.I2CDevice(bus, addr, iaddr_bytes=iaddr_bytes, page_bytes=page_bytes, delay=0)
+            for method in ("ioctl_write", "write"):
+                data = bytes(bytearray(random.randint(0, 255) for _ in range(size - 3)))
+                self.assertEqual(getattr(i2c, method)(3, data), len(data))
+                self.assertSequenceEqual(i2c.ioctl_read(3, len(data)), bytearray(data))
+
+        with self.assertRaises(IOError):
+            pylibi2c.I2CDevice(bus, 0x50, flags=pylibi2c.I2C_M_NOSTART).ioctl_read(0, 1)
+
+    def test_write_cycle(self):
+        data = bytes(bytearray(range(64)))
+
+        # Device still busy after fixed 1ms delay, only first page written
+        i2c = pylibi2c.I2CDevice("sim:eeprom@0x50:twr=3000", 0x50, delay=1)
+        self.assertEqual(i2c.ioctl_write(0, data), 8)
+
+        # ACK polling wait it finish
+        i2c = pylibi2c.I2CDevice("sim:eeprom@0x50:twr=3000", 0x50, completion=pylibi2c.I2C_COMPLETION_ACK_POLL)
+        self.assertEqual(i2c.ioctl_write(0, data), len(data))
+        self.assertEqual(i2c.write(0, data), len(data))
+        time.sleep(0.005)
+        self.assertSequenceEqual(i2c.ioctl_read(0, len(data)), bytearray(data))
+
+        # Give up after poll_max attempts
+        i2c = pylibi2c.I2CDevice("sim:eeprom@0x50:twr=100000", 0x50,
+                                 completion=pylibi2c.I2C_COMPLETION_ACK_POLL, poll_max=3)
+        self.assertEqual(i2c.ioctl_write(0, data), -1)
+
+    def test_parallel(self):
+        # Each read sleep 2 * 10ms on simulated adapter, 4 threads on 4 buses should run concurrently
+        def worker(i2c):
+            for _ in range(3):
+                self.assertEqual(len(i2c.ioctl_read(0, 16)), 16)
+
+        devices = [pylibi2c.I2CDevice("sim:eeprom@0x50:latency=10000", 0x50) for _ in range(4)]
+        threads = [threading.Thread(target=worker, args=(i2c,)) for i2c in devices]
+
+        start = time.time()
+        for t in threads:
+            t.start()
+
+        for t in threads:
+            t.join()
+
+        self.assertLess(time.time() - start, 0.75 * len(devices) * 3 * 2 * 0.01)
+
+    def test_close(self):
+        i2c = pylibi2c.I2CDevice(BUS, 0x56)
+        i2c.close()
+        i2c.close()
+
+        with self.assertRaises(IOError):
+            i2c.ioctl_read(0, 1)
+
+    def test_large_read(self):
+        size = 65536
+        image = bytearray(random.getrandbits(8) for _ in range(size))
+        i2c = pylibi2c.I2CDevice("sim:eeprom@0x50:size=65536:page=128:twr=0", 0x50, iaddr_bytes=2, page_bytes=128,
+                                 completion=pylibi2c.I2C_COMPLETION_ACK_POLL)
+        self.assertEqual(i2c.ioctl_write(0, image), size)
+
+        self.assertSequenceEqual(i2c.ioctl_read(0, size), image)
+        self.assertSequenceEqual(i2c.read(0, size), image)
+        self.assertSequenceEqual(i2c.ioctl_read(0x1234, 20000), image[0x1234:0x1234 + 20000])
+
+        # Internal address wraparound
+        self.assertSequenceEqual(i2c.ioctl_read(0xff00, 512), image[0xff00:] + image[:0x100])
+
+        chunks = list(i2c.ioctl_iter_read(0, size, 10000))
+        self.assertEqual([len(c) for c in chunks], [10000] * 6 + [5536])
+        self.assertSequenceEqual(bytearray().join(chunks), image)
+        self.assertSequenceEqual(bytearray().join(i2c.iter_read(0x100, 0x300)), image[0x100:0x400])
+        self.assertEqual(list(i2c.iter_read(0, 0)), [])
+
+        with self.assertRaises(ValueError):
+            i2c.iter_read(0, 1, 0)
+
+    def test_register(self):
+        i2c = pylibi2c.I2CDevice("sim:eeprom@0x50,reg@0x48", 0x48, page_bytes=256)
+        data = bytes(bytearray(range(255, -1, -1)))
+        self.assertEqual(i2c.ioctl_write(0, data), len(data))
+        self.assertSequenceEqual(i2c.ioctl_read(0, len(data)), bytearray(data))
+        self.assertSequenceEqual(i2c.read(0xfe, 4), bytearray([1, 0, 255, 254]))
+
+
+class SharedBusTest(unittest.TestCase):
+    def test_init(self):
+        with self.assertRaises(TypeError):
+            pylibi2c.I2CBus()
+
+        with self.assertRaises(IOError):
+            pylibi2c.I2CBus("/dev/i2c-100")
+
+        with self.assertRaises(TypeError):
+            pylibi2c.I2CDevice(1.0, 0x50)
+
+    def test_close(self):
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50")
+        i2c = pylibi2c.I2CDevice(bus, 0x50)
+        self.assertEqual(sys.getrefcount(bus), 3)
+        self.assertEqual(len(i2c.ioctl_read(0, 16)), 16)
+
+        bus.close()
+        bus.close()
+        self.assertEqual(bus.fd, -1)
+        with self.assertRaises(IOError):
+            i2c.read(0, 1)
+
+        with self.assertRaises(IOError):
+            bus.lock()
+
+        i2c.close()
+        self.assertEqual(sys.getrefcount(bus), 2)
+
+    def test_close_locked(self):
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50")
+        i2c = pylibi2c.I2CDevice(bus, 0x50)
+        fd = bus.fd
+        errors = []
+
+        def worker():
+            try:
+                bus.lock()
+            except IOError:
+                errors.append("lock")
+
+        # Close while locked is deferred until unlock, other thread waiting lock failed
+        with bus:
+            t = threading.Thread(target=worker)
+            t.start()
+            time.sleep(0.01)
+            bus.close()
+            os.fstat(fd)
+            with self.assertRaises(IOError):
+                i2c.read(0, 1)
+
+        t.join()
+        self.assertEqual(errors, ["lock"])
+        with self.assertRaises(OSError):
+            os.fstat(fd)
+
+    def test_close_inflight(self):
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50:latency=20000")
+        i2c = pylibi2c.I2CDevice(bus, 0x50)
+        fd = bus.fd
+        result = []
+
+        # Transfer of other thread hold bus, it's closed after transfer done
+        t = threading.Thread(target=lambda: result.append(len(i2c.ioctl_read(0, 16))))
+        t.start()
+        time.sleep(0.01)
+        bus.close()
+        os.fstat(fd)
+        t.join()
+
+        # Closed between pages, write return pages already written
+        for method in ("ioctl_write", "write"):
+            bus = pylibi2c.I2CBus("sim:eeprom@0x50:page=16:twr=0:latency=20000")
+            write = getattr(pylibi2c.I2CDevice(bus, 0x50, page_bytes=16, delay=0), method)
+            result = []
+            t = threading.Thread(target=lambda: result.append(write(0, b"\x5a" * 64)))
+            t.start()
+            time.sleep(0.01)
+            bus.close()
+            t.join()
+            self.assertEqual(result, [16], method)
+
+        self.assertEqual(result, [16])
+        with self.assertRaises(OSError):
+            os.fstat(fd)
+
+    def test_lock(self):
+        with pylibi2c.I2CDevice("sim:eeprom@0x50", 0x50) as i2c:
+            self.assertEqual(len(i2c.read(0, 1)), 1)
+
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50", flock=True)
+        i2c = pylibi2c.I2CDevice(bus, 0x50, completion=pylibi2c.I2C_COMPLETION_ACK_POLL)
+        order = []
+
+        def worker():
+            with bus:
+                order.append("worker")
+
+        # Recursive, other thread wait until outermost unlock
+        with bus:
+            bus.lock()
+            t = threading.Thread(target=worker)
+            t.start()
+            self.assertEqual(i2c.write(0, b"\x5a"), 1)
+            bus.unlock()
+            time.sleep(0.01)
+            order.append("main")
+
+        t.join()
+        self.assertEqual(order, ["main", "worker"])
+
+    def test_unlock(self):
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50")
+        i2c = pylibi2c.I2CDevice(bus, 0x50)
+
+        # Stray unlock failed, bus still usable
+        with self.assertRaises(IOError) as cm:
+            bus.unlock()
+        self.assertEqual(cm.exception.errno, errno.EPERM)
+        self.assertEqual(len(i2c.ioctl_read(0, 4)), 4)
+
+        # Other thread can't unlock lock of this thread
+        errors = []
+
+        def worker():
+            try:
+                bus.unlock()
+            except IOError as err:
+                errors.append(err.errno)
+
+        with bus:
+            t = threading.Thread(target=worker)
+            t.start()
+            t.join()
+            self.assertEqual(len(i2c.ioctl_read(0, 4)), 4)
+
+        self.assertEqual(errors, [errno.EPERM])
+        with self.assertRaises(IOError):
+            bus.unlock()
+
+        # Lock is released, other thread can take it
+        t = threading.Thread(target=lambda: bus.lock() or errors.append(bus.unlock()))
+        t.start()
+        t.join()
+        self.assertEqual(errors, [errno.EPERM, None])
+        self.assertEqual(len(i2c.ioctl_read(0, 4)), 4)
+
+    def test_parallel_devices(self):
+        # Devices on one bus, file I/O select and transfer must not interleave
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50:twr=0:latency=100,eeprom@0x51:twr=0:latency=100")
+        errors = []
+
+        def worker(addr):
+            i2c = pylibi2c.I2CDevice(bus, addr, completion=pylibi2c.I2C_COMPLETION_ACK_POLL)
+            for i in range(20):
+                data = bytes(bytearray([addr, i] * 8))
+                if i2c.write(0, data) != len(data) or i2c.read(0, len(data)) != bytearray(data):
+                    errors.append(addr)
+
+        threads = [threading.Thread(target=worker, args=(addr,)) for addr in (0x50, 0x51)]
+        for t in threads:
+            t.start()
+
+        for t in threads:
+            t.join()
+
+        self.assertEqual(errors, [])
+
+
+class SMBusTest(unittest.TestCase):
+    def check_smbus(self, i2c):
+        i2c.write_quick(0)
+        i2c.write_byte_data(0x10, 0xa5)
+        self.assertEqual(i2c.read_byte_data(0x10), 0xa5)
+        i2c.write_word_data(0x20, 0x1234)
+        self.assertEqual(i2c.read_word_data(0x20), 0x1234)
+        self.assertEqual(i2c.read_byte_data(0x21), 0x12)
+
+        # Receive byte from register pointer set by send byte
+        i2c.write_byte(0x20)
+        self.assertEqual(i2c.read_byte(), 0x34)
+
+        # Process call write word to #command, read next word
+        i2c.write_word_data(0x32, 0x5678)
+        self.assertEqual(i2c.process_call(0x30, 0xabcd), 0x5678)
+        self.assertEqual(i2c.read_word_data(0x30), 0xabcd)
+
+        data = bytes(bytearray(range(1, 33)))
+        self.assertEqual(i2c.write_block_data(0x40, data), len(data))
+        self.assertSequenceEqual(i2c.read_block_data(0x40), bytearray(data))
+        self.assertSequenceEqual(i2c.read_i2c_block_data(0x40, 4), bytearray([32, 1, 2, 3]))
+        self.assertEqual(i2c.write_i2c_block_data(0x80, b"\x03abc"), 4)
+        self.assertSequenceEqual(i2c.read_block_data(0x80), bytearray(b"abc"))
+
+    def test_smbus(self):
+        i2c = pylibi2c.I2CDevice("sim:reg@0x48", 0x48)
+        self.assertEqual(i2c.pec, False)
+        self.check_smbus(i2c)
+
+        # Block write length is 1 - 32, same as C API
+        for write in (i2c.write_block_data, i2c.write_i2c_block_data):
+            for size in (0, 33):
+                with self.assertRaises(ValueError):
+                    write(0, bytes(bytearray(size)))
+
+        with self.assertRaises(ValueError):
+            i2c.read_i2c_block_data(0, 0)
+
+        with self.assertRaises(TypeError):
+            i2c.pec = 1
+
+        # Block length 0 is protocol error
+        i2c.write_byte_data(0, 0)
+        with self.assertRaises(IOError):
+            i2c.read_block_data(0)
+
+        with self.assertRaises(IOError):
+            pylibi2c.I2CDevice("sim:reg@0x48", 0x49).read_byte()
+
+    def test_pec(self):
+        i2c = pylibi2c.I2CDevice("sim:reg@0x48:pec=1", 0x48, pec=True)
+        self.assertEqual(i2c.pec, True)
+        self.check_smbus(i2c)
+
+        # Device check PEC, NAK write without it
+        i2c.pec = False
+        with self.assertRaises(IOError):
+            i2c.write_byte_data(0x10, 0)
+
+        # Master check PEC
+        i2c = pylibi2c.I2CDevice("sim:reg@0x48", 0x48, pec=True)
+        i2c.write_byte_data(0x10, 0x5a)
+        with self.assertRaises(IOError):
+            i2c.read_byte_data(0x10)
+
+    def test_smbus_adapter(self):
+        # Adapter only support SMBus, using ioctl(I2C_SMBUS)
+        bus = pylibi2c.I2CBus("sim:smbus,reg@0x48:pec=1")
+        i2c = pylibi2c.I2CDevice(bus, 0x48, pec=True)
+        self.check_smbus(i2c)
+
+        with self.assertRaises(IOError):
+            i2c.ioctl_read(0, 1)
+
+        i2c.pec = False
+        with self.assertRaises(IOError):
+            i2c.write_byte_data(0x10, 0)
+
+
+class AdapterTest(unittest.TestCase):
+    def test_list_adapters(self):
+        sysfs = tempfile.mkdtemp()
+        for entry, name in (("i2c-10", "adapter ten\n"), ("i2c-2", "adapter two\n"), ("2-0050", "24c04\n")):
+            os.mkdir(os.path.join(sysfs, entry))
+            with open(os.path.join(sysfs, entry, "name"), "w") as fp:
+                fp.write(name)
+
+        adapters = pylibi2c.list_adapters(sysfs)
+        self.assertEqual([a["nr"] for a in adapters], [2, 10])
+        self.assertEqual([a["name"] for a in adapters], ["adapter two", "adapter ten"])
+        self.assertEqual(adapters[0]["bus"], "/dev/i2c-2")
+        shutil.rmtree(sysfs)
+
+        with self.assertRaises(IOError):
+            pylibi2c.list_adapters(sysfs)
+
+    def test_method(self):
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50")
+        self.assertTrue(bus.funcs & pylibi2c.I2C_FUNC_I2C)
+        self.assertEqual(bus.method, pylibi2c.I2C_METHOD_IOCTL)
+
+        bus = pylibi2c.I2CBus("sim:smbus,eeprom@0x50:size=512:page=16")
+        self.assertFalse(bus.funcs & pylibi2c.I2C_FUNC_I2C)
+        self.assertEqual(bus.method, pylibi2c.I2C_METHOD_SMBUS)
+
+        # SMBus only adapter, i2c block transfer not cross page and 32 bytes
+        i2c = pylibi2c.I2CDevice(bus, 0x50, page_bytes=16, completion=pylibi2c.I2C_COMPLETION_ACK_POLL)
+        data = bytes(bytearray(range(100)))
+        self.assertEqual(i2c.auto_write(0x08, data), len(data))
+        self.assertSequenceEqual(i2c.auto_read(0x08, len(data)), bytearray(data))
+        self.assertEqual(i2c.write(0, data), -1)
+
+        i2c.iaddr_bytes = 2
+        with self.assertRaises(IOError):
+            i2c.auto_read(0, 1)
+
+        bus.close()
+        with self.assertRaises(IOError):
+            bus.method
+
+
+class ScanTest(unittest.TestCase):
+    def test_scan(self):
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50,reg@0x48")
+        found = pylibi2c.scan([bus, "sim:smbus,reg@0x20,eeprom@0x57", "sim:eeprom@0x03"])
+        self.assertEqual(found, [[0x48, 0x50], [0x20, 0x57], []])
+
+        # Address range and single bus
+        self.assertEqual(pylibi2c.scan([bus], first=0x03, last=0x49), [[0x48]])
+        self.assertEqual(pylibi2c.scan(["sim:eeprom@0x03"], first=0x03, last=0x03), [[0x03]])
+        self.assertEqual(pylibi2c.scan([]), [])
+
+        # Adapter can't send zero-length message, probe with 1 byte read
+        noquick = pylibi2c.I2CBus("sim:noquick,reg@0x20,eeprom@0x50:size=512")
+        self.assertEqual(noquick.funcs & pylibi2c.I2C_FUNC_SMBUS_QUICK, 0)
+        self.assertEqual(pylibi2c.scan([noquick, "sim:smbus,noquick,reg@0x20"]), [[0x20, 0x50, 0x51], [0x20]])
+
+        with self.assertRaises(ValueError):
+            pylibi2c.scan([bus], first=0x50, last=0x48)
+
+        with self.assertRaises(ValueError):
+            pylibi2c.scan([bus], last=0x80)
+
+        bus.close()
+        with self.assertRaises(IOError):
+            pylibi2c.scan([bus])
+
+
+class GangTest(unittest.TestCase):
+    def test_gang_program(self):
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50:size=512:page=16,eeprom@0x54:size=512:page=16")
+        devices = [pylibi2c.I2CDevice(bus, 0x50, page_bytes=16, completion=pylibi2c.I2C_COMPLETION_ACK_POLL),
+                   pylibi2c.I2CDevice(bus, 0x54, page_bytes=16, completion=pylibi2c.I2C_COMPLETION_ACK_POLL),
+                   pylibi2c.I2CDevice("sim:eeprom@0x50:size=512:page=16", 0x50, page_bytes=16,
+                                      completion=pylibi2c.I2C_COMPLETION_ACK_POLL),
+                   pylibi2c.I2CDevice("sim:eeprom@0x50", 0x57)]
+
+        image = bytes(bytearray(range(200)))
+        results = pylibi2c.gang_program(devices, 0x10, image)
+        self.assertEqual([r["stage"] for r in results], [pylibi2c.I2C_GANG_DONE] * 3 + [pylibi2c.I2C_GANG_WRITE])
+        self.assertEqual([r["error"] for r in results], [0, 0, 0, errno.ENXIO])
+        self.assertTrue(all(r["write_us"] > 0 and r["verify_us"] > 0 for r in results[:3]))
+
+        for device in devices[:3]:
+            self.assertSequenceEqual(device.ioctl_read(0x10, len(image)), bytearray(image))
+
+        # Same image again, nothing differ
+        results = pylibi2c.gang_program(devices[:3], 0x10, image, diff=True)
+        self.assertEqual([r["stage"] for r in results], [pylibi2c.I2C_GANG_DONE] * 3)
+        self.assertEqual(pylibi2c.gang_program([], 0, image), [])
+
+        with self.assertRaises(TypeError):
+            pylibi2c.gang_program([bus], 0, image)
+
+        bus.close()
+        with self.assertRaises(IOError):
+            pylibi2c.gang_program(devices, 0, image)
+
+
+class FramTest(unittest.TestCase):
+    def test_fram(self):
+        data = bytes(bytearray(random.randint(0, 255) for _ in range(20000)))
+        bus = pylibi2c.I2CBus("sim:fram@0x50:size=32768")
+        fram = pylibi2c.I2CDevice(bus, 0x50, iaddr_bytes=2, delay=100, completion=pylibi2c.I2C_COMPLETION_NONE)
+        self.assertEqual(fram.completion, pylibi2c.I2C_COMPLETION_NONE)
+
+        # Not split by page and no write cycle wait, only limit by max message bytes
+        start = time.time()
+        self.assertEqual(fram.ioctl_write(0x100, data), len(data))
+        self.assertLess(time.time() - start, 0.1)
+        self.assertEqual(fram.stats()["xfers"], 3)
+        self.assertEqual(fram.stats()["delay_us"], 0)
+        self.assertSequenceEqual(fram.ioctl_read(0x100, len(data)), bytearray(data))
+
+        # File I/O write is split by staging buffer
+        bus.reset_stats()
+        self.assertEqual(fram.write(0x7000, data[:4096]), 4096)
+        self.assertEqual(fram.stats()["xfers"], 1)
+        self.assertSequenceEqual(fram.ioctl_read(0x7000, 4096), bytearray(data[:4096]))
+
+        # Write not cross end of internal address space
+        bus.reset_stats()
+        self.assertEqual(fram.ioctl_write(0xfff0, data[:32]), 32)
+        self.assertEqual(fram.stats()["xfers"], 2)
+
+        fram.page_bytes = 4096
+        with self.assertRaises(ValueError):
+            fram.page_bytes = 8192
+
+
+class PartTest(unittest.TestCase):
+    def test_parts(self):
+        parts = dict((part["name"], part) for part in pylibi2c.parts())
+        self.assertEqual(parts["24c16"]["size"], 2048)
+        self.assertEqual(parts["24c16"]["block_bits"], 3)
+        self.assertEqual(parts["24c256"]["iaddr_bytes"], 2)
+        self.assertEqual(parts["fm24cl64"]["twr_max_us"], 0)
+
+        with self.assertRaises(ValueError):
+            pylibi2c.I2CDevice("sim:eeprom@0x50", 0x50, part="24c99")
+
+    def test_block_select(self):
+        data = bytes(bytearray(random.randint(0, 255) for _ in range(2048)))
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50:size=2048:page=16")
+        i2c = pylibi2c.I2CDevice(bus, 0x50, part="24C16")
+        self.assertEqual(i2c.page_bytes, 16)
+        self.assertEqual(i2c.block_bits, 3)
+        self.assertEqual(i2c.completion, pylibi2c.I2C_COMPLETION_ACK_POLL)
+
+        # Whole linear address space with one call, block select address carry internal address high bits
+        self.assertEqual(i2c.ioctl_write(0, data), len(data))
+        self.assertEqual(i2c.write(0x1f8, data[:16]), 16)
+        self.assertEqual(i2c.ioctl_read(0x1f8, 16), bytearray(data[:16]))
+        self.assertEqual(i2c.ioctl_write(0x1f8, data[0x1f8:0x208]), 16)
+
+        # Chunks of all blocks batched in one transfer
+        bus.reset_stats()
+        self.assertSequenceEqual(i2c.ioctl_read(0, len(data)), bytearray(data))
+        self.assertEqual(bus.stats()["xfers"], 1)
+        self.assertSequenceEqual(i2c.read(0, len(data)), bytearray(data))
+        self.assertSequenceEqual(i2c.read(0x2f0, 0x20), bytearray(data[0x2f0:0x310]))
+
+        # Device statistics sum all block select address
+        stats = i2c.stats()
+        self.assertEqual(stats["bytes_in"], 2 * len(data) + 0x20)
+        for key in ("xfers", "bytes_in", "bytes_out", "latency"):
+            self.assertEqual(stats[key], bus.stats()[key])
+
+        bus.reset_stats()
+        self.assertEqual(i2c.ioctl_write(0, data), len(data))
+        self.assertEqual(i2c.stats()["bytes_out"], bus.stats()["bytes_out"])
+        self.assertGreaterEqual(i2c.stats()["bytes_out"], len(data) + 2048 // 16)
+
+        # Explicit argument override part profile
+        i2c = pylibi2c.I2CDevice(bus, 0x50, part="24c16", block_bits=0)
+        self.assertEqual(i2c.block_bits, 0)
+        self.assertSequenceEqual(i2c.ioctl_read(0x100, 16), bytearray(data[:16]))
+
+    def test_fram_part(self):
+        data = bytes(bytearray(random.randint(0, 255) for _ in range(0x2000)))
+        bus = pylibi2c.I2CBus("sim:fram@0x50:size=8192")
+        fram = pylibi2c.I2CDevice(bus, 0x50, part="fm24cl64")
+        self.assertEqual(fram.iaddr_bytes, 2)
+        self.assertEqual(fram.completion, pylibi2c.I2C_COMPLETION_NONE)
+        self.assertEqual(fram.ioctl_write(0, data), len(data))
+        self.assertEqual(fram.stats()["xfers"], 1)
+        self.assertSequenceEqual(fram.ioctl_read(0, len(data)), bytearray(data))
+
+        # File I/O read not wait between internal address and data
+        bus.reset_stats()
+        start = time.time()
+        for _ in range(100):
+            self.assertSequenceEqual(fram.read(0, 16), bytearray(data[:16]))
+        self.assertLess(time.time() - start, 0.05)
+        self.assertEqual(fram.stats()["delay_us"], 0)
+
+
+class VectorTest(unittest.TestCase):
+    def test_readv_writev(self):
+        data = bytes(bytearray(random.randint(0, 255) for _ in range(8192)))
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50:size=8192:page=32")
+        i2c = pylibi2c.I2CDevice(bus, 0x50, iaddr_bytes=2, page_bytes=32, completion=pylibi2c.I2C_COMPLETION_ACK_POLL)
+
+        # Each region split by page
+        regions = [(0x10, data[:40]), (0x100, data[40:41]), (0x1f00, data[41:141])]
+        self.assertEqual(i2c.writev(regions), 141)
+        self.assertEqual(i2c.writev([]), 0)
+
+        # All regions read with one transfer
+        bus.reset_stats()
+        result = i2c.readv([(0x10, 40), (0x100, 1), (0x1f00, 100), (0x200, 0)])
+        self.assertEqual(bus.stats()["xfers"], 1)
+        self.assertEqual(len(result), 4)
+        self.assertSequenceEqual(result[0], bytearray(data[:40]))
+        self.assertSequenceEqual(result[1], bytearray(data[40:41]))
+        self.assertSequenceEqual(result[2], bytearray(data[41:141]))
+        self.assertSequenceEqual(result[3], bytearray())
+        self.assertEqual(i2c.readv([]), [])
+
+        # More regions than one transfer messages
+        i2c.ioctl_write(0, data[:1024])
+        bus.reset_stats()
+        result = i2c.readv([(iaddr, 4) for iaddr in range(0, 1024, 16)])
+        self.assertSequenceEqual(bytearray().join(result), bytearray(b"".join(data[i:i + 4] for i in range(0, 1024, 16))))
+        self.assertGreater(bus.stats()["xfers"], 1)
+        self.assertLess(bus.stats()["xfers"], 64)
+
+        with self.assertRaises(TypeError):
+            i2c.readv([(0, 1, 2)])
+
+        with self.assertRaises(IOError):
+            pylibi2c.I2CDevice(bus, 0x60).readv([(0, 1), (8, 1)])
+
+
+class TxnTest(unittest.TestCase):
+    def test_txn(self):
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50:page=16:twr=0,reg@0x48")
+        eeprom = pylibi2c.I2CDevice(bus, 0x50, page_bytes=16)
+        reg = pylibi2c.I2CDevice(bus, 0x48)
+        data = bytes(bytearray(range(16)))
+        self.assertEqual(eeprom.ioctl_write(0, data), len(data))
+
+        # Segments of two slaves submit with one ioctl
+        txn = pylibi2c.I2CTxn(bus)
+        bus.reset_stats()
+        self.assertEqual(txn.add_read(eeprom, 4, 4), 1)
+        self.assertEqual(txn.add_write(reg, 0x10, b"\xa5\x5a"), 2)
+        self.assertEqual(txn.add_read(reg, 0x10, 2), 4)
+        self.assertEqual(txn.add_address(eeprom, 0), 5)
+        self.assertEqual(txn.nmsgs, 6)
+        self.assertEqual(txn.submit(), 6)
+        self.assertEqual(txn.status, (0,) * 6)
+        self.assertEqual(bus.stats()["xfers"], 1)
+        self.assertSequenceEqual(txn.data(1), bytearray(data[4:8]))
+        self.assertSequenceEqual(txn.data(4), bytearray(b"\xa5\x5a"))
+        self.assertSequenceEqual(reg.ioctl_read(0x10, 2), bytearray(b"\xa5\x5a"))
+
+        with self.assertRaises(IndexError):
+            txn.data(2)
+
+        # Reuse after reset, previous segments are dropped
+        txn.reset()
+        self.assertEqual(txn.nmsgs, 0)
+        self.assertEqual(txn.status, ())
+        self.assertEqual(txn.submit(), 0)
+        self.assertEqual(txn.add_read(reg, 0x11, 1), 1)
+        self.assertEqual(txn.submit(), 2)
+        self.assertSequenceEqual(txn.data(1), bytearray(b"\x5a"))
+
+        # Device not on transaction bus
+        with self.assertRaises(ValueError):
+            txn.add_read(pylibi2c.I2CDevice("sim:reg@0x48", 0x48), 0, 1)
+
+        # Transaction full, max 42 segments(I2C_RDWR_IOCTL_MAX_MSGS)
+        txn.reset()
+        with self.assertRaises(IOError):
+            for _ in range(64):
+                txn.add_address(eeprom, 0)
+        self.assertEqual(txn.nmsgs, 42)
+
+        bus.close()
+        with self.assertRaises(IOError):
+            txn.submit()
+
+    def test_txn_nak(self):
+        for name, status in (("sim:eeprom@0x50,reg@0x48", None), ("sim:partial,eeprom@0x50,reg@0x48", 3)):
+            bus = pylibi2c.I2CBus(name)
+            eeprom = pylibi2c.I2CDevice(bus, 0x50)
+            missing = pylibi2c.I2CDevice(bus, 0x60)
+            reg = pylibi2c.I2CDevice(bus, 0x48)
+
+            # Slave in middle of transaction NAK
+            txn = pylibi2c.I2CTxn(bus)
+            txn.add_write(reg, 0x20, b"\x11")
+            txn.add_read(eeprom, 0, 2)
+            txn.add_read(missing, 0, 2)
+            txn.add_read(reg, 0x20, 1)
+            self.assertEqual(txn.nmsgs, 7)
+
+            if status is None:
+                # Adapter fail whole transfer, all segments has errno
+                self.assertEqual(txn.submit(), -1)
+                self.assertEqual(txn.status, (-errno.ENXIO,) * 7)
+            else:
+                # Adapter stop at NAK, completed segments success, following segments are not transferred
+                self.assertEqual(txn.submit(), status)
+                self.assertEqual(txn.status, (0,) * status + (-errno.EIO,) * (7 - status))
+
+            # Write before failed slave is on bus, retry without failed slave after reset
+            txn.reset()
+            txn.add_read(eeprom, 0, 2)
+            txn.add_read(reg, 0x20, 1)
+            self.assertEqual(txn.submit(), 4)
+            self.assertEqual(txn.status, (0,) * 4)
+            self.assertSequenceEqual(txn.data(3), bytearray(b"\x11"))
+
+
+class RetryTest(unittest.TestCase):
+    def test_retry(self):
+        data = bytes(bytearray(range(64)))
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50:page=16:twr=20000")
+
+        # Device NAK next page during write cycle, abort with partial progress
+        i2c = pylibi2c.I2CDevice(bus, 0x50, page_bytes=16, delay=1)
+        self.assertEqual(i2c.retries, 0)
+        self.assertEqual(i2c.retry_on, pylibi2c.I2C_RETRY_DEFAULT)
+        self.assertEqual(i2c.ioctl_write(0, data), 16)
+        time.sleep(0.03)
+
+        # NAK is not transient, same as without retry
+        i2c.retries = 5
+        i2c.retry_on = pylibi2c.I2C_RETRY_IO
+        self.assertEqual(i2c.write(0, data), 16)
+        self.assertEqual(i2c.stats()["retries"], 0)
+        time.sleep(0.03)
+
+        # Retry failed page after backoff, resume until all pages written
+        i2c.retry_on = pylibi2c.I2C_RETRY_NAK
+        i2c.retry_backoff = 10000
+        self.assertEqual(i2c.ioctl_write(0, data), len(data))
+        time.sleep(0.03)
+        self.assertEqual(i2c.write(0x40, data), len(data))
+        time.sleep(0.03)
+        self.assertSequenceEqual(i2c.ioctl_read(0, 128), bytearray(data * 2))
+        self.assertGreaterEqual(i2c.stats()["retries"], 6)
+        self.assertEqual(bus.stats()["retries"], i2c.stats()["retries"])
+
+        # Give up after retries used up
+        i2c = pylibi2c.I2CDevice(bus, 0x50, page_bytes=16, delay=1, retries=1, retry_backoff=100)
+        self.assertEqual(i2c.retry_backoff, 100)
+        self.assertEqual(i2c.ioctl_write(0, data), 16)
+
+    def test_retry_poll(self):
+        data = bytes(bytearray(range(16)))
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50:page=16:twr=20000")
+
+        # Polling timeout before write cycle done, poll again, page is programmed once
+        for write in ("write", "ioctl_write"):
+            i2c = pylibi2c.I2CDevice(bus, 0x50, page_bytes=16, completion=pylibi2c.I2C_COMPLETION_ACK_POLL,
+                                     poll_timeout=1, retries=5, retry_on=pylibi2c.I2C_RETRY_TIMEOUT, retry_backoff=5000)
+            bus.reset_stats()
+            self.assertEqual(getattr(i2c, write)(0, data), len(data))
+            self.assertGreaterEqual(i2c.stats()["retries"], 1)
+            self.assertEqual(i2c.stats()["bytes_out"], 1 + len(data) + 1)
+
+        # Large backoff is capped at 500ms each retry
+        i2c = pylibi2c.I2CDevice(bus, 0x50, page_bytes=16, completion=pylibi2c.I2C_COMPLETION_ACK_POLL,
+                                 poll_timeout=1, retries=20, retry_on=pylibi2c.I2C_RETRY_TIMEOUT, retry_backoff=1000000)
+        self.assertEqual(i2c.ioctl_write(0, data), len(data))
+        self.assertSequenceEqual(i2c.ioctl_read(0, 16), bytearray(data))
+
+
+class StatsTest(unittest.TestCase):
+    def test_stats(self):
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50:page=16,reg@0x48")
+        i2c = pylibi2c.I2CDevice(bus, 0x50, page_bytes=16, completion=pylibi2c.I2C_COMPLETION_ACK_POLL)
+        self.assertEqual(i2c.ioctl_write(0, b"\x55" * 32), 32)
+        self.assertSequenceEqual(i2c.ioctl_read(0, 32), bytearray(b"\x55" * 32))
+
+        stats = i2c.stats()
+        self.assertEqual(stats["bytes_in"], 32)
+        self.assertGreaterEqual(stats["bytes_out"], 34)
+        self.assertGreater(stats["poll_us"], 0)
+        self.assertEqual(stats["errors"], 0)
+        self.assertEqual(sum(sum(h) for h in stats["latency"].values()), stats["xfers"])
+        self.assertEqual(sum(stats["latency"]["read"]), 1)
+        self.assertEqual(len(stats["latency"]["write"]), 24)
+
+        # Fixed delay and NAK
+        i2c = pylibi2c.I2CDevice(bus, 0x48, delay=2)
+        self.assertEqual(i2c.write(0, b"\x01"), 1)
+        self.assertEqual(i2c.stats()["delay_us"], 2000)
+        with self.assertRaises(IOError):
+            pylibi2c.I2CDevice(bus, 0x57).ioctl_read(0, 1)
+
+        self.assertEqual(pylibi2c.I2CDevice(bus, 0x57).stats()["naks"], 1)
+
+        stats = bus.stats()
+        self.assertGreaterEqual(stats["naks"], 1)
+        self.assertGreater(stats["ioctls"], stats["naks"])
+        self.assertEqual(stats["delay_us"], 2000)
+
+        bus.reset_stats()
+        self.assertEqual(bus.stats()["xfers"], 0)
+        self.assertEqual(i2c.stats()["delay_us"], 0)
+
+        # Native SMBus transfer
+        i2c = pylibi2c.I2CDevice("sim:smbus,reg@0x20", 0x20)
+        i2c.write_byte_data(0x10, 0x5a)
+        self.assertEqual(i2c.read_byte_data(0x10), 0x5a)
+        stats = i2c.stats()
+        self.assertEqual(sum(stats["latency"]["smbus"]), 2)
+        self.assertEqual((stats["bytes_in"], stats["bytes_out"]), (1, 3))
+
+        bus.close()
+        with self.assertRaises(IOError):
+            bus.stats()
+
+
+class TraceTest(unittest.TestCase):
+    def test_trace(self):
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50:page=16:twr=0")
+        i2c = pylibi2c.I2CDevice(bus, 0x50, page_bytes=16)
+
+        pylibi2c.trace_start()
+        while pylibi2c.trace_read():
+            pass
+
+        self.assertEqual(i2c.ioctl_write(0x0c, b"\xa5" * 8), 8)
+        self.assertSequenceEqual(i2c.ioctl_read(0x0c, 8), bytearray(b"\xa5" * 8))
+        with self.assertRaises(IOError):
+            pylibi2c.I2CDevice(bus, 0x57).ioctl_read(0, 1)
+
+        smbus = pylibi2c.I2CDevice("sim:smbus,reg@0x20", 0x20)
+        smbus.write_byte_data(0x10, 0x5a)
+        pylibi2c.trace_stop()
+        self.assertEqual(smbus.read_byte_data(0x10), 0x5a)
+
+        traces = pylibi2c.trace_read()
+        self.assertEqual([t["type"] for t in traces], [pylibi2c.I2C_TRACE_RDWR] * 4 + [pylibi2c.I2C_TRACE_SMBUS])
+        self.assertEqual([t["iaddr"] for t in traces], [0x0c, 0x10, 0x0c, 0, 0x10])
+        self.assertEqual([t["len"] for t in traces], [5, 5, 9, 2, 2])
+        # Simulated adapter support NOSTART, page write is address message and NOSTART data message
+        self.assertEqual([t["nmsgs"] for t in traces], [2, 2, 2, 2, 2])
+        self.assertEqual([t["addr"] for t in traces], [0x50, 0x50, 0x50, 0x57, 0x20])
+        self.assertEqual([t["result"] for t in traces], [2, 2, 2, -errno.ENXIO, 0])
+        self.assertEqual(traces[2]["flags"] & pylibi2c.I2C_M_NOSTART, 0)
+        self.assertTrue(traces[2]["flags"] & 1)
+        self.assertTrue(all(t["end_ns"] >= t["start_ns"] for t in traces))
+        self.assertEqual([t["seq"] - traces[0]["seq"] for t in traces], list(range(5)))
+        self.assertEqual(pylibi2c.trace_read(), [])
+
+
+class ReplayTest(unittest.TestCase):
+    def setUp(self):
+        self.path = tempfile.mktemp(suffix=".rec")
+
+    def tearDown(self):
+        if os.path.exists(self.path):
+            os.remove(self.path)
+
+    def test_record_replay(self):
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50:page=16:twr=0")
+        i2c = pylibi2c.I2CDevice(bus, 0x50, page_bytes=16)
+
+        bus.record_start(self.path)
+        with self.assertRaises(IOError):
+            bus.record_start(self.path)
+
+        self.assertEqual(i2c.ioctl_write(0x10, b"\x5a" * 32), 32)
+        self.assertEqual(i2c.write(0x40, b"\xa5" * 4), 4)
+        self.assertSequenceEqual(i2c.ioctl_read(0x10, 32), bytearray(b"\x5a" * 32))
+        self.assertSequenceEqual(i2c.read(0x40, 4), bytearray(b"\xa5" * 4))
+        bus.record_stop()
+
+        with open(self.path, "rb") as fp:
+            self.assertEqual(fp.read(8), b"I2CREC01")
+
+        # Same device, every transfer and read back data same as recorded
+        replay = pylibi2c.I2CBus("sim:eeprom@0x50:page=16:twr=0")
+        stat = replay.replay(self.path)
+        self.assertGreaterEqual(stat["records"], 6)
+        self.assertEqual(stat["diverged"], 0)
+        self.assertEqual(stat["mismatches"], 0)
+        self.assertEqual(stat["bytes"], 2 * (1 + 16) + (1 + 4) + (1 + 32) + 1 + 4)
+        self.assertEqual(stat["recorded_bytes"], stat["bytes"])
+        self.assertGreater(stat["replay_ns"], 0)
+        self.assertGreaterEqual(stat["replay_span_ns"], stat["replay_ns"])
+        self.assertSequenceEqual(pylibi2c.I2CDevice(replay, 0x50).ioctl_read(0x10, 32), bytearray(b"\x5a" * 32))
+
+        # Device missing, every transfer diverged
+        stat = pylibi2c.I2CBus("sim:eeprom@0x51").replay(self.path, realtime=True)
+        self.assertEqual(stat["diverged"], stat["records"])
+        self.assertEqual(stat["bytes"], 0)
+        self.assertEqual(stat["recorded_bytes"], 2 * (1 + 16) + (1 + 4) + (1 + 32) + 1 + 4)
+
+        with open(self.path, "r+b") as fp:
+            fp.write(b"BADMAGIC")
+
+        with self.assertRaises(IOError) as cm:
+            replay.replay(self.path)
+        self.assertEqual(cm.exception.errno, errno.EBADMSG)
+
+    def test_replay_close(self):
+        bus = pylibi2c.I2CBus("sim:reg@0x48")
+        i2c = pylibi2c.I2CDevice(bus, 0x48)
+
+        bus.record_start(self.path)
+        for _ in range(5):
+            i2c.ioctl_read(0, 1)
+            time.sleep(0.02)
+        bus.record_stop()
+
+        # Bus closed by other thread while realtime replay, replay stop with EBADF
+        replay = pylibi2c.I2CBus("sim:reg@0x48")
+        fd = replay.fd
+        errors = []
+
+        def worker():
+            try:
+                replay.replay(self.path, realtime=True)
+            except IOError as err:
+                errors.append(err.errno)
+
+        t = threading.Thread(target=worker)
+        t.start()
+        time.sleep(0.03)
+        replay.close()
+        t.join()
+
+        self.assertEqual(errors, [errno.EBADF])
+        with self.assertRaises(OSError):
+            os.fstat(fd)
+
+
+class CacheTest(unittest.TestCase):
+    def test_write_back(self):
+        bus = pylibi2c.I2CBus("sim:eeprom@0x50:size=256:page=16")
+        i2c = pylibi2c.I2CDevice(bus, 0x50, page_bytes=16, completion=pylibi2c.I2C_COMPLETION_ACK_POLL)
+        self.assertEqual(i2c.ioctl_write(0, bytes(bytearray(256))), 256)
+
+        cache = i2c.cache(256)
+        self.assertSequenceEqual(cache.read(0, 4), bytearray(4))
+
+        # Scattered single byte writes only touch cache
+        for iaddr in range(3, 256, 7):
+            self.assertEqual(cache.write(iaddr, bytes(bytearray([iaddr]))), 1)
+
+        self.assertEqual(cache.write(0x40, b"\xaa" * 40), 40)
+        self.assertEqual(cache.dirty, 16)
+        self.assertSequenceEqual(cache.read(3, 1), bytearray([3]))
+        self.assertSequenceEqual(cache.read(0x40, 40), bytearray(b"\xaa" * 40))
+        self.assertSequenceEqual(i2c.ioctl_read(3, 1), bytearray(1))
+
+        expected = bytearray(256)
+        for iaddr in range(3, 256, 7):
+            expected[iaddr] = iaddr
+
+        expected[0x40:0x68] = b"\xaa" * 40
+        cache.flush()
+        self.assertEqual(cache.dirty, 0)
+        self.assertSequenceEqual(i2c.ioctl_read(0, 256), expected)
+
+        with self.assertRaises(IOError):
+            cache.read(250, 7)
+
+        with self.assertRaises(IOError):
+            cache.write(256, b"\x00")
+
+    def test_invalidate_sync(self):
+        i2c = pylibi2c.I2CDevice("sim:eeprom@0x50:twr=0", 0x50, page_bytes=8)
+        self.assertEqual(i2c.ioctl_write(0, b"\x11" * 16), 16)
+
+        with i2c.cache(64) as cache:
+            self.assertSequenceEqual(cache.read(0, 2), bytearray(b"\x11\x11"))
+
+            # Changed behind cache, still see cached data until invalidate
+            self.assertEqual(i2c.ioctl_write(0, b"\x22"), 1)
+            self.assertSequenceEqual(cache.read(0, 1), bytearray(b"\x11"))
+            cache.invalidate(0, 1)
+            self.assertSequenceEqual(cache.read(0, 1), bytearray(b"\x22"))
+
+            # Invalidate discard dirty data
+            cache.write(8, b"\x33")
+            cache.invalidate()
+            self.assertEqual(cache.dirty, 0)
+            self.assertSequenceEqual(cache.read(8, 1), bytearray(b"\x11"))
+
+            cache.write(9, b"\x44")
+            cache.sync()
+            self.assertEqual(cache.dirty, 0)
+            self.assertEqual(i2c.ioctl_write(9, b"\x55"), 1)
+            self.assertSequenceEqual(cache.read(8, 2), bytearray(b"\x11\x55"))
+
+            # Close write back
+            cache.write(16, b"\x66")
+
+        self.assertSequenceEqual(i2c.ioctl_read(16, 1), bytearray(b"\x66"))
+        with self.assertRaises(IOError):
+            cache.read(0, 1)
+
+        cache = i2c.cache(64)
+        i2c.close()
+        with self.assertRaises(IOError):
+            cache.flush()
+
+        with self.assertRaises(IOError):
+            pylibi2c.I2CDevice("sim:eeprom@0x50", 0x50).cache(0)
+
+
+class WriteDiffTest(unittest.TestCase):
+    def setUp(self):
+        self.i2c = pylibi2c.I2CDevice("sim:eeprom@0x50:size=4096:page=32", 0x50, iaddr_bytes=2, page_bytes=32,
+                                      completion=pylibi2c.I2C_COMPLETION_ACK_POLL)
+        self.image = bytearray(random.getrandbits(8) for _ in range(4096))
+        self.assertEqual(self.i2c.ioctl_write(0, bytes(self.image)), 4096)
+
+    def update(self):
+        image = bytearray(self.image)
+        # Page 0, 10(two bytes), 11 - 12(cross page boundary) and last page changed
+        for iaddr in (5, 320, 330, 383, 384, 4095):
+            image[iaddr] ^= 0xff
+
+        return image
+
+    def test_read_back(self):
+        image = self.update()
+        self.assertEqual(self.i2c.write_diff(0, bytes(image)), (5, 123))
+        self.assertSequenceEqual(self.i2c.ioctl_read(0, 4096), image)
+        self.assertEqual(self.i2c.write_diff(0, bytes(image)), (0, 128))
+
+        # Unaligned range, partial head and tail page
+        self.assertEqual(self.i2c.write_diff(330, b"\x00" * 60), (3, 0))
+        self.assertSequenceEqual(self.i2c.ioctl_read(320, 80), image[320:330] + bytearray(60) + image[390:400])
+
+    def test_manifest(self):
+        manifest = self.i2c.diff_manifest(0, bytes(self.image))
+        self.assertEqual(len(manifest), 128 * 8)
+
+        image = self.update()
+        self.assertEqual(self.i2c.write_diff(0, bytes(image), manifest), (5, 123))
+        self.assertSequenceEqual(self.i2c.ioctl_read(0, 4096), image)
+        self.assertEqual(manifest, self.i2c.diff_manifest(0, bytes(image)))
+
+        # Trust manifest, device is not read back
+        self.assertEqual(self.i2c.write_diff(0, bytes(image), manifest=manifest), (0, 128))
+
+        with self.assertRaises(ValueError):
+            self.i2c.write_diff(0, bytes(image), bytearray(8))
+
+        with self.assertRaises((TypeError, BufferError)):
+            self.i2c.write_diff(0, bytes(image), bytes(manifest))
+
+        with self.assertRaises(IOError):
+            pylibi2c.I2CDevice("sim:eeprom@0x50", 0x51).write_diff(0, b"\x00")
+
+
 if __name__ == '__main__':
     unittest.main()
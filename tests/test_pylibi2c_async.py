@@ -0,0 +1,15 @@
+import sys
+import unittest
+
+# Async aread/awrite cases use async def and asyncio.run, only importable with python 3.7+
+if sys.version_info >= (3, 7):
+    from async_cases import AsyncTest
+else:
+    @unittest.skip("aread/awrite require python 3.7+")
+    class AsyncTest(unittest.TestCase):
+        def test_aread_awrite(self):
+            pass
+
+
+if __name__ == '__main__':
+    unittest.main()